@@ -19,10 +19,25 @@ import java.io.IOException;
 import java.io.InputStream;
 import java.nio.ByteBuffer;
 import java.nio.ByteOrder;
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.Callable;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
 
 import static android.opengl.GLES30.*;
 
 class ImageLoader {
+    private static final int MAX_DECODE_THREADS = 4;
+    private static ExecutorService sDecodeExecutor;
+
+    private static synchronized ExecutorService getDecodeExecutor() {
+        if (sDecodeExecutor == null) {
+            int threads = Math.max(1, Math.min(MAX_DECODE_THREADS, Runtime.getRuntime().availableProcessors()));
+            sDecodeExecutor = Executors.newFixedThreadPool(threads);
+        }
+        return sDecodeExecutor;
+    }
 
     private static void loadBitmapFromInputStream(InputStream aInputStream, final String aFileName, final long aFileReader, final int aTrackingHandle) {
         try {
@@ -114,6 +129,35 @@ class ImageLoader {
         }
     }
 
+    // Decodes every file on the decode thread pool and returns once all of them
+    // have been processed or have failed.
+    @Keep
+    private static void loadBatch(final AssetManager aAssets, final String[] aFileNames, final long aFileReader, final int[] aTrackingHandles) {
+        List<Callable<Void>> tasks = new ArrayList<>(aFileNames.length);
+        for (int i = 0; i < aFileNames.length; i++) {
+            final String fileName = aFileNames[i];
+            final int trackingHandle = aTrackingHandles[i];
+            tasks.add(new Callable<Void>() {
+                @Override
+                public Void call() {
+                    if (fileName.startsWith("/")) {
+                        loadFromRawFile(fileName, aFileReader, trackingHandle);
+                    } else {
+                        loadFromAssets(aAssets, fileName, aFileReader, trackingHandle);
+                    }
+                    return null;
+                }
+            });
+        }
+        try {
+            getDecodeExecutor().invokeAll(tasks);
+        } catch (InterruptedException e) {
+            for (int trackingHandle: aTrackingHandles) {
+                ImageLoadFailed(aFileReader, trackingHandle, "Image decode interrupted");
+            }
+        }
+    }
+
     private native static void ProcessImage(
             final long aFileReader,
             final int aTrackingHandle,
@@ -0,0 +1,92 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_ALLOCATION_TRACKER_DOT_H
+#define VRB_ALLOCATION_TRACKER_DOT_H
+
+#include "vrb/MacroUtils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vrb {
+
+enum class AllocationTag {
+  None,
+  Cull,
+  Draw,
+  Parse,
+  Upload,
+  Cache,
+  Count
+};
+
+// Counts heap allocations made through the global operator new. The hooks are
+// only compiled in when VRB_ALLOCATION_TRACKING is defined; otherwise every
+// count stays zero and IsAvailable() returns false.
+//
+// Allocations are attributed to the innermost AllocationScope of the thread
+// making them. Frame counts cover every thread between BeginFrame() and
+// EndFrame(), so a benchmark can assert a steady state frame allocates nothing.
+// RenderContext::Update() ends the previous frame and begins the next one.
+class AllocationTracker {
+public:
+  struct Counts {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;
+    Counts() : allocations(0), frees(0), bytes(0) {}
+  };
+
+  static bool IsAvailable();
+  static void SetEnabled(const bool aEnabled);
+  static bool IsEnabled();
+  static void BeginFrame();
+  static void EndFrame();
+  // Counts of the last completed frame.
+  static Counts GetFrameCounts();
+  static Counts GetFrameCounts(const AllocationTag aTag);
+  // Counts since tracking was enabled or Reset() was called.
+  static Counts GetTotalCounts();
+  static Counts GetTotalCounts(const AllocationTag aTag);
+  static void Reset();
+  static const char* GetTagName(const AllocationTag aTag);
+
+  // Internal interface used by the operator new and delete hooks.
+  static void RecordAllocation(const uint64_t aBytes);
+  static void RecordFree(const uint64_t aBytes);
+  static AllocationTag GetCurrentTag();
+  static void SetCurrentTag(const AllocationTag aTag);
+private:
+  AllocationTracker() = delete;
+  VRB_NO_DEFAULTS(AllocationTracker)
+};
+
+class AllocationScope {
+public:
+  AllocationScope(const AllocationTag aTag) : mPrevious(AllocationTracker::GetCurrentTag()) {
+    AllocationTracker::SetCurrentTag(aTag);
+  }
+  ~AllocationScope() {
+    AllocationTracker::SetCurrentTag(mPrevious);
+  }
+private:
+  const AllocationTag mPrevious;
+  AllocationScope() = delete;
+  VRB_NO_DEFAULTS(AllocationScope)
+  VRB_NO_NEW_DELETE
+};
+
+} // namespace vrb
+
+#if defined(VRB_ALLOCATION_TRACKING)
+#define VRB_ALLOCATION_SCOPE_NAME(line) vrbAllocationScope##line
+#define VRB_ALLOCATION_SCOPE_LINE(tag, line) vrb::AllocationScope VRB_ALLOCATION_SCOPE_NAME(line)(vrb::AllocationTag::tag)
+#define VRB_ALLOCATION_SCOPE(tag) VRB_ALLOCATION_SCOPE_LINE(tag, __LINE__)
+#else
+#define VRB_ALLOCATION_SCOPE(tag)
+#endif // defined(VRB_ALLOCATION_TRACKING)
+
+#endif // VRB_ALLOCATION_TRACKER_DOT_H
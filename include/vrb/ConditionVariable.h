@@ -27,6 +27,9 @@ public:
   bool Signal() {
     return pthread_cond_signal(&mCond) == 0;
   }
+  bool Broadcast() {
+    return pthread_cond_broadcast(&mCond) == 0;
+  }
 protected:
   pthread_cond_t mCond;
 private:
@@ -22,6 +22,13 @@ public:
   void SetFileReader(FileReaderPtr aFileReader);
   DataCachePtr GetDataCache();
   FileReaderPtr GetFileReader();
+  RenderStateCachePtr GetRenderStateCache();
+  GeometryCachePtr GetGeometryCache();
+  DrawableRegistryPtr GetDrawableRegistry();
+  RenderStatsPtr GetRenderStats();
+  GpuMemoryLedgerPtr GetGpuMemoryLedger();
+  GLDeletionQueuePtr GetGLDeletionQueue();
+  TextureCachePtr GetTextureCache();
   TextureGLPtr LoadTexture(const std::string& TextureName, const bool aUseCache = true);
   void UpdateResourceGL();
   void AddResourceGL(ResourceGL* aResource);
@@ -17,6 +17,47 @@ public:
   const Matrix& GetTransform() const;
   void PushTransform(const Matrix& aTransform);
   void PopTransform();
+  // Frustum culling is only performed while a camera is set.
+  void SetCamera(const Camera& aCamera);
+  void ClearCamera();
+  bool HasCamera() const;
+  const Vector& GetCameraPosition() const;
+  const Matrix& GetViewProjection() const;
+  bool IsVisible(const Vector& aCenter, const float aRadius) const;
+  // Height in pixels used to convert projected sizes to screen space.
+  void SetViewportHeight(const int32_t aHeight);
+  int32_t GetViewportHeight() const;
+  // Approximate on screen size in pixels of a world space length at the given
+  // world position. Returns zero when no camera is set.
+  float GetProjectedSize(const Vector& aPosition, const float aSize) const;
+  // Reports the on screen size of a box in the space of the current transform
+  // to the texture drawn on it, which streams its levels accordingly. Ignored
+  // for textures that do not stream.
+  void ReportTextureUse(Texture& aTexture, const Vector& aMin, const Vector& aMax) const;
+  // Optional broad phase. While an index and a camera are set, nodes held by
+  // the index are only visible when their world bounds intersect the frustum.
+  void SetSpatialIndex(const SpatialIndexPtr& aIndex);
+  SpatialIndexPtr GetSpatialIndex() const;
+  bool IsNodeVisible(const Node& aNode);
+  // Optional software occlusion culling. Occluder meshes are rasterized into
+  // a low resolution CPU depth buffer the first time a box is tested after
+  // SetCamera(). Call AddOccluder() again after editing an occluder's mesh.
+  void SetOcclusionCulling(const bool aEnabled);
+  bool IsOcclusionCullingEnabled() const;
+  void SetOcclusionResolution(const int32_t aWidth, const int32_t aHeight);
+  void AddOccluder(const GeometryPtr& aGeometry);
+  void RemoveOccluder(const GeometryPtr& aGeometry);
+  void ClearOccluders();
+  // Tests a box in the space of the current transform against the occluders.
+  bool IsOccluded(const Vector& aMin, const Vector& aMax);
+  // Boxes reported as occluded since the last SetCamera().
+  int32_t GetOccludedCount() const;
+  // Called by each node the cull pass visits, for the frame's RenderStats.
+  void CountNode();
+  // Whether a test since the last ResetCameraUse() depended on the camera, in
+  // which case the cull result has to be redone when the camera moves.
+  void ResetCameraUse();
+  bool WasCameraUsed() const;
 
 protected:
   struct State;
@@ -9,6 +9,8 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <vector>
+
 namespace vrb {
 
 class DataCache {
@@ -18,6 +20,18 @@ public:
   uint32_t CacheData(std::unique_ptr<uint8_t[]>& aData, const size_t aDataSize);
   size_t LoadData(const uint32_t aHandle, std::unique_ptr<uint8_t[]>& aData);
   void RemoveData(const uint32_t aHandle);
+  // Reads the data for aHandles on worker threads, in the given order.
+  // LoadData() hands out prefetched data without reading the file again.
+  // Workers pause once the prefetched and in flight data reaches the limit
+  // and resume as LoadData() consumes it.
+  void Prefetch(const std::vector<uint32_t>& aHandles);
+  // Bytes held by prefetched data, 32MB by default.
+  void SetPrefetchLimit(const size_t aBytes);
+  // True once the data for aHandle has been prefetched and not loaded yet.
+  bool IsPrefetched(const uint32_t aHandle);
+  // Clears the prefetch queue and discards prefetched data, including reads
+  // that are still in flight.
+  void DropPrefetchedData();
 protected:
   struct State;
   DataCache(State& aState);
@@ -6,6 +6,7 @@
 #ifndef VRB_DRAWABLE_DOT_H
 #define VRB_DRAWABLE_DOT_H
 
+#include "vrb/DrawableRegistry.h"
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 #include "vrb/Node.h"
@@ -15,6 +16,9 @@ namespace vrb {
 class Drawable : public std::enable_shared_from_this<Drawable> {
 public:
   DrawablePtr CreateDrawablePtr();
+  // Handle assigned by the DrawableRegistry the Drawable was last acquired from.
+  const DrawableHandle& GetDrawableHandle() const;
+  void SetDrawableHandle(const DrawableHandle& aHandle);
   virtual RenderStatePtr& GetRenderState() = 0;
   virtual void SetRenderState(const RenderStatePtr& aRenderState) = 0;
   virtual void Draw(const Camera& aCamera, const Matrix& aModelTransform) = 0;
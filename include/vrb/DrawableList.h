@@ -8,10 +8,11 @@
 
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
 
 namespace vrb {
 
-class DrawableList {
+class DrawableList : protected ResourceGL {
 public:
   static DrawableListPtr Create(CreationContextPtr& aContext);
 
@@ -19,13 +20,42 @@ public:
   void PushLight(const Light& aLight);
   void PopLights(const int aCount);
   void AddDrawable(DrawablePtr&& aDrawable, const Matrix& aTransform);
+  // Stores a DrawableRegistry handle, so no reference is taken per frame.
+  void AddDrawable(Drawable& aDrawable, const Matrix& aTransform);
   void Draw(const Camera& aCamera);
+  // Runs of at least aThreshold drawables sharing a Geometry mesh, RenderState
+  // and lights are submitted as one instanced draw.
+  void SetBatchingEnabled(const bool aEnabled);
+  bool IsBatchingEnabled() const;
+  void SetBatchThreshold(const int32_t aThreshold);
+  int32_t GetBatchThreshold() const;
+  // Counters for the last call to Draw().
+  int32_t GetDrawCount() const;
+  int32_t GetInstancedDrawCount() const;
+  int32_t GetDrawsSaved() const;
+  // Retained mode. Once a root is set, Update() only culls the scene again
+  // when nodes are added, a child is toggled on, lights change or the camera
+  // moves while the previous cull depended on it. Removed and toggled off subtrees are dropped from the list and
+  // transform edits are patched in place. Call Invalidate() after edits the
+  // list is not told about, such as InstancedGeometry or LOD settings.
+  void SetRoot(const NodePtr& aRoot);
+  NodePtr GetRoot() const;
+  // Returns true when the list, or a RenderState it draws with, changed since
+  // the previous call.
+  bool Update(CullVisitor& aVisitor);
+  void Invalidate();
+  int32_t GetRebuildCount() const;
+  int32_t GetPatchCount() const;
 
 protected:
   struct State;
   DrawableList(State& aState, CreationContextPtr& aContext);
   ~DrawableList();
 
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
 private:
   State& m;
   DrawableList() = delete;
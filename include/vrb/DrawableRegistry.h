@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_DRAWABLE_REGISTRY_DOT_H
+#define VRB_DRAWABLE_REGISTRY_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+// Plain handle to a registered Drawable. A handle goes stale, rather than
+// dangling, once the registry releases its Drawable.
+struct DrawableHandle {
+  uint32_t index;
+  uint32_t generation;
+  DrawableHandle() : index(0), generation(0) {}
+  bool IsValid() const { return generation != 0; }
+};
+
+// Keeps one reference to each Drawable that has been culled so draw lists can
+// store handles instead of shared pointers. A Drawable that nothing else
+// references any more is only released by RetireFrame() once no frame uses
+// it. Must only be used on the render thread.
+class DrawableRegistry {
+public:
+  static DrawableRegistryPtr Create();
+  // Returns the handle of aDrawable, registering it on first use.
+  DrawableHandle Acquire(Drawable& aDrawable);
+  // Returns nullptr for stale handles. Marks the Drawable as used this frame.
+  Drawable* Resolve(const DrawableHandle& aHandle);
+  void RetireFrame();
+  void Clear();
+  int32_t GetCount() const;
+  uint32_t GetFrame() const;
+protected:
+  struct State;
+  DrawableRegistry(State& aState);
+  ~DrawableRegistry();
+private:
+  State& m;
+  DrawableRegistry() = delete;
+  VRB_NO_DEFAULTS(DrawableRegistry)
+};
+
+} // namespace vrb
+
+#endif // VRB_DRAWABLE_REGISTRY_DOT_H
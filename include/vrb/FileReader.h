@@ -12,6 +12,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace vrb {
 
@@ -33,6 +34,13 @@ class FileReader {
 public:
   virtual void ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) = 0;
   virtual void ReadImageFile(const std::string& aFileName, FileHandlerPtr aHandler) = 0;
+  // Reads aFileNames[i] into aHandlers[i]. Readers that can decode in parallel
+  // do so; the handlers are still called on the calling thread.
+  virtual void ReadImageFiles(const std::vector<std::string>& aFileNames, const std::vector<FileHandlerPtr>& aHandlers) {
+    for (size_t index = 0; (index < aFileNames.size()) && (index < aHandlers.size()); index++) {
+      ReadImageFile(aFileNames[index], aHandlers[index]);
+    }
+  }
 protected:
   FileReader() {}
   virtual ~FileReader() {}
@@ -21,6 +21,7 @@ public:
   static FileReaderAndroidPtr Create();
   void ReadRawFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
   void ReadImageFile(const std::string& aFileName, FileHandlerPtr aHandler) override;
+  void ReadImageFiles(const std::vector<std::string>& aFileNames, const std::vector<FileHandlerPtr>& aHandlers) override;
   void Init(JNIEnv* aEnv, jobject& aAssetManager, const ClassLoaderAndroidPtr& classLoader);
   void Shutdown();
   void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
@@ -49,6 +49,9 @@ typedef std::shared_ptr<Drawable> DrawablePtr;
 class DrawableList;
 typedef std::shared_ptr<DrawableList> DrawableListPtr;
 
+class DrawableRegistry;
+typedef std::shared_ptr<DrawableRegistry> DrawableRegistryPtr;
+
 class FBO;
 typedef std::shared_ptr<FBO> FBOPtr;
 
@@ -65,17 +68,37 @@ typedef std::shared_ptr<FileReaderAndroid> FileReaderAndroidPtr;
 
 class Geometry;
 typedef std::shared_ptr<Geometry> GeometryPtr;
+typedef std::weak_ptr<Geometry> GeometryWeak;
+
+class GeometryCache;
+typedef std::shared_ptr<GeometryCache> GeometryCachePtr;
+
+class GLDeletionQueue;
+typedef std::shared_ptr<GLDeletionQueue> GLDeletionQueuePtr;
 
 class GLExtensions;
 typedef std::shared_ptr<GLExtensions> GLExtensionsPtr;
 
+class GpuMemoryLedger;
+typedef std::shared_ptr<GpuMemoryLedger> GpuMemoryLedgerPtr;
+
 class Group;
 typedef std::weak_ptr<Group> GroupWeak;
 typedef std::shared_ptr<Group> GroupPtr;
 
+class GroupObserver;
+typedef std::shared_ptr<GroupObserver> GroupObserverPtr;
+typedef std::weak_ptr<GroupObserver> GroupObserverWeak;
+
+class InstancedGeometry;
+typedef std::shared_ptr<InstancedGeometry> InstancedGeometryPtr;
+
 class Light;
 typedef std::shared_ptr<Light> LightPtr;
 
+class LOD;
+typedef std::shared_ptr<LOD> LODPtr;
+
 class Matrix;
 
 #if defined(ANDROID)
@@ -89,6 +112,9 @@ typedef std::shared_ptr<Node> NodePtr;
 class NodeFactoryObj;
 typedef std::shared_ptr<NodeFactoryObj> NodeFactoryObjPtr;
 
+class OcclusionBuffer;
+typedef std::shared_ptr<OcclusionBuffer> OcclusionBufferPtr;
+
 class UpdatableStore;
 
 class ParserObj;
@@ -109,6 +135,17 @@ typedef std::weak_ptr<RenderContext> RenderContextWeak;
 
 class RenderState;
 typedef std::shared_ptr<RenderState> RenderStatePtr;
+typedef std::weak_ptr<RenderState> RenderStateWeak;
+
+class RenderStateCache;
+typedef std::shared_ptr<RenderStateCache> RenderStateCachePtr;
+
+class RenderStateObserver;
+typedef std::shared_ptr<RenderStateObserver> RenderStateObserverPtr;
+typedef std::weak_ptr<RenderStateObserver> RenderStateObserverWeak;
+
+class RenderStats;
+typedef std::shared_ptr<RenderStats> RenderStatsPtr;
 
 class ResourceGL;
 class ResourceGLList;
@@ -121,6 +158,9 @@ typedef std::shared_ptr<RunnableQueue> RunnableQueuePtr;
 class SharedEGLContext;
 typedef std::shared_ptr<SharedEGLContext> SharedEGLContextPtr;
 
+class SpatialIndex;
+typedef std::shared_ptr<SpatialIndex> SpatialIndexPtr;
+
 #if defined(ANDROID)
 class SurfaceTextureFactory;
 typedef std::shared_ptr<SurfaceTextureFactory> SurfaceTextureFactoryPtr;
@@ -132,14 +172,20 @@ typedef std::shared_ptr<SurfaceTextureObserver> SurfaceTextureObserverPtr;
 class Texture;
 typedef std::shared_ptr<Texture> TexturePtr;
 
+class TextureAtlas;
+typedef std::shared_ptr<TextureAtlas> TextureAtlasPtr;
+typedef std::weak_ptr<TextureAtlas> TextureAtlasWeak;
+
 class TextureCache;
 typedef std::shared_ptr<TextureCache> TextureCachePtr;
+typedef std::weak_ptr<TextureCache> TextureCacheWeak;
 
 class TextureCubeMap;
 typedef std::shared_ptr<TextureCubeMap> TextureCubeMapPtr;
 
 class TextureGL;
 typedef std::shared_ptr<TextureGL> TextureGLPtr;
+typedef std::weak_ptr<TextureGL> TextureGLWeak;
 
 #if defined(ANDROID)
 class TextureSurface;
@@ -152,6 +198,9 @@ typedef std::shared_ptr<Toggle> TogglePtr;
 class Transform;
 typedef std::shared_ptr<Transform> TransformPtr;
 
+class TriangleBVH;
+typedef std::shared_ptr<TriangleBVH> TriangleBVHPtr;
+
 class Updatable;
 class UpdatableList;
 
@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GL_DELETION_QUEUE_DOT_H
+#define VRB_GL_DELETION_QUEUE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <cstdint>
+
+namespace vrb {
+
+// Collects GL object names from any thread and deletes them on the render
+// thread once they have been queued for a number of frames, so draws already
+// submitted can finish with them. RenderContext drains the queue on every
+// Update() and flushes it in ShutdownGL().
+class GLDeletionQueue {
+public:
+  static GLDeletionQueuePtr Create();
+  // Frames a name waits before it is deleted, 2 by default.
+  void SetFrameDelay(const int32_t aFrames);
+  int32_t GetFrameDelay() const;
+  // Names deleted by one Drain(), 256 by default. Zero or less removes the cap.
+  void SetMaxDeletionsPerFrame(const int32_t aCount);
+  int32_t GetMaxDeletionsPerFrame() const;
+
+  void DeleteBuffer(const GLuint aBuffer);
+  void DeleteTexture(const GLuint aTexture);
+  void DeleteProgram(const GLuint aProgram);
+  void DeleteShader(const GLuint aShader);
+  void DeleteFramebuffer(const GLuint aFramebuffer);
+  void DeleteRenderbuffer(const GLuint aRenderbuffer);
+  void DeleteSync(GLsync aSync);
+
+  // Render thread only. Advances the frame and deletes what is due.
+  void Drain();
+  // Render thread only. Deletes everything queued regardless of delay or cap.
+  void Flush();
+  // Forgets everything queued without calling GL. For names that belong to a
+  // context that was lost, a new one may already use them for live objects.
+  void Discard();
+  int32_t GetPendingCount() const;
+  uint64_t GetDeletedCount() const;
+protected:
+  struct State;
+  GLDeletionQueue(State& aState);
+  ~GLDeletionQueue();
+private:
+  State& m;
+  GLDeletionQueue() = delete;
+  VRB_NO_DEFAULTS(GLDeletionQueue)
+};
+
+} // namespace vrb
+
+#endif // VRB_GL_DELETION_QUEUE_DOT_H
@@ -13,6 +13,7 @@
 #include "vrb/ResourceGL.h"
 #include "vrb/gl.h"
 
+#include <string>
 #include <vector>
 
 namespace vrb {
@@ -34,6 +35,14 @@ public:
   void SetRenderState(const RenderStatePtr& aRenderState) override;
   void Draw(const Camera& aCamera, const Matrix& aModelTransform) override;
 
+  // Number of floats per instance read by DrawInstanced: a column major model
+  // matrix followed by an RGBA tint.
+  static const GLsizei kInstanceFloatCount = 20;
+  void DrawInstanced(const Camera& aCamera, const GLuint aInstanceBuffer, const GLsizei aInstanceCount);
+  // Geometries with the same batch key and RenderState draw identical meshes and
+  // may be merged into a single instanced draw.
+  const void* GetBatchKey() const;
+
   // Geometry interface
   VertexArrayPtr GetVertexArray() const;
   void SetVertexArray(const VertexArrayPtr& aVertexArray);
@@ -47,6 +56,66 @@ public:
   int32_t GetFaceCount() const;
   const Face& GetFace(int32_t aIndex) const;
 
+  // Indexed geometry interface. Builds the interleaved vertex buffer directly
+  // instead of expanding faces from a VertexArray. aUVLength is the number of
+  // UV components stored per vertex: 2, 3 for cube map textures, or 0 for none.
+  void SetIndexedData(
+    const std::vector<Vector>& aPositions,
+    const std::vector<Vector>& aNormals,
+    const std::vector<Vector>& aUVs,
+    const std::vector<GLushort>& aIndices,
+    const int32_t aUVLength = 2);
+  // UV components per vertex the Geometry is drawn with.
+  int32_t GetUVLength() const;
+  void ShareIndexedData(const Geometry& aSource);
+  // The indexed data and its GL buffers, shared by every Geometry that uses
+  // them. Opaque outside of Geometry, see GeometryCache.
+  struct IndexedBuffers;
+  typedef std::shared_ptr<IndexedBuffers> IndexedBuffersPtr;
+  typedef std::weak_ptr<IndexedBuffers> IndexedBuffersWeak;
+  IndexedBuffersPtr GetIndexedBuffers() const;
+  void SetIndexedBuffers(const IndexedBuffersPtr& aBuffers);
+  bool HasIndexedData() const;
+  // Returns the mesh as indexed triangles. Face based Geometry is converted by
+  // welding identical vertex, normal and UV combinations.
+  bool GetIndexedData(
+    std::vector<Vector>& aPositions,
+    std::vector<Vector>& aNormals,
+    std::vector<Vector>& aUVs,
+    std::vector<GLushort>& aIndices) const;
+  bool GetBounds(Vector& aMin, Vector& aMax) const;
+  // Triangle hierarchy used for ray picking. Built on first use and rebuilt
+  // after the mesh changes.
+  TriangleBVHPtr GetBVH();
+
+  // Dynamic indexed geometry cycles through several vertex buffers so vertex
+  // updates never write to a buffer the GPU may still be reading.
+  void SetDynamic(const bool aDynamic);
+  bool IsDynamic() const;
+  void UpdateVertices(
+    const int32_t aFirstVertex,
+    const std::vector<Vector>& aPositions,
+    const std::vector<Vector>& aNormals,
+    const std::vector<Vector>& aUVs);
+
+  // Places the face based Geometry nodes in one vertex and index buffer pair,
+  // each Geometry using its own region of the shared buffers. Geometry that
+  // already created its GL buffers is left unchanged.
+  static void ShareBuffers(const std::vector<GeometryPtr>& aGeometries);
+
+  // Named index ranges record which parts of a merged Geometry came from which
+  // source group, so the parts can still be identified and toggled. Ranges must
+  // be added in index order and need not cover every index. Only the indices of
+  // disabled ranges are skipped, indices outside of every range are always drawn.
+  int32_t AddRange(const std::string& aName, const int32_t aFirstIndex, const int32_t aIndexCount);
+  int32_t GetRangeCount() const;
+  const std::string& GetRangeName(const int32_t aRange) const;
+  bool GetRange(const int32_t aRange, int32_t& aFirstIndex, int32_t& aIndexCount) const;
+  int32_t FindRange(const std::string& aName) const;
+  int32_t GetRangeForIndex(const int32_t aIndex) const;
+  void ToggleRange(const int32_t aRange, const bool aEnabled);
+  bool IsRangeEnabled(const int32_t aRange) const;
+
 protected:
   struct State;
   Geometry(State& aState, CreationContextPtr& aContext);
@@ -0,0 +1,41 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GEOMETRY_CACHE_DOT_H
+#define VRB_GEOMETRY_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+#include <string>
+
+namespace vrb {
+
+// Shares the indexed data of procedural Geometry created with identical
+// parameters, see GeometryUtil. The cache only holds weak references, so the
+// data and its GL buffers are released once no Geometry uses them.
+class GeometryCache {
+public:
+  static GeometryCachePtr Create();
+  // Makes aGeometry use the indexed data cached under aKey. Returns false
+  // when there is none.
+  bool Find(const std::string& aKey, const GeometryPtr& aGeometry);
+  void Add(const std::string& aKey, const GeometryPtr& aGeometry);
+  void Clear();
+  int32_t GetCount();
+protected:
+  struct State;
+  GeometryCache(State& aState);
+  ~GeometryCache();
+private:
+  State& m;
+  GeometryCache() = delete;
+  VRB_NO_DEFAULTS(GeometryCache)
+};
+
+}
+
+#endif // VRB_GEOMETRY_CACHE_DOT_H
@@ -0,0 +1,29 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GEOMETRY_UTIL_DOT_H
+#define VRB_GEOMETRY_UTIL_DOT_H
+
+#include "vrb/Forward.h"
+
+namespace vrb {
+
+// Procedural primitives built with Geometry::SetIndexedData. Primitives created
+// with identical parameters share one set of GL buffers. A RenderState must
+// still be set on the returned Geometry before it is drawn. The UVs have two
+// components, so the primitives are not meant for cube map textures.
+
+// Quad in the XY plane centered on the origin facing +Z.
+GeometryPtr CreateQuadGeometry(CreationContextPtr& aContext, const float aWidth, const float aHeight);
+// Quad with rounded corners in the XY plane centered on the origin facing +Z.
+GeometryPtr CreateRoundedPanelGeometry(CreationContextPtr& aContext, const float aWidth, const float aHeight,
+                                       const float aRadius, const int aCornerSegments);
+// Open cylinder around the Y axis centered on the origin with normals facing out.
+GeometryPtr CreateCylinderGeometry(CreationContextPtr& aContext, const float aRadius, const float aHeight,
+                                   const int aSegments);
+
+} // namespace vrb
+
+#endif // VRB_GEOMETRY_UTIL_DOT_H
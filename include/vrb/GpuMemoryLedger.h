@@ -0,0 +1,56 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_GPU_MEMORY_LEDGER_DOT_H
+#define VRB_GPU_MEMORY_LEDGER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+#include <string>
+
+namespace vrb {
+
+enum class GpuMemoryCategory {
+  Vertex,
+  Index,
+  Texture,
+  Program,
+  FBO,
+  Count
+};
+
+// Bytes of GPU memory held by each resource, by category. Sizes are what vrb
+// asked the driver for, not what the driver actually allocated. Thread safe,
+// since resources may be uploaded off the render thread.
+class GpuMemoryLedger {
+public:
+  static GpuMemoryLedgerPtr Create();
+  // Replaces the bytes aOwner holds in aCategory. Zero bytes removes the entry.
+  void Set(const void* aOwner, const GpuMemoryCategory aCategory, const uint64_t aBytes, const char* aLabel);
+  // Removes every entry of aOwner.
+  void Release(const void* aOwner);
+  uint64_t GetTotal() const;
+  uint64_t GetTotal(const GpuMemoryCategory aCategory) const;
+  int32_t GetOwnerCount() const;
+  // One line per owner still holding GPU memory. Anything listed after
+  // RenderContext::ShutdownGL() has leaked.
+  std::string GetReport() const;
+  void LogReport() const;
+  static const char* GetCategoryName(const GpuMemoryCategory aCategory);
+protected:
+  struct State;
+  GpuMemoryLedger(State& aState);
+  ~GpuMemoryLedger();
+private:
+  State& m;
+  GpuMemoryLedger() = delete;
+  VRB_NO_DEFAULTS(GpuMemoryLedger)
+};
+
+} // namespace vrb
+
+#endif // VRB_GPU_MEMORY_LEDGER_DOT_H
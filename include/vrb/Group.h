@@ -12,6 +12,21 @@
 
 namespace vrb {
 
+// Receives changes made to a Group. Observers are held weakly.
+class GroupObserver {
+public:
+  virtual void NodeAdded(Group& aGroup, const Node& aNode) {}
+  virtual void NodeRemoved(Group& aGroup, const Node& aNode) {}
+  virtual void ChildToggled(Group& aGroup, const Node& aNode, const bool aEnabled) {}
+  virtual void LightsChanged(Group& aGroup) {}
+  virtual void TransformChanged(Transform& aTransform) {}
+protected:
+  GroupObserver() {}
+  virtual ~GroupObserver() {}
+private:
+  VRB_NO_DEFAULTS(GroupObserver)
+};
+
 class Group : public Node {
 public:
   static GroupPtr Create(CreationContextPtr& aContext);
@@ -27,8 +42,13 @@ public:
   void InsertNode(NodePtr aNode, uint32_t aIndex);
   const NodePtr& GetNode(uint32_t aIndex) const;
   int32_t GetNodeCount() const;
+  // Returns false for children a subclass skips during culling, such as nodes
+  // toggled off in a Toggle.
+  bool IsEnabled(const Node& aNode);
   void SortNodes(const std::function<bool(const vrb::NodePtr&, const vrb::NodePtr&)>& aFunction);
   void TakeChildren(GroupPtr& aGroup);
+  void AddObserver(const GroupObserverPtr& aObserver);
+  void RemoveObserver(const GroupObserverPtr& aObserver);
 
 protected:
   bool Traverse(const GroupPtr& aParent, const Node::TraverseFunction& aTraverseFunction) override;
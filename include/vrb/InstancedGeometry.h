@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_INSTANCED_GEOMETRY_DOT_H
+#define VRB_INSTANCED_GEOMETRY_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Drawable.h"
+#include "vrb/Node.h"
+#include "vrb/ResourceGL.h"
+
+namespace vrb {
+
+// Draws many copies of a single Geometry with one glDrawElementsInstanced call.
+// Each instance has its own model matrix and tint. Instances outside of the
+// CullVisitor frustum are dropped before the instance buffer is uploaded.
+class InstancedGeometry : public Node, public Drawable, protected ResourceGL {
+public:
+  static InstancedGeometryPtr Create(CreationContextPtr& aContext);
+
+  // Node interface
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+
+  // From Drawable
+  RenderStatePtr& GetRenderState() override;
+  void SetRenderState(const RenderStatePtr& aRenderState) override;
+  void Draw(const Camera& aCamera, const Matrix& aModelTransform) override;
+
+  // InstancedGeometry interface
+  GeometryPtr GetGeometry() const;
+  void SetGeometry(const GeometryPtr& aGeometry);
+  int32_t AddInstance(const Matrix& aTransform, const Color& aTint);
+  void SetInstance(const int32_t aIndex, const Matrix& aTransform, const Color& aTint);
+  void RemoveInstance(const int32_t aIndex);
+  void ClearInstances();
+  int32_t GetInstanceCount() const;
+  int32_t GetVisibleInstanceCount() const;
+
+protected:
+  struct State;
+  InstancedGeometry(State& aState, CreationContextPtr& aContext);
+  ~InstancedGeometry();
+
+  // From ResourceGL
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  InstancedGeometry() = delete;
+  VRB_NO_DEFAULTS(InstancedGeometry)
+};
+
+} // namespace vrb
+
+#endif // VRB_INSTANCED_GEOMETRY_DOT_H
@@ -0,0 +1,52 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_LOD_DOT_H
+#define VRB_LOD_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Group.h"
+
+namespace vrb {
+
+// Group that culls only one of its children, chosen each frame from the
+// projected screen space error of each level. Children are ordered from the
+// finest level to the coarsest. The coarsest level whose geometric error
+// projects to less than the threshold is drawn. Hysteresis keeps the current
+// level until the error moves past the threshold by the given fraction.
+class LOD : public Group {
+public:
+  static LODPtr Create(CreationContextPtr& aContext);
+
+  // Node interface
+  void Cull(CullVisitor& aVisitor, DrawableList& aDrawables) override;
+
+  // Group interface
+  void RemoveNode(Node& aNode) override;
+
+  // LOD interface
+  void AddLevel(NodePtr aNode, const float aGeometricError);
+  void SetGeometricError(const Node& aNode, const float aGeometricError);
+  void SetCenter(const Vector& aCenter);
+  void SetErrorThreshold(const float aPixels);
+  void SetHysteresis(const float aFraction);
+  int32_t GetCurrentLevel() const;
+
+protected:
+  typedef Group Super;
+  struct State;
+  LOD(State& aState, CreationContextPtr& aContext);
+  ~LOD();
+
+private:
+  State& m;
+  LOD() = delete;
+  VRB_NO_DEFAULTS(LOD)
+};
+
+} // namespace vrb
+
+#endif // VRB_LOD_DOT_H
@@ -0,0 +1,39 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_MESH_SIMPLIFIER_DOT_H
+#define VRB_MESH_SIMPLIFIER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/gl.h"
+
+#include <vector>
+
+namespace vrb {
+
+// Edge collapse simplification driven by quadric error metrics (Garland and
+// Heckbert). The mesh is reduced in place toward aTargetTriangleCount. Open
+// edges such as UV seams are preserved with boundary quadrics. Returns the
+// largest geometric error introduced, in the units of aPositions.
+float SimplifyMesh(
+    std::vector<Vector>& aPositions,
+    std::vector<Vector>& aNormals,
+    std::vector<Vector>& aUVs,
+    std::vector<GLushort>& aIndices,
+    const size_t aTargetTriangleCount);
+
+// Creates a simplified copy of aSource with roughly aRatio of its triangles
+// using the same RenderState. aError receives the geometric error of the copy.
+GeometryPtr CreateSimplifiedGeometry(CreationContextPtr& aContext, const GeometryPtr& aSource,
+                                     const float aRatio, float& aError);
+
+// Builds an LOD node with aSource as the finest level followed by up to
+// aLevelCount - 1 levels, each with aRatio of the triangles of the previous one.
+LODPtr CreateLODFromGeometry(CreationContextPtr& aContext, const GeometryPtr& aSource,
+                             const int32_t aLevelCount, const float aRatio);
+
+} // namespace vrb
+
+#endif // VRB_MESH_SIMPLIFIER_DOT_H
@@ -49,6 +49,15 @@ public:
   // NodeFactoryObj interface
   void SetModelRoot(GroupPtr aGroup);
   GroupPtr& GetModelRoot();
+  // When enabled, Geometries of a model that share a RenderState are merged into
+  // a single Geometry when the model finishes loading. Each source group is kept
+  // as a named range of the merged Geometry.
+  void SetStaticBatching(const bool aEnabled);
+  bool GetStaticBatching() const;
+  // When enabled, materials with identical content share a RenderState from the
+  // RenderStateCache. Disabled by default so each model can modify its own.
+  void SetShareRenderStates(const bool aEnabled);
+  bool GetShareRenderStates() const;
 
 protected:
   struct State;
@@ -0,0 +1,46 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_OCCLUSION_BUFFER_DOT_H
+#define VRB_OCCLUSION_BUFFER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/gl.h"
+
+#include <vector>
+
+namespace vrb {
+
+// Low resolution CPU depth buffer. Occluder triangles are rasterized into it
+// and bounding boxes are tested against it, four pixels at a time.
+class OcclusionBuffer {
+public:
+  static OcclusionBufferPtr Create();
+  // The width is rounded up to a multiple of four.
+  void SetResolution(const int32_t aWidth, const int32_t aHeight);
+  int32_t GetWidth() const;
+  int32_t GetHeight() const;
+  void Clear(const Matrix& aViewProjection);
+  void RasterizeTriangles(const Matrix& aModel, const std::vector<Vector>& aPositions, const std::vector<GLushort>& aIndices);
+  // Conservative: boxes crossing the near plane are always visible.
+  bool IsBoxVisible(const Matrix& aModel, const Vector& aMin, const Vector& aMax) const;
+  // Triangles rasterized since the last Clear().
+  int32_t GetTriangleCount() const;
+  // Normalized device depth, row by row from the bottom of the screen.
+  const float* GetDepthData() const;
+protected:
+  struct State;
+  OcclusionBuffer(State& aState);
+  ~OcclusionBuffer();
+private:
+  State& m;
+  OcclusionBuffer() = delete;
+  VRB_NO_DEFAULTS(OcclusionBuffer)
+};
+
+} // namespace vrb
+
+#endif // VRB_OCCLUSION_BUFFER_DOT_H
@@ -0,0 +1,37 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RAY_PICKER_DOT_H
+#define VRB_RAY_PICKER_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/Vector.h"
+
+#include <string>
+
+namespace vrb {
+
+struct PickResult {
+  GeometryPtr geometry;
+  int32_t triangle;
+  // Named range of the Geometry containing the triangle, or -1.
+  int32_t range;
+  float distance;
+  Vector barycentric;
+  Vector uv;
+  Vector position;
+  Vector normal;
+  PickResult() : triangle(-1), range(-1), distance(0.0f) {}
+};
+
+// Finds the nearest Geometry triangle hit by a world space ray below aRoot.
+// Children disabled in their Group, such as nodes toggled off or LOD levels
+// not currently drawn, and disabled Geometry ranges are skipped. Positions,
+// normals and distances in the result are in world space.
+bool PickNearest(const NodePtr& aRoot, const Vector& aOrigin, const Vector& aDirection, PickResult& aResult);
+
+} // namespace vrb
+
+#endif // VRB_RAY_PICKER_DOT_H
@@ -29,6 +29,20 @@ public:
 
   DataCachePtr& GetDataCache();
   TextureCachePtr& GetTextureCache();
+  RenderStateCachePtr& GetRenderStateCache();
+  GeometryCachePtr& GetGeometryCache();
+  DrawableRegistryPtr& GetDrawableRegistry();
+  // Per frame counters. Each Update() closes the frame being counted.
+  RenderStatsPtr& GetRenderStats();
+  GpuMemoryLedgerPtr& GetGpuMemoryLedger();
+  // GL objects released off the render thread are deleted through this queue.
+  GLDeletionQueuePtr& GetGLDeletionQueue();
+  // After InitializeGL, textures are restored over several Update() calls,
+  // spending up to aMilliseconds per frame (2ms by default) but always
+  // restoring at least one. Textures still waiting render as a placeholder.
+  void SetRestoreBudget(const float aMilliseconds);
+  float GetRestoreBudget() const;
+  bool IsRestoringResources();
   CreationContextPtr& GetRenderThreadCreationContext();
   GLExtensionsPtr GetGLExtensions() const;
 #if defined(ANDROID)
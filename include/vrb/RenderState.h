@@ -14,6 +14,17 @@
 
 namespace vrb{
 
+// Receives material, texture and tint edits. Observers are held weakly.
+class RenderStateObserver {
+public:
+  virtual void RenderStateChanged(RenderState& aRenderState) = 0;
+protected:
+  RenderStateObserver() {}
+  virtual ~RenderStateObserver() {}
+private:
+  VRB_NO_DEFAULTS(RenderStateObserver)
+};
+
 class RenderState : protected ResourceGL {
 public:
   static RenderStatePtr Create(CreationContextPtr& aContext);
@@ -21,6 +32,8 @@ public:
   GLint AttributePosition() const;
   GLint AttributeNormal() const;
   GLint AttributeUV() const;
+  GLint AttributeInstanceModel() const;
+  GLint AttributeInstanceTint() const;
   uint32_t GetLightId() const;
   void ResetLights(const uint32_t aId);
   void AddLight(const Vector& aDirection, const Color& aAmbient, const Color& aDiffuse, const Color& aSpecular);
@@ -34,8 +47,13 @@ public:
   const Color& GetTintColor() const;
   void SetTintColor(const Color& aColor);
   bool Enable(const Matrix& aPerspective, const Matrix& aView, const Matrix& aModel);
+  // Enables the instanced variant of the program. The model matrix and tint are
+  // read from the per-instance attributes instead of uniforms.
+  bool EnableInstanced(const Matrix& aPerspective, const Matrix& aView);
   void Disable();
   void SetLightsEnabled(bool aEnabled);
+  void AddObserver(const RenderStateObserverPtr& aObserver);
+  void RemoveObserver(const RenderStateObserverPtr& aObserver);
 protected:
   struct State;
   RenderState(State& aState, CreationContextPtr& aContext);
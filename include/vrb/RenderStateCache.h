@@ -0,0 +1,48 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RENDER_STATE_CACHE_DOT_H
+#define VRB_RENDER_STATE_CACHE_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <cstdint>
+
+namespace vrb {
+
+// Shares RenderState objects between materials with identical content. The
+// cache only holds weak references, so a RenderState is released once no
+// Geometry uses it. A shared RenderState is seen by every model using the same
+// material, so callers that need to modify one should create their own. A
+// RenderState modified after it was returned leaves the cache, so later
+// lookups of the original material get a new RenderState.
+class RenderStateCache {
+public:
+  static RenderStateCachePtr Create();
+  RenderStatePtr FindOrCreate(
+      CreationContextPtr& aContext,
+      const Color& aAmbient,
+      const Color& aDiffuse,
+      const Color& aSpecular,
+      const float aSpecularExponent,
+      const TexturePtr& aTexture);
+  void Clear();
+  int32_t GetCount();
+  int32_t GetHitCount();
+  int32_t GetMissCount();
+protected:
+  struct State;
+  RenderStateCache(State& aState);
+  ~RenderStateCache();
+private:
+  State& m;
+  RenderStateCache() = delete;
+  VRB_NO_DEFAULTS(RenderStateCache)
+};
+
+}
+
+#endif // VRB_RENDER_STATE_CACHE_DOT_H
@@ -0,0 +1,75 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_RENDER_STATS_DOT_H
+#define VRB_RENDER_STATS_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include "vrb/gl.h"
+#include <cstdint>
+#include <vector>
+
+namespace vrb {
+
+// Per frame counters filled in by the cull and draw passes. RenderContext
+// closes the current frame at the start of each Update() and keeps a rolling
+// history of completed frames. Must only be used on the render thread, except
+// for CountUpload() which resources initialized off the render thread call.
+class RenderStats {
+public:
+  struct Frame {
+    uint32_t frame;
+    uint32_t nodesTraversed;
+    uint32_t nodesCulled;
+    uint32_t drawablesSubmitted;
+    uint32_t drawCalls;
+    uint64_t triangles;
+    uint32_t programSwitches;
+    uint32_t textureBinds;
+    uint32_t bufferBinds;
+    uint64_t bytesUploaded;
+    Frame();
+  };
+
+  static RenderStatsPtr Create();
+  // Number of completed frames kept in the history, 120 by default.
+  void SetHistorySize(const int32_t aSize);
+  int32_t GetHistorySize() const;
+  // Frame still being counted.
+  Frame GetCurrentFrame() const;
+  uint32_t GetFrameNumber() const;
+  // Last completed frame, all zero before the first one completes.
+  const Frame& GetLastFrame() const;
+  // Completed frames, oldest first.
+  void GetHistory(std::vector<Frame>& aHistory) const;
+  // Average of the frames in the history, with the frame number of the last one.
+  Frame GetAverage() const;
+  void NextFrame();
+  void Reset();
+
+  void CountNodeTraversed();
+  void CountNodeCulled();
+  void CountDrawables(const uint32_t aCount);
+  void CountDraw(const uint64_t aTriangles);
+  // Only counted when aProgram differs from the last program counted.
+  void CountProgram(const GLuint aProgram);
+  void CountTextureBind();
+  void CountBufferBind();
+  void CountUpload(const uint64_t aBytes);
+protected:
+  struct State;
+  RenderStats(State& aState);
+  ~RenderStats();
+private:
+  State& m;
+  RenderStats() = delete;
+  VRB_NO_DEFAULTS(RenderStats)
+};
+
+} // namespace vrb
+
+#endif // VRB_RENDER_STATS_DOT_H
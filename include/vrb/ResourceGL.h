@@ -9,11 +9,21 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace vrb {
 
 class ResourceGL {
 public:
+  // Resources below kRestoreImmediately are restored over several frames
+  // after InitializeGL, highest priority and most recently used first.
+  static const int32_t kRestoreImmediately = INT32_MAX;
   virtual bool SupportOffRenderThreadInitialization() { return false; }
+  virtual int32_t GetRestorePriority() { return kRestoreImmediately; }
+  virtual uint32_t GetLastUsedFrame() { return 0; }
+  // DataCache handles read back by InitializeGL, prefetched before a restore.
+  virtual void GetRestoreDataHandles(std::vector<uint32_t>& aHandles) {}
   virtual void InitializeGL() = 0;
   virtual void ShutdownGL() = 0;
 protected:
@@ -0,0 +1,44 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_SPATIAL_INDEX_DOT_H
+#define VRB_SPATIAL_INDEX_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+
+#include <vector>
+
+namespace vrb {
+
+// Loose octree over the world bounds of the Geometry nodes below a root node.
+// Transform::SetTransform marks the affected subtree dirty and Update() moves
+// only the Geometry below it. Adding or removing nodes requires SetRoot() to
+// be called again. Geometry reachable through more than one path from the root
+// is not indexed, so Contains() returns false for it.
+class SpatialIndex {
+public:
+  static SpatialIndexPtr Create(CreationContextPtr& aContext);
+  void SetRoot(const NodePtr& aRoot);
+  void Update();
+  bool Contains(const Node& aNode) const;
+  int32_t GetNodeCount() const;
+  void QuerySphere(const Vector& aCenter, const float aRadius, std::vector<NodePtr>& aResult) const;
+  void QueryBox(const Vector& aMin, const Vector& aMax, std::vector<NodePtr>& aResult) const;
+  // Nodes whose bounds intersect the frustum of the visitor's camera.
+  void QueryVisible(const CullVisitor& aVisitor, std::vector<NodePtr>& aResult) const;
+protected:
+  struct State;
+  SpatialIndex(State& aState, CreationContextPtr& aContext);
+  ~SpatialIndex();
+private:
+  State& m;
+  SpatialIndex() = delete;
+  VRB_NO_DEFAULTS(SpatialIndex)
+};
+
+} // namespace vrb
+
+#endif // VRB_SPATIAL_INDEX_DOT_H
@@ -22,6 +22,18 @@ public:
   GLenum GetTarget() const;
   void SetName(const std::string& aName);
   void SetTextureParameter(GLenum aName, GLint aParam);
+  // Higher priority textures are restored first after a context loss.
+  void SetPriority(const int32_t aPriority);
+  int32_t GetPriority() const;
+  // RenderStats frame the texture was last bound in.
+  uint32_t GetLastBindFrame() const;
+  // Maps the 0 to 1 UVs of a geometry onto the part of the GL texture that
+  // holds the image: uv * scale + offset. Identity unless the image was
+  // packed into a TextureAtlas.
+  void GetUVTransform(float& aOffsetU, float& aOffsetV, float& aScaleU, float& aScaleV) const;
+  // Called by the cull pass with the on screen size in pixels of a drawable
+  // using the texture. The largest size reported in a frame is kept.
+  void ReportScreenSize(const float aPixels);
 protected:
   struct State;
   Texture(State& aState, CreationContextPtr& aContext);
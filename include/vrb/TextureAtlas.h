@@ -0,0 +1,69 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TEXTURE_ATLAS_DOT_H
+#define VRB_TEXTURE_ATLAS_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/ResourceGL.h"
+#include "vrb/Texture.h"
+
+#include "vrb/gl.h"
+#include <cstdint>
+
+namespace vrb {
+
+// A single RGBA texture that small images are packed into with a skyline
+// allocator. Images can be added and removed from any thread; they are
+// uploaded the next time the atlas is bound or updated on the render thread.
+// Removed images leave free rectangles that later images are placed in first,
+// and the atlas starts over once it holds no images.
+class TextureAtlas : public Texture, protected ResourceGL {
+public:
+  // Pixel rectangle of an image in the atlas, without the padding around it.
+  struct Region {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    Region() : x(0), y(0), width(0), height(0) {}
+  };
+
+  static TextureAtlasPtr Create(CreationContextPtr& aContext, const int32_t aWidth, const int32_t aHeight);
+  int32_t GetWidth() const;
+  int32_t GetHeight() const;
+  // Copies a tightly packed RGBA image into free space. Returns false when
+  // the image does not fit.
+  bool AddImage(const uint8_t* aImage, const int32_t aWidth, const int32_t aHeight, Region& aRegion);
+  // Returns the space of an image added with AddImage() for reuse.
+  void RemoveImage(const Region& aRegion);
+  int32_t GetImageCount() const;
+  // Fraction of the atlas covered by images and their padding.
+  float GetUsage() const;
+  // Uploads the images added since the last update and returns the GL
+  // texture. Must be called on the render thread.
+  GLuint Update();
+protected:
+  struct State;
+  TextureAtlas(State& aState, CreationContextPtr& aContext);
+  ~TextureAtlas();
+
+  // Texture interface
+  void AboutToBind() override;
+
+  // ResourceGL interface
+  void InitializeGL() override;
+  void ShutdownGL() override;
+
+private:
+  State& m;
+  TextureAtlas() = delete;
+  VRB_NO_DEFAULTS(TextureAtlas)
+};
+
+} // namespace vrb
+
+#endif // VRB_TEXTURE_ATLAS_DOT_H
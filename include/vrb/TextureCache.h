@@ -8,11 +8,21 @@
 
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
+#include "vrb/TextureAtlas.h"
 
+#include "vrb/gl.h"
 #include <string>
 
 namespace vrb {
 
+// Android onTrimMemory() levels map to Moderate for TRIM_MEMORY_RUNNING_LOW
+// and to Critical from TRIM_MEMORY_RUNNING_CRITICAL up.
+enum class TextureMemoryPressure {
+  None,
+  Moderate,
+  Critical
+};
+
 class TextureCache {
 public:
   static TextureCachePtr Create();
@@ -21,6 +31,58 @@ public:
   TextureGLPtr FindTexture(const std::string& aTextureName);
   void AddTexture(const std::string& aTextureName, TextureGLPtr& aTexture);
   TextureGLPtr GetDefaultTexture();
+  // When enabled, small RGBA images loaded through CreationContext::LoadTexture
+  // are packed into shared atlases so they can be drawn without switching
+  // textures. Disabled by default because atlas images can not repeat.
+  void SetAtlasEnabled(const bool aEnabled);
+  bool IsAtlasEnabled() const;
+  // Atlases are aAtlasSize square, 1024 by default. Images larger than
+  // aMaxImageSize, 128 by default, keep a texture of their own.
+  void SetAtlasSize(const int32_t aAtlasSize, const int32_t aMaxImageSize);
+  // Returns the atlas the image was copied into, or nullptr when the image
+  // is not suited for one. The caller owns the region and returns it with
+  // TextureAtlas::RemoveImage(); the cache only keeps weak references.
+  TextureAtlasPtr AddToAtlas(CreationContextPtr& aContext, const uint8_t* aImage, const uint64_t aImageLength,
+                             const int aWidth, const int aHeight, const GLenum aFormat, TextureAtlas::Region& aRegion);
+  // When enabled, images loaded through CreationContext::LoadTexture that are
+  // identical to an already loaded one share its texture. Disabled by default
+  // because every image is hashed.
+  void SetDeduplicationEnabled(const bool aEnabled);
+  bool IsDeduplicationEnabled() const;
+  // Registers the decoded or compressed payload of aTexture. When an identical
+  // image was already loaded under another name, aTextureName is aliased to
+  // that texture, which is returned. Returns nullptr for new content or when
+  // deduplication is disabled. Candidates with the same hash are compared byte
+  // for byte against the image held by the original texture, so images placed
+  // in an atlas are never shared.
+  TextureGLPtr AddTextureContent(const std::string& aTextureName, const TextureGLPtr& aTexture, const uint8_t* aImage,
+                                 const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  // Number of images found to duplicate an already loaded one, and the image
+  // bytes that were not decoded into a second texture because of it.
+  uint32_t GetDuplicateCount() const;
+  uint64_t GetDuplicateBytesSaved() const;
+  // RGBA images loaded through CreationContext::LoadTexture whose larger side
+  // is at least aSize are streamed progressively, see
+  // TextureGL::SetStreamingImageData(). Zero, the default, disables streaming.
+  void SetStreamingThreshold(const int32_t aSize);
+  int32_t GetStreamingThreshold() const;
+  // Bytes of finer levels uploaded per frame, 4MB by default. The texture
+  // largest on screen always refines by one level per frame.
+  void SetStreamingBudget(const uint64_t aBytesPerFrame);
+  void AddStreamingTexture(const TextureGLPtr& aTexture);
+  // Under pressure, RGBA textures loaded through CreationContext::LoadTexture
+  // drop their largest levels: one for Moderate and two for Critical, one
+  // less for textures drawn in the last frame. Levels come back, most visible
+  // textures first, once the pressure is None again.
+  void SetMemoryPressure(const TextureMemoryPressure aPressure);
+  TextureMemoryPressure GetMemoryPressure() const;
+  // While the texture bytes in the GpuMemoryLedger exceed aBytes the least
+  // visible textures drop one more level per frame. Zero, the default, sets
+  // no budget.
+  void SetTextureMemoryBudget(const uint64_t aBytes);
+  uint64_t GetTextureMemoryBudget() const;
+  // Called by RenderContext::Update() on the render thread.
+  void UpdateStreaming(const uint32_t aFrame);
 protected:
   struct State;
   TextureCache(State& aState);
@@ -24,6 +24,9 @@ public:
                    const std::string& aFileXPos, const std::string& aFileXNeg,
                    const std::string& aFileYPos, const std::string& aFileYNeg,
                    const std::string& aFileZPos, const std::string& aFileZNeg);
+  // Loads all six faces from one file: a KTX cube map, or an image with the
+  // faces laid out as a horizontal or vertical cross or strip.
+  static void Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTexture, const std::string& aFile);
   void SetImageData(const GLenum aFaceTarget, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
 protected:
   struct State;
@@ -35,6 +38,9 @@ protected:
 
   // ResourceGL interface
   bool SupportOffRenderThreadInitialization() override;
+  int32_t GetRestorePriority() override;
+  uint32_t GetLastUsedFrame() override;
+  void GetRestoreDataHandles(std::vector<uint32_t>& aHandles) override;
   void InitializeGL() override;
   void ShutdownGL() override;
 
@@ -10,6 +10,7 @@
 #include "vrb/MacroUtils.h"
 #include "vrb/ResourceGL.h"
 #include "vrb/Texture.h"
+#include "vrb/TextureAtlas.h"
 
 #include "vrb/gl.h"
 #include <string>
@@ -21,6 +22,43 @@ public:
   static TextureGLPtr Create(CreationContextPtr& aContext);
 
   void SetImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  // Uses an image already packed into aAtlas instead of a texture of its own.
+  void SetAtlasImage(const TextureAtlasPtr& aAtlas, const TextureAtlas::Region& aRegion);
+  // Renders the image of aTexture, which holds identical content, instead of
+  // uploading a copy.
+  void SetAliasTexture(const TextureGLPtr& aTexture);
+  // Like SetImageData() for large RGBA images. A mip chain is built on a
+  // worker thread, once it is done the levels up to 64 pixels are uploaded
+  // when the texture is bound and finer levels are streamed in by
+  // UpdateStreaming() as the on screen size reported by the CullVisitor asks
+  // for them.
+  void SetStreamingImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat);
+  bool IsStreaming() const;
+  // Higher for textures that are larger on screen, zero once the texture has
+  // not been seen for a while.
+  float GetStreamingPriority(const uint32_t aFrame) const;
+  // Moves the resident levels one step towards the ones wanted in aFrame.
+  // Refining is skipped when it would upload more than aBudget bytes, levels
+  // no longer needed are always dropped. Returns the bytes uploaded. Must be
+  // called on the render thread, see TextureCache::UpdateStreaming().
+  uint64_t UpdateStreaming(const uint32_t aFrame, const uint64_t aBudget);
+  // Keeps the aLevels largest levels out of GPU memory, they come back once
+  // lowered again. A texture created from a single RGBA image is turned into
+  // a streaming one first: a worker reads the image back from the DataCache
+  // and builds its mip chain. It returns to the single level once no levels
+  // are dropped. Returns false when the texture can not drop levels, which
+  // includes every single level texture without a DataCache. Render thread
+  // only.
+  bool SetDroppedLevels(const int32_t aLevels);
+  int32_t GetDroppedLevels() const;
+  // Levels that can be dropped without going below 64 pixels.
+  int32_t GetMaxDroppedLevels() const;
+  uint64_t GetTextureBytes() const;
+  // Bytes the texture will hold once the levels wanted in aFrame are resident.
+  uint64_t GetWantedTextureBytes(const uint32_t aFrame) const;
+  // True when the full resolution level, in memory or in the DataCache, holds
+  // exactly aImage. Atlas and alias textures never match.
+  bool MatchesImageData(const uint8_t* aImage, const uint64_t aImageLength) const;
 protected:
   struct State;
   TextureGL(State& aState, CreationContextPtr& aContext);
@@ -31,6 +69,9 @@ protected:
 
   // ResourceGL interface
   bool SupportOffRenderThreadInitialization() override;
+  int32_t GetRestorePriority() override;
+  uint32_t GetLastUsedFrame() override;
+  void GetRestoreDataHandles(std::vector<uint32_t>& aHandles) override;
   void InitializeGL() override;
   void ShutdownGL() override;
 
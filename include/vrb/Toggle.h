@@ -21,7 +21,6 @@ public:
 
   // Toggle interface
   void ToggleAll(const bool aEnabled);
-  bool IsEnabled(const Node& aNode);
   void ToggleChild(const Node& aNode, const bool aEnabled);
 
 protected:
@@ -0,0 +1,54 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef VRB_TRIANGLE_BVH_DOT_H
+#define VRB_TRIANGLE_BVH_DOT_H
+
+#include "vrb/Forward.h"
+#include "vrb/MacroUtils.h"
+#include "vrb/Vector.h"
+#include "vrb/gl.h"
+
+#include <functional>
+#include <vector>
+
+namespace vrb {
+
+// Bounding volume hierarchy over the triangles of one mesh, built with the
+// surface area heuristic and used for ray queries.
+class TriangleBVH {
+public:
+  struct Hit {
+    int32_t triangle;
+    float distance;
+    // Weights of the triangle's first, second and third vertex.
+    Vector barycentric;
+    Vector uv;
+    Vector position;
+    Vector normal;
+    Hit() : triangle(-1), distance(0.0f) {}
+  };
+  // Return false to ignore a triangle, for example one in a disabled range.
+  typedef std::function<bool(const int32_t aTriangle)> TriangleFilter;
+
+  static TriangleBVHPtr Create();
+  void Build(const std::vector<Vector>& aPositions, const std::vector<Vector>& aUVs, const std::vector<GLushort>& aIndices);
+  bool Intersect(const Vector& aOrigin, const Vector& aDirection, const float aMaxDistance,
+                 const TriangleFilter& aFilter, Hit& aResult) const;
+  int32_t GetTriangleCount() const;
+  int32_t GetNodeCount() const;
+protected:
+  struct State;
+  TriangleBVH(State& aState);
+  ~TriangleBVH();
+private:
+  State& m;
+  TriangleBVH() = delete;
+  VRB_NO_DEFAULTS(TriangleBVH)
+};
+
+} // namespace vrb
+
+#endif // VRB_TRIANGLE_BVH_DOT_H
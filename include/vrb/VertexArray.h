@@ -9,6 +9,8 @@
 #include "vrb/Forward.h"
 #include "vrb/MacroUtils.h"
 
+#include <cstdint>
+
 namespace vrb {
 
 class VertexArray {
@@ -35,6 +37,9 @@ public:
 
   void AddNormal(const int aIndex, const Vector& aNormal);
 
+  // Incremented whenever a vertex position is set or appended.
+  uint32_t GetVersion() const;
+
 protected:
   struct State;
   VertexArray(State& aState, CreationContextPtr& aContext);
@@ -8,6 +8,11 @@
 
 #include "vrb/CullVisitor.h"
 #include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+#include "vrb/gl.h"
+
+#include <unordered_set>
+#include <vector>
 
 namespace vrb {
 
@@ -18,12 +23,53 @@ struct CullVisitor::State {
     TransformNode() : prev(nullptr), transform(Matrix::Identity()) {}
   };
 
+  struct Plane {
+    Vector normal;
+    float distance;
+    Plane() : distance(0.0f) {}
+  };
+
   const Matrix identity;
   TransformNode* transformList;
+  bool hasCamera;
+  Vector cameraPosition;
+  Plane frustum[6];
+  float projectionScale;
+  int32_t viewportHeight;
+  SpatialIndexPtr spatialIndex;
+  std::unordered_set<const Node*> visibleNodes;
+  bool visibleNodesValid;
+
+  struct Occluder {
+    GeometryWeak geometry;
+    std::vector<Vector> positions;
+    std::vector<GLushort> indices;
+  };
+  bool occlusionEnabled;
+  OcclusionBufferPtr occlusionBuffer;
+  std::vector<Occluder> occluders;
+  Matrix viewProjection;
+  bool occlusionValid;
+  int32_t occludedCount;
+  RenderStatsPtr stats;
+  bool cameraUsed;
 
-  State() : identity(Matrix::Identity()), transformList(nullptr) {}
+  State()
+      : identity(Matrix::Identity())
+      , transformList(nullptr)
+      , hasCamera(false)
+      , projectionScale(1.0f)
+      , viewportHeight(1024)
+      , visibleNodesValid(false)
+      , occlusionEnabled(false)
+      , viewProjection(Matrix::Identity())
+      , occlusionValid(false)
+      , occludedCount(0)
+      , cameraUsed(false)
+  {}
   ~State() { Reset(); }
   void Reset();
+  void RasterizeOccluders();
 };
 
 } // namespace vrb
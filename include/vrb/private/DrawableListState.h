@@ -7,13 +7,23 @@
 #define VRB_DRAWABLE_LIST_STATE_DOT_H
 
 #include "vrb/DrawableList.h"
+#include "vrb/private/ResourceGLState.h"
 #include "vrb/Color.h"
+#include "vrb/DrawableRegistry.h"
+#include "vrb/Group.h"
 #include "vrb/Light.h"
 #include "vrb/Matrix.h"
+#include "vrb/RenderState.h"
+#include "vrb/gl.h"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace vrb {
 
-struct DrawableList::State {
+struct DrawableList::State : public ResourceGL::State {
   struct LightSnapshot {
     LightSnapshot* next;
     LightSnapshot* masterNext;
@@ -37,21 +47,112 @@ struct DrawableList::State {
   struct DrawNode {
     DrawNode* next;
     LightSnapshot* lights;
-    DrawablePtr drawable;
+    DrawableHandle handle;
+    // Resolved from the handle at the start of each pass, nullptr once stale.
+    Drawable* drawable;
     Matrix transform;
 
-    DrawNode() : next(nullptr), lights(nullptr) {}
+    DrawNode() : next(nullptr), lights(nullptr), drawable(nullptr) {}
+  };
+  struct BatchEntry {
+    DrawNode* node;
+    Geometry* geometry;
+    const void* renderState;
+    const void* batchKey;
+    uint32_t lightId;
+  };
+
+  // Forwards scene and RenderState edits to the retained list.
+  class Observer : public GroupObserver, public RenderStateObserver {
+  public:
+    Observer(DrawableList::State* aState) : state(aState) {}
+    void NodeAdded(Group&, const Node&) override;
+    void NodeRemoved(Group&, const Node& aNode) override;
+    void ChildToggled(Group&, const Node& aNode, const bool aEnabled) override;
+    void LightsChanged(Group&) override;
+    void TransformChanged(Transform& aTransform) override;
+    void RenderStateChanged(RenderState&) override;
+    DrawableList::State* state;
+  private:
+    VRB_NO_DEFAULTS(Observer)
   };
 
+  DrawableRegistryPtr registry;
+  // A list created without a RenderContext retires frames of its own registry.
+  bool ownsRegistry;
+  RenderStatsPtr stats;
   DrawNode* drawables;
   LightSnapshot* currentLights;
   LightSnapshot* lights;
   uint32_t idCount;
   int depth;
+  bool batching;
+  int32_t batchThreshold;
+  GLuint instanceObjectId;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
+  uint64_t instanceBufferSize;
+  std::vector<BatchEntry> entries;
+  std::vector<float> instanceData;
+  int32_t drawCount;
+  int32_t instancedDrawCount;
+  int32_t drawsSaved;
+  NodePtr root;
+  std::shared_ptr<Observer> observer;
+  std::vector<GroupWeak> observedGroups;
+  std::vector<RenderStateWeak> observedRenderStates;
+  bool rebuild;
+  bool changed;
+  // Removed nodes map to true, toggled off nodes to false.
+  std::unordered_map<const Node*, bool> removedNodes;
+  std::unordered_set<const Node*> dirtyTransforms;
+  bool hadCamera;
+  // Set when the last rebuild ran a camera dependent test such as frustum,
+  // occlusion or LOD selection.
+  bool cameraDependent;
+  Matrix viewProjection;
+  Matrix baseTransform;
+  int32_t rebuildCount;
+  int32_t patchCount;
 
-  State() : drawables(nullptr), currentLights(nullptr), lights(nullptr), idCount(0), depth(0) {}
-  ~State() { Reset(); }
+  State()
+      : ownsRegistry(false)
+      , drawables(nullptr)
+      , currentLights(nullptr)
+      , lights(nullptr)
+      , idCount(0)
+      , depth(0)
+      , batching(true)
+      , batchThreshold(4)
+      , instanceObjectId(0)
+      , instanceBufferSize(0)
+      , drawCount(0)
+      , instancedDrawCount(0)
+      , drawsSaved(0)
+      , rebuild(true)
+      , changed(true)
+      , hadCamera(false)
+      , cameraDependent(false)
+      , viewProjection(Matrix::Identity())
+      , baseTransform(Matrix::Identity())
+      , rebuildCount(0)
+      , patchCount(0)
+  {
+    observer = std::make_shared<Observer>(this);
+  }
+  ~State() {
+    observer->state = nullptr;
+    StopObserving();
+    Reset();
+  }
   void Reset();
+  void StopObserving();
+  void Observe(const NodePtr& aNode);
+  bool PatchRemovedNodes();
+  bool PatchTransforms();
+  void ApplyLights(DrawNode* aNode);
+  void DrawBatched(const Camera& aCamera);
+  void DrawBatch(const Camera& aCamera, const size_t aStart, const size_t aEnd);
 };
 
 }
@@ -10,7 +10,9 @@
 
 namespace vrb {
 
-struct Drawable::State {};
+struct Drawable::State {
+  DrawableHandle handle;
+};
 
 }
 
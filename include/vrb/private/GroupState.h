@@ -7,7 +7,9 @@
 #define VRB_GROUP_STATE_DOT_H
 
 #include "vrb/Forward.h"
+#include "vrb/Group.h"
 #include "vrb/private/NodeState.h"
+#include <algorithm>
 #include <vector>
 
 namespace vrb {
@@ -16,8 +18,26 @@ struct Group::State : public Node::State {
   std::vector<NodePtr> children;
   std::vector<LightPtr> lights;
   GroupWeak self;
+  std::vector<GroupObserverWeak> observers;
   bool Contains(const Node& aNode);
   bool Contains(const Light& aLight);
+  // Calls aFunction on every live observer, dropping expired ones.
+  template<typename Function>
+  void NotifyObservers(const Function& aFunction) {
+    if (observers.empty()) {
+      return;
+    }
+    std::vector<GroupObserverWeak> current(observers);
+    for (GroupObserverWeak& weak: current) {
+      GroupObserverPtr observer = weak.lock();
+      if (observer) {
+        aFunction(*observer);
+      }
+    }
+    observers.erase(std::remove_if(observers.begin(), observers.end(), [](const GroupObserverWeak& aObserver) {
+      return aObserver.expired();
+    }), observers.end());
+  }
   virtual bool IsEnabled(const Node&) { return true; }
   virtual void Clear() { children.clear(); }
 };
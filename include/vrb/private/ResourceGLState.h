@@ -9,13 +9,18 @@
 #include "vrb/ResourceGL.h"
 #include "vrb/Logger.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace vrb {
 
 struct ResourceGL::State {
   ResourceGL* prevResource;
   ResourceGL* nextResource;
+  // Set while the resource waits in the restore list after InitializeGL.
+  bool restorePending;
 
-  State() : prevResource(nullptr), nextResource(nullptr) {}
+  State() : prevResource(nullptr), nextResource(nullptr), restorePending(false) {}
   ~State() {
     if (prevResource) { prevResource->m.nextResource = nextResource; }
     if (nextResource) { nextResource->m.prevResource = prevResource; }
@@ -78,6 +83,11 @@ struct ResourceGL::State {
   }
 
   void GetOffRenderThreadResources(ResourceGLList& aTail);
+  void GetDeferredRestoreResources(ResourceGLList& aList);
+  void SortForRestore(ResourceGL& aTail);
+  void GetRestoreDataHandles(std::vector<uint32_t>& aHandles);
+  bool RestoreNext(ResourceGLList& aList);
+  void ClearRestorePending();
 };
 
 class ResourceGLTail : public ResourceGL {
@@ -113,6 +123,28 @@ public:
     m.GetOffRenderThreadResources(aList);
   }
 
+  // Moves resources that do not need to be restored immediately to aList.
+  void GetDeferredRestoreResources(ResourceGLList& aList) {
+    m.GetDeferredRestoreResources(aList);
+  }
+
+  void SortForRestore() {
+    m.SortForRestore(mTail);
+  }
+
+  void GetRestoreDataHandles(std::vector<uint32_t>& aHandles) {
+    m.GetRestoreDataHandles(aHandles);
+  }
+
+  // Initializes the first resource in the list and moves it to aList.
+  bool RestoreNext(ResourceGLList& aList) {
+    return m.RestoreNext(aList);
+  }
+
+  void ClearRestorePending() {
+    m.ClearRestorePending();
+  }
+
   bool Update() {
     if (!m.nextResource) {
       return false;
@@ -158,6 +190,80 @@ ResourceGL::State::GetOffRenderThreadResources(ResourceGLList& aList) {
   }
 }
 
+inline void
+ResourceGL::State::GetDeferredRestoreResources(ResourceGLList& aList) {
+  ResourceGL* current = nextResource;
+  while (current->m.nextResource) {
+    ResourceGL* resource = current;
+    current = current->m.nextResource;
+    if (resource->GetRestorePriority() < ResourceGL::kRestoreImmediately) {
+      resource->m.RemoveFromCurrentList();
+      resource->m.restorePending = true;
+      aList.Append(resource);
+    }
+  }
+}
+
+inline void
+ResourceGL::State::SortForRestore(ResourceGL& aTail) {
+  std::vector<ResourceGL*> sorted;
+  ResourceGL* current = nextResource;
+  while (current->m.nextResource) {
+    sorted.push_back(current);
+    current = current->m.nextResource;
+  }
+  if (sorted.size() < 2) {
+    return;
+  }
+  ResourceGL* previous = sorted.front()->m.prevResource;
+  std::stable_sort(sorted.begin(), sorted.end(), [](ResourceGL* aLeft, ResourceGL* aRight) {
+    const int32_t leftPriority = aLeft->GetRestorePriority();
+    const int32_t rightPriority = aRight->GetRestorePriority();
+    if (leftPriority != rightPriority) {
+      return leftPriority > rightPriority;
+    }
+    return aLeft->GetLastUsedFrame() > aRight->GetLastUsedFrame();
+  });
+  for (ResourceGL* resource: sorted) {
+    previous->m.nextResource = resource;
+    resource->m.prevResource = previous;
+    previous = resource;
+  }
+  previous->m.nextResource = &aTail;
+  aTail.m.prevResource = previous;
+}
+
+inline void
+ResourceGL::State::GetRestoreDataHandles(std::vector<uint32_t>& aHandles) {
+  ResourceGL* current = nextResource;
+  while (current->m.nextResource) {
+    current->GetRestoreDataHandles(aHandles);
+    current = current->m.nextResource;
+  }
+}
+
+inline bool
+ResourceGL::State::RestoreNext(ResourceGLList& aList) {
+  ResourceGL* resource = nextResource;
+  if (!resource || !resource->m.nextResource) {
+    return false;
+  }
+  resource->m.RemoveFromCurrentList();
+  resource->m.restorePending = false;
+  resource->InitializeGL();
+  aList.Append(resource);
+  return true;
+}
+
+inline void
+ResourceGL::State::ClearRestorePending() {
+  ResourceGL* current = nextResource;
+  while (current->m.nextResource) {
+    current->m.restorePending = false;
+    current = current->m.nextResource;
+  }
+}
+
 } // namespace vrb
 
 #endif // VRB_RESOURCE_GL_STATE_DOT_H
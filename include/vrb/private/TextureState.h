@@ -19,8 +19,31 @@ struct Texture::State {
   std::string name;
   GLenum target;
   GLuint texture;
-
-  State() : target(GL_TEXTURE_2D), texture(0) {
+  // Bound instead of texture while texture has not been created, or when the
+  // image lives in another texture such as a TextureAtlas.
+  GLuint placeholder;
+  RenderStatsPtr stats;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
+  int32_t priority;
+  uint32_t lastBindFrame;
+  // Offset u, offset v, scale u, scale v.
+  float uvTransform[4];
+  // Largest on screen size reported in screenSizeFrame, zero until reported.
+  float screenSize;
+  uint32_t screenSizeFrame;
+
+  State()
+      : target(GL_TEXTURE_2D)
+      , texture(0)
+      , placeholder(0)
+      , priority(0)
+      , lastBindFrame(0)
+      , screenSize(0.0f)
+      , screenSizeFrame(0)
+  {
+    uvTransform[0] = uvTransform[1] = 0.0f;
+    uvTransform[2] = uvTransform[3] = 1.0f;
     intMap[GL_TEXTURE_MAG_FILTER] = GL_NEAREST;
     intMap[GL_TEXTURE_MIN_FILTER] = GL_NEAREST;
     intMap[GL_TEXTURE_WRAP_S] = GL_CLAMP_TO_EDGE;
@@ -0,0 +1,272 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/AllocationTracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+const int kTagCount = (int)vrb::AllocationTag::Count;
+
+// Plain atomics so the hooks never allocate while counting.
+struct Counters {
+  std::atomic<uint64_t> allocations;
+  std::atomic<uint64_t> frees;
+  std::atomic<uint64_t> bytes;
+
+  void Clear() {
+    allocations.store(0, std::memory_order_relaxed);
+    frees.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+  }
+
+  vrb::AllocationTracker::Counts Get() const {
+    vrb::AllocationTracker::Counts result;
+    result.allocations = allocations.load(std::memory_order_relaxed);
+    result.frees = frees.load(std::memory_order_relaxed);
+    result.bytes = bytes.load(std::memory_order_relaxed);
+    return result;
+  }
+};
+
+std::atomic<bool> sEnabled(false);
+std::atomic<bool> sInFrame(false);
+Counters sTotal[kTagCount];
+Counters sFrame[kTagCount];
+vrb::AllocationTracker::Counts sLastFrame[kTagCount];
+thread_local vrb::AllocationTag sCurrentTag = vrb::AllocationTag::None;
+
+vrb::AllocationTracker::Counts
+Sum(const vrb::AllocationTracker::Counts* aCounts) {
+  vrb::AllocationTracker::Counts result;
+  for (int ix = 0; ix < kTagCount; ix++) {
+    result.allocations += aCounts[ix].allocations;
+    result.frees += aCounts[ix].frees;
+    result.bytes += aCounts[ix].bytes;
+  }
+  return result;
+}
+
+} // namespace
+
+namespace vrb {
+
+bool
+AllocationTracker::IsAvailable() {
+#if defined(VRB_ALLOCATION_TRACKING)
+  return true;
+#else
+  return false;
+#endif // defined(VRB_ALLOCATION_TRACKING)
+}
+
+void
+AllocationTracker::SetEnabled(const bool aEnabled) {
+  sEnabled.store(aEnabled);
+}
+
+bool
+AllocationTracker::IsEnabled() {
+  return sEnabled.load();
+}
+
+void
+AllocationTracker::BeginFrame() {
+  for (Counters& counters: sFrame) {
+    counters.Clear();
+  }
+  sInFrame.store(true);
+}
+
+void
+AllocationTracker::EndFrame() {
+  sInFrame.store(false);
+  for (int ix = 0; ix < kTagCount; ix++) {
+    sLastFrame[ix] = sFrame[ix].Get();
+  }
+}
+
+AllocationTracker::Counts
+AllocationTracker::GetFrameCounts() {
+  return Sum(sLastFrame);
+}
+
+AllocationTracker::Counts
+AllocationTracker::GetFrameCounts(const AllocationTag aTag) {
+  if (aTag == AllocationTag::Count) {
+    return Counts();
+  }
+  return sLastFrame[(int)aTag];
+}
+
+AllocationTracker::Counts
+AllocationTracker::GetTotalCounts() {
+  Counts totals[kTagCount];
+  for (int ix = 0; ix < kTagCount; ix++) {
+    totals[ix] = sTotal[ix].Get();
+  }
+  return Sum(totals);
+}
+
+AllocationTracker::Counts
+AllocationTracker::GetTotalCounts(const AllocationTag aTag) {
+  if (aTag == AllocationTag::Count) {
+    return Counts();
+  }
+  return sTotal[(int)aTag].Get();
+}
+
+void
+AllocationTracker::Reset() {
+  for (int ix = 0; ix < kTagCount; ix++) {
+    sTotal[ix].Clear();
+    sFrame[ix].Clear();
+    sLastFrame[ix] = Counts();
+  }
+}
+
+const char*
+AllocationTracker::GetTagName(const AllocationTag aTag) {
+  switch (aTag) {
+    case AllocationTag::None: return "None";
+    case AllocationTag::Cull: return "Cull";
+    case AllocationTag::Draw: return "Draw";
+    case AllocationTag::Parse: return "Parse";
+    case AllocationTag::Upload: return "Upload";
+    case AllocationTag::Cache: return "Cache";
+    case AllocationTag::Count: break;
+  }
+  return "Unknown";
+}
+
+void
+AllocationTracker::RecordAllocation(const uint64_t aBytes) {
+  if (!sEnabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const int kTag = (int)sCurrentTag;
+  sTotal[kTag].allocations.fetch_add(1, std::memory_order_relaxed);
+  sTotal[kTag].bytes.fetch_add(aBytes, std::memory_order_relaxed);
+  if (sInFrame.load(std::memory_order_relaxed)) {
+    sFrame[kTag].allocations.fetch_add(1, std::memory_order_relaxed);
+    sFrame[kTag].bytes.fetch_add(aBytes, std::memory_order_relaxed);
+  }
+}
+
+void
+AllocationTracker::RecordFree(const uint64_t aBytes) {
+  if (!sEnabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const int kTag = (int)sCurrentTag;
+  sTotal[kTag].frees.fetch_add(1, std::memory_order_relaxed);
+  if (sInFrame.load(std::memory_order_relaxed)) {
+    sFrame[kTag].frees.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+AllocationTag
+AllocationTracker::GetCurrentTag() {
+  return sCurrentTag;
+}
+
+void
+AllocationTracker::SetCurrentTag(const AllocationTag aTag) {
+  sCurrentTag = aTag;
+}
+
+} // namespace vrb
+
+#if defined(VRB_ALLOCATION_TRACKING)
+
+namespace {
+
+// Forwards straight to malloc and free so memory from these hooks and from a
+// foreign operator new can be released by either side.
+void*
+TrackedAllocate(size_t aSize) {
+  if (aSize == 0) {
+    aSize = 1;
+  }
+  void* result = malloc(aSize);
+  if (result) {
+    vrb::AllocationTracker::RecordAllocation(aSize);
+  }
+  return result;
+}
+
+void*
+TrackedAllocateAligned(size_t aSize, const size_t aAlignment) {
+  if (aSize == 0) {
+    aSize = 1;
+  }
+  void* result = nullptr;
+  if (posix_memalign(&result, std::max(aAlignment, sizeof(void*)), aSize) != 0) {
+    return nullptr;
+  }
+  vrb::AllocationTracker::RecordAllocation(aSize);
+  return result;
+}
+
+void*
+CheckAllocation(void* aResult) {
+  if (!aResult) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+    throw std::bad_alloc();
+#else
+    abort();
+#endif
+  }
+  return aResult;
+}
+
+void
+TrackedFree(void* aPointer, const size_t aSize) {
+  if (!aPointer) {
+    return;
+  }
+  vrb::AllocationTracker::RecordFree(aSize);
+  free(aPointer);
+}
+
+} // namespace
+
+void* operator new(size_t aSize) { return CheckAllocation(TrackedAllocate(aSize)); }
+void* operator new[](size_t aSize) { return CheckAllocation(TrackedAllocate(aSize)); }
+void* operator new(size_t aSize, const std::nothrow_t&) noexcept { return TrackedAllocate(aSize); }
+void* operator new[](size_t aSize, const std::nothrow_t&) noexcept { return TrackedAllocate(aSize); }
+void operator delete(void* aPointer) noexcept { TrackedFree(aPointer, 0); }
+void operator delete[](void* aPointer) noexcept { TrackedFree(aPointer, 0); }
+void operator delete(void* aPointer, size_t aSize) noexcept { TrackedFree(aPointer, aSize); }
+void operator delete[](void* aPointer, size_t aSize) noexcept { TrackedFree(aPointer, aSize); }
+void operator delete(void* aPointer, const std::nothrow_t&) noexcept { TrackedFree(aPointer, 0); }
+void operator delete[](void* aPointer, const std::nothrow_t&) noexcept { TrackedFree(aPointer, 0); }
+
+#if defined(__cpp_aligned_new)
+void* operator new(size_t aSize, std::align_val_t aAlignment) {
+  return CheckAllocation(TrackedAllocateAligned(aSize, (size_t)aAlignment));
+}
+void* operator new[](size_t aSize, std::align_val_t aAlignment) {
+  return CheckAllocation(TrackedAllocateAligned(aSize, (size_t)aAlignment));
+}
+void* operator new(size_t aSize, std::align_val_t aAlignment, const std::nothrow_t&) noexcept {
+  return TrackedAllocateAligned(aSize, (size_t)aAlignment);
+}
+void* operator new[](size_t aSize, std::align_val_t aAlignment, const std::nothrow_t&) noexcept {
+  return TrackedAllocateAligned(aSize, (size_t)aAlignment);
+}
+void operator delete(void* aPointer, std::align_val_t) noexcept { TrackedFree(aPointer, 0); }
+void operator delete[](void* aPointer, std::align_val_t) noexcept { TrackedFree(aPointer, 0); }
+void operator delete(void* aPointer, size_t aSize, std::align_val_t) noexcept { TrackedFree(aPointer, aSize); }
+void operator delete[](void* aPointer, size_t aSize, std::align_val_t) noexcept { TrackedFree(aPointer, aSize); }
+void operator delete(void* aPointer, std::align_val_t, const std::nothrow_t&) noexcept { TrackedFree(aPointer, 0); }
+void operator delete[](void* aPointer, std::align_val_t, const std::nothrow_t&) noexcept { TrackedFree(aPointer, 0); }
+#endif // defined(__cpp_aligned_new)
+
+#endif // defined(VRB_ALLOCATION_TRACKING)
@@ -6,12 +6,14 @@
 #include "vrb/ContextSynchronizer.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/ConditionVariable.h"
+#include "vrb/GLError.h"
 #include "vrb/Logger.h"
 #include "vrb/RenderContext.h"
 
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
 
+#include "vrb/gl.h"
 #include <pthread.h>
 #include <vector>
 
@@ -35,6 +37,9 @@ struct ContextSynchronizer::State {
   ResourceGLList* uninitializedResources;
   ResourceGLList* resources;
   UpdatableList* updatables;
+  // Signaled once the GL commands issued on the creation thread before the
+  // lists were handed off have completed.
+  GLsync fence;
 
   State()
       : threadSelf(0)
@@ -44,12 +49,31 @@ struct ContextSynchronizer::State {
       , uninitializedResources(nullptr)
       , resources(nullptr)
       , updatables(nullptr)
+      , fence(nullptr)
   {}
+  bool IsFenceSignaled();
   bool IsOnCreationThread() {
     return pthread_equal(threadSelf, pthread_self()) > 0;
   }
 };
 
+bool
+ContextSynchronizer::State::IsFenceSignaled() {
+  if (!fence) {
+    return true;
+  }
+  const GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return false;
+  }
+  if (status == GL_WAIT_FAILED) {
+    VRB_WARN("glClientWaitSync failed in ContextSynchronizer");
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+  return true;
+}
+
 ContextSynchronizerPtr
 ContextSynchronizer::Create(RenderContextPtr& aContext) {
   ContextSynchronizerPtr result = std::make_shared<ConcreteClass<ContextSynchronizer, ContextSynchronizer::State> >();
@@ -110,6 +134,13 @@ ContextSynchronizer::AdoptLists(
       m.updatables = &aUpdatables;
     }
     if (m.uninitializedResources|| m.resources || m.updatables) {
+      if (m.resources) {
+        // Only initialized resources have GL commands in flight. The flush
+        // makes sure the fence reaches the GPU, otherwise the render thread
+        // could wait on it forever.
+        m.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        VRB_GL_CHECK(glFlush());
+      }
       m.waiting = true;
       while (m.waiting) {
         if (!m.cond.Wait()) {
@@ -142,7 +173,9 @@ ContextSynchronizer::Signal(bool& aIsActive) {
   }
   MutexAutoLock lock(m.cond);
   aIsActive = m.active;
-  if (m.waiting) {
+  // Resources still being written by the creation thread are adopted on a
+  // later frame instead of stalling this one.
+  if (m.waiting && m.IsFenceSignaled()) {
     m.waiting = false;
     if (m.uninitializedResources) {
       m.context->GetUninitializedResourceGLList().AppendAndAdoptList(*m.uninitializedResources);
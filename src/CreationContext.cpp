@@ -8,15 +8,20 @@
 
 #include "vrb/ContextSynchronizer.h"
 #include "vrb/DataCache.h"
+#include "vrb/DrawableRegistry.h"
 #include "vrb/FileReader.h"
+#include "vrb/GeometryCache.h"
 #include "vrb/Logger.h"
 #include "vrb/RenderContext.h"
+#include "vrb/RenderStateCache.h"
+#include "vrb/TextureAtlas.h"
 #include "vrb/TextureCache.h"
 #include "vrb/TextureGL.h"
 
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
 
+#include <algorithm>
 #include <pthread.h>
 
 #define ASSERT_ON_CREATION_THREAD()                                          \
@@ -32,7 +37,7 @@ typedef std::shared_ptr<TextureHandler> TextureHandlerPtr;
 
 class TextureHandler : public vrb::FileHandler {
 public:
-  static TextureHandlerPtr Create(const vrb::TextureGLPtr& aTexture);
+  static TextureHandlerPtr Create(const vrb::TextureGLPtr& aTexture, const vrb::CreationContextPtr& aContext);
   void BindFileHandle(const std::string& aFileName, const int aFileHandle) override;
   void LoadFailed(const int aFileHandle, const std::string& aReason) override;
   void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {};
@@ -42,20 +47,23 @@ public:
   ~TextureHandler() {}
 protected:
   vrb::TextureGLPtr mTexture;
+  vrb::CreationContextWeak mContext;
+  std::string mFileName;
 private:
   VRB_NO_DEFAULTS(TextureHandler)
 };
 
 TextureHandlerPtr
-TextureHandler::Create(const vrb::TextureGLPtr& aTexture) {
+TextureHandler::Create(const vrb::TextureGLPtr& aTexture, const vrb::CreationContextPtr& aContext) {
   TextureHandlerPtr result = std::make_shared<TextureHandler>();
   result->mTexture = aTexture;
+  result->mContext = aContext;
   return result;
 }
 
 void
 TextureHandler::BindFileHandle(const std::string& aFileName, const int aFileHandle) {
-
+  mFileName = aFileName;
 }
 
 void
@@ -65,9 +73,33 @@ TextureHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
 
 void
 TextureHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
-  if (mTexture) {
-    mTexture->SetImageData(aImage, aImageLength, aWidth, aHeight, aFormat);
+  if (!mTexture) {
+    return;
+  }
+  vrb::CreationContextPtr context = mContext.lock();
+  vrb::TextureCachePtr cache = context ? context->GetTextureCache() : nullptr;
+  vrb::TextureGLPtr original = cache ? cache->AddTextureContent(mFileName, mTexture, aImage.get(), aImageLength, aWidth, aHeight, aFormat) : nullptr;
+  if (original) {
+    mTexture->SetAliasTexture(original);
+    return;
+  }
+  if (cache && cache->IsAtlasEnabled()) {
+    vrb::TextureAtlas::Region region;
+    vrb::TextureAtlasPtr atlas = cache->AddToAtlas(context, aImage.get(), aImageLength, aWidth, aHeight, aFormat, region);
+    if (atlas) {
+      mTexture->SetAtlasImage(atlas, region);
+      return;
+    }
+  }
+  const int32_t kStreamingThreshold = cache ? cache->GetStreamingThreshold() : 0;
+  if ((kStreamingThreshold > 0) && (aFormat == GL_RGBA) && (std::max(aWidth, aHeight) >= kStreamingThreshold)) {
+    mTexture->SetStreamingImageData(aImage, aImageLength, aWidth, aHeight, aFormat);
+    if (mTexture->IsStreaming()) {
+      cache->AddStreamingTexture(mTexture);
+    }
+    return;
   }
+  mTexture->SetImageData(aImage, aImageLength, aWidth, aHeight, aFormat);
 }
 
 }
@@ -83,6 +115,12 @@ struct CreationContext::State {
   FileReaderPtr fileReader;
   DataCachePtr dataCache;
   TextureCachePtr textureCache;
+  RenderStateCachePtr renderStateCache;
+  GeometryCachePtr geometryCache;
+  DrawableRegistryPtr drawableRegistry;
+  RenderStatsPtr renderStats;
+  GpuMemoryLedgerPtr gpuMemoryLedger;
+  GLDeletionQueuePtr deletionQueue;
   pthread_t threadSelf;
 
   State() {}
@@ -99,6 +137,12 @@ CreationContext::Create(RenderContextPtr& aContext) {
   result->m.sync = ContextSynchronizer::Create(aContext);
   result->m.dataCache = aContext->GetDataCache();
   result->m.textureCache = aContext->GetTextureCache();
+  result->m.renderStateCache = aContext->GetRenderStateCache();
+  result->m.geometryCache = aContext->GetGeometryCache();
+  result->m.drawableRegistry = aContext->GetDrawableRegistry();
+  result->m.renderStats = aContext->GetRenderStats();
+  result->m.gpuMemoryLedger = aContext->GetGpuMemoryLedger();
+  result->m.deletionQueue = aContext->GetGLDeletionQueue();
   return result;
 }
 
@@ -142,6 +186,41 @@ CreationContext::GetFileReader() {
   return m.fileReader;
 }
 
+RenderStateCachePtr
+CreationContext::GetRenderStateCache() {
+  return m.renderStateCache;
+}
+
+GeometryCachePtr
+CreationContext::GetGeometryCache() {
+  return m.geometryCache;
+}
+
+DrawableRegistryPtr
+CreationContext::GetDrawableRegistry() {
+  return m.drawableRegistry;
+}
+
+RenderStatsPtr
+CreationContext::GetRenderStats() {
+  return m.renderStats;
+}
+
+GpuMemoryLedgerPtr
+CreationContext::GetGpuMemoryLedger() {
+  return m.gpuMemoryLedger;
+}
+
+GLDeletionQueuePtr
+CreationContext::GetGLDeletionQueue() {
+  return m.deletionQueue;
+}
+
+TextureCachePtr
+CreationContext::GetTextureCache() {
+  return m.textureCache;
+}
+
 TextureGLPtr
 CreationContext::LoadTexture(const std::string& aTextureName, const bool aUseCache) {
   TextureGLPtr result;
@@ -162,7 +241,7 @@ CreationContext::LoadTexture(const std::string& aTextureName, const bool aUseCac
   }
   result = TextureGL::Create(context);
   m.textureCache->AddTexture(aTextureName, result);
-  m.fileReader->ReadImageFile(aTextureName, TextureHandler::Create(result));
+  m.fileReader->ReadImageFile(aTextureName, TextureHandler::Create(result, context));
   result->SetName(aTextureName);
 
   return result;
@@ -7,6 +7,42 @@
 #include "vrb/private/CullVisitorState.h"
 
 #include "vrb/ConcreteClass.h"
+#include "vrb/AllocationTracker.h"
+#include "vrb/Camera.h"
+#include "vrb/CreationContext.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/Node.h"
+#include "vrb/OcclusionBuffer.h"
+#include "vrb/RenderStats.h"
+#include "vrb/SpatialIndex.h"
+#include "vrb/Texture.h"
+#include "vrb/TextureGL.h"
+#include "vrb/Transform.h"
+
+#include <algorithm>
+
+namespace {
+
+vrb::Matrix
+GetWorldTransform(const vrb::Node& aNode) {
+  vrb::Matrix result = vrb::Matrix::Identity();
+  std::vector<vrb::GroupPtr> parents;
+  aNode.GetParents(parents);
+  while (parents.size() > 0) {
+    vrb::GroupPtr parent = parents[0];
+    vrb::TransformPtr transform = std::dynamic_pointer_cast<vrb::Transform>(parent);
+    if (transform) {
+      result.PreMultiplyInPlace(transform->GetTransform());
+    }
+    parents.clear();
+    parent->GetParents(parents);
+  }
+  return result;
+}
+
+}
 
 namespace vrb {
 
@@ -20,6 +56,22 @@ CullVisitor::State::Reset() {
   }
 }
 
+void
+CullVisitor::State::RasterizeOccluders() {
+  if (!occlusionBuffer) {
+    occlusionBuffer = OcclusionBuffer::Create();
+  }
+  occlusionBuffer->Clear(viewProjection);
+  occluders.erase(std::remove_if(occluders.begin(), occluders.end(), [](const Occluder& aOccluder) {
+    return aOccluder.geometry.expired();
+  }), occluders.end());
+  for (const Occluder& occluder: occluders) {
+    GeometryPtr geometry = occluder.geometry.lock();
+    occlusionBuffer->RasterizeTriangles(GetWorldTransform(*geometry), occluder.positions, occluder.indices);
+  }
+  occlusionValid = true;
+}
+
 CullVisitorPtr
 CullVisitor::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<CullVisitor, CullVisitor::State> >(aContext);
@@ -36,6 +88,7 @@ CullVisitor::GetTransform() const {
 
 void
 CullVisitor::PushTransform(const Matrix& aTransform) {
+  VRB_ALLOCATION_SCOPE(Cull);
   State::TransformNode* node = new State::TransformNode;
   if (m.transformList) {
     node->transform = m.transformList->transform.PostMultiply(aTransform);
@@ -55,9 +108,251 @@ CullVisitor::PopTransform() {
   }
 }
 
-CullVisitor::CullVisitor(State& aState, CreationContextPtr& aContext) : m(aState) {}
+void
+CullVisitor::SetCamera(const Camera& aCamera) {
+  const Matrix viewProjection = aCamera.GetPerspective().PostMultiply(aCamera.GetView());
+  // Gribb/Hartmann plane extraction: each plane is the fourth row of the
+  // view projection matrix plus or minus one of the other rows.
+  const float kSigns[6] = {1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f};
+  for (int plane = 0; plane < 6; plane++) {
+    const int32_t kRow = plane / 2;
+    const float kSign = kSigns[plane];
+    Vector normal(
+        viewProjection.At(0, 3) + (kSign * viewProjection.At(0, kRow)),
+        viewProjection.At(1, 3) + (kSign * viewProjection.At(1, kRow)),
+        viewProjection.At(2, 3) + (kSign * viewProjection.At(2, kRow)));
+    float distance = viewProjection.At(3, 3) + (kSign * viewProjection.At(3, kRow));
+    const float kMagnitude = normal.Magnitude();
+    if (kMagnitude > 0.0f) {
+      normal /= kMagnitude;
+      distance /= kMagnitude;
+    }
+    m.frustum[plane].normal = normal;
+    m.frustum[plane].distance = distance;
+  }
+  m.cameraPosition = aCamera.GetTransform().GetTranslation();
+  // Element [1][1] of a perspective matrix is cot(fov / 2).
+  m.projectionScale = aCamera.GetPerspective().At(1, 1);
+  m.viewProjection = viewProjection;
+  m.hasCamera = true;
+  m.visibleNodesValid = false;
+  m.occlusionValid = false;
+  m.occludedCount = 0;
+}
+
+void
+CullVisitor::ClearCamera() {
+  m.hasCamera = false;
+  m.visibleNodesValid = false;
+  m.occlusionValid = false;
+}
+
+bool
+CullVisitor::HasCamera() const {
+  return m.hasCamera;
+}
+
+const Vector&
+CullVisitor::GetCameraPosition() const {
+  return m.cameraPosition;
+}
+
+const Matrix&
+CullVisitor::GetViewProjection() const {
+  return m.viewProjection;
+}
+
+bool
+CullVisitor::IsVisible(const Vector& aCenter, const float aRadius) const {
+  if (!m.hasCamera) {
+    return true;
+  }
+  m.cameraUsed = true;
+  for (const State::Plane& plane: m.frustum) {
+    if ((plane.normal.Dot(aCenter) + plane.distance) < -aRadius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+CullVisitor::SetViewportHeight(const int32_t aHeight) {
+  m.viewportHeight = aHeight;
+}
+
+int32_t
+CullVisitor::GetViewportHeight() const {
+  return m.viewportHeight;
+}
+
+float
+CullVisitor::GetProjectedSize(const Vector& aPosition, const float aSize) const {
+  if (!m.hasCamera) {
+    return 0.0f;
+  }
+  m.cameraUsed = true;
+  const float kDistance = std::max((aPosition - m.cameraPosition).Magnitude(), 0.0001f);
+  return aSize * m.projectionScale * 0.5f * (float)m.viewportHeight / kDistance;
+}
+
+void
+CullVisitor::ReportTextureUse(Texture& aTexture, const Vector& aMin, const Vector& aMax) const {
+  TextureGL* texture = dynamic_cast<TextureGL*>(&aTexture);
+  if (!m.hasCamera || !texture || !texture->IsStreaming()) {
+    return;
+  }
+  const Matrix& transform = GetTransform();
+  const float kScale = std::max(
+      Vector(transform.At(0, 0), transform.At(0, 1), transform.At(0, 2)).Magnitude(),
+      std::max(Vector(transform.At(1, 0), transform.At(1, 1), transform.At(1, 2)).Magnitude(),
+               Vector(transform.At(2, 0), transform.At(2, 1), transform.At(2, 2)).Magnitude()));
+  const Vector kWorldCenter = transform.MultiplyPosition((aMin + aMax) * 0.5f);
+  aTexture.ReportScreenSize(GetProjectedSize(kWorldCenter, (aMax - aMin).Magnitude() * kScale));
+}
+
+CullVisitor::CullVisitor(State& aState, CreationContextPtr& aContext) : m(aState) {
+  if (aContext) {
+    m.stats = aContext->GetRenderStats();
+  }
+}
 CullVisitor::~CullVisitor() {}
 
+void
+CullVisitor::SetSpatialIndex(const SpatialIndexPtr& aIndex) {
+  m.spatialIndex = aIndex;
+  m.visibleNodes.clear();
+  m.visibleNodesValid = false;
+}
+
+SpatialIndexPtr
+CullVisitor::GetSpatialIndex() const {
+  return m.spatialIndex;
+}
+
+bool
+CullVisitor::IsNodeVisible(const Node& aNode) {
+  if (!m.spatialIndex || !m.hasCamera) {
+    return true;
+  }
+  VRB_ALLOCATION_SCOPE(Cull);
+  m.cameraUsed = true;
+  if (!m.visibleNodesValid) {
+    m.spatialIndex->Update();
+    std::vector<NodePtr> visible;
+    m.spatialIndex->QueryVisible(*this, visible);
+    m.visibleNodes.clear();
+    for (const NodePtr& node: visible) {
+      m.visibleNodes.insert(node.get());
+    }
+    m.visibleNodesValid = true;
+  }
+  if (m.visibleNodes.count(&aNode) > 0) {
+    return true;
+  }
+  if (!m.spatialIndex->Contains(aNode)) {
+    return true;
+  }
+  if (m.stats) {
+    m.stats->CountNodeCulled();
+  }
+  return false;
+}
+
+void
+CullVisitor::SetOcclusionCulling(const bool aEnabled) {
+  m.occlusionEnabled = aEnabled;
+  m.occlusionValid = false;
+}
+
+bool
+CullVisitor::IsOcclusionCullingEnabled() const {
+  return m.occlusionEnabled;
+}
+
+void
+CullVisitor::SetOcclusionResolution(const int32_t aWidth, const int32_t aHeight) {
+  if (!m.occlusionBuffer) {
+    m.occlusionBuffer = OcclusionBuffer::Create();
+  }
+  m.occlusionBuffer->SetResolution(aWidth, aHeight);
+  m.occlusionValid = false;
+}
+
+void
+CullVisitor::AddOccluder(const GeometryPtr& aGeometry) {
+  if (!aGeometry) {
+    return;
+  }
+  RemoveOccluder(aGeometry);
+  State::Occluder occluder;
+  std::vector<Vector> normals;
+  std::vector<Vector> uvs;
+  if (!aGeometry->GetIndexedData(occluder.positions, normals, uvs, occluder.indices)) {
+    VRB_WARN("CullVisitor::AddOccluder geometry has no triangles");
+    return;
+  }
+  occluder.geometry = aGeometry;
+  m.occluders.push_back(std::move(occluder));
+  m.occlusionValid = false;
+}
+
+void
+CullVisitor::RemoveOccluder(const GeometryPtr& aGeometry) {
+  m.occluders.erase(std::remove_if(m.occluders.begin(), m.occluders.end(), [&](const State::Occluder& aOccluder) {
+    return aOccluder.geometry.lock() == aGeometry;
+  }), m.occluders.end());
+  m.occlusionValid = false;
+}
+
+void
+CullVisitor::ClearOccluders() {
+  m.occluders.clear();
+  m.occlusionValid = false;
+}
+
+bool
+CullVisitor::IsOccluded(const Vector& aMin, const Vector& aMax) {
+  if (!m.occlusionEnabled || !m.hasCamera || m.occluders.empty()) {
+    return false;
+  }
+  VRB_ALLOCATION_SCOPE(Cull);
+  m.cameraUsed = true;
+  if (!m.occlusionValid) {
+    m.RasterizeOccluders();
+  }
+  if (m.occlusionBuffer->IsBoxVisible(GetTransform(), aMin, aMax)) {
+    return false;
+  }
+  m.occludedCount++;
+  if (m.stats) {
+    m.stats->CountNodeCulled();
+  }
+  return true;
+}
+
+int32_t
+CullVisitor::GetOccludedCount() const {
+  return m.occludedCount;
+}
+
+void
+CullVisitor::CountNode() {
+  if (m.stats) {
+    m.stats->CountNodeTraversed();
+  }
+}
+
+void
+CullVisitor::ResetCameraUse() {
+  m.cameraUsed = false;
+}
+
+bool
+CullVisitor::WasCameraUsed() const {
+  return m.cameraUsed;
+}
+
 } // namespace vrb
 
 
@@ -6,18 +6,26 @@
 #include "vrb/DataCache.h"
 #include "vrb/ConcreteClass.h"
 
+#include "vrb/AllocationTracker.h"
+#include "vrb/ConditionVariable.h"
 #include "vrb/Logger.h"
 #include "vrb/Mutex.h"
 
+#include <algorithm>
+#include <deque>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace {
 static const std::string sFilePrefix = "/vrb_data_cache_";
+static const int32_t kMaxPrefetchThreads = 4;
+static const size_t kDefaultPrefetchLimit = 32 * 1024 * 1024;
 struct CachedData {
   std::string path;
   size_t size;
@@ -42,6 +50,36 @@ private:
 };
 typedef std::unordered_map<uint32_t, CachedData>::iterator cacheIterator_t;
 
+struct PrefetchedData {
+  size_t size;
+  std::unique_ptr<uint8_t[]> data;
+  PrefetchedData() : size(0) {}
+};
+
+size_t
+ReadCachedData(const CachedData& aInfo, std::unique_ptr<uint8_t[]>& aData) {
+  int file = open(aInfo.path.c_str(), O_RDONLY);
+  if (file < 0) {
+    VRB_ERROR("Failed to open cache file: %s for reading", aInfo.path.c_str());
+    return 0;
+  }
+  CloseFileOnReturn hold(file);
+  aData = std::make_unique<uint8_t[]>(aInfo.size);
+  size_t toRead = aInfo.size;
+  size_t place = 0;
+  while (toRead > 0) {
+    ssize_t dataRead = read(file, &(aData[place]), toRead);
+    if (dataRead <= 0) {
+      VRB_ERROR("Failed to read from cache file: %s", aInfo.path.c_str());
+      aData = nullptr;
+      return 0;
+    }
+    toRead -= (size_t)dataRead;
+    place = aInfo.size - toRead;
+  }
+  return aInfo.size;
+}
+
 }
 
 namespace vrb {
@@ -51,9 +89,101 @@ struct DataCache::State {
   std::string cachePath;
   uint32_t handleCount;
   std::unordered_map<uint32_t, CachedData> cache;
-  State() : handleCount(0) {}
+  // Guards everything below. Broadcast whenever a prefetch finishes.
+  ConditionVariable prefetchLock;
+  std::deque<uint32_t> prefetchQueue;
+  std::unordered_set<uint32_t> prefetching;
+  std::unordered_map<uint32_t, PrefetchedData> prefetched;
+  int32_t prefetchThreads;
+  size_t prefetchLimit;
+  // Bytes held in prefetched plus bytes being read.
+  size_t prefetchBytes;
+  // Bumped by DropPrefetchedData() so reads in flight are discarded.
+  uint32_t prefetchGeneration;
+  State()
+      : handleCount(0)
+      , prefetchThreads(0)
+      , prefetchLimit(kDefaultPrefetchLimit)
+      , prefetchBytes(0)
+      , prefetchGeneration(0)
+  {}
+  bool FindCachedData(const uint32_t aHandle, CachedData& aInfo);
+  void ReleasePrefetched(const size_t aBytes);
+  void RunPrefetch();
+  static void* PrefetchThread(void* aState);
 };
 
+bool
+DataCache::State::FindCachedData(const uint32_t aHandle, CachedData& aInfo) {
+  MutexAutoLock lock(cacheLock);
+  cacheIterator_t found = cache.find(aHandle);
+  if (found == cache.end()) {
+    return false;
+  }
+  aInfo = found->second;
+  return true;
+}
+
+// Called with prefetchLock held. Wakes workers paused on the limit.
+void
+DataCache::State::ReleasePrefetched(const size_t aBytes) {
+  prefetchBytes -= std::min(prefetchBytes, aBytes);
+  prefetchLock.Broadcast();
+}
+
+void
+DataCache::State::RunPrefetch() {
+  VRB_ALLOCATION_SCOPE(Cache);
+  while (true) {
+    uint32_t handle = 0;
+    uint32_t generation = 0;
+    CachedData info;
+    {
+      MutexAutoLock lock(prefetchLock);
+      while (true) {
+        if (prefetchQueue.empty()) {
+          prefetchThreads--;
+          prefetchLock.Broadcast();
+          return;
+        }
+        handle = prefetchQueue.front();
+        if (!FindCachedData(handle, info)) {
+          prefetchQueue.pop_front();
+          continue;
+        }
+        // A block larger than the limit is still read when nothing else is held.
+        if ((prefetchBytes == 0) || ((prefetchBytes + info.size) <= prefetchLimit)) {
+          break;
+        }
+        prefetchLock.Wait();
+      }
+      prefetchQueue.pop_front();
+      prefetching.insert(handle);
+      prefetchBytes += info.size;
+      generation = prefetchGeneration;
+    }
+    PrefetchedData result;
+    result.size = ReadCachedData(info, result.data);
+    MutexAutoLock lock(prefetchLock);
+    prefetching.erase(handle);
+    if (result.data && (generation == prefetchGeneration)) {
+      prefetched[handle] = std::move(result);
+      prefetchLock.Broadcast();
+    } else if (generation == prefetchGeneration) {
+      ReleasePrefetched(info.size);
+    } else {
+      // DropPrefetchedData() already released the bytes of this read.
+      prefetchLock.Broadcast();
+    }
+  }
+}
+
+void*
+DataCache::State::PrefetchThread(void* aState) {
+  ((DataCache::State*)aState)->RunPrefetch();
+  return nullptr;
+}
+
 DataCachePtr
 DataCache::Create() {
   DataCachePtr result = std::make_shared<ConcreteClass <DataCache, DataCache::State> >();
@@ -62,6 +192,7 @@ DataCache::Create() {
 
 uint32_t
 DataCache::CacheData(std::unique_ptr<uint8_t[]>& aData, const size_t aDataSize) {
+  VRB_ALLOCATION_SCOPE(Cache);
   uint32_t handle = 0;
   std::string root;
   {
@@ -107,33 +238,29 @@ DataCache::CacheData(std::unique_ptr<uint8_t[]>& aData, const size_t aDataSize)
 
 size_t
 DataCache::LoadData(const uint32_t aHandle, std::unique_ptr<uint8_t[]>& aData) {
-  cacheIterator_t found;
+  VRB_ALLOCATION_SCOPE(Cache);
   {
-    MutexAutoLock lock(m.cacheLock);
-    found = m.cache.find(aHandle);
-    if (found == m.cache.end()) {
-      VRB_ERROR("Failed to find cache file from handle: %u", aHandle);
-      return 0;
+    MutexAutoLock lock(m.prefetchLock);
+    m.prefetchQueue.erase(std::remove(m.prefetchQueue.begin(), m.prefetchQueue.end(), aHandle), m.prefetchQueue.end());
+    while (m.prefetching.count(aHandle) > 0) {
+      m.prefetchLock.Wait();
+    }
+    auto found = m.prefetched.find(aHandle);
+    if (found != m.prefetched.end()) {
+      const size_t size = found->second.size;
+      aData = std::move(found->second.data);
+      m.prefetched.erase(found);
+      m.ReleasePrefetched(size);
+      return size;
     }
   }
-  CachedData info = found->second;
-  int file = open(info.path.c_str(), O_RDONLY);
-  if (file < 0) {
-    VRB_ERROR("Failed to open cache file: %s for reading", info.path.c_str());
+  CachedData info;
+  if (!m.FindCachedData(aHandle, info)) {
+    VRB_ERROR("Failed to find cache file from handle: %u", aHandle);
     return 0;
   }
-  CloseFileOnReturn hold(file);
-  aData = std::make_unique<uint8_t[]>(info.size);
-  size_t toRead = info.size;
-  size_t place = 0;
-  while (toRead > 0) {
-    ssize_t dataRead = read(file, &(aData[place]), toRead);
-    if (dataRead < 0) {
-      VRB_ERROR("Failed to read from cache file: %s", info.path.c_str());
-      return 0;
-    }
-    toRead -= (size_t)dataRead;
-    place = info.size - toRead;
+  if (ReadCachedData(info, aData) == 0) {
+    return 0;
   }
   VRB_LOG("Loaded cached data: %u size: %u", aHandle, (uint32_t)info.size);
   return info.size;
@@ -141,6 +268,18 @@ DataCache::LoadData(const uint32_t aHandle, std::unique_ptr<uint8_t[]>& aData) {
 
 void
 DataCache::RemoveData(const uint32_t aHandle) {
+  {
+    MutexAutoLock lock(m.prefetchLock);
+    m.prefetchQueue.erase(std::remove(m.prefetchQueue.begin(), m.prefetchQueue.end(), aHandle), m.prefetchQueue.end());
+    while (m.prefetching.count(aHandle) > 0) {
+      m.prefetchLock.Wait();
+    }
+    auto found = m.prefetched.find(aHandle);
+    if (found != m.prefetched.end()) {
+      m.ReleasePrefetched(found->second.size);
+      m.prefetched.erase(found);
+    }
+  }
   std::string path;
   {
     MutexAutoLock lock(m.cacheLock);
@@ -164,8 +303,64 @@ DataCache::SetCachePath(const std::string& aPath) {
   m.cachePath = aPath;
 }
 
+void
+DataCache::SetPrefetchLimit(const size_t aBytes) {
+  MutexAutoLock lock(m.prefetchLock);
+  m.prefetchLimit = aBytes;
+  m.prefetchLock.Broadcast();
+}
+
+void
+DataCache::Prefetch(const std::vector<uint32_t>& aHandles) {
+  if (aHandles.empty()) {
+    return;
+  }
+  MutexAutoLock lock(m.prefetchLock);
+  for (const uint32_t handle: aHandles) {
+    if ((m.prefetched.count(handle) == 0) && (m.prefetching.count(handle) == 0)) {
+      m.prefetchQueue.push_back(handle);
+    }
+  }
+  const int32_t kWanted = std::min(kMaxPrefetchThreads, (int32_t)m.prefetchQueue.size());
+  while (m.prefetchThreads < kWanted) {
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, &DataCache::State::PrefetchThread, &m) != 0) {
+      VRB_ERROR("Failed to start DataCache prefetch thread");
+      break;
+    }
+    pthread_detach(thread);
+    m.prefetchThreads++;
+  }
+  VRB_LOG("Prefetching %u cached data blocks on %d threads", (uint32_t)m.prefetchQueue.size(), m.prefetchThreads);
+}
+
+bool
+DataCache::IsPrefetched(const uint32_t aHandle) {
+  MutexAutoLock lock(m.prefetchLock);
+  return m.prefetched.count(aHandle) > 0;
+}
+
+void
+DataCache::DropPrefetchedData() {
+  MutexAutoLock lock(m.prefetchLock);
+  m.prefetchQueue.clear();
+  m.prefetched.clear();
+  m.prefetchGeneration++;
+  m.prefetchBytes = 0;
+  m.prefetchLock.Broadcast();
+}
+
 DataCache::DataCache(State& aState) : m(aState) {}
 DataCache::~DataCache() {
+  {
+    // Prefetch threads use the state, wait for them to finish.
+    MutexAutoLock lock(m.prefetchLock);
+    m.prefetchQueue.clear();
+    m.prefetchLock.Broadcast();
+    while (m.prefetchThreads > 0) {
+      m.prefetchLock.Wait();
+    }
+  }
   // No need to lock since if destructor is called, no references are left
   for (cacheIterator_t info = m.cache.begin(); info != m.cache.end(); info++) {
     if (remove(info->second.path.c_str()) < 0) {
@@ -13,6 +13,16 @@ Drawable::CreateDrawablePtr() {
   return shared_from_this();
 }
 
+const DrawableHandle&
+Drawable::GetDrawableHandle() const {
+  return m.handle;
+}
+
+void
+Drawable::SetDrawableHandle(const DrawableHandle& aHandle) {
+  m.handle = aHandle;
+}
+
 Drawable::Drawable(State& aState, CreationContextPtr& aContext) : m(aState) {}
 Drawable::~Drawable() {}
 
@@ -6,10 +6,27 @@
 #include "vrb/DrawableList.h"
 #include "vrb/private/DrawableListState.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/Camera.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/CreationContext.h"
 #include "vrb/Drawable.h"
+#include "vrb/DrawableRegistry.h"
+#include "vrb/Geometry.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
+#include "vrb/Group.h"
+#include "vrb/LOD.h"
+#include "vrb/Logger.h"
+#include "vrb/Node.h"
 #include "vrb/RenderState.h"
+#include "vrb/RenderStats.h"
+#include "vrb/Transform.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace vrb {
 
@@ -30,6 +47,277 @@ DrawableList::State::Reset() {
     currentLight = currentLight->masterNext;
     delete tmp;
   }
+  if (ownsRegistry && registry) {
+    registry->RetireFrame();
+  }
+}
+
+void
+DrawableList::State::Observer::NodeAdded(Group&, const Node&) {
+  if (state) {
+    state->rebuild = true;
+  }
+}
+
+void
+DrawableList::State::Observer::NodeRemoved(Group&, const Node& aNode) {
+  if (state) {
+    state->removedNodes[&aNode] = true;
+  }
+}
+
+void
+DrawableList::State::Observer::ChildToggled(Group&, const Node& aNode, const bool aEnabled) {
+  if (!state) {
+    return;
+  }
+  if (aEnabled) {
+    state->rebuild = true;
+  } else if (state->removedNodes.count(&aNode) == 0) {
+    state->removedNodes[&aNode] = false;
+  }
+}
+
+void
+DrawableList::State::Observer::LightsChanged(Group&) {
+  if (state) {
+    state->rebuild = true;
+  }
+}
+
+void
+DrawableList::State::Observer::TransformChanged(Transform& aTransform) {
+  if (state) {
+    state->dirtyTransforms.insert(&aTransform);
+  }
+}
+
+void
+DrawableList::State::Observer::RenderStateChanged(RenderState&) {
+  if (state) {
+    state->changed = true;
+  }
+}
+
+void
+DrawableList::State::StopObserving() {
+  GroupObserverPtr groupObserver = observer;
+  for (GroupWeak& weak: observedGroups) {
+    GroupPtr group = weak.lock();
+    if (group) {
+      group->RemoveObserver(groupObserver);
+    }
+  }
+  observedGroups.clear();
+  RenderStateObserverPtr renderStateObserver = observer;
+  for (RenderStateWeak& weak: observedRenderStates) {
+    RenderStatePtr renderState = weak.lock();
+    if (renderState) {
+      renderState->RemoveObserver(renderStateObserver);
+    }
+  }
+  observedRenderStates.clear();
+}
+
+void
+DrawableList::State::Observe(const NodePtr& aNode) {
+  GroupPtr group = std::dynamic_pointer_cast<Group>(aNode);
+  if (!group) {
+    return;
+  }
+  group->AddObserver(observer);
+  observedGroups.push_back(group);
+  // Disabled children are observed too so toggling them back on is seen.
+  for (int32_t ix = 0; ix < group->GetNodeCount(); ix++) {
+    Observe(group->GetNode(ix));
+  }
+}
+
+bool
+DrawableList::State::PatchRemovedNodes() {
+  DrawNode* previous = nullptr;
+  DrawNode* current = drawables;
+  while (current) {
+    const Node* node = dynamic_cast<const Node*>(registry->Resolve(current->handle));
+    if (!node) {
+      return false;
+    }
+    bool remove = false;
+    while (node) {
+      auto removed = removedNodes.find(node);
+      std::vector<GroupPtr> parents;
+      node->GetParents(parents);
+      if (removed != removedNodes.end()) {
+        // A removed node must now be detached and a toggled node must only
+        // live in its Toggle, otherwise other paths to it can not be told apart.
+        if (parents.size() != (removed->second ? 0 : 1)) {
+          return false;
+        }
+        remove = true;
+        break;
+      }
+      if (node == root.get()) {
+        break;
+      }
+      if (parents.size() != 1) {
+        return false;
+      }
+      node = parents[0].get();
+    }
+    DrawNode* next = current->next;
+    if (remove) {
+      if (previous) {
+        previous->next = next;
+      } else {
+        drawables = next;
+      }
+      delete current;
+    } else {
+      previous = current;
+    }
+    current = next;
+  }
+  return true;
+}
+
+bool
+DrawableList::State::PatchTransforms() {
+  if (dirtyTransforms.empty()) {
+    return true;
+  }
+  for (DrawNode* current = drawables; current; current = current->next) {
+    const Node* node = dynamic_cast<const Node*>(registry->Resolve(current->handle));
+    if (!node) {
+      return false;
+    }
+    const bool kIsGeometry = dynamic_cast<const Geometry*>(node) != nullptr;
+    Matrix world = Matrix::Identity();
+    bool affected = false;
+    bool dependsOnCamera = false;
+    while (node) {
+      const Transform* transform = dynamic_cast<const Transform*>(node);
+      if (transform) {
+        world = transform->GetTransform().PostMultiply(world);
+        affected = affected || (dirtyTransforms.count(transform) > 0);
+      }
+      dependsOnCamera = dependsOnCamera || (dynamic_cast<const LOD*>(node) != nullptr);
+      if (node == root.get()) {
+        break;
+      }
+      std::vector<GroupPtr> parents;
+      node->GetParents(parents);
+      if (parents.size() != 1) {
+        return false;
+      }
+      node = parents[0].get();
+    }
+    if (!affected) {
+      continue;
+    }
+    // Anything other than plain Geometry may cull differently once moved.
+    if (!node || !kIsGeometry || dependsOnCamera) {
+      return false;
+    }
+    current->transform = baseTransform.PostMultiply(world);
+  }
+  return true;
+}
+
+void
+DrawableList::State::ApplyLights(DrawNode* aNode) {
+  const uint32_t id = aNode->lights ? aNode->lights->id : 0;
+  RenderStatePtr& renderState = aNode->drawable->GetRenderState();
+  if (id != renderState->GetLightId()) {
+    renderState->ResetLights(id);
+    LightSnapshot* snapshot = aNode->lights;
+    while (snapshot) {
+      renderState->AddLight(snapshot->direction, snapshot->ambient, snapshot->diffuse, snapshot->specular);
+      snapshot = snapshot->next;
+    }
+  }
+}
+
+void
+DrawableList::State::DrawBatched(const Camera& aCamera) {
+  entries.clear();
+  DrawNode* current = drawables;
+  while (current) {
+    current->drawable = registry->Resolve(current->handle);
+    if (!current->drawable) {
+      current = current->next;
+      continue;
+    }
+    BatchEntry entry;
+    entry.node = current;
+    entry.geometry = dynamic_cast<Geometry*>(current->drawable);
+    entry.renderState = current->drawable->GetRenderState().get();
+    entry.batchKey = entry.geometry ? entry.geometry->GetBatchKey() : nullptr;
+    entry.lightId = current->lights ? current->lights->id : 0;
+    entries.push_back(entry);
+    current = current->next;
+  }
+  // Only adjacent drawables are merged so the submission order stays the scene
+  // order. Instances are drawn in order, so a merged run blends the same way as
+  // the individual draws it replaces.
+  size_t start = 0;
+  while (start < entries.size()) {
+    size_t end = start + 1;
+    if (entries[start].batchKey) {
+      while ((end < entries.size()) &&
+             (entries[end].batchKey == entries[start].batchKey) &&
+             (entries[end].renderState == entries[start].renderState) &&
+             (entries[end].lightId == entries[start].lightId)) {
+        end++;
+      }
+    }
+    if (((end - start) >= (size_t)std::max(batchThreshold, 2)) && (instanceObjectId != 0)) {
+      DrawBatch(aCamera, start, end);
+    } else {
+      for (size_t ix = start; ix < end; ix++) {
+        ApplyLights(entries[ix].node);
+        entries[ix].node->drawable->Draw(aCamera, entries[ix].node->transform);
+        drawCount++;
+        if (stats) {
+          stats->CountDrawables(1);
+        }
+      }
+    }
+    start = end;
+  }
+  entries.clear();
+}
+
+void
+DrawableList::State::DrawBatch(const Camera& aCamera, const size_t aStart, const size_t aEnd) {
+  static const float kWhite[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  const size_t kFloatCount = (size_t)Geometry::kInstanceFloatCount;
+  const size_t kCount = aEnd - aStart;
+  instanceData.resize(kCount * kFloatCount);
+  float* target = instanceData.data();
+  for (size_t ix = aStart; ix < aEnd; ix++) {
+    memcpy(target, entries[ix].node->transform.Data(), 16 * sizeof(float));
+    memcpy(target + 16, kWhite, sizeof(kWhite));
+    target += kFloatCount;
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, instanceObjectId));
+  // Orphan the previous frame's contents so the driver does not stall on them.
+  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, instanceData.size() * sizeof(float), nullptr, GL_STREAM_DRAW));
+  if (ledger && (instanceBufferSize != instanceData.size() * sizeof(float))) {
+    instanceBufferSize = instanceData.size() * sizeof(float);
+    ledger->Set(this, GpuMemoryCategory::Vertex, instanceBufferSize, "DrawableList");
+  }
+  VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, instanceData.size() * sizeof(float), instanceData.data()));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  if (stats) {
+    stats->CountBufferBind();
+    stats->CountUpload(instanceData.size() * sizeof(float));
+    stats->CountDrawables((uint32_t)kCount);
+  }
+  ApplyLights(entries[aStart].node);
+  entries[aStart].geometry->DrawInstanced(aCamera, instanceObjectId, (GLsizei)kCount);
+  drawCount++;
+  instancedDrawCount++;
+  drawsSaved += (int32_t)kCount - 1;
 }
 
 DrawableListPtr
@@ -40,6 +328,7 @@ DrawableList::Create(CreationContextPtr& aContext) {
 void
 DrawableList::Reset() {
   m.Reset();
+  m.rebuild = true;
 }
 
 void
@@ -69,8 +358,15 @@ DrawableList::PopLights(const int aCount) {
 
 void
 DrawableList::AddDrawable(DrawablePtr&& aDrawable, const Matrix& aTransform) {
+  if (aDrawable) {
+    AddDrawable(*aDrawable, aTransform);
+  }
+}
+
+void
+DrawableList::AddDrawable(Drawable& aDrawable, const Matrix& aTransform) {
   State::DrawNode* node = new State::DrawNode;
-  node->drawable = aDrawable;
+  node->handle = m.registry->Acquire(aDrawable);
   node->transform = aTransform;
   node->lights = m.currentLights;
   node->next = m.drawables;
@@ -79,23 +375,188 @@ DrawableList::AddDrawable(DrawablePtr&& aDrawable, const Matrix& aTransform) {
 
 void
 DrawableList::Draw(const Camera& aCamera) {
+  VRB_ALLOCATION_SCOPE(Draw);
+  m.drawCount = 0;
+  m.instancedDrawCount = 0;
+  m.drawsSaved = 0;
+  if (m.batching) {
+    m.DrawBatched(aCamera);
+    return;
+  }
   State::DrawNode* current = m.drawables;
   while (current) {
-    const uint32_t id = current->lights ? current->lights->id : 0;
-    if (id != current->drawable->GetRenderState()->GetLightId()) {
-      current->drawable->GetRenderState()->ResetLights(id);
-      State::LightSnapshot* snapshot = current->lights;
-      while (snapshot) {
-        current->drawable->GetRenderState()->AddLight(snapshot->direction, snapshot->ambient, snapshot->diffuse, snapshot->specular);
-        snapshot = snapshot->next;
+    current->drawable = m.registry->Resolve(current->handle);
+    if (current->drawable) {
+      m.ApplyLights(current);
+      current->drawable->Draw(aCamera, current->transform);
+      m.drawCount++;
+      if (m.stats) {
+        m.stats->CountDrawables(1);
       }
     }
-    current->drawable->Draw(aCamera, current->transform);
     current = current->next;
   }
 }
 
-DrawableList::DrawableList(State& aState, CreationContextPtr& aContext) : m(aState) {}
-DrawableList::~DrawableList() {}
+void
+DrawableList::SetBatchingEnabled(const bool aEnabled) {
+  m.batching = aEnabled;
+}
+
+bool
+DrawableList::IsBatchingEnabled() const {
+  return m.batching;
+}
+
+void
+DrawableList::SetBatchThreshold(const int32_t aThreshold) {
+  m.batchThreshold = aThreshold;
+}
+
+int32_t
+DrawableList::GetBatchThreshold() const {
+  return m.batchThreshold;
+}
+
+int32_t
+DrawableList::GetDrawCount() const {
+  return m.drawCount;
+}
+
+int32_t
+DrawableList::GetInstancedDrawCount() const {
+  return m.instancedDrawCount;
+}
+
+int32_t
+DrawableList::GetDrawsSaved() const {
+  return m.drawsSaved;
+}
+
+void
+DrawableList::SetRoot(const NodePtr& aRoot) {
+  m.StopObserving();
+  m.Reset();
+  m.root = aRoot;
+  m.removedNodes.clear();
+  m.dirtyTransforms.clear();
+  m.rebuild = true;
+}
+
+NodePtr
+DrawableList::GetRoot() const {
+  return m.root;
+}
+
+bool
+DrawableList::Update(CullVisitor& aVisitor) {
+  VRB_ALLOCATION_SCOPE(Cull);
+  if (!m.root) {
+    VRB_WARN("DrawableList::Update called without a root node");
+    return false;
+  }
+  const bool kHasCamera = aVisitor.HasCamera();
+  // A list whose cull did not look at the camera stays valid while it moves,
+  // which is the common case for a head tracked camera.
+  if ((kHasCamera != m.hadCamera) ||
+      (kHasCamera && m.cameraDependent &&
+       memcmp(aVisitor.GetViewProjection().Data(), m.viewProjection.Data(), 16 * sizeof(float)) != 0)) {
+    m.rebuild = true;
+  }
+  // Broad phase, occlusion and LOD results depend on where nodes are.
+  if (!m.dirtyTransforms.empty() &&
+      (m.cameraDependent || aVisitor.GetSpatialIndex() || aVisitor.IsOcclusionCullingEnabled())) {
+    m.rebuild = true;
+  }
+  if (!m.rebuild && (!m.removedNodes.empty() || !m.dirtyTransforms.empty())) {
+    if (m.PatchRemovedNodes() && m.PatchTransforms()) {
+      m.patchCount++;
+      m.changed = true;
+    } else {
+      m.rebuild = true;
+    }
+  }
+  m.removedNodes.clear();
+  m.dirtyTransforms.clear();
+
+  if (m.rebuild) {
+    m.StopObserving();
+    m.Reset();
+    m.baseTransform = aVisitor.GetTransform();
+    aVisitor.ResetCameraUse();
+    m.root->Cull(aVisitor, *this);
+    m.cameraDependent = aVisitor.WasCameraUsed();
+    m.Observe(m.root);
+    std::unordered_set<RenderState*> renderStates;
+    for (State::DrawNode* current = m.drawables; current; current = current->next) {
+      Drawable* drawable = m.registry->Resolve(current->handle);
+      if (!drawable) {
+        continue;
+      }
+      RenderStatePtr& renderState = drawable->GetRenderState();
+      if (renderState && renderStates.insert(renderState.get()).second) {
+        renderState->AddObserver(m.observer);
+        m.observedRenderStates.push_back(renderState);
+      }
+    }
+    // Edits made while culling, such as LOD selection, are already in the list.
+    m.removedNodes.clear();
+    m.dirtyTransforms.clear();
+    m.hadCamera = kHasCamera;
+    m.viewProjection = aVisitor.GetViewProjection();
+    m.rebuild = false;
+    m.rebuildCount++;
+    m.changed = true;
+  }
+
+  const bool kChanged = m.changed;
+  m.changed = false;
+  return kChanged;
+}
+
+void
+DrawableList::Invalidate() {
+  m.rebuild = true;
+}
+
+int32_t
+DrawableList::GetRebuildCount() const {
+  return m.rebuildCount;
+}
+
+int32_t
+DrawableList::GetPatchCount() const {
+  return m.patchCount;
+}
+
+DrawableList::DrawableList(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {
+  m.registry = aContext->GetDrawableRegistry();
+  m.stats = aContext->GetRenderStats();
+  m.ledger = aContext->GetGpuMemoryLedger();
+  m.deletionQueue = aContext->GetGLDeletionQueue();
+  if (!m.registry) {
+    m.registry = DrawableRegistry::Create();
+    m.ownsRegistry = true;
+  }
+}
+DrawableList::~DrawableList() {
+  ShutdownGL();
+}
+
+// ResourceGL interface
+void
+DrawableList::InitializeGL() {
+  VRB_GL_CHECK(glGenBuffers(1, &m.instanceObjectId));
+}
+
+void
+DrawableList::ShutdownGL() {
+  m.deletionQueue->DeleteBuffer(m.instanceObjectId);
+  m.instanceObjectId = 0;
+  m.instanceBufferSize = 0;
+  if (m.ledger) {
+    m.ledger->Release(&m);
+  }
+}
 
 } // namespace vrb
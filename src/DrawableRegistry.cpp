@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/DrawableRegistry.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Drawable.h"
+
+#include <vector>
+
+namespace vrb {
+
+struct DrawableRegistry::State {
+  struct Slot {
+    DrawablePtr drawable;
+    uint32_t generation;
+    uint32_t lastFrame;
+    Slot() : generation(1), lastFrame(0) {}
+  };
+  std::vector<Slot> slots;
+  std::vector<uint32_t> freeSlots;
+  uint32_t frame;
+  int32_t count;
+
+  State() : frame(1), count(0) {}
+
+  void Release(const uint32_t aIndex) {
+    Slot& slot = slots[aIndex];
+    slot.drawable = nullptr;
+    slot.generation++;
+    if (slot.generation == 0) {
+      slot.generation = 1;
+    }
+    freeSlots.push_back(aIndex);
+    count--;
+  }
+};
+
+DrawableRegistryPtr
+DrawableRegistry::Create() {
+  return std::make_shared<ConcreteClass<DrawableRegistry, DrawableRegistry::State> >();
+}
+
+DrawableHandle
+DrawableRegistry::Acquire(Drawable& aDrawable) {
+  const DrawableHandle& kCurrent = aDrawable.GetDrawableHandle();
+  if (Resolve(kCurrent) == &aDrawable) {
+    return kCurrent;
+  }
+  uint32_t index = 0;
+  if (!m.freeSlots.empty()) {
+    index = m.freeSlots.back();
+    m.freeSlots.pop_back();
+  } else {
+    index = (uint32_t)m.slots.size();
+    m.slots.emplace_back();
+  }
+  State::Slot& slot = m.slots[index];
+  // The only reference count change a Drawable sees for its registered lifetime.
+  slot.drawable = aDrawable.CreateDrawablePtr();
+  slot.lastFrame = m.frame;
+  m.count++;
+  DrawableHandle handle;
+  handle.index = index;
+  handle.generation = slot.generation;
+  aDrawable.SetDrawableHandle(handle);
+  return handle;
+}
+
+Drawable*
+DrawableRegistry::Resolve(const DrawableHandle& aHandle) {
+  if (!aHandle.IsValid() || (aHandle.index >= m.slots.size())) {
+    return nullptr;
+  }
+  State::Slot& slot = m.slots[aHandle.index];
+  if ((slot.generation != aHandle.generation) || !slot.drawable) {
+    return nullptr;
+  }
+  slot.lastFrame = m.frame;
+  return slot.drawable.get();
+}
+
+void
+DrawableRegistry::RetireFrame() {
+  for (uint32_t ix = 0; ix < m.slots.size(); ix++) {
+    State::Slot& slot = m.slots[ix];
+    // Only the registry still holds the Drawable and the retired frame did not use it.
+    if (slot.drawable && (slot.drawable.use_count() == 1) && (slot.lastFrame < m.frame)) {
+      m.Release(ix);
+    }
+  }
+  m.frame++;
+}
+
+void
+DrawableRegistry::Clear() {
+  for (uint32_t ix = 0; ix < m.slots.size(); ix++) {
+    if (m.slots[ix].drawable) {
+      m.Release(ix);
+    }
+  }
+}
+
+int32_t
+DrawableRegistry::GetCount() const {
+  return m.count;
+}
+
+uint32_t
+DrawableRegistry::GetFrame() const {
+  return m.frame;
+}
+
+DrawableRegistry::DrawableRegistry(State& aState) : m(aState) {}
+DrawableRegistry::~DrawableRegistry() {}
+
+} // namespace vrb
@@ -7,14 +7,20 @@
 #include "vrb/ConcreteClass.h"
 
 #include "vrb/RenderContext.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
 #include "vrb/GLExtensions.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
 
+#include <algorithm>
+
 namespace vrb {
 
 struct FBO::State {
   RenderContextWeak context;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
   bool valid;
   GLuint depth;
   GLuint fbo;
@@ -24,16 +30,19 @@ struct FBO::State {
   void Clear() {
     if (depth) {
       if (attributes.multiview) {
-        glDeleteTextures(1, &depth);
+        deletionQueue->DeleteTexture(depth);
       } else {
-        glDeleteRenderbuffers(1, &depth);
+        deletionQueue->DeleteRenderbuffer(depth);
       }
       depth = 0;
     }
     if (fbo) {
-      glDeleteFramebuffers(1, &fbo);
+      deletionQueue->DeleteFramebuffer(fbo);
       fbo = 0;
     }
+    if (ledger) {
+      ledger->Release(this);
+    }
     valid = false;
   }
 
@@ -126,6 +135,8 @@ FBOPtr
 FBO::Create(RenderContextPtr& aContext) {
   FBOPtr result = std::make_shared<ConcreteClass<FBO, FBO::State> >();
   result->m.context = aContext;
+  result->m.ledger = aContext->GetGpuMemoryLedger();
+  result->m.deletionQueue = aContext->GetGLDeletionQueue();
   return result;
 }
 
@@ -151,6 +162,12 @@ FBO::SetTextureHandle(const GLuint aHandle,
 
     if (GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER)) {
       m.valid = true;
+      if (m.ledger && m.depth) {
+        // The color attachment belongs to the caller, only the depth buffer is the FBO's.
+        const uint64_t kLayers = m.attributes.multiview ? 2 : 1;
+        const uint64_t kSamples = (uint64_t)std::max(m.attributes.samples, 1);
+        m.ledger->Set(&m, GpuMemoryCategory::FBO, (uint64_t)aWidth * (uint64_t)aHeight * 4 * kLayers * kSamples, "FBO");
+      }
     } else {
       VRB_ERROR("Failed to create valid frame buffer object");
       m.Clear();
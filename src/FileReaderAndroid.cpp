@@ -9,10 +9,13 @@
 #include "vrb/ClassLoaderAndroid.h"
 #include "vrb/JNIException.h"
 #include "vrb/Logger.h"
+#include "vrb/Mutex.h"
 
 
 #include <jni.h>
+#include <algorithm>
 #include <fstream>
+#include <unordered_map>
 #include <vector>
 
 #include <android/asset_manager.h>
@@ -28,6 +31,20 @@ namespace {
 inline jlong jptr(vrb::FileReaderAndroid* ptr) { return reinterpret_cast<intptr_t>(ptr); }
 inline vrb::FileReaderAndroid* ptr(jlong jptr) { return reinterpret_cast<vrb::FileReaderAndroid*>(jptr); }
 
+// Result of one image in a batch, filled in from the Java decode threads.
+struct DecodedImage {
+  vrb::FileHandlerPtr handler;
+  std::unique_ptr<uint8_t[]> image;
+  uint64_t length;
+  int width;
+  int height;
+  GLenum format;
+  std::string error;
+  bool done;
+
+  DecodedImage() : length(0), width(0), height(0), format(0), done(false) {}
+};
+
 }
 
 namespace vrb {
@@ -40,8 +57,11 @@ struct FileReaderAndroid::State {
   jclass imageLoaderClass;
   jmethodID loadFromAssets;
   jmethodID loadFromRawFile;
+  jmethodID loadBatch;
   int imageTargetHandle;
   FileHandlerPtr imageTarget;
+  Mutex batchLock;
+  std::unordered_map<int, DecodedImage> batch;
   State()
       : trackingHandleCount(0)
       , env(nullptr)
@@ -50,6 +70,7 @@ struct FileReaderAndroid::State {
       , imageLoaderClass(nullptr)
       , loadFromAssets(nullptr)
       , loadFromRawFile(nullptr)
+      , loadBatch(nullptr)
       , imageTargetHandle(0)
   {}
 
@@ -87,6 +108,40 @@ struct FileReaderAndroid::State {
     AAsset_close(asset);
   }
 
+  // Returns true when aFileHandle belongs to a batch, in which case the
+  // result is kept until the whole batch has been decoded.
+  bool storeDecodedImage(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength,
+                         const int aWidth, const int aHeight, const GLenum aFormat) {
+    MutexAutoLock hold(batchLock);
+    auto entry = batch.find(aFileHandle);
+    if (entry == batch.end()) {
+      return false;
+    }
+    DecodedImage& decoded = entry->second;
+    if (!decoded.done) {
+      decoded.image = std::move(aImage);
+      decoded.length = aImageLength;
+      decoded.width = aWidth;
+      decoded.height = aHeight;
+      decoded.format = aFormat;
+      decoded.done = true;
+    }
+    return true;
+  }
+
+  bool storeDecodeFailure(const int aFileHandle, const std::string& aReason) {
+    MutexAutoLock hold(batchLock);
+    auto entry = batch.find(aFileHandle);
+    if (entry == batch.end()) {
+      return false;
+    }
+    if (!entry->second.done) {
+      entry->second.error = aReason;
+      entry->second.done = true;
+    }
+    return true;
+  }
+
   void readRawFile(const std::string& aFileName, FileHandlerPtr aHandler) {
     const int handle = nextHandle();
     aHandler->BindFileHandle(aFileName, handle);
@@ -148,6 +203,67 @@ FileReaderAndroid::ReadImageFile(const std::string& aFileName, FileHandlerPtr aH
   m.env->DeleteLocalRef(jFileName);
 }
 
+void
+FileReaderAndroid::ReadImageFiles(const std::vector<std::string>& aFileNames, const std::vector<FileHandlerPtr>& aHandlers) {
+  if (!m.loadBatch || !m.am) {
+    FileReader::ReadImageFiles(aFileNames, aHandlers);
+    return;
+  }
+  const size_t count = std::min(aFileNames.size(), aHandlers.size());
+  std::vector<int> handles;
+  std::vector<std::string> names;
+  {
+    MutexAutoLock hold(m.batchLock);
+    for (size_t index = 0; index < count; index++) {
+      if (!aHandlers[index]) {
+        continue;
+      }
+      const int handle = m.nextHandle();
+      aHandlers[index]->BindFileHandle(aFileNames[index], handle);
+      m.batch[handle].handler = aHandlers[index];
+      handles.push_back(handle);
+      names.push_back(aFileNames[index]);
+    }
+  }
+  if (handles.empty()) {
+    return;
+  }
+
+  jclass stringClass = m.env->FindClass("java/lang/String");
+  jobjectArray jFileNames = m.env->NewObjectArray((jsize)names.size(), stringClass, nullptr);
+  for (size_t index = 0; index < names.size(); index++) {
+    jstring jFileName = m.env->NewStringUTF(names[index].c_str());
+    m.env->SetObjectArrayElement(jFileNames, (jsize)index, jFileName);
+    m.env->DeleteLocalRef(jFileName);
+  }
+  jintArray jHandles = m.env->NewIntArray((jsize)handles.size());
+  m.env->SetIntArrayRegion(jHandles, 0, (jsize)handles.size(), handles.data());
+  m.env->CallStaticVoidMethod(m.imageLoaderClass, m.loadBatch, m.jassetManager, jFileNames, jptr(this), jHandles);
+  VRB_CHECK_JNI_EXCEPTION(m.env);
+  m.env->DeleteLocalRef(jHandles);
+  m.env->DeleteLocalRef(jFileNames);
+  m.env->DeleteLocalRef(stringClass);
+
+  // Hand the results over in request order on this thread.
+  for (const int handle: handles) {
+    DecodedImage decoded;
+    {
+      MutexAutoLock hold(m.batchLock);
+      auto entry = m.batch.find(handle);
+      if (entry == m.batch.end()) {
+        continue;
+      }
+      decoded = std::move(entry->second);
+      m.batch.erase(entry);
+    }
+    if (decoded.image) {
+      decoded.handler->ProcessImageFile(handle, decoded.image, decoded.length, decoded.width, decoded.height, decoded.format);
+    } else {
+      decoded.handler->LoadFailed(handle, decoded.error.empty() ? "Image decode did not complete." : decoded.error);
+    }
+  }
+}
+
 void
 FileReaderAndroid::Init(JNIEnv* aEnv, jobject &aAssetManager, const ClassLoaderAndroidPtr& classLoader) {
   m.env = aEnv;
@@ -166,6 +282,10 @@ FileReaderAndroid::Init(JNIEnv* aEnv, jobject &aAssetManager, const ClassLoaderA
   if (!m.loadFromRawFile) {
     VRB_ERROR("Failed to find Java function ImageLoader::loadFromRawfile");
   }
+  m.loadBatch = m.env->GetStaticMethodID(m.imageLoaderClass, "loadBatch", "(Landroid/content/res/AssetManager;[Ljava/lang/String;J[I)V");
+  if (!m.loadBatch) {
+    VRB_ERROR("Failed to find Java function ImageLoader::loadBatch");
+  }
 }
 
 void
@@ -176,11 +296,15 @@ FileReaderAndroid::Shutdown() {
     m.am = nullptr;
     m.env = nullptr;
     m.loadFromAssets = 0;
+    m.loadBatch = 0;
   }
 }
 
 void
 FileReaderAndroid::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]> &aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if (m.storeDecodedImage(aFileHandle, aImage, aImageLength, aWidth, aHeight, aFormat)) {
+    return;
+  }
   if (m.imageTargetHandle != aFileHandle) {
     return;
   }
@@ -197,6 +321,9 @@ FileReaderAndroid::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8
 
 void
 FileReaderAndroid::ImageFileLoadFailed(const int aFileHandle, const std::string& aReason) {
+  if (m.storeDecodeFailure(aFileHandle, aReason)) {
+    return;
+  }
   if (!m.imageTarget || (m.imageTargetHandle != aFileHandle)) {
     return;
   }
@@ -0,0 +1,223 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/GLError.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+
+#include <deque>
+#include <vector>
+
+namespace vrb {
+
+struct GLDeletionQueue::State {
+  enum class Type {
+    Buffer,
+    Texture,
+    Program,
+    Shader,
+    Framebuffer,
+    Renderbuffer,
+    Sync
+  };
+  struct Entry {
+    Type type;
+    GLuint name;
+    GLsync sync;
+    uint32_t frame;
+    Entry(const Type aType, const GLuint aName, GLsync aSync, const uint32_t aFrame)
+        : type(aType), name(aName), sync(aSync), frame(aFrame) {}
+  };
+  mutable Mutex lock;
+  // Entries are queued in frame order so the due ones are always at the front.
+  std::deque<Entry> entries;
+  uint32_t frame;
+  int32_t frameDelay;
+  int32_t maxPerFrame;
+  uint64_t deletedCount;
+  std::vector<Entry> due;
+  std::vector<GLuint> buffers;
+  std::vector<GLuint> textures;
+  std::vector<GLuint> framebuffers;
+  std::vector<GLuint> renderbuffers;
+
+  State() : frame(0), frameDelay(2), maxPerFrame(256), deletedCount(0) {}
+
+  void Add(const Type aType, const GLuint aName, GLsync aSync) {
+    MutexAutoLock guard(lock);
+    entries.emplace_back(aType, aName, aSync, frame);
+  }
+
+  // Takes the due entries out of the queue so GL is not called with the lock held.
+  void TakeDue(const bool aFlush) {
+    MutexAutoLock guard(lock);
+    if (!aFlush) {
+      frame++;
+    }
+    while (!entries.empty()) {
+      if (!aFlush) {
+        if ((maxPerFrame > 0) && ((int32_t)due.size() >= maxPerFrame)) {
+          break;
+        }
+        if ((int32_t)(frame - entries.front().frame) < frameDelay) {
+          break;
+        }
+      }
+      due.push_back(entries.front());
+      entries.pop_front();
+    }
+    deletedCount += due.size();
+  }
+
+  void DeleteDue() {
+    for (const Entry& entry: due) {
+      switch (entry.type) {
+        case Type::Buffer: buffers.push_back(entry.name); break;
+        case Type::Texture: textures.push_back(entry.name); break;
+        case Type::Framebuffer: framebuffers.push_back(entry.name); break;
+        case Type::Renderbuffer: renderbuffers.push_back(entry.name); break;
+        case Type::Program: VRB_GL_CHECK(glDeleteProgram(entry.name)); break;
+        case Type::Shader: VRB_GL_CHECK(glDeleteShader(entry.name)); break;
+        case Type::Sync: VRB_GL_CHECK(glDeleteSync(entry.sync)); break;
+      }
+    }
+    due.clear();
+    if (!buffers.empty()) {
+      VRB_GL_CHECK(glDeleteBuffers((GLsizei)buffers.size(), buffers.data()));
+      buffers.clear();
+    }
+    if (!textures.empty()) {
+      VRB_GL_CHECK(glDeleteTextures((GLsizei)textures.size(), textures.data()));
+      textures.clear();
+    }
+    if (!framebuffers.empty()) {
+      VRB_GL_CHECK(glDeleteFramebuffers((GLsizei)framebuffers.size(), framebuffers.data()));
+      framebuffers.clear();
+    }
+    if (!renderbuffers.empty()) {
+      VRB_GL_CHECK(glDeleteRenderbuffers((GLsizei)renderbuffers.size(), renderbuffers.data()));
+      renderbuffers.clear();
+    }
+  }
+};
+
+GLDeletionQueuePtr
+GLDeletionQueue::Create() {
+  return std::make_shared<ConcreteClass<GLDeletionQueue, GLDeletionQueue::State> >();
+}
+
+void
+GLDeletionQueue::SetFrameDelay(const int32_t aFrames) {
+  MutexAutoLock lock(m.lock);
+  m.frameDelay = aFrames < 0 ? 0 : aFrames;
+}
+
+int32_t
+GLDeletionQueue::GetFrameDelay() const {
+  MutexAutoLock lock(m.lock);
+  return m.frameDelay;
+}
+
+void
+GLDeletionQueue::SetMaxDeletionsPerFrame(const int32_t aCount) {
+  MutexAutoLock lock(m.lock);
+  m.maxPerFrame = aCount;
+}
+
+int32_t
+GLDeletionQueue::GetMaxDeletionsPerFrame() const {
+  MutexAutoLock lock(m.lock);
+  return m.maxPerFrame;
+}
+
+void
+GLDeletionQueue::DeleteBuffer(const GLuint aBuffer) {
+  if (aBuffer) {
+    m.Add(State::Type::Buffer, aBuffer, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteTexture(const GLuint aTexture) {
+  if (aTexture) {
+    m.Add(State::Type::Texture, aTexture, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteProgram(const GLuint aProgram) {
+  if (aProgram) {
+    m.Add(State::Type::Program, aProgram, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteShader(const GLuint aShader) {
+  if (aShader) {
+    m.Add(State::Type::Shader, aShader, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteFramebuffer(const GLuint aFramebuffer) {
+  if (aFramebuffer) {
+    m.Add(State::Type::Framebuffer, aFramebuffer, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteRenderbuffer(const GLuint aRenderbuffer) {
+  if (aRenderbuffer) {
+    m.Add(State::Type::Renderbuffer, aRenderbuffer, nullptr);
+  }
+}
+
+void
+GLDeletionQueue::DeleteSync(GLsync aSync) {
+  if (aSync) {
+    m.Add(State::Type::Sync, 0, aSync);
+  }
+}
+
+void
+GLDeletionQueue::Drain() {
+  m.TakeDue(false);
+  m.DeleteDue();
+}
+
+void
+GLDeletionQueue::Flush() {
+  m.TakeDue(true);
+  m.DeleteDue();
+}
+
+void
+GLDeletionQueue::Discard() {
+  MutexAutoLock guard(m.lock);
+  if (!m.entries.empty()) {
+    VRB_WARN("Discarding %d GL objects queued for deletion in a previous context", (int32_t)m.entries.size());
+  }
+  m.entries.clear();
+}
+
+int32_t
+GLDeletionQueue::GetPendingCount() const {
+  MutexAutoLock lock(m.lock);
+  return (int32_t)m.entries.size();
+}
+
+uint64_t
+GLDeletionQueue::GetDeletedCount() const {
+  MutexAutoLock lock(m.lock);
+  return m.deletedCount;
+}
+
+GLDeletionQueue::GLDeletionQueue(State& aState) : m(aState) {}
+GLDeletionQueue::~GLDeletionQueue() {}
+
+} // namespace vrb
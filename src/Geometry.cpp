@@ -9,18 +9,29 @@
 #include "vrb/private/NodeState.h"
 #include "vrb/private/ResourceGLState.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/Camera.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
 #include "vrb/CullVisitor.h"
 #include "vrb/DrawableList.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
 #include "vrb/Matrix.h"
 #include "vrb/RenderState.h"
+#include "vrb/RenderStats.h"
 #include "vrb/Texture.h"
+#include "vrb/TriangleBVH.h"
 #include "vrb/VertexArray.h"
 #include "vrb/Vector.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace {
@@ -36,10 +47,286 @@ CopyIndecies(std::vector<GLushort> &aTarget, const std::vector<int> &aSource) {
   }
 }
 
+// Buffers are deleted through the context's queue since they may be released
+// off the render thread or while a submitted draw still uses them.
+static void
+DeleteBuffer(const vrb::GLDeletionQueuePtr& aQueue, GLuint& aBuffer) {
+  if (aBuffer == 0) {
+    return;
+  }
+  aQueue->DeleteBuffer(aBuffer);
+  aBuffer = 0;
+}
+
+static void
+CountUpload(vrb::RenderStats* aStats, const size_t aBytes) {
+  if (aStats) {
+    aStats->CountUpload((uint64_t)aBytes);
+  }
+}
+
+// Number of vertex buffers cycled through by dynamic geometry. A buffer is
+// only written again once the fence of the last draw that used it has passed.
+static const int kDynamicBufferCount = 3;
+
+struct VertexBufferSlot {
+  GLuint id;
+  GLsync fence;
+  size_t dirtyStart;
+  size_t dirtyEnd;
+
+  VertexBufferSlot() : id(0), fence(nullptr), dirtyStart(0), dirtyEnd(0) {}
+  void AddDirtyRange(const size_t aStart, const size_t aEnd) {
+    if (dirtyStart == dirtyEnd) {
+      dirtyStart = aStart;
+      dirtyEnd = aEnd;
+      return;
+    }
+    dirtyStart = std::min(dirtyStart, aStart);
+    dirtyEnd = std::max(dirtyEnd, aEnd);
+  }
+  void ClearDirtyRange() {
+    dirtyStart = dirtyEnd = 0;
+  }
+  void DeleteFence() {
+    if (fence) {
+      VRB_GL_CHECK(glDeleteSync(fence));
+      fence = nullptr;
+    }
+  }
+};
+
 }
 
 namespace vrb {
 
+struct Geometry::IndexedBuffers {
+  std::vector<float> vertices;
+  std::vector<GLushort> indices;
+  GLsizei uvLength;
+  GLuint vertexObjectId;
+  GLuint indexObjectId;
+  bool dirty;
+  bool dynamic;
+  bool pending;
+  int currentSlot;
+  VertexBufferSlot slots[kDynamicBufferCount];
+  vrb::GpuMemoryLedgerPtr ledger;
+  vrb::GLDeletionQueuePtr deletionQueue;
+
+  IndexedBuffers()
+      : uvLength(0)
+      , vertexObjectId(0)
+      , indexObjectId(0)
+      , dirty(true)
+      , dynamic(false)
+      , pending(false)
+      , currentSlot(0)
+  {}
+
+  ~IndexedBuffers() {
+    Release();
+  }
+
+  GLsizei VertexSize() const {
+    return (6 + uvLength) * sizeof(float);
+  }
+
+  std::shared_ptr<IndexedBuffers> CloneData() const {
+    std::shared_ptr<IndexedBuffers> result = std::make_shared<IndexedBuffers>();
+    result->vertices = vertices;
+    result->indices = indices;
+    result->uvLength = uvLength;
+    result->dynamic = dynamic;
+    return result;
+  }
+
+  void MarkVerticesDirty(const size_t aStart, const size_t aEnd) {
+    if (!dynamic) {
+      dirty = true;
+      return;
+    }
+    for (VertexBufferSlot& slot: slots) {
+      slot.AddDirtyRange(aStart, aEnd);
+    }
+    pending = true;
+  }
+
+  void Upload(vrb::RenderStats* aStats) {
+    if (indexObjectId == 0) {
+      VRB_GL_CHECK(glGenBuffers(1, &indexObjectId));
+      dirty = true;
+    }
+    if (dynamic) {
+      UploadDynamic(aStats);
+    } else {
+      UploadStatic(aStats);
+    }
+  }
+
+  void UploadStatic(vrb::RenderStats* aStats) {
+    if (slots[0].id != 0) {
+      // Switched from dynamic to static, keep the first buffer of the ring.
+      vertexObjectId = slots[0].id;
+      for (int ix = 1; ix < kDynamicBufferCount; ix++) {
+        DeleteBuffer(deletionQueue, slots[ix].id);
+      }
+      for (VertexBufferSlot& slot: slots) {
+        slot.DeleteFence();
+        slot.id = 0;
+      }
+    }
+    if (vertexObjectId == 0) {
+      VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
+      dirty = true;
+    }
+    if (!dirty) {
+      return;
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW));
+    CountUpload(aStats, sizeof(float) * vertices.size());
+    UploadIndices(aStats);
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    UpdateLedger();
+    dirty = false;
+  }
+
+  void UploadDynamic(vrb::RenderStats* aStats) {
+    if ((slots[0].id == 0) && (vertexObjectId != 0)) {
+      // Switched from static to dynamic, reuse the existing buffer.
+      slots[0].id = vertexObjectId;
+    }
+    const GLsizeiptr kSize = sizeof(float) * vertices.size();
+    if (dirty) {
+      for (VertexBufferSlot& slot: slots) {
+        if (slot.id == 0) {
+          VRB_GL_CHECK(glGenBuffers(1, &slot.id));
+        }
+        VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, slot.id));
+        VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kSize, vertices.data(), GL_DYNAMIC_DRAW));
+        CountUpload(aStats, (size_t)kSize);
+        slot.DeleteFence();
+        slot.ClearDirtyRange();
+      }
+      UploadIndices(aStats);
+      VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+      currentSlot = 0;
+      vertexObjectId = slots[0].id;
+      UpdateLedger();
+      dirty = false;
+      pending = false;
+      return;
+    }
+    if (!pending) {
+      return;
+    }
+    currentSlot = (currentSlot + 1) % kDynamicBufferCount;
+    VertexBufferSlot& slot = slots[currentSlot];
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, slot.id));
+    bool busy = false;
+    if (slot.fence) {
+      const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+      busy = (status == GL_TIMEOUT_EXPIRED) || (status == GL_WAIT_FAILED);
+    }
+    if (busy) {
+      // The GPU is still reading this buffer. Orphan the storage instead of waiting.
+      VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kSize, vertices.data(), GL_DYNAMIC_DRAW));
+      CountUpload(aStats, (size_t)kSize);
+    } else if (slot.dirtyEnd > slot.dirtyStart) {
+      const GLintptr kOffset = sizeof(float) * slot.dirtyStart;
+      const GLsizeiptr kLength = sizeof(float) * (slot.dirtyEnd - slot.dirtyStart);
+      void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, kOffset, kLength,
+          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+      if (mapped) {
+        memcpy(mapped, &vertices[slot.dirtyStart], (size_t)kLength);
+        if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+          VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kSize, vertices.data(), GL_DYNAMIC_DRAW));
+          CountUpload(aStats, (size_t)kSize);
+        } else {
+          CountUpload(aStats, (size_t)kLength);
+        }
+      } else {
+        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, kOffset, kLength, &vertices[slot.dirtyStart]));
+        CountUpload(aStats, (size_t)kLength);
+      }
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    slot.DeleteFence();
+    slot.ClearDirtyRange();
+    vertexObjectId = slot.id;
+    pending = false;
+  }
+
+  void UploadIndices(vrb::RenderStats* aStats) {
+    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexObjectId));
+    VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW));
+    CountUpload(aStats, sizeof(GLushort) * indices.size());
+    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  }
+
+  void UpdateLedger() {
+    if (!ledger) {
+      return;
+    }
+    int32_t vertexBuffers = 0;
+    if (slots[0].id != 0) {
+      for (const VertexBufferSlot& slot: slots) {
+        vertexBuffers += slot.id ? 1 : 0;
+      }
+    } else if (vertexObjectId != 0) {
+      vertexBuffers = 1;
+    }
+    ledger->Set(this, vrb::GpuMemoryCategory::Vertex, sizeof(float) * vertices.size() * vertexBuffers, "Geometry");
+    ledger->Set(this, vrb::GpuMemoryCategory::Index, indexObjectId ? sizeof(GLushort) * indices.size() : 0, "Geometry");
+  }
+
+  void FenceDraw() {
+    if (!dynamic) {
+      return;
+    }
+    VertexBufferSlot& slot = slots[currentSlot];
+    slot.DeleteFence();
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  // Deletes the GL objects. The data is kept so the next Upload() recreates them.
+  // The queue is only set by the first upload, before it there is nothing to delete.
+  void Release() {
+    if (!deletionQueue) {
+      Reset();
+      return;
+    }
+    for (VertexBufferSlot& slot: slots) {
+      if (slot.fence) {
+        deletionQueue->DeleteSync(slot.fence);
+        slot.fence = nullptr;
+      }
+      if (slot.id == vertexObjectId) {
+        vertexObjectId = 0;
+      }
+      DeleteBuffer(deletionQueue, slot.id);
+    }
+    DeleteBuffer(deletionQueue, vertexObjectId);
+    DeleteBuffer(deletionQueue, indexObjectId);
+    if (ledger) {
+      ledger->Release(this);
+    }
+    Reset();
+  }
+
+  void Reset() {
+    vertexObjectId = 0;
+    indexObjectId = 0;
+    for (VertexBufferSlot& slot: slots) {
+      slot = VertexBufferSlot();
+    }
+    currentSlot = 0;
+    dirty = true;
+    pending = false;
+  }
+};
+
 struct Geometry::State : public Node::State, public ResourceGL::State, public Drawable::State {
   RenderStatePtr renderState;
   VertexArrayPtr vertexArray;
@@ -48,12 +335,125 @@ struct Geometry::State : public Node::State, public ResourceGL::State, public Dr
   int triangleCount;
   GLuint vertexObjectId;
   GLuint indexObjectId;
+  IndexedBuffersPtr indexed;
+
+  struct Range {
+    std::string name;
+    int32_t firstIndex;
+    int32_t indexCount;
+    bool enabled;
+    Range() : firstIndex(0), indexCount(0), enabled(true) {}
+  };
+  std::vector<Range> ranges;
+  int32_t disabledRanges;
+  struct SharedBuffers;
+  std::shared_ptr<SharedBuffers> shared;
+  TriangleBVHPtr bvh;
+  bool boundsValid;
+  // VertexArray version the cached bounds and BVH were computed from.
+  uint32_t vertexVersion;
+  Vector boundsMin;
+  Vector boundsMax;
+  GLintptr vertexOffset;
+  GLintptr indexOffset;
+  // Floats and indices reserved for this Geometry in the shared buffers.
+  size_t vertexCapacity;
+  size_t indexCapacity;
+  RenderStatsPtr stats;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
+
+  State()
+      : vertexCount(0)
+      , triangleCount(0)
+      , vertexObjectId(0)
+      , indexObjectId(0)
+      , disabledRanges(0)
+      , boundsValid(false)
+      , vertexVersion(0)
+      , vertexOffset(0)
+      , indexOffset(0)
+      , vertexCapacity(0)
+      , indexCapacity(0)
+  {}
+  ~State();
+  void ValidateCaches() {
+    // Indexed data holds its own copy of the positions.
+    if (!indexed && vertexArray && (vertexVersion != vertexArray->GetVersion())) {
+      vertexVersion = vertexArray->GetVersion();
+      boundsValid = false;
+      bvh = nullptr;
+    }
+  }
+  void DeleteBuffers();
+  void CreateBuffers(const std::vector<float>& aVertices, const std::vector<GLushort>& aIndices);
+  void UploadIndexed();
+  void AppendBuffers(std::vector<float>& aVertices, std::vector<GLushort>& aIndices) const;
+
+  bool ValidRange(const int32_t aRange) const {
+    return (aRange >= 0) && (aRange < (int32_t)ranges.size());
+  }
+
+  // Issues the draw call, skipping any disabled ranges. Indices outside of
+  // every range are always drawn. An instance count of zero draws without
+  // instancing.
+  void DrawElements(const GLsizei aInstanceCount) {
+    const int32_t kCount = IndexCount();
+    int32_t start = 0;
+    if (disabledRanges > 0) {
+      for (const Range& range: ranges) {
+        if (range.enabled) {
+          continue;
+        }
+        DrawElements(start, std::min(range.firstIndex, kCount) - start, aInstanceCount);
+        start = std::max(start, std::min(range.firstIndex + range.indexCount, kCount));
+      }
+    }
+    DrawElements(start, kCount - start, aInstanceCount);
+  }
+
+  void DrawElements(const int32_t aFirst, const int32_t aCount, const GLsizei aInstanceCount) {
+    if (aCount <= 0) {
+      return;
+    }
+    const GLvoid* kOffset = (const GLvoid*)(IndexOffset() + aFirst * sizeof(GLushort));
+    if (aInstanceCount > 0) {
+      VRB_GL_CHECK(glDrawElementsInstanced(GL_TRIANGLES, aCount, GL_UNSIGNED_SHORT, kOffset, aInstanceCount));
+    } else {
+      VRB_GL_CHECK(glDrawElements(GL_TRIANGLES, aCount, GL_UNSIGNED_SHORT, kOffset));
+    }
+    if (stats) {
+      stats->CountDraw((uint64_t)(aCount / 3) * (uint64_t)std::max(aInstanceCount, 1));
+    }
+  }
+
+  void DetachIndexed() {
+    // Copy shared buffers before modifying them so other Geometry nodes are not affected.
+    if (indexed && (indexed.use_count() > 1)) {
+      indexed = indexed->CloneData();
+    }
+  }
+
+  GLuint VertexObjectId() const;
+  GLuint IndexObjectId() const;
+
+  GLintptr VertexOffset() const {
+    return shared ? vertexOffset : 0;
+  }
 
-  State() : vertexCount(0), triangleCount(0), vertexObjectId(0), indexObjectId(0) {}
+  GLintptr IndexOffset() const {
+    return shared ? indexOffset : 0;
+  }
 
+  GLsizei IndexCount() const {
+    return indexed ? (GLsizei)indexed->indices.size() : triangleCount * 3;
+  }
 
   GLsizei UVLength() const {
-    vrb::TexturePtr texture = renderState->GetTexture();
+    if (indexed) {
+      return indexed->uvLength;
+    }
+    vrb::TexturePtr texture = renderState ? renderState->GetTexture() : nullptr;
     if (!texture) {
       return 0;
     }
@@ -76,8 +476,207 @@ struct Geometry::State : public Node::State, public ResourceGL::State, public Dr
     return PositionSize() + NormalSize() + UVSize();
   }
 
+  bool EnableVertexAttributes() {
+    const bool kUseTextureCoords = renderState->HasTexture() && (UVLength() > 0);
+    const GLsizei kSize = VertexSize();
+    const GLsizei kPositionSize = PositionSize();
+    const GLsizei kNormalSize = NormalSize();
+    const GLsizei kUVLength = UVLength();
+    // Shared model buffers have no base vertex draw call in GLES 3.0, so the
+    // Geometry's region is selected through the attribute offsets instead.
+    const GLintptr kBase = VertexOffset();
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, VertexObjectId()));
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)renderState->AttributePosition(), 3, GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)kBase));
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)renderState->AttributeNormal(), 3, GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)(kBase + kPositionSize)));
+    if (kUseTextureCoords) {
+      VRB_GL_CHECK(glVertexAttribPointer((GLuint)renderState->AttributeUV(), kUVLength, GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)(kBase + kPositionSize + kNormalSize)));
+    }
+
+    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexObjectId()));
+    if (stats) {
+      stats->CountBufferBind();
+      stats->CountBufferBind();
+    }
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)renderState->AttributePosition()));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)renderState->AttributeNormal()));
+    if (kUseTextureCoords) {
+      VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)renderState->AttributeUV()));
+    }
+    return kUseTextureCoords;
+  }
+
+  void DisableVertexAttributes(const bool aUseTextureCoords) {
+    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)renderState->AttributePosition()));
+    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)renderState->AttributeNormal()));
+    if (aUseTextureCoords) {
+      VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)renderState->AttributeUV()));
+    }
+  }
+};
+
+// Vertex and index buffer pair shared by several face based Geometry nodes,
+// usually all of the Geometry created from one model file.
+struct Geometry::State::SharedBuffers {
+  std::vector<Geometry::State*> members;
+  GLuint vertexObjectId;
+  GLuint indexObjectId;
+  bool uploaded;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
+
+  SharedBuffers() : vertexObjectId(0), indexObjectId(0), uploaded(false) {}
+  ~SharedBuffers() {
+    Reset();
+  }
+
+  void Upload(const Geometry::State& aOwner) {
+    RenderStats* stats = aOwner.stats.get();
+    ledger = aOwner.ledger;
+    deletionQueue = aOwner.deletionQueue;
+    std::vector<float> vertices;
+    std::vector<GLushort> indices;
+    for (Geometry::State* member: members) {
+      member->vertexOffset = (GLintptr)(vertices.size() * sizeof(float));
+      member->indexOffset = (GLintptr)(indices.size() * sizeof(GLushort));
+      member->AppendBuffers(vertices, indices);
+      member->vertexCapacity = vertices.size() - (size_t)member->vertexOffset / sizeof(float);
+      member->indexCapacity = indices.size() - (size_t)member->indexOffset / sizeof(GLushort);
+    }
+    VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
+    VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices.size(), vertices.data(), GL_STATIC_DRAW));
+    VRB_LOG("Allocate: %d for shared GL_ARRAY_BUFFER: %d", (int32_t)(sizeof(float) * vertices.size()), vertexObjectId);
+    CountUpload(stats, sizeof(float) * vertices.size());
+    VRB_GL_CHECK(glGenBuffers(1, &indexObjectId));
+    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexObjectId));
+    VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * indices.size(), indices.data(), GL_STATIC_DRAW));
+    VRB_LOG("Allocate: %d for shared GL_ELEMENT_ARRAY_BUFFER: %d", (int32_t)(sizeof(GLushort) * indices.size()), indexObjectId);
+    CountUpload(stats, sizeof(GLushort) * indices.size());
+    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    if (ledger) {
+      ledger->Set(this, GpuMemoryCategory::Vertex, sizeof(float) * vertices.size(), "Geometry shared");
+      ledger->Set(this, GpuMemoryCategory::Index, sizeof(GLushort) * indices.size(), "Geometry shared");
+    }
+    uploaded = true;
+  }
+
+  void Remove(Geometry::State* aMember) {
+    members.erase(std::remove(members.begin(), members.end(), aMember), members.end());
+  }
+
+  // Called by every member on shutdown, only the first call deletes anything.
+  void Reset() {
+    DeleteBuffer(deletionQueue, vertexObjectId);
+    DeleteBuffer(deletionQueue, indexObjectId);
+    if (ledger) {
+      ledger->Release(this);
+    }
+    uploaded = false;
+  }
 };
 
+Geometry::State::~State() {
+  if (shared) {
+    shared->Remove(this);
+  }
+  DeleteBuffers();
+}
+
+void
+Geometry::State::DeleteBuffers() {
+  DeleteBuffer(deletionQueue, vertexObjectId);
+  DeleteBuffer(deletionQueue, indexObjectId);
+  if (ledger) {
+    ledger->Release(this);
+  }
+}
+
+void
+Geometry::State::CreateBuffers(const std::vector<float>& aVertices, const std::vector<GLushort>& aIndices) {
+  DeleteBuffers();
+  VRB_GL_CHECK(glGenBuffers(1, &vertexObjectId));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vertexObjectId));
+  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * aVertices.size(), aVertices.data(), GL_STATIC_DRAW));
+  VRB_LOG("Allocate: %d for GL_ARRAY_BUFFER: %d", (int32_t)(sizeof(float) * aVertices.size()), vertexObjectId);
+  CountUpload(stats.get(), sizeof(float) * aVertices.size());
+
+  VRB_GL_CHECK(glGenBuffers(1, &indexObjectId));
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexObjectId));
+  VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * aIndices.size(), aIndices.data(), GL_STATIC_DRAW));
+  VRB_LOG("Allocate: %d for GL_ELEMENT_ARRAY_BUFFER: %d", (int32_t)(sizeof(GLushort) * aIndices.size()), indexObjectId);
+  CountUpload(stats.get(), sizeof(GLushort) * aIndices.size());
+  if (ledger) {
+    ledger->Set(this, GpuMemoryCategory::Vertex, sizeof(float) * aVertices.size(), "Geometry");
+    ledger->Set(this, GpuMemoryCategory::Index, sizeof(GLushort) * aIndices.size(), "Geometry");
+  }
+
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+void
+Geometry::State::UploadIndexed() {
+  if (!indexed->ledger) {
+    indexed->ledger = ledger;
+    indexed->deletionQueue = deletionQueue;
+  }
+  indexed->Upload(stats.get());
+}
+
+GLuint
+Geometry::State::VertexObjectId() const {
+  if (indexed) {
+    return indexed->vertexObjectId;
+  }
+  return shared ? shared->vertexObjectId : vertexObjectId;
+}
+
+GLuint
+Geometry::State::IndexObjectId() const {
+  if (indexed) {
+    return indexed->indexObjectId;
+  }
+  return shared ? shared->indexObjectId : indexObjectId;
+}
+
+void
+Geometry::State::AppendBuffers(std::vector<float>& aVertices, std::vector<GLushort>& aIndices) const {
+  const bool kUseTextureCoords = renderState && renderState->HasTexture();
+  const size_t kUVLength = (size_t)UVLength();
+  GLushort count = 0;
+
+  auto appendVertex = [&](const GLushort aVertex, const GLushort aNormal, const GLushort aUV) {
+    const Vector& vertex = vertexArray->GetVertex(aVertex - 1);
+    const Vector& normal = vertexArray->GetNormal(aNormal - 1);
+    aVertices.insert(aVertices.end(), vertex.Data(), vertex.Data() + 3);
+    aVertices.insert(aVertices.end(), normal.Data(), normal.Data() + 3);
+    if (kUseTextureCoords) {
+      const Vector& uv = vertexArray->GetUV(aUV - 1);
+      aVertices.insert(aVertices.end(), uv.Data(), uv.Data() + kUVLength);
+    }
+    aIndices.push_back(count);
+    count++;
+  };
+
+  for (const Face& face: faces) {
+    if (face.vertices.size() == 0) {
+      break;
+    }
+    if (face.vertices.size() < 3) {
+      std::string message;
+      for (auto index: face.vertices) { message += " "; message += std::to_string(index); }
+      VRB_ERROR("Face with only %d vertices:%s", (int32_t)face.vertices.size(), message.c_str());
+      continue;
+    }
+    for (int ix = 1; ix <= face.vertices.size() - 2; ix++) {
+      appendVertex(face.vertices[0], face.normals[0], kUseTextureCoords ? face.uvs[0] : 0);
+      appendVertex(face.vertices[ix], face.normals[ix], kUseTextureCoords ? face.uvs[ix] : 0);
+      appendVertex(face.vertices[ix + 1], face.normals[ix + 1], kUseTextureCoords ? face.uvs[ix + 1] : 0);
+    }
+  }
+}
+
 GeometryPtr
 Geometry::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<Geometry, Geometry::State> >(aContext);
@@ -86,7 +685,25 @@ Geometry::Create(CreationContextPtr& aContext) {
 // Node interface
 void
 Geometry::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
-  aDrawables.AddDrawable(std::move(CreateDrawablePtr()), aVisitor.GetTransform());
+  VRB_ALLOCATION_SCOPE(Cull);
+  aVisitor.CountNode();
+  if (!aVisitor.IsNodeVisible(*this)) {
+    return;
+  }
+  if (aVisitor.IsOcclusionCullingEnabled()) {
+    Vector min, max;
+    if (GetBounds(min, max) && aVisitor.IsOccluded(min, max)) {
+      return;
+    }
+  }
+  TexturePtr texture = m.renderState ? m.renderState->GetTexture() : nullptr;
+  if (texture && aVisitor.HasCamera()) {
+    Vector min, max;
+    if (GetBounds(min, max)) {
+      aVisitor.ReportTextureUse(*texture, min, max);
+    }
+  }
+  aDrawables.AddDrawable(*this, aVisitor.GetTransform());
 }
 
 // Drawable interface
@@ -102,37 +719,84 @@ Geometry::SetRenderState(const RenderStatePtr& aRenderState) {
 
 void
 Geometry::Draw(const Camera& aCamera, const Matrix& aModelTransform) {
+  if (m.indexed) {
+    m.UploadIndexed();
+  }
   if (m.renderState->Enable(aCamera.GetPerspective(), aCamera.GetView(), aModelTransform)) {
-    const bool kUseTextureCoords = m.renderState->HasTexture();
-    const GLsizei kSize = m.VertexSize();
-    const GLsizei kPositionSize = m.PositionSize();
-    const GLsizei kNormalSize = m.NormalSize();
-    const GLsizei kUVLength = m.UVLength();
-    VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexObjectId));
-    VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributePosition(), 3, GL_FLOAT, GL_FALSE, kSize, nullptr));
-    VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributeNormal(), 3, GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)kPositionSize));
-    if (kUseTextureCoords) {
-      VRB_GL_CHECK(glVertexAttribPointer((GLuint)m.renderState->AttributeUV(), kUVLength, GL_FLOAT, GL_FALSE, kSize, (const GLvoid*)(kPositionSize + kNormalSize)));
-    }
-
-    VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indexObjectId));
-    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributePosition()));
-    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributeNormal()));
-    if (kUseTextureCoords) {
-      VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)m.renderState->AttributeUV()));
-    }
-    VRB_GL_CHECK(glDrawElements(GL_TRIANGLES, m.triangleCount * 3, GL_UNSIGNED_SHORT, 0));
-    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributePosition()));
-    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributeNormal()));
-    if (kUseTextureCoords) {
-      VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)m.renderState->AttributeUV()));
+    const bool kUseTextureCoords = m.EnableVertexAttributes();
+    m.DrawElements(0);
+    if (m.indexed) {
+      m.indexed->FenceDraw();
     }
+    m.DisableVertexAttributes(kUseTextureCoords);
     m.renderState->Disable();
     VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
     VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
   }
 }
 
+void
+Geometry::DrawInstanced(const Camera& aCamera, const GLuint aInstanceBuffer, const GLsizei aInstanceCount) {
+  if ((aInstanceBuffer == 0) || (aInstanceCount <= 0)) {
+    return;
+  }
+  if (m.indexed) {
+    m.UploadIndexed();
+  }
+  if (!m.renderState->EnableInstanced(aCamera.GetPerspective(), aCamera.GetView())) {
+    return;
+  }
+  const bool kUseTextureCoords = m.EnableVertexAttributes();
+  const GLint kModel = m.renderState->AttributeInstanceModel();
+  const GLint kTint = m.renderState->AttributeInstanceTint();
+  const GLsizei kStride = kInstanceFloatCount * sizeof(float);
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, aInstanceBuffer));
+  if (m.stats) {
+    m.stats->CountBufferBind();
+  }
+  if (kModel >= 0) {
+    // A mat4 attribute occupies four consecutive locations, one per column.
+    for (GLuint column = 0; column < 4; column++) {
+      const GLuint location = (GLuint)kModel + column;
+      VRB_GL_CHECK(glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, kStride, (const GLvoid*)(column * 4 * sizeof(float))));
+      VRB_GL_CHECK(glEnableVertexAttribArray(location));
+      VRB_GL_CHECK(glVertexAttribDivisor(location, 1));
+    }
+  }
+  if (kTint >= 0) {
+    VRB_GL_CHECK(glVertexAttribPointer((GLuint)kTint, 4, GL_FLOAT, GL_FALSE, kStride, (const GLvoid*)(16 * sizeof(float))));
+    VRB_GL_CHECK(glEnableVertexAttribArray((GLuint)kTint));
+    VRB_GL_CHECK(glVertexAttribDivisor((GLuint)kTint, 1));
+  }
+  m.DrawElements(aInstanceCount);
+  if (m.indexed) {
+    m.indexed->FenceDraw();
+  }
+  if (kModel >= 0) {
+    for (GLuint column = 0; column < 4; column++) {
+      VRB_GL_CHECK(glVertexAttribDivisor((GLuint)kModel + column, 0));
+      VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)kModel + column));
+    }
+  }
+  if (kTint >= 0) {
+    VRB_GL_CHECK(glVertexAttribDivisor((GLuint)kTint, 0));
+    VRB_GL_CHECK(glDisableVertexAttribArray((GLuint)kTint));
+  }
+  m.DisableVertexAttributes(kUseTextureCoords);
+  m.renderState->Disable();
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+}
+
+const void*
+Geometry::GetBatchKey() const {
+  // Geometry with hidden ranges draws a subset of the shared mesh.
+  if (m.indexed && (m.disabledRanges == 0)) {
+    return m.indexed.get();
+  }
+  return this;
+}
+
 // Geometry interface
 VertexArrayPtr
 Geometry::GetVertexArray() const {
@@ -141,93 +805,43 @@ Geometry::GetVertexArray() const {
 
 void
 Geometry::SetVertexArray(const VertexArrayPtr& aVertexArray) {
+  m.bvh = nullptr;
+  m.boundsValid = false;
   m.vertexArray = aVertexArray;
 }
 
 void
 Geometry::UpdateBuffers() {
-  if (m.vertexObjectId == 0 || m.indexObjectId == 0) {
+  VRB_ALLOCATION_SCOPE(Upload);
+  if (m.indexed) {
+    m.indexed->dirty = true;
+    m.UploadIndexed();
+    return;
+  }
+  if (m.VertexObjectId() == 0 || m.IndexObjectId() == 0) {
     VRB_WARN("Geometry GL objects not created");
     return;
   }
-  const bool kUseTextureCoords = m.renderState->HasTexture();
-  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexObjectId));
-  const GLintptr kVectorSize = m.PositionSize();
-  GLintptr kUVSize = m.UVSize();
-
+  std::vector<float> vertices;
   std::vector<GLushort> indices;
-  GLushort count = 0;
-  GLintptr offset = 0;
-
-  for (auto& face: m.faces) {
-    if (face.vertices.size() == 0) {
-      break;
-    }
-    if (face.vertices.size() < 3) {
-      std::string message;
-      for (auto index: face.vertices) { message += " "; message += std::to_string(index); }
-      VRB_ERROR("Face with only %d vertices:%s", (int32_t)face.vertices.size(), message.c_str());
-      continue;
-    }
-    const GLushort vertexIndex = (GLushort)(face.vertices[0] - 1);
-    const GLushort normalIndex = (GLushort)(face.normals[0] - 1);
-    const GLushort uvIndex = (GLushort)(kUseTextureCoords ? face.uvs[0] - 1 : -1);
-    const Vector& firstVertex = m.vertexArray->GetVertex(vertexIndex);
-    const Vector& firstNormal = m.vertexArray->GetNormal(normalIndex);
-    const Vector& firstUV = m.vertexArray->GetUV(uvIndex);
-    for (int ix = 1; ix <= face.vertices.size() - 2; ix++) {
-      std::string out;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, firstVertex.Data()));
-      offset += kVectorSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, firstNormal.Data()));
-      offset += kVectorSize;
-      out += " " + firstVertex.ToString() + firstNormal.ToString();
-      if (kUseTextureCoords) {
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, firstUV.Data()));
-        offset += kUVSize;
-        out += firstUV.ToString();
-      }
-      indices.push_back(count);
-      count++;
-
-      const Vector v1 = m.vertexArray->GetVertex(face.vertices[ix] - 1);
-      const Vector n1 = m.vertexArray->GetNormal(face.normals[ix] - 1);
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, v1.Data()));
-      offset += kVectorSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, n1.Data()));
-      offset += kVectorSize;
-      out += "/" + v1.ToString() + n1.ToString();
-      if (kUseTextureCoords) {
-        const Vector uv1 = m.vertexArray->GetUV(face.uvs[ix] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, uv1.Data()));
-        offset += kUVSize;
-        out += uv1.ToString();
-      }
-      indices.push_back(count);
-      count++;
-
-      const Vector v2 = m.vertexArray->GetVertex(face.vertices[ix + 1] - 1);
-      const Vector n2 = m.vertexArray->GetNormal(face.normals[ix + 1] - 1);
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, v2.Data()));
-      offset += kVectorSize;
-      VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kVectorSize, n2.Data()));
-      offset += kVectorSize;
-      out += "/" + v2.ToString() + n2.ToString();
-      if (kUseTextureCoords) {
-        const Vector uv2 = m.vertexArray->GetUV(face.uvs[ix + 1] - 1);
-        VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, offset, kUVSize, uv2.Data()));
-        offset += kUVSize;
-        out += uv2.ToString();
-      }
-      indices.push_back(count);
-      count++;
-//      VRB_LOG("array buffer[%d] o:%d c:%d : %s", ix, (int)offset, count, out.c_str());
+  m.AppendBuffers(vertices, indices);
+  if (m.shared && ((vertices.size() > m.vertexCapacity) || (indices.size() > m.indexCapacity))) {
+    // Writing past the region reserved in the shared buffers would overwrite
+    // the next member, move to buffers of its own instead.
+    m.shared->Remove(&m);
+    if (m.shared->members.empty()) {
+      m.shared->Reset();
     }
+    m.shared = nullptr;
+    m.CreateBuffers(vertices, indices);
+    return;
   }
 
-  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indexObjectId));
-  VRB_GL_CHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(GLushort) * indices.size(), indices.data()));
-
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.VertexObjectId()));
+  VRB_GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, m.VertexOffset(), sizeof(float) * vertices.size(), vertices.data()));
+  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.IndexObjectId()));
+  VRB_GL_CHECK(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m.IndexOffset(), sizeof(GLushort) * indices.size(), indices.data()));
+  CountUpload(m.stats.get(), sizeof(float) * vertices.size() + sizeof(GLushort) * indices.size());
 
   VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
   VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
@@ -238,6 +852,8 @@ Geometry::AddFace(
     const std::vector<int>& aVertices,
     const std::vector<int>& aUVs,
     const std::vector<int>& aNormals) {
+  m.bvh = nullptr;
+  m.boundsValid = false;
 
   Face face;
   m.vertexCount += aVertices.size();
@@ -291,12 +907,377 @@ Geometry::GetFace(int32_t aIndex) const {
   return m.faces[aIndex];
 }
 
+void
+Geometry::SetIndexedData(
+    const std::vector<Vector>& aPositions,
+    const std::vector<Vector>& aNormals,
+    const std::vector<Vector>& aUVs,
+    const std::vector<GLushort>& aIndices,
+    const int32_t aUVLength) {
+  if (aPositions.size() > std::numeric_limits<GLushort>::max()) {
+    VRB_ERROR("Indexed Geometry vertex count %d is greater than max size of GLushort", (int)aPositions.size());
+    return;
+  }
+  if ((aIndices.size() % 3) != 0) {
+    VRB_WARN("Indexed Geometry index count %d is not a multiple of three", (int)aIndices.size());
+  }
+  for (GLushort index: aIndices) {
+    if (index >= aPositions.size()) {
+      VRB_ERROR("Indexed Geometry index %d out of range of %d vertices", (int)index, (int)aPositions.size());
+      return;
+    }
+  }
+  IndexedBuffersPtr buffers = std::make_shared<IndexedBuffers>();
+  const bool kHasNormals = aNormals.size() >= aPositions.size();
+  if (aUVs.size() >= aPositions.size()) {
+    buffers->uvLength = (GLsizei)std::min(std::max(aUVLength, 0), 3);
+  }
+  buffers->vertices.reserve(aPositions.size() * (6 + buffers->uvLength));
+  for (size_t ix = 0; ix < aPositions.size(); ix++) {
+    const Vector& position = aPositions[ix];
+    const Vector& normal = kHasNormals ? aNormals[ix] : Vector(0.0f, 0.0f, 1.0f);
+    buffers->vertices.insert(buffers->vertices.end(), position.Data(), position.Data() + 3);
+    buffers->vertices.insert(buffers->vertices.end(), normal.Data(), normal.Data() + 3);
+    if (buffers->uvLength > 0) {
+      buffers->vertices.insert(buffers->vertices.end(), aUVs[ix].Data(), aUVs[ix].Data() + buffers->uvLength);
+    }
+  }
+  buffers->indices = aIndices;
+  m.indexed = std::move(buffers);
+  m.bvh = nullptr;
+  m.boundsValid = false;
+  m.vertexCount = (int)aPositions.size();
+  m.triangleCount = (int)aIndices.size() / 3;
+}
+
+int32_t
+Geometry::GetUVLength() const {
+  return (int32_t)m.UVLength();
+}
+
+void
+Geometry::ShareIndexedData(const Geometry& aSource) {
+  if (!aSource.m.indexed) {
+    VRB_WARN("Geometry::ShareIndexedData source has no indexed data");
+    return;
+  }
+  m.indexed = aSource.m.indexed;
+  m.bvh = aSource.m.bvh;
+  m.boundsValid = aSource.m.boundsValid;
+  m.boundsMin = aSource.m.boundsMin;
+  m.boundsMax = aSource.m.boundsMax;
+  m.vertexCount = aSource.m.vertexCount;
+  m.triangleCount = aSource.m.triangleCount;
+}
+
+Geometry::IndexedBuffersPtr
+Geometry::GetIndexedBuffers() const {
+  return m.indexed;
+}
+
+void
+Geometry::SetIndexedBuffers(const IndexedBuffersPtr& aBuffers) {
+  if (!aBuffers) {
+    return;
+  }
+  m.indexed = aBuffers;
+  m.bvh = nullptr;
+  m.boundsValid = false;
+  m.vertexCount = (int)(aBuffers->vertices.size() / (size_t)(6 + aBuffers->uvLength));
+  m.triangleCount = (int)aBuffers->indices.size() / 3;
+}
+
+bool
+Geometry::HasIndexedData() const {
+  return m.indexed != nullptr;
+}
+
+bool
+Geometry::GetIndexedData(
+    std::vector<Vector>& aPositions,
+    std::vector<Vector>& aNormals,
+    std::vector<Vector>& aUVs,
+    std::vector<GLushort>& aIndices) const {
+  aPositions.clear();
+  aNormals.clear();
+  aUVs.clear();
+  aIndices.clear();
+  if (m.indexed) {
+    const size_t kUVLength = (size_t)m.indexed->uvLength;
+    const size_t kStride = 6 + kUVLength;
+    for (size_t ix = 0; (ix + kStride) <= m.indexed->vertices.size(); ix += kStride) {
+      const float* vertex = &m.indexed->vertices[ix];
+      aPositions.push_back(Vector(vertex[0], vertex[1], vertex[2]));
+      aNormals.push_back(Vector(vertex[3], vertex[4], vertex[5]));
+      if (kUVLength > 0) {
+        aUVs.push_back(Vector(vertex[6], vertex[7], kUVLength > 2 ? vertex[8] : 0.0f));
+      }
+    }
+    aIndices = m.indexed->indices;
+    return true;
+  }
+  if (!m.vertexArray) {
+    return false;
+  }
+  const bool kUseUVs = m.renderState && m.renderState->HasTexture();
+  std::unordered_map<uint64_t, GLushort> welded;
+  auto addVertex = [&](const Face& aFace, const size_t aIndex) -> bool {
+    const uint64_t kVertex = aFace.vertices[aIndex];
+    const uint64_t kNormal = aIndex < aFace.normals.size() ? aFace.normals[aIndex] : 0;
+    const uint64_t kUV = (kUseUVs && (aIndex < aFace.uvs.size())) ? aFace.uvs[aIndex] : 0;
+    const uint64_t kKey = (kVertex << 32) | (kNormal << 16) | kUV;
+    auto it = welded.find(kKey);
+    if (it != welded.end()) {
+      aIndices.push_back(it->second);
+      return true;
+    }
+    if (aPositions.size() >= std::numeric_limits<GLushort>::max()) {
+      return false;
+    }
+    const GLushort kIndex = (GLushort)aPositions.size();
+    aPositions.push_back(m.vertexArray->GetVertex(kVertex - 1));
+    aNormals.push_back(kNormal > 0 ? m.vertexArray->GetNormal(kNormal - 1) : Vector(0.0f, 0.0f, 1.0f));
+    if (kUseUVs) {
+      aUVs.push_back(kUV > 0 ? m.vertexArray->GetUV(kUV - 1) : Vector());
+    }
+    welded[kKey] = kIndex;
+    aIndices.push_back(kIndex);
+    return true;
+  };
+  for (const Face& face: m.faces) {
+    for (size_t ix = 1; (ix + 1) < face.vertices.size(); ix++) {
+      if (!addVertex(face, 0) || !addVertex(face, ix) || !addVertex(face, ix + 1)) {
+        VRB_ERROR("Geometry '%s' has too many vertices to convert to indexed data", GetName().c_str());
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+TriangleBVHPtr
+Geometry::GetBVH() {
+  m.ValidateCaches();
+  if (m.bvh) {
+    return m.bvh;
+  }
+  std::vector<Vector> positions, normals, uvs;
+  std::vector<GLushort> indices;
+  if (!GetIndexedData(positions, normals, uvs, indices)) {
+    return nullptr;
+  }
+  m.bvh = TriangleBVH::Create();
+  m.bvh->Build(positions, uvs, indices);
+  return m.bvh;
+}
+
+bool
+Geometry::GetBounds(Vector& aMin, Vector& aMax) const {
+  m.ValidateCaches();
+  if (m.boundsValid) {
+    aMin = m.boundsMin;
+    aMax = m.boundsMax;
+    return true;
+  }
+  bool found = false;
+  auto expand = [&](const float* aPoint) {
+    if (!found) {
+      aMin.Set(aPoint[0], aPoint[1], aPoint[2]);
+      aMax = aMin;
+      found = true;
+      return;
+    }
+    aMin.Set(std::min(aMin.x(), aPoint[0]), std::min(aMin.y(), aPoint[1]), std::min(aMin.z(), aPoint[2]));
+    aMax.Set(std::max(aMax.x(), aPoint[0]), std::max(aMax.y(), aPoint[1]), std::max(aMax.z(), aPoint[2]));
+  };
+  if (m.indexed) {
+    const size_t kStride = (size_t)(6 + m.indexed->uvLength);
+    for (size_t ix = 0; ix + 2 < m.indexed->vertices.size(); ix += kStride) {
+      expand(&m.indexed->vertices[ix]);
+    }
+  } else if (m.vertexArray) {
+    for (const Face& face: m.faces) {
+      for (GLushort index: face.vertices) {
+        expand(m.vertexArray->GetVertex(index - 1).Data());
+      }
+    }
+  }
+  if (found) {
+    m.boundsMin = aMin;
+    m.boundsMax = aMax;
+    m.boundsValid = true;
+  }
+  return found;
+}
+
+void
+Geometry::SetDynamic(const bool aDynamic) {
+  if (!m.indexed) {
+    VRB_WARN("Geometry::SetDynamic requires indexed data");
+    return;
+  }
+  if (m.indexed->dynamic == aDynamic) {
+    return;
+  }
+  m.DetachIndexed();
+  m.indexed->dynamic = aDynamic;
+  m.indexed->dirty = true;
+}
+
+bool
+Geometry::IsDynamic() const {
+  return m.indexed && m.indexed->dynamic;
+}
+
+void
+Geometry::UpdateVertices(
+    const int32_t aFirstVertex,
+    const std::vector<Vector>& aPositions,
+    const std::vector<Vector>& aNormals,
+    const std::vector<Vector>& aUVs) {
+  if (!m.indexed) {
+    VRB_WARN("Geometry::UpdateVertices requires indexed data");
+    return;
+  }
+  const size_t kStride = (size_t)(6 + m.indexed->uvLength);
+  const size_t kVertexCount = m.indexed->vertices.size() / kStride;
+  if ((aFirstVertex < 0) || ((size_t)aFirstVertex + aPositions.size() > kVertexCount)) {
+    VRB_ERROR("Geometry::UpdateVertices range %d + %d out of bounds of %d vertices",
+              aFirstVertex, (int)aPositions.size(), (int)kVertexCount);
+    return;
+  }
+  if (aPositions.empty()) {
+    return;
+  }
+  m.DetachIndexed();
+  m.bvh = nullptr;
+  m.boundsValid = false;
+  const bool kHasNormals = aNormals.size() >= aPositions.size();
+  const bool kHasUVs = (m.indexed->uvLength > 0) && (aUVs.size() >= aPositions.size());
+  for (size_t ix = 0; ix < aPositions.size(); ix++) {
+    float* vertex = &m.indexed->vertices[(aFirstVertex + ix) * kStride];
+    memcpy(vertex, aPositions[ix].Data(), 3 * sizeof(float));
+    if (kHasNormals) {
+      memcpy(vertex + 3, aNormals[ix].Data(), 3 * sizeof(float));
+    }
+    if (kHasUVs) {
+      memcpy(vertex + 6, aUVs[ix].Data(), m.indexed->uvLength * sizeof(float));
+    }
+  }
+  m.indexed->MarkVerticesDirty(aFirstVertex * kStride, (aFirstVertex + aPositions.size()) * kStride);
+}
+
+void
+Geometry::ShareBuffers(const std::vector<GeometryPtr>& aGeometries) {
+  std::shared_ptr<State::SharedBuffers> shared = std::make_shared<State::SharedBuffers>();
+  std::vector<GeometryPtr> candidates;
+  for (const GeometryPtr& geometry: aGeometries) {
+    State& state = geometry->m;
+    // Only face based Geometry that has not created its own buffers yet can join.
+    if (state.indexed || state.shared || (state.vertexObjectId != 0) || state.faces.empty()) {
+      continue;
+    }
+    candidates.push_back(geometry);
+  }
+  if (candidates.size() < 2) {
+    return;
+  }
+  for (const GeometryPtr& geometry: candidates) {
+    geometry->m.shared = shared;
+    shared->members.push_back(&geometry->m);
+  }
+}
+
+int32_t
+Geometry::AddRange(const std::string& aName, const int32_t aFirstIndex, const int32_t aIndexCount) {
+  if ((aFirstIndex < 0) || (aIndexCount < 0)) {
+    VRB_ERROR("Invalid Geometry range '%s': %d %d", aName.c_str(), aFirstIndex, aIndexCount);
+    return -1;
+  }
+  if (!m.ranges.empty()) {
+    const State::Range& last = m.ranges.back();
+    if (aFirstIndex < (last.firstIndex + last.indexCount)) {
+      VRB_ERROR("Geometry range '%s' overlaps or precedes range '%s'", aName.c_str(), last.name.c_str());
+      return -1;
+    }
+  }
+  State::Range range;
+  range.name = aName;
+  range.firstIndex = aFirstIndex;
+  range.indexCount = aIndexCount;
+  m.ranges.push_back(range);
+  return (int32_t)m.ranges.size() - 1;
+}
+
+int32_t
+Geometry::GetRangeCount() const {
+  return (int32_t)m.ranges.size();
+}
+
+const std::string&
+Geometry::GetRangeName(const int32_t aRange) const {
+  static const std::string sEmpty;
+  if (!m.ValidRange(aRange)) {
+    return sEmpty;
+  }
+  return m.ranges[aRange].name;
+}
+
+bool
+Geometry::GetRange(const int32_t aRange, int32_t& aFirstIndex, int32_t& aIndexCount) const {
+  if (!m.ValidRange(aRange)) {
+    return false;
+  }
+  aFirstIndex = m.ranges[aRange].firstIndex;
+  aIndexCount = m.ranges[aRange].indexCount;
+  return true;
+}
+
+int32_t
+Geometry::FindRange(const std::string& aName) const {
+  for (int32_t ix = 0; ix < (int32_t)m.ranges.size(); ix++) {
+    if (m.ranges[ix].name == aName) {
+      return ix;
+    }
+  }
+  return -1;
+}
+
+int32_t
+Geometry::GetRangeForIndex(const int32_t aIndex) const {
+  for (int32_t ix = 0; ix < (int32_t)m.ranges.size(); ix++) {
+    const State::Range& range = m.ranges[ix];
+    if ((aIndex >= range.firstIndex) && (aIndex < (range.firstIndex + range.indexCount))) {
+      return ix;
+    }
+  }
+  return -1;
+}
+
+void
+Geometry::ToggleRange(const int32_t aRange, const bool aEnabled) {
+  if (!m.ValidRange(aRange) || (m.ranges[aRange].enabled == aEnabled)) {
+    return;
+  }
+  m.ranges[aRange].enabled = aEnabled;
+  m.disabledRanges += aEnabled ? -1 : 1;
+}
+
+bool
+Geometry::IsRangeEnabled(const int32_t aRange) const {
+  return m.ValidRange(aRange) && m.ranges[aRange].enabled;
+}
+
 Geometry::Geometry(State& aState, CreationContextPtr& aContext) :
     Node(aState, aContext),
     ResourceGL(aState, aContext),
     Drawable(aState, aContext),
     m(aState)
-{}
+{
+  m.stats = aContext->GetRenderStats();
+  m.ledger = aContext->GetGpuMemoryLedger();
+  m.deletionQueue = aContext->GetGLDeletionQueue();
+}
 Geometry::~Geometry() {}
 
 // ResourceGL interface
@@ -307,27 +1288,37 @@ Geometry::SupportOffRenderThreadInitialization() {
 
 void
 Geometry::InitializeGL() {
+  VRB_ALLOCATION_SCOPE(Upload);
+  if (m.indexed) {
+    m.UploadIndexed();
+    return;
+  }
   if (!m.renderState) {
     VRB_ERROR("Unable to initialize Geometry Node. No RenderState set");
+    return;
   }
-  VRB_GL_CHECK(glGenBuffers(1, &m.vertexObjectId));
-  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.vertexObjectId));
-  GLsizei kTriangleSize = m.VertexSize() * 3;
-
-  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, kTriangleSize * m.triangleCount, nullptr, GL_STATIC_DRAW));
-  VRB_LOG("Allocate: %d for GL_ARRAY_BUFFER: %d", kTriangleSize * m.triangleCount, m.vertexObjectId);
-
-  VRB_GL_CHECK(glGenBuffers(1, &m.indexObjectId));
-  VRB_GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.indexObjectId));
-  VRB_GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * m.triangleCount * 3, nullptr, GL_STATIC_DRAW));
-  VRB_LOG("Allocate: %d for GL_ELEMENT_ARRAY_BUFFER: %d", (int32_t)sizeof(GLushort) * m.triangleCount * 3, m.indexObjectId);
-
-  UpdateBuffers();
+  if (m.shared) {
+    // The first member to be initialized uploads the whole model.
+    if (!m.shared->uploaded) {
+      m.shared->Upload(m);
+    }
+    return;
+  }
+  std::vector<float> vertices;
+  std::vector<GLushort> indices;
+  m.AppendBuffers(vertices, indices);
+  m.CreateBuffers(vertices, indices);
 }
 
 void
 Geometry::ShutdownGL() {
-
+  if (m.indexed) {
+    m.indexed->Release();
+  }
+  if (m.shared) {
+    m.shared->Reset();
+  }
+  m.DeleteBuffers();
 }
 
 }
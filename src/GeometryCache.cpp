@@ -0,0 +1,87 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GeometryCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/AllocationTracker.h"
+#include "vrb/Geometry.h"
+#include "vrb/Mutex.h"
+
+#include <unordered_map>
+
+namespace vrb {
+
+struct GeometryCache::State {
+  Mutex lock;
+  std::unordered_map<std::string, Geometry::IndexedBuffersWeak> cache;
+
+  void Prune() {
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (it->second.expired()) {
+        it = cache.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+};
+
+GeometryCachePtr
+GeometryCache::Create() {
+  return std::make_shared<ConcreteClass<GeometryCache, GeometryCache::State> >();
+}
+
+bool
+GeometryCache::Find(const std::string& aKey, const GeometryPtr& aGeometry) {
+  if (!aGeometry) {
+    return false;
+  }
+  Geometry::IndexedBuffersPtr buffers;
+  {
+    MutexAutoLock lock(m.lock);
+    auto it = m.cache.find(aKey);
+    if (it == m.cache.end()) {
+      return false;
+    }
+    buffers = it->second.lock();
+    if (!buffers) {
+      m.cache.erase(it);
+      return false;
+    }
+  }
+  aGeometry->SetIndexedBuffers(buffers);
+  return true;
+}
+
+void
+GeometryCache::Add(const std::string& aKey, const GeometryPtr& aGeometry) {
+  Geometry::IndexedBuffersPtr buffers = aGeometry ? aGeometry->GetIndexedBuffers() : nullptr;
+  if (!buffers) {
+    return;
+  }
+  VRB_ALLOCATION_SCOPE(Cache);
+  MutexAutoLock lock(m.lock);
+  m.Prune();
+  m.cache[aKey] = buffers;
+}
+
+void
+GeometryCache::Clear() {
+  MutexAutoLock lock(m.lock);
+  m.cache.clear();
+}
+
+int32_t
+GeometryCache::GetCount() {
+  MutexAutoLock lock(m.lock);
+  m.Prune();
+  return (int32_t)m.cache.size();
+}
+
+GeometryCache::GeometryCache(State& aState) : m(aState) {}
+GeometryCache::~GeometryCache() {}
+
+}
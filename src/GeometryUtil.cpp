@@ -0,0 +1,132 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GeometryUtil.h"
+
+#include "vrb/CreationContext.h"
+#include "vrb/Geometry.h"
+#include "vrb/GeometryCache.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+typedef std::function<void(std::vector<vrb::Vector>&, std::vector<vrb::Vector>&, std::vector<vrb::Vector>&, std::vector<GLushort>&)> BuildFunction;
+
+// Geometry created with the same key shares the indexed data through the
+// GeometryCache of the context.
+vrb::GeometryPtr
+CreateShared(vrb::CreationContextPtr& aContext, const std::string& aKey, const BuildFunction& aBuild) {
+  vrb::GeometryPtr result = vrb::Geometry::Create(aContext);
+  vrb::GeometryCachePtr cache = aContext->GetGeometryCache();
+  if (cache && cache->Find(aKey, result)) {
+    return result;
+  }
+  std::vector<vrb::Vector> positions;
+  std::vector<vrb::Vector> normals;
+  std::vector<vrb::Vector> uvs;
+  std::vector<GLushort> indices;
+  aBuild(positions, normals, uvs, indices);
+  result->SetIndexedData(positions, normals, uvs, indices);
+  if (cache) {
+    cache->Add(aKey, result);
+  }
+  return result;
+}
+
+}
+
+namespace vrb {
+
+GeometryPtr
+CreateQuadGeometry(CreationContextPtr& aContext, const float aWidth, const float aHeight) {
+  const std::string key = "quad:" + std::to_string(aWidth) + ":" + std::to_string(aHeight);
+  return CreateShared(aContext, key, [=](std::vector<Vector>& aPositions, std::vector<Vector>& aNormals,
+                                         std::vector<Vector>& aUVs, std::vector<GLushort>& aIndices) {
+    const float x = aWidth * 0.5f;
+    const float y = aHeight * 0.5f;
+    aPositions = {Vector(-x, y, 0.0f), Vector(-x, -y, 0.0f), Vector(x, -y, 0.0f), Vector(x, y, 0.0f)};
+    aNormals.assign(4, Vector(0.0f, 0.0f, 1.0f));
+    aUVs = {Vector(0.0f, 0.0f, 0.0f), Vector(0.0f, 1.0f, 0.0f), Vector(1.0f, 1.0f, 0.0f), Vector(1.0f, 0.0f, 0.0f)};
+    aIndices = {0, 1, 2, 0, 2, 3};
+  });
+}
+
+GeometryPtr
+CreateRoundedPanelGeometry(CreationContextPtr& aContext, const float aWidth, const float aHeight,
+                           const float aRadius, const int aCornerSegments) {
+  const float radius = std::min(aRadius, std::min(aWidth, aHeight) * 0.5f);
+  const int segments = std::max(aCornerSegments, 1);
+  const std::string key = "panel:" + std::to_string(aWidth) + ":" + std::to_string(aHeight) + ":"
+                          + std::to_string(radius) + ":" + std::to_string(segments);
+  return CreateShared(aContext, key, [=](std::vector<Vector>& aPositions, std::vector<Vector>& aNormals,
+                                         std::vector<Vector>& aUVs, std::vector<GLushort>& aIndices) {
+    const float x = aWidth * 0.5f;
+    const float y = aHeight * 0.5f;
+    // Corner centers in counter clockwise order starting at the top right.
+    const Vector corners[4] = {
+        Vector(x - radius, y - radius, 0.0f), Vector(-x + radius, y - radius, 0.0f),
+        Vector(-x + radius, -y + radius, 0.0f), Vector(x - radius, -y + radius, 0.0f)};
+    aPositions.push_back(Vector(0.0f, 0.0f, 0.0f));
+    for (int corner = 0; corner < 4; corner++) {
+      for (int ix = 0; ix <= segments; ix++) {
+        const float angle = (corner + ((float)ix / (float)segments)) * PI_FLOAT * 0.5f;
+        aPositions.push_back(corners[corner] + Vector(cosf(angle) * radius, sinf(angle) * radius, 0.0f));
+      }
+    }
+    for (const Vector& position: aPositions) {
+      aNormals.push_back(Vector(0.0f, 0.0f, 1.0f));
+      aUVs.push_back(Vector((position.x() + x) / aWidth, (y - position.y()) / aHeight, 0.0f));
+    }
+    const GLushort kPerimeterCount = (GLushort)(aPositions.size() - 1);
+    for (GLushort ix = 1; ix <= kPerimeterCount; ix++) {
+      aIndices.push_back(0);
+      aIndices.push_back(ix);
+      aIndices.push_back(ix == kPerimeterCount ? (GLushort)1 : (GLushort)(ix + 1));
+    }
+  });
+}
+
+GeometryPtr
+CreateCylinderGeometry(CreationContextPtr& aContext, const float aRadius, const float aHeight,
+                       const int aSegments) {
+  const int segments = std::max(aSegments, 3);
+  const std::string key = "cylinder:" + std::to_string(aRadius) + ":" + std::to_string(aHeight) + ":"
+                          + std::to_string(segments);
+  return CreateShared(aContext, key, [=](std::vector<Vector>& aPositions, std::vector<Vector>& aNormals,
+                                         std::vector<Vector>& aUVs, std::vector<GLushort>& aIndices) {
+    const float y = aHeight * 0.5f;
+    // The seam vertices are duplicated so the texture wraps once around the cylinder.
+    for (int ix = 0; ix <= segments; ix++) {
+      const float u = (float)ix / (float)segments;
+      const float angle = u * PI_FLOAT * 2.0f;
+      const Vector normal(sinf(angle), 0.0f, cosf(angle));
+      aPositions.push_back(Vector(normal.x() * aRadius, y, normal.z() * aRadius));
+      aPositions.push_back(Vector(normal.x() * aRadius, -y, normal.z() * aRadius));
+      aNormals.push_back(normal);
+      aNormals.push_back(normal);
+      aUVs.push_back(Vector(u, 0.0f, 0.0f));
+      aUVs.push_back(Vector(u, 1.0f, 0.0f));
+    }
+    for (int ix = 0; ix < segments; ix++) {
+      const GLushort top = (GLushort)(ix * 2);
+      aIndices.push_back(top);
+      aIndices.push_back((GLushort)(top + 1));
+      aIndices.push_back((GLushort)(top + 3));
+      aIndices.push_back(top);
+      aIndices.push_back((GLushort)(top + 3));
+      aIndices.push_back((GLushort)(top + 2));
+    }
+  });
+}
+
+} // namespace vrb
@@ -0,0 +1,166 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/GpuMemoryLedger.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <unordered_map>
+
+namespace {
+
+const int kCategoryCount = (int)vrb::GpuMemoryCategory::Count;
+
+}
+
+namespace vrb {
+
+struct GpuMemoryLedger::State {
+  struct Entry {
+    std::string label;
+    uint64_t bytes[kCategoryCount];
+    Entry() : bytes() {}
+    bool IsEmpty() const {
+      for (uint64_t value: bytes) {
+        if (value > 0) {
+          return false;
+        }
+      }
+      return true;
+    }
+  };
+  mutable Mutex lock;
+  std::unordered_map<const void*, Entry> entries;
+  uint64_t totals[kCategoryCount];
+
+  State() : totals() {}
+};
+
+GpuMemoryLedgerPtr
+GpuMemoryLedger::Create() {
+  return std::make_shared<ConcreteClass<GpuMemoryLedger, GpuMemoryLedger::State> >();
+}
+
+void
+GpuMemoryLedger::Set(const void* aOwner, const GpuMemoryCategory aCategory, const uint64_t aBytes, const char* aLabel) {
+  if (!aOwner || (aCategory == GpuMemoryCategory::Count)) {
+    return;
+  }
+  const int kCategory = (int)aCategory;
+  MutexAutoLock lock(m.lock);
+  auto found = m.entries.find(aOwner);
+  if (found == m.entries.end()) {
+    if (aBytes == 0) {
+      return;
+    }
+    found = m.entries.emplace(aOwner, State::Entry()).first;
+  }
+  State::Entry& entry = found->second;
+  m.totals[kCategory] -= entry.bytes[kCategory];
+  m.totals[kCategory] += aBytes;
+  entry.bytes[kCategory] = aBytes;
+  if (aLabel) {
+    entry.label = aLabel;
+  }
+  if (entry.IsEmpty()) {
+    m.entries.erase(found);
+  }
+}
+
+void
+GpuMemoryLedger::Release(const void* aOwner) {
+  MutexAutoLock lock(m.lock);
+  auto found = m.entries.find(aOwner);
+  if (found == m.entries.end()) {
+    return;
+  }
+  for (int ix = 0; ix < kCategoryCount; ix++) {
+    m.totals[ix] -= found->second.bytes[ix];
+  }
+  m.entries.erase(found);
+}
+
+uint64_t
+GpuMemoryLedger::GetTotal() const {
+  MutexAutoLock lock(m.lock);
+  uint64_t result = 0;
+  for (uint64_t value: m.totals) {
+    result += value;
+  }
+  return result;
+}
+
+uint64_t
+GpuMemoryLedger::GetTotal(const GpuMemoryCategory aCategory) const {
+  if (aCategory == GpuMemoryCategory::Count) {
+    return 0;
+  }
+  MutexAutoLock lock(m.lock);
+  return m.totals[(int)aCategory];
+}
+
+int32_t
+GpuMemoryLedger::GetOwnerCount() const {
+  MutexAutoLock lock(m.lock);
+  return (int32_t)m.entries.size();
+}
+
+std::string
+GpuMemoryLedger::GetReport() const {
+  MutexAutoLock lock(m.lock);
+  std::string result;
+  char buffer[128];
+  for (const auto& item: m.entries) {
+    snprintf(buffer, sizeof(buffer), "%p %s:", item.first, item.second.label.c_str());
+    result += buffer;
+    for (int ix = 0; ix < kCategoryCount; ix++) {
+      if (item.second.bytes[ix] == 0) {
+        continue;
+      }
+      snprintf(buffer, sizeof(buffer), " %s=%" PRIu64, GetCategoryName((GpuMemoryCategory)ix), item.second.bytes[ix]);
+      result += buffer;
+    }
+    result += "\n";
+  }
+  return result;
+}
+
+void
+GpuMemoryLedger::LogReport() const {
+  const std::string kReport = GetReport();
+  if (kReport.empty()) {
+    VRB_LOG("GPU memory ledger is empty");
+    return;
+  }
+  VRB_WARN("GPU memory still held: %" PRIu64 " bytes by %d owners", GetTotal(), GetOwnerCount());
+  size_t start = 0;
+  while (start < kReport.size()) {
+    const size_t end = kReport.find('\n', start);
+    VRB_WARN("  %s", kReport.substr(start, end - start).c_str());
+    start = end + 1;
+  }
+}
+
+const char*
+GpuMemoryLedger::GetCategoryName(const GpuMemoryCategory aCategory) {
+  switch (aCategory) {
+    case GpuMemoryCategory::Vertex: return "vertex";
+    case GpuMemoryCategory::Index: return "index";
+    case GpuMemoryCategory::Texture: return "texture";
+    case GpuMemoryCategory::Program: return "program";
+    case GpuMemoryCategory::FBO: return "fbo";
+    case GpuMemoryCategory::Count: break;
+  }
+  return "unknown";
+}
+
+GpuMemoryLedger::GpuMemoryLedger(State& aState) : m(aState) {}
+GpuMemoryLedger::~GpuMemoryLedger() {}
+
+} // namespace vrb
@@ -6,7 +6,9 @@
 #include "vrb/Group.h"
 #include "vrb/private/GroupState.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CullVisitor.h"
 #include "vrb/DrawableList.h"
 #include "vrb/Light.h"
 #include <algorithm>
@@ -45,6 +47,8 @@ Group::Create(CreationContextPtr& aContext) {
 
 void
 Group::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_ALLOCATION_SCOPE(Cull);
+  aVisitor.CountNode();
   for (LightPtr& light: m.lights) {
     aDrawables.PushLight(*light);
   }
@@ -60,6 +64,9 @@ void
 Group::AddLight(LightPtr aLight) {
   if (!m.Contains(*aLight)) {
     m.lights.push_back(std::move(aLight));
+    m.NotifyObservers([this](GroupObserver& aObserver) {
+      aObserver.LightsChanged(*this);
+    });
   }
 }
 
@@ -68,6 +75,9 @@ Group::RemoveLight(const Light& aLight) {
   for (auto it = m.lights.begin(); it != m.lights.end(); it++) {
     if (it->get() == &aLight) {
       m.lights.erase(it);
+      m.NotifyObservers([this](GroupObserver& aObserver) {
+        aObserver.LightsChanged(*this);
+      });
       return;
     }
   }
@@ -77,7 +87,11 @@ void
 Group::AddNode(NodePtr aNode) {
   if (!m.Contains(*aNode)) {
     AddToParents(m.self, *aNode);
+    const Node& node = *aNode;
     m.children.push_back(std::move(aNode));
+    m.NotifyObservers([&](GroupObserver& aObserver) {
+      aObserver.NodeAdded(*this, node);
+    });
   }
 }
 
@@ -85,8 +99,13 @@ void
 Group::RemoveNode(Node& aNode) {
   for (auto childIt = m.children.begin(); childIt != m.children.end(); childIt++) {
     if (childIt->get() == &aNode) {
+      // Keep the node alive until observers have been told about it.
+      NodePtr node = *childIt;
       m.children.erase(childIt);
       RemoveFromParents(*this, aNode);
+      m.NotifyObservers([&](GroupObserver& aObserver) {
+        aObserver.NodeRemoved(*this, aNode);
+      });
       return;
     }
   }
@@ -96,7 +115,11 @@ void
 Group::InsertNode(NodePtr aNode, uint32_t aIndex) {
   if (!m.Contains(*aNode)) {
     AddToParents(m.self, *aNode);
+    const Node& node = *aNode;
     m.children.insert(m.children.begin() + aIndex, std::move(aNode));
+    m.NotifyObservers([&](GroupObserver& aObserver) {
+      aObserver.NodeAdded(*this, node);
+    });
   }
 }
 
@@ -110,6 +133,11 @@ Group::GetNodeCount() const {
   return m.children.size();
 }
 
+bool
+Group::IsEnabled(const Node& aNode) {
+  return m.IsEnabled(aNode);
+}
+
 void
 Group::SortNodes(const std::function<bool(const vrb::NodePtr&, const vrb::NodePtr&)>& aFunction) {
   std::sort(m.children.begin(), m.children.end(), aFunction);
@@ -117,10 +145,40 @@ Group::SortNodes(const std::function<bool(const vrb::NodePtr&, const vrb::NodePt
 
 void
 Group::TakeChildren(GroupPtr& aSource) {
-  for (NodePtr& child: aSource->m.children) {
+  std::vector<NodePtr> children = aSource->m.children;
+  for (NodePtr& child: children) {
     m.children.push_back(child);
   }
   aSource->m.Clear();
+  for (NodePtr& child: children) {
+    aSource->m.NotifyObservers([&](GroupObserver& aObserver) {
+      aObserver.NodeRemoved(*aSource, *child);
+    });
+    m.NotifyObservers([&](GroupObserver& aObserver) {
+      aObserver.NodeAdded(*this, *child);
+    });
+  }
+}
+
+void
+Group::AddObserver(const GroupObserverPtr& aObserver) {
+  if (!aObserver) {
+    return;
+  }
+  for (const GroupObserverWeak& observer: m.observers) {
+    if (observer.lock() == aObserver) {
+      return;
+    }
+  }
+  m.observers.push_back(aObserver);
+}
+
+void
+Group::RemoveObserver(const GroupObserverPtr& aObserver) {
+  m.observers.erase(std::remove_if(m.observers.begin(), m.observers.end(), [&](const GroupObserverWeak& aCurrent) {
+    GroupObserverPtr current = aCurrent.lock();
+    return !current || (current == aObserver);
+  }), m.observers.end());
 }
 
 bool
@@ -0,0 +1,242 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/InstancedGeometry.h"
+
+#include "vrb/private/DrawableState.h"
+#include "vrb/private/NodeState.h"
+#include "vrb/private/ResourceGLState.h"
+
+#include "vrb/AllocationTracker.h"
+#include "vrb/Camera.h"
+#include "vrb/Color.h"
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/CullVisitor.h"
+#include "vrb/DrawableList.h"
+#include "vrb/Geometry.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace vrb {
+
+struct InstancedGeometry::State : public Node::State, public ResourceGL::State, public Drawable::State {
+  struct Instance {
+    Matrix transform;
+    Color tint;
+    Instance() : transform(Matrix::Identity()) {}
+  };
+
+  GeometryPtr geometry;
+  RenderStatePtr nullRenderState;
+  std::vector<Instance> instances;
+  std::vector<int32_t> visible;
+  std::vector<float> instanceData;
+  GLuint instanceObjectId;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
+  uint64_t instanceBufferSize;
+  bool boundsDirty;
+  bool hasBounds;
+  Vector boundsCenter;
+  float boundsRadius;
+
+  State()
+      : instanceObjectId(0)
+      , instanceBufferSize(0)
+      , boundsDirty(true)
+      , hasBounds(false)
+      , boundsRadius(0.0f)
+  {}
+
+  void UpdateBounds() {
+    if (!boundsDirty) {
+      return;
+    }
+    boundsDirty = false;
+    Vector min, max;
+    hasBounds = geometry && geometry->GetBounds(min, max);
+    if (hasBounds) {
+      boundsCenter = (min + max) * 0.5f;
+      boundsRadius = (max - boundsCenter).Magnitude();
+    }
+  }
+
+  // Largest axis scale of the matrix, used to grow the bounding sphere radius.
+  static float MaxScale(const Matrix& aTransform) {
+    const float kX = Vector(aTransform.At(0, 0), aTransform.At(0, 1), aTransform.At(0, 2)).Magnitude();
+    const float kY = Vector(aTransform.At(1, 0), aTransform.At(1, 1), aTransform.At(1, 2)).Magnitude();
+    const float kZ = Vector(aTransform.At(2, 0), aTransform.At(2, 1), aTransform.At(2, 2)).Magnitude();
+    return std::max(kX, std::max(kY, kZ));
+  }
+};
+
+InstancedGeometryPtr
+InstancedGeometry::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<InstancedGeometry, InstancedGeometry::State> >(aContext);
+}
+
+// Node interface
+void
+InstancedGeometry::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  VRB_ALLOCATION_SCOPE(Cull);
+  aVisitor.CountNode();
+  m.visible.clear();
+  if (!m.geometry) {
+    return;
+  }
+  m.UpdateBounds();
+  const Matrix& kParent = aVisitor.GetTransform();
+  for (int32_t ix = 0; ix < (int32_t)m.instances.size(); ix++) {
+    if (m.hasBounds && aVisitor.HasCamera()) {
+      const Matrix world = kParent.PostMultiply(m.instances[ix].transform);
+      const Vector center = world.MultiplyPosition(m.boundsCenter);
+      if (!aVisitor.IsVisible(center, m.boundsRadius * State::MaxScale(world))) {
+        continue;
+      }
+    }
+    m.visible.push_back(ix);
+  }
+  if (!m.visible.empty()) {
+    aDrawables.AddDrawable(*this, kParent);
+  }
+}
+
+// Drawable interface
+RenderStatePtr&
+InstancedGeometry::GetRenderState() {
+  if (!m.geometry) {
+    return m.nullRenderState;
+  }
+  return m.geometry->GetRenderState();
+}
+
+void
+InstancedGeometry::SetRenderState(const RenderStatePtr& aRenderState) {
+  if (m.geometry) {
+    m.geometry->SetRenderState(aRenderState);
+  }
+}
+
+void
+InstancedGeometry::Draw(const Camera& aCamera, const Matrix& aModelTransform) {
+  if (!m.geometry || m.visible.empty() || (m.instanceObjectId == 0)) {
+    return;
+  }
+  const size_t kFloatCount = (size_t)Geometry::kInstanceFloatCount;
+  m.instanceData.resize(m.visible.size() * kFloatCount);
+  float* target = m.instanceData.data();
+  for (int32_t index: m.visible) {
+    const State::Instance& instance = m.instances[index];
+    const Matrix world = aModelTransform.PostMultiply(instance.transform);
+    memcpy(target, world.Data(), 16 * sizeof(float));
+    memcpy(target + 16, instance.tint.Data(), 4 * sizeof(float));
+    target += kFloatCount;
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, m.instanceObjectId));
+  VRB_GL_CHECK(glBufferData(GL_ARRAY_BUFFER, m.instanceData.size() * sizeof(float), m.instanceData.data(), GL_STREAM_DRAW));
+  if (m.ledger && (m.instanceBufferSize != m.instanceData.size() * sizeof(float))) {
+    m.instanceBufferSize = m.instanceData.size() * sizeof(float);
+    m.ledger->Set(&m, GpuMemoryCategory::Vertex, m.instanceBufferSize, "InstancedGeometry");
+  }
+  VRB_GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  m.geometry->DrawInstanced(aCamera, m.instanceObjectId, (GLsizei)m.visible.size());
+}
+
+// InstancedGeometry interface
+GeometryPtr
+InstancedGeometry::GetGeometry() const {
+  return m.geometry;
+}
+
+void
+InstancedGeometry::SetGeometry(const GeometryPtr& aGeometry) {
+  m.geometry = aGeometry;
+  m.boundsDirty = true;
+}
+
+int32_t
+InstancedGeometry::AddInstance(const Matrix& aTransform, const Color& aTint) {
+  State::Instance instance;
+  instance.transform = aTransform;
+  instance.tint = aTint;
+  m.instances.push_back(instance);
+  return (int32_t)m.instances.size() - 1;
+}
+
+void
+InstancedGeometry::SetInstance(const int32_t aIndex, const Matrix& aTransform, const Color& aTint) {
+  if ((aIndex < 0) || (aIndex >= (int32_t)m.instances.size())) {
+    VRB_ERROR("InstancedGeometry::SetInstance index out of range: %d", aIndex);
+    return;
+  }
+  m.instances[aIndex].transform = aTransform;
+  m.instances[aIndex].tint = aTint;
+}
+
+void
+InstancedGeometry::RemoveInstance(const int32_t aIndex) {
+  if ((aIndex < 0) || (aIndex >= (int32_t)m.instances.size())) {
+    VRB_ERROR("InstancedGeometry::RemoveInstance index out of range: %d", aIndex);
+    return;
+  }
+  m.instances.erase(m.instances.begin() + aIndex);
+  m.visible.clear();
+}
+
+void
+InstancedGeometry::ClearInstances() {
+  m.instances.clear();
+  m.visible.clear();
+}
+
+int32_t
+InstancedGeometry::GetInstanceCount() const {
+  return (int32_t)m.instances.size();
+}
+
+int32_t
+InstancedGeometry::GetVisibleInstanceCount() const {
+  return (int32_t)m.visible.size();
+}
+
+InstancedGeometry::InstancedGeometry(State& aState, CreationContextPtr& aContext) :
+    Node(aState, aContext),
+    Drawable(aState, aContext),
+    ResourceGL(aState, aContext),
+    m(aState)
+{
+  m.ledger = aContext->GetGpuMemoryLedger();
+  m.deletionQueue = aContext->GetGLDeletionQueue();
+}
+InstancedGeometry::~InstancedGeometry() {
+  ShutdownGL();
+}
+
+// ResourceGL interface
+void
+InstancedGeometry::InitializeGL() {
+  VRB_GL_CHECK(glGenBuffers(1, &m.instanceObjectId));
+}
+
+void
+InstancedGeometry::ShutdownGL() {
+  m.deletionQueue->DeleteBuffer(m.instanceObjectId);
+  m.instanceObjectId = 0;
+  m.instanceBufferSize = 0;
+  if (m.ledger) {
+    m.ledger->Release(&m);
+  }
+}
+
+} // namespace vrb
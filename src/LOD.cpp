@@ -0,0 +1,135 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/LOD.h"
+#include "vrb/private/GroupState.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/CullVisitor.h"
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace vrb {
+
+struct LOD::State : public Group::State {
+  std::unordered_map<const Node*, float> errors;
+  Vector center;
+  float threshold;
+  float hysteresis;
+  int32_t currentLevel;
+
+  State()
+      : threshold(1.0f)
+      , hysteresis(0.1f)
+      , currentLevel(0)
+  {}
+
+  bool IsEnabled(const Node& aNode) override {
+    return (currentLevel >= 0) && (currentLevel < (int32_t)children.size()) &&
+           (children[currentLevel].get() == &aNode);
+  }
+
+  void Clear() override {
+    errors.clear();
+    currentLevel = 0;
+    Group::State::Clear();
+  }
+
+  float GetError(const int32_t aLevel) const {
+    auto it = errors.find(children[aLevel].get());
+    return it != errors.end() ? it->second : 0.0f;
+  }
+
+  void SelectLevel(const CullVisitor& aVisitor) {
+    const int32_t kCount = (int32_t)children.size();
+    if (!aVisitor.HasCamera() || (kCount == 0)) {
+      currentLevel = 0;
+      return;
+    }
+    const Matrix& transform = aVisitor.GetTransform();
+    const Vector kWorldCenter = transform.MultiplyPosition(center);
+    const float kScale = std::max(
+        Vector(transform.At(0, 0), transform.At(0, 1), transform.At(0, 2)).Magnitude(),
+        std::max(Vector(transform.At(1, 0), transform.At(1, 1), transform.At(1, 2)).Magnitude(),
+                 Vector(transform.At(2, 0), transform.At(2, 1), transform.At(2, 2)).Magnitude()));
+    auto projected = [&](const int32_t aLevel) {
+      return aVisitor.GetProjectedSize(kWorldCenter, GetError(aLevel) * kScale);
+    };
+    int32_t level = std::min(std::max(currentLevel, 0), kCount - 1);
+    while ((level > 0) && (projected(level) > (threshold * (1.0f + hysteresis)))) {
+      level--;
+    }
+    while (((level + 1) < kCount) && (projected(level + 1) < (threshold * (1.0f - hysteresis)))) {
+      level++;
+    }
+    currentLevel = level;
+  }
+};
+
+LODPtr
+LOD::Create(CreationContextPtr& aContext) {
+  LODPtr lod = std::make_shared<ConcreteClass<LOD, LOD::State> >(aContext);
+  lod->m.self = lod;
+  return lod;
+}
+
+// Node interface
+void
+LOD::Cull(CullVisitor& aVisitor, DrawableList& aDrawables) {
+  m.SelectLevel(aVisitor);
+  Super::Cull(aVisitor, aDrawables);
+}
+
+// Group interface
+void
+LOD::RemoveNode(Node& aNode) {
+  m.errors.erase(&aNode);
+  Super::RemoveNode(aNode);
+}
+
+// LOD interface
+void
+LOD::AddLevel(NodePtr aNode, const float aGeometricError) {
+  if (!aNode) {
+    return;
+  }
+  m.errors[aNode.get()] = aGeometricError;
+  AddNode(std::move(aNode));
+}
+
+void
+LOD::SetGeometricError(const Node& aNode, const float aGeometricError) {
+  if (m.Contains(aNode)) {
+    m.errors[&aNode] = aGeometricError;
+  }
+}
+
+void
+LOD::SetCenter(const Vector& aCenter) {
+  m.center = aCenter;
+}
+
+void
+LOD::SetErrorThreshold(const float aPixels) {
+  m.threshold = aPixels;
+}
+
+void
+LOD::SetHysteresis(const float aFraction) {
+  m.hysteresis = std::min(std::max(aFraction, 0.0f), 0.9f);
+}
+
+int32_t
+LOD::GetCurrentLevel() const {
+  return m.currentLevel;
+}
+
+LOD::LOD(State& aState, CreationContextPtr& aContext) : Group(aState, aContext), m(aState) {}
+LOD::~LOD() {}
+
+} // namespace vrb
@@ -0,0 +1,412 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/MeshSimplifier.h"
+
+#include "vrb/Geometry.h"
+#include "vrb/LOD.h"
+#include "vrb/Logger.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// Symmetric 4x4 error quadric stored as its upper triangle.
+struct Quadric {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+  Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+  static Quadric FromPlane(const double aA, const double aB, const double aC, const double aD, const double aWeight) {
+    Quadric result;
+    result.a2 = aWeight * aA * aA; result.ab = aWeight * aA * aB; result.ac = aWeight * aA * aC; result.ad = aWeight * aA * aD;
+    result.b2 = aWeight * aB * aB; result.bc = aWeight * aB * aC; result.bd = aWeight * aB * aD;
+    result.c2 = aWeight * aC * aC; result.cd = aWeight * aC * aD;
+    result.d2 = aWeight * aD * aD;
+    return result;
+  }
+
+  Quadric& operator+=(const Quadric& aOther) {
+    a2 += aOther.a2; ab += aOther.ab; ac += aOther.ac; ad += aOther.ad;
+    b2 += aOther.b2; bc += aOther.bc; bd += aOther.bd;
+    c2 += aOther.c2; cd += aOther.cd;
+    d2 += aOther.d2;
+    return *this;
+  }
+
+  double Evaluate(const vrb::Vector& aPoint) const {
+    const double x = aPoint.x(), y = aPoint.y(), z = aPoint.z();
+    return (a2 * x * x) + (2 * ab * x * y) + (2 * ac * x * z) + (2 * ad * x)
+         + (b2 * y * y) + (2 * bc * y * z) + (2 * bd * y)
+         + (c2 * z * z) + (2 * cd * z)
+         + d2;
+  }
+
+  // Point minimizing the quadric, if the system is well conditioned.
+  bool Optimal(vrb::Vector& aResult) const {
+    const double det = (a2 * ((b2 * c2) - (bc * bc))) - (ab * ((ab * c2) - (bc * ac))) + (ac * ((ab * bc) - (b2 * ac)));
+    if (std::fabs(det) < 1e-12) {
+      return false;
+    }
+    const double inv = 1.0 / det;
+    const double x = -inv * ((ad * ((b2 * c2) - (bc * bc))) - (ab * ((bd * c2) - (bc * cd))) + (ac * ((bd * bc) - (b2 * cd))));
+    const double y = -inv * ((a2 * ((bd * c2) - (cd * bc))) - (ad * ((ab * c2) - (bc * ac))) + (ac * ((ab * cd) - (bd * ac))));
+    const double z = -inv * ((a2 * ((b2 * cd) - (bc * bd))) - (ab * ((ab * cd) - (bd * ac))) + (ad * ((ab * bc) - (b2 * ac))));
+    aResult.Set((float)x, (float)y, (float)z);
+    return true;
+  }
+};
+
+struct Collapse {
+  double cost;
+  uint32_t keep;
+  uint32_t remove;
+  uint32_t keepVersion;
+  uint32_t removeVersion;
+  vrb::Vector target;
+  float weight; // Interpolation factor from keep toward remove for attributes.
+  bool operator>(const Collapse& aOther) const { return cost > aOther.cost; }
+};
+
+const double kBoundaryWeight = 1000.0;
+
+class Simplifier {
+public:
+  Simplifier(std::vector<vrb::Vector>& aPositions, std::vector<vrb::Vector>& aNormals,
+             std::vector<vrb::Vector>& aUVs, std::vector<GLushort>& aIndices)
+      : mPositions(aPositions), mNormals(aNormals), mUVs(aUVs), mIndices(aIndices) {}
+
+  float Run(const size_t aTargetTriangleCount);
+
+private:
+  vrb::Vector TriangleNormal(const uint32_t aTriangle, const uint32_t aMoved, const vrb::Vector& aPosition) const;
+  void BuildQuadrics();
+  void PushCollapse(const uint32_t aFirst, const uint32_t aSecond);
+  bool Flips(const uint32_t aVertex, const uint32_t aOther, const vrb::Vector& aPosition) const;
+  void Compact();
+
+  std::vector<vrb::Vector>& mPositions;
+  std::vector<vrb::Vector>& mNormals;
+  std::vector<vrb::Vector>& mUVs;
+  std::vector<GLushort>& mIndices;
+  std::vector<Quadric> mQuadrics;
+  std::vector<Quadric> mSurfaceQuadrics;
+  // Total area behind each surface quadric. Dividing by it turns the area
+  // weighted error into a mean squared distance that does not scale with the mesh.
+  std::vector<double> mSurfaceWeights;
+  std::vector<uint32_t> mVersions;
+  std::vector<bool> mRemovedVertices;
+  std::vector<bool> mRemovedTriangles;
+  std::vector<std::vector<uint32_t>> mVertexTriangles;
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> mQueue;
+};
+
+vrb::Vector
+Simplifier::TriangleNormal(const uint32_t aTriangle, const uint32_t aMoved, const vrb::Vector& aPosition) const {
+  vrb::Vector points[3];
+  for (int ix = 0; ix < 3; ix++) {
+    const uint32_t vertex = mIndices[(aTriangle * 3) + ix];
+    points[ix] = (vertex == aMoved) ? aPosition : mPositions[vertex];
+  }
+  return (points[1] - points[0]).Cross(points[2] - points[0]);
+}
+
+void
+Simplifier::BuildQuadrics() {
+  const size_t kTriangleCount = mIndices.size() / 3;
+  mQuadrics.assign(mPositions.size(), Quadric());
+  mSurfaceQuadrics.assign(mPositions.size(), Quadric());
+  mSurfaceWeights.assign(mPositions.size(), 0.0);
+  std::unordered_map<uint64_t, int> edgeUse;
+  for (uint32_t triangle = 0; triangle < kTriangleCount; triangle++) {
+    const vrb::Vector normal = TriangleNormal(triangle, (uint32_t)-1, vrb::Vector());
+    const float kArea = normal.Magnitude();
+    if (kArea <= 0.0f) {
+      continue;
+    }
+    const vrb::Vector unit = normal / kArea;
+    const vrb::Vector& origin = mPositions[mIndices[triangle * 3]];
+    const Quadric plane = Quadric::FromPlane(unit.x(), unit.y(), unit.z(), -unit.Dot(origin), kArea * 0.5);
+    for (int ix = 0; ix < 3; ix++) {
+      const uint32_t vertex = mIndices[(triangle * 3) + ix];
+      mQuadrics[vertex] += plane;
+      mSurfaceQuadrics[vertex] += plane;
+      mSurfaceWeights[vertex] += kArea * 0.5;
+      const uint32_t next = mIndices[(triangle * 3) + ((ix + 1) % 3)];
+      const uint64_t key = ((uint64_t)std::min(vertex, next) << 32) | std::max(vertex, next);
+      edgeUse[key]++;
+    }
+  }
+  // Edges used by a single triangle get a plane perpendicular to the triangle
+  // so the border does not shrink.
+  for (uint32_t triangle = 0; triangle < kTriangleCount; triangle++) {
+    const vrb::Vector normal = TriangleNormal(triangle, (uint32_t)-1, vrb::Vector()).Normalize();
+    for (int ix = 0; ix < 3; ix++) {
+      const uint32_t vertex = mIndices[(triangle * 3) + ix];
+      const uint32_t next = mIndices[(triangle * 3) + ((ix + 1) % 3)];
+      const uint64_t key = ((uint64_t)std::min(vertex, next) << 32) | std::max(vertex, next);
+      if (edgeUse[key] != 1) {
+        continue;
+      }
+      const vrb::Vector edge = mPositions[next] - mPositions[vertex];
+      const vrb::Vector side = edge.Cross(normal).Normalize();
+      const float kLength = edge.Magnitude();
+      const Quadric border = Quadric::FromPlane(side.x(), side.y(), side.z(), -side.Dot(mPositions[vertex]), kBoundaryWeight * kLength * kLength);
+      mQuadrics[vertex] += border;
+      mQuadrics[next] += border;
+    }
+  }
+}
+
+void
+Simplifier::PushCollapse(const uint32_t aFirst, const uint32_t aSecond) {
+  Quadric combined = mQuadrics[aFirst];
+  combined += mQuadrics[aSecond];
+  Collapse collapse;
+  collapse.keep = aFirst;
+  collapse.remove = aSecond;
+  collapse.keepVersion = mVersions[aFirst];
+  collapse.removeVersion = mVersions[aSecond];
+
+  const vrb::Vector& first = mPositions[aFirst];
+  const vrb::Vector& second = mPositions[aSecond];
+  vrb::Vector candidates[4] = {first, second, (first + second) * 0.5f, vrb::Vector()};
+  int count = 3;
+  if (combined.Optimal(candidates[3])) {
+    count = 4;
+  }
+  collapse.cost = -1.0;
+  for (int ix = 0; ix < count; ix++) {
+    const double cost = combined.Evaluate(candidates[ix]);
+    if ((collapse.cost < 0.0) || (cost < collapse.cost)) {
+      collapse.cost = std::max(cost, 0.0);
+      collapse.target = candidates[ix];
+    }
+  }
+  const vrb::Vector edge = second - first;
+  const float kLengthSquared = edge.Dot(edge);
+  collapse.weight = kLengthSquared > 0.0f ? edge.Dot(collapse.target - first) / kLengthSquared : 0.0f;
+  collapse.weight = std::min(std::max(collapse.weight, 0.0f), 1.0f);
+  mQueue.push(collapse);
+}
+
+bool
+Simplifier::Flips(const uint32_t aVertex, const uint32_t aOther, const vrb::Vector& aPosition) const {
+  for (uint32_t triangle: mVertexTriangles[aVertex]) {
+    if (mRemovedTriangles[triangle]) {
+      continue;
+    }
+    const GLushort* indices = &mIndices[triangle * 3];
+    if ((indices[0] == aOther) || (indices[1] == aOther) || (indices[2] == aOther)) {
+      continue;
+    }
+    const vrb::Vector before = TriangleNormal(triangle, (uint32_t)-1, vrb::Vector());
+    const vrb::Vector after = TriangleNormal(triangle, aVertex, aPosition);
+    if (after.Dot(before) <= 0.0f) {
+      return true;
+    }
+  }
+  return false;
+}
+
+float
+Simplifier::Run(const size_t aTargetTriangleCount) {
+  const size_t kTriangleCount = mIndices.size() / 3;
+  mIndices.resize(kTriangleCount * 3);
+  BuildQuadrics();
+  mVersions.assign(mPositions.size(), 0);
+  mRemovedVertices.assign(mPositions.size(), false);
+  mRemovedTriangles.assign(kTriangleCount, false);
+  mVertexTriangles.assign(mPositions.size(), std::vector<uint32_t>());
+  for (uint32_t triangle = 0; triangle < kTriangleCount; triangle++) {
+    for (int ix = 0; ix < 3; ix++) {
+      mVertexTriangles[mIndices[(triangle * 3) + ix]].push_back(triangle);
+    }
+  }
+  for (uint32_t triangle = 0; triangle < kTriangleCount; triangle++) {
+    for (int ix = 0; ix < 3; ix++) {
+      const uint32_t vertex = mIndices[(triangle * 3) + ix];
+      const uint32_t next = mIndices[(triangle * 3) + ((ix + 1) % 3)];
+      if (vertex < next) {
+        PushCollapse(vertex, next);
+      }
+    }
+  }
+
+  size_t live = kTriangleCount;
+  double maxError = 0.0;
+  const bool kHasNormals = mNormals.size() >= mPositions.size();
+  const bool kHasUVs = mUVs.size() >= mPositions.size();
+  while ((live > aTargetTriangleCount) && !mQueue.empty()) {
+    const Collapse collapse = mQueue.top();
+    mQueue.pop();
+    const uint32_t keep = collapse.keep;
+    const uint32_t remove = collapse.remove;
+    if (mRemovedVertices[keep] || mRemovedVertices[remove] ||
+        (mVersions[keep] != collapse.keepVersion) || (mVersions[remove] != collapse.removeVersion)) {
+      continue;
+    }
+    if (Flips(keep, remove, collapse.target) || Flips(remove, keep, collapse.target)) {
+      continue;
+    }
+
+    Quadric surface = mSurfaceQuadrics[keep];
+    surface += mSurfaceQuadrics[remove];
+    const double kSurfaceWeight = mSurfaceWeights[keep] + mSurfaceWeights[remove];
+    if (kSurfaceWeight > 0.0) {
+      maxError = std::max(maxError, surface.Evaluate(collapse.target) / kSurfaceWeight);
+    }
+
+    mPositions[keep] = collapse.target;
+    if (kHasNormals) {
+      mNormals[keep] = (mNormals[keep] * (1.0f - collapse.weight) + mNormals[remove] * collapse.weight).Normalize();
+    }
+    if (kHasUVs) {
+      mUVs[keep] = mUVs[keep] * (1.0f - collapse.weight) + mUVs[remove] * collapse.weight;
+    }
+    mQuadrics[keep] += mQuadrics[remove];
+    mSurfaceQuadrics[keep] = surface;
+    mSurfaceWeights[keep] = kSurfaceWeight;
+    mRemovedVertices[remove] = true;
+    mVersions[keep]++;
+
+    for (uint32_t triangle: mVertexTriangles[remove]) {
+      if (mRemovedTriangles[triangle]) {
+        continue;
+      }
+      GLushort* indices = &mIndices[triangle * 3];
+      if ((indices[0] == keep) || (indices[1] == keep) || (indices[2] == keep)) {
+        mRemovedTriangles[triangle] = true;
+        live--;
+        continue;
+      }
+      for (int ix = 0; ix < 3; ix++) {
+        if (indices[ix] == remove) {
+          indices[ix] = (GLushort)keep;
+        }
+      }
+      mVertexTriangles[keep].push_back(triangle);
+    }
+    mVertexTriangles[remove].clear();
+
+    std::vector<uint32_t> neighbors;
+    for (uint32_t triangle: mVertexTriangles[keep]) {
+      if (mRemovedTriangles[triangle]) {
+        continue;
+      }
+      for (int ix = 0; ix < 3; ix++) {
+        const uint32_t vertex = mIndices[(triangle * 3) + ix];
+        if ((vertex != keep) && (std::find(neighbors.begin(), neighbors.end(), vertex) == neighbors.end())) {
+          neighbors.push_back(vertex);
+        }
+      }
+    }
+    for (uint32_t neighbor: neighbors) {
+      PushCollapse(keep, neighbor);
+    }
+  }
+  Compact();
+  return (float)std::sqrt(maxError);
+}
+
+void
+Simplifier::Compact() {
+  std::vector<int32_t> remap(mPositions.size(), -1);
+  std::vector<vrb::Vector> positions, normals, uvs;
+  std::vector<GLushort> indices;
+  const bool kHasNormals = mNormals.size() >= mPositions.size();
+  const bool kHasUVs = mUVs.size() >= mPositions.size();
+  for (size_t triangle = 0; triangle < mRemovedTriangles.size(); triangle++) {
+    if (mRemovedTriangles[triangle]) {
+      continue;
+    }
+    for (int ix = 0; ix < 3; ix++) {
+      const GLushort vertex = mIndices[(triangle * 3) + ix];
+      if (remap[vertex] < 0) {
+        remap[vertex] = (int32_t)positions.size();
+        positions.push_back(mPositions[vertex]);
+        if (kHasNormals) { normals.push_back(mNormals[vertex]); }
+        if (kHasUVs) { uvs.push_back(mUVs[vertex]); }
+      }
+      indices.push_back((GLushort)remap[vertex]);
+    }
+  }
+  mPositions.swap(positions);
+  mNormals.swap(normals);
+  mUVs.swap(uvs);
+  mIndices.swap(indices);
+}
+
+}
+
+namespace vrb {
+
+float
+SimplifyMesh(
+    std::vector<Vector>& aPositions,
+    std::vector<Vector>& aNormals,
+    std::vector<Vector>& aUVs,
+    std::vector<GLushort>& aIndices,
+    const size_t aTargetTriangleCount) {
+  if (aIndices.size() < 3) {
+    return 0.0f;
+  }
+  Simplifier simplifier(aPositions, aNormals, aUVs, aIndices);
+  return simplifier.Run(aTargetTriangleCount);
+}
+
+GeometryPtr
+CreateSimplifiedGeometry(CreationContextPtr& aContext, const GeometryPtr& aSource, const float aRatio, float& aError) {
+  aError = 0.0f;
+  std::vector<Vector> positions, normals, uvs;
+  std::vector<GLushort> indices;
+  if (!aSource || !aSource->GetIndexedData(positions, normals, uvs, indices)) {
+    return nullptr;
+  }
+  const size_t kTarget = (size_t)((float)(indices.size() / 3) * std::min(std::max(aRatio, 0.0f), 1.0f));
+  aError = SimplifyMesh(positions, normals, uvs, indices, kTarget);
+  if (indices.empty()) {
+    return nullptr;
+  }
+  GeometryPtr result = Geometry::Create(aContext);
+  result->SetName(aSource->GetName());
+  result->SetRenderState(aSource->GetRenderState());
+  result->SetIndexedData(positions, normals, uvs, indices, aSource->GetUVLength());
+  return result;
+}
+
+LODPtr
+CreateLODFromGeometry(CreationContextPtr& aContext, const GeometryPtr& aSource, const int32_t aLevelCount, const float aRatio) {
+  if (!aSource) {
+    return nullptr;
+  }
+  LODPtr result = LOD::Create(aContext);
+  result->SetName(aSource->GetName());
+  Vector min, max;
+  if (aSource->GetBounds(min, max)) {
+    result->SetCenter((min + max) * 0.5f);
+  }
+  result->AddLevel(aSource, 0.0f);
+  GeometryPtr previous = aSource;
+  float previousError = 0.0f;
+  for (int32_t level = 1; level < aLevelCount; level++) {
+    float error = 0.0f;
+    GeometryPtr simplified = CreateSimplifiedGeometry(aContext, previous, aRatio, error);
+    if (!simplified) {
+      break;
+    }
+    // Errors accumulate across levels since each level simplifies the previous one.
+    previousError += error;
+    result->AddLevel(simplified, previousError);
+    previous = simplified;
+  }
+  return result;
+}
+
+} // namespace vrb
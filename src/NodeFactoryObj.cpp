@@ -12,12 +12,15 @@
 #include "vrb/Group.h"
 #include "vrb/Mutex.h"
 #include "vrb/RenderState.h"
+#include "vrb/RenderStateCache.h"
 #include "vrb/Texture.h"
 #include "vrb/TextureGL.h"
 #include "vrb/Vector.h"
 #include "vrb/VertexArray.h"
 
+#include <limits>
 #include <unordered_map>
+#include <vector>
 
 namespace {
 
@@ -47,18 +50,25 @@ struct NodeFactoryObj::State {
   GeometryPtr currentGeometry;
   Material* currentMaterial;
   RenderStatePtr defaultRenderState;
+  std::vector<GeometryPtr> geometries;
+  bool staticBatching;
+  bool shareRenderStates;
 
   State()
       : groupId(0)
-      , currentMaterial(nullptr) {}
+      , currentMaterial(nullptr)
+      , staticBatching(false)
+      , shareRenderStates(false) {}
 
   void Reset() {
     groupId = 0;
     vertices = nullptr;
     currentGeometry = nullptr;
     currentMaterial = nullptr;
+    geometries.clear();
   }
   void CreateRenderState(Material& aMaterial);
+  void MergeGeometries();
 };
 
 void
@@ -68,16 +78,99 @@ NodeFactoryObj::State::CreateRenderState(Material& aMaterial) {
   }
 
   CreationContextPtr creation = context.lock();
-  if (creation) {
-    aMaterial.state = RenderState::Create(creation);
-    if (!aMaterial.diffuseTextureName.empty()) {
-      TexturePtr texture = creation->LoadTexture(aMaterial.diffuseTextureName);
-      aMaterial.state->SetTexture(texture);
-    }
+  if (!creation) {
+    return;
+  }
+  TexturePtr texture;
+  if (!aMaterial.diffuseTextureName.empty()) {
+    texture = creation->LoadTexture(aMaterial.diffuseTextureName);
+  }
+  RenderStateCachePtr cache = shareRenderStates ? creation->GetRenderStateCache() : nullptr;
+  if (cache) {
+    aMaterial.state = cache->FindOrCreate(creation, aMaterial.ambient, aMaterial.diffuse, aMaterial.specular, aMaterial.specularExponent, texture);
+    return;
+  }
+  aMaterial.state = RenderState::Create(creation);
+  if (texture) {
+    aMaterial.state->SetTexture(texture);
   }
   aMaterial.state->SetMaterial(aMaterial.ambient, aMaterial.diffuse, aMaterial.specular, aMaterial.specularExponent);
 }
 
+void
+NodeFactoryObj::State::MergeGeometries() {
+  CreationContextPtr creation = context.lock();
+  if (!creation || !root || (geometries.size() < 2)) {
+    return;
+  }
+  // Face based Geometry expands every triangle vertex, so the index count is
+  // also the vertex count and has to fit in a GLushort.
+  const int32_t kMaxIndices = std::numeric_limits<GLushort>::max();
+  std::vector<RenderState*> order;
+  std::unordered_map<RenderState*, std::vector<GeometryPtr>> buckets;
+  for (GeometryPtr& geometry: geometries) {
+    if (geometry->GetFaceCount() == 0) {
+      root->RemoveNode(*geometry);
+      continue;
+    }
+    RenderState* key = geometry->GetRenderState().get();
+    std::vector<GeometryPtr>& bucket = buckets[key];
+    if (bucket.empty()) {
+      order.push_back(key);
+    }
+    bucket.push_back(geometry);
+  }
+
+  int32_t merged = 0;
+  int32_t created = 0;
+  geometries.clear();
+  for (RenderState* key: order) {
+    std::vector<GeometryPtr>& bucket = buckets[key];
+    if (bucket.size() < 2) {
+      geometries.insert(geometries.end(), bucket.begin(), bucket.end());
+      continue;
+    }
+    GeometryPtr target;
+    int32_t indexCount = 0;
+    for (GeometryPtr& source: bucket) {
+      int32_t sourceCount = 0;
+      for (int32_t ix = 0; ix < source->GetFaceCount(); ix++) {
+        const size_t kSize = source->GetFace(ix).vertices.size();
+        if (kSize >= 3) {
+          sourceCount += (int32_t)(kSize - 2) * 3;
+        }
+      }
+      if (!target || ((indexCount + sourceCount) > kMaxIndices)) {
+        target = Geometry::Create(creation);
+        target->SetName(source->GetName());
+        target->SetVertexArray(vertices);
+        target->SetRenderState(source->GetRenderState());
+        root->AddNode(target);
+        geometries.push_back(target);
+        indexCount = 0;
+        created++;
+      }
+      for (int32_t ix = 0; ix < source->GetFaceCount(); ix++) {
+        const Geometry::Face& face = source->GetFace(ix);
+        if (face.vertices.size() < 3) {
+          continue;
+        }
+        std::vector<int> faceVertices(face.vertices.begin(), face.vertices.end());
+        std::vector<int> faceUVs(face.uvs.begin(), face.uvs.end());
+        std::vector<int> faceNormals(face.normals.begin(), face.normals.end());
+        target->AddFace(faceVertices, faceUVs, faceNormals);
+      }
+      target->AddRange(source->GetName(), indexCount, sourceCount);
+      indexCount += sourceCount;
+      root->RemoveNode(*source);
+      merged++;
+    }
+  }
+  if (merged > 0) {
+    VRB_LOG("Static batching merged %d Geometry nodes into %d in: %s", merged, created, root->GetName().c_str());
+  }
+}
+
 NodeFactoryObjPtr
 NodeFactoryObj::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<NodeFactoryObj, NodeFactoryObj::State> >(aContext);
@@ -101,6 +194,10 @@ NodeFactoryObj::StartModel(const std::string& aFileName) {
 
 void
 NodeFactoryObj::FinishModel() {
+  if (m.staticBatching) {
+    m.MergeGeometries();
+  }
+  Geometry::ShareBuffers(m.geometries);
   m.Reset();
 }
 
@@ -119,6 +216,7 @@ NodeFactoryObj::SetGroupNames(const std::vector<std::string>& aNames) {
   m.currentGeometry = Geometry::Create(creation);
   m.currentGeometry->SetName(aNames.front());
   m.root->AddNode(m.currentGeometry);
+  m.geometries.push_back(m.currentGeometry);
   m.currentGeometry->SetVertexArray(m.vertices);
   if (!m.defaultRenderState) {
     m.defaultRenderState = RenderState::Create(creation);
@@ -277,6 +375,26 @@ NodeFactoryObj::GetModelRoot() {
   return m.root;
 }
 
+void
+NodeFactoryObj::SetStaticBatching(const bool aEnabled) {
+  m.staticBatching = aEnabled;
+}
+
+bool
+NodeFactoryObj::GetStaticBatching() const {
+  return m.staticBatching;
+}
+
+void
+NodeFactoryObj::SetShareRenderStates(const bool aEnabled) {
+  m.shareRenderStates = aEnabled;
+}
+
+bool
+NodeFactoryObj::GetShareRenderStates() const {
+  return m.shareRenderStates;
+}
+
 NodeFactoryObj::NodeFactoryObj(State& aState, CreationContextPtr& aContext) : m(aState) {
   m.context = aContext;
 }
@@ -0,0 +1,372 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/OcclusionBuffer.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Matrix.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#  include <xmmintrin.h>
+#  define VRB_OCCLUSION_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define VRB_OCCLUSION_NEON 1
+#endif
+
+namespace {
+
+const int32_t kDefaultWidth = 256;
+const int32_t kDefaultHeight = 128;
+const float kEmptyDepth = std::numeric_limits<float>::max();
+
+#if defined(VRB_OCCLUSION_SSE)
+typedef __m128 Float4;
+typedef __m128 Mask4;
+inline Float4 Splat(const float aValue) { return _mm_set1_ps(aValue); }
+inline Float4 Ramp(const float aValue) { return _mm_setr_ps(aValue, aValue + 1.0f, aValue + 2.0f, aValue + 3.0f); }
+inline Float4 Load(const float* aData) { return _mm_loadu_ps(aData); }
+inline void Store(float* aData, const Float4 aValue) { _mm_storeu_ps(aData, aValue); }
+inline Float4 MulAdd(const Float4 aA, const Float4 aB, const Float4 aC) { return _mm_add_ps(_mm_mul_ps(aA, aB), aC); }
+inline Float4 Min(const Float4 aA, const Float4 aB) { return _mm_min_ps(aA, aB); }
+inline Mask4 GreaterEqual(const Float4 aA, const Float4 aB) { return _mm_cmpge_ps(aA, aB); }
+inline Mask4 And(const Mask4 aA, const Mask4 aB) { return _mm_and_ps(aA, aB); }
+inline Float4 Select(const Mask4 aMask, const Float4 aA, const Float4 aB) {
+  return _mm_or_ps(_mm_and_ps(aMask, aA), _mm_andnot_ps(aMask, aB));
+}
+inline bool Any(const Mask4 aMask) { return _mm_movemask_ps(aMask) != 0; }
+#elif defined(VRB_OCCLUSION_NEON)
+typedef float32x4_t Float4;
+typedef uint32x4_t Mask4;
+inline Float4 Splat(const float aValue) { return vdupq_n_f32(aValue); }
+inline Float4 Ramp(const float aValue) {
+  const float kValues[4] = {aValue, aValue + 1.0f, aValue + 2.0f, aValue + 3.0f};
+  return vld1q_f32(kValues);
+}
+inline Float4 Load(const float* aData) { return vld1q_f32(aData); }
+inline void Store(float* aData, const Float4 aValue) { vst1q_f32(aData, aValue); }
+inline Float4 MulAdd(const Float4 aA, const Float4 aB, const Float4 aC) { return vaddq_f32(vmulq_f32(aA, aB), aC); }
+inline Float4 Min(const Float4 aA, const Float4 aB) { return vminq_f32(aA, aB); }
+inline Mask4 GreaterEqual(const Float4 aA, const Float4 aB) { return vcgeq_f32(aA, aB); }
+inline Mask4 And(const Mask4 aA, const Mask4 aB) { return vandq_u32(aA, aB); }
+inline Float4 Select(const Mask4 aMask, const Float4 aA, const Float4 aB) { return vbslq_f32(aMask, aA, aB); }
+inline bool Any(const Mask4 aMask) {
+  const uint32x2_t kHalf = vorr_u32(vget_low_u32(aMask), vget_high_u32(aMask));
+  return (vget_lane_u32(kHalf, 0) | vget_lane_u32(kHalf, 1)) != 0;
+}
+#else
+struct Float4 { float v[4]; };
+struct Mask4 { bool v[4]; };
+inline Float4 Splat(const float aValue) { return Float4{{aValue, aValue, aValue, aValue}}; }
+inline Float4 Ramp(const float aValue) { return Float4{{aValue, aValue + 1.0f, aValue + 2.0f, aValue + 3.0f}}; }
+inline Float4 Load(const float* aData) { return Float4{{aData[0], aData[1], aData[2], aData[3]}}; }
+inline void Store(float* aData, const Float4 aValue) { std::copy(aValue.v, aValue.v + 4, aData); }
+inline Float4 MulAdd(const Float4 aA, const Float4 aB, const Float4 aC) {
+  Float4 result;
+  for (int ix = 0; ix < 4; ix++) { result.v[ix] = (aA.v[ix] * aB.v[ix]) + aC.v[ix]; }
+  return result;
+}
+inline Float4 Min(const Float4 aA, const Float4 aB) {
+  Float4 result;
+  for (int ix = 0; ix < 4; ix++) { result.v[ix] = std::min(aA.v[ix], aB.v[ix]); }
+  return result;
+}
+inline Mask4 GreaterEqual(const Float4 aA, const Float4 aB) {
+  Mask4 result;
+  for (int ix = 0; ix < 4; ix++) { result.v[ix] = aA.v[ix] >= aB.v[ix]; }
+  return result;
+}
+inline Mask4 And(const Mask4 aA, const Mask4 aB) {
+  Mask4 result;
+  for (int ix = 0; ix < 4; ix++) { result.v[ix] = aA.v[ix] && aB.v[ix]; }
+  return result;
+}
+inline Float4 Select(const Mask4 aMask, const Float4 aA, const Float4 aB) {
+  Float4 result;
+  for (int ix = 0; ix < 4; ix++) { result.v[ix] = aMask.v[ix] ? aA.v[ix] : aB.v[ix]; }
+  return result;
+}
+inline bool Any(const Mask4 aMask) { return aMask.v[0] || aMask.v[1] || aMask.v[2] || aMask.v[3]; }
+#endif
+
+struct ClipVertex {
+  float x, y, z, w;
+};
+
+ClipVertex
+ToClip(const vrb::Matrix& aMatrix, const vrb::Vector& aPoint) {
+  ClipVertex result;
+  result.x = (aMatrix.At(0, 0) * aPoint.x()) + (aMatrix.At(1, 0) * aPoint.y()) + (aMatrix.At(2, 0) * aPoint.z()) + aMatrix.At(3, 0);
+  result.y = (aMatrix.At(0, 1) * aPoint.x()) + (aMatrix.At(1, 1) * aPoint.y()) + (aMatrix.At(2, 1) * aPoint.z()) + aMatrix.At(3, 1);
+  result.z = (aMatrix.At(0, 2) * aPoint.x()) + (aMatrix.At(1, 2) * aPoint.y()) + (aMatrix.At(2, 2) * aPoint.z()) + aMatrix.At(3, 2);
+  result.w = (aMatrix.At(0, 3) * aPoint.x()) + (aMatrix.At(1, 3) * aPoint.y()) + (aMatrix.At(2, 3) * aPoint.z()) + aMatrix.At(3, 3);
+  return result;
+}
+
+// Signed distance to the near plane, z = -w in clip space.
+inline float
+NearDistance(const ClipVertex& aVertex) {
+  return aVertex.z + aVertex.w;
+}
+
+}
+
+namespace vrb {
+
+struct OcclusionBuffer::State {
+  int32_t width;
+  int32_t height;
+  std::vector<float> depth;
+  Matrix viewProjection;
+  int32_t triangleCount;
+
+  State()
+      : width(kDefaultWidth)
+      , height(kDefaultHeight)
+      , viewProjection(Matrix::Identity())
+      , triangleCount(0)
+  {}
+
+  void ToScreen(const ClipVertex& aVertex, float& aX, float& aY, float& aZ) const {
+    const float kInverseW = 1.0f / aVertex.w;
+    aX = ((aVertex.x * kInverseW) * 0.5f + 0.5f) * width;
+    aY = ((aVertex.y * kInverseW) * 0.5f + 0.5f) * height;
+    aZ = aVertex.z * kInverseW;
+  }
+
+  void RasterizeClipped(const ClipVertex& aV0, const ClipVertex& aV1, const ClipVertex& aV2);
+  void RasterizeScreen(const float* aX, const float* aY, const float* aZ);
+};
+
+void
+OcclusionBuffer::State::RasterizeClipped(const ClipVertex& aV0, const ClipVertex& aV1, const ClipVertex& aV2) {
+  const ClipVertex kInput[3] = {aV0, aV1, aV2};
+  // Clipping a triangle against one plane leaves at most four vertices.
+  ClipVertex polygon[4];
+  int count = 0;
+  for (int ix = 0; ix < 3; ix++) {
+    const ClipVertex& current = kInput[ix];
+    const ClipVertex& next = kInput[(ix + 1) % 3];
+    const float kCurrentDistance = NearDistance(current);
+    const float kNextDistance = NearDistance(next);
+    if (kCurrentDistance >= 0.0f) {
+      polygon[count++] = current;
+    }
+    if ((kCurrentDistance >= 0.0f) != (kNextDistance >= 0.0f)) {
+      const float kT = kCurrentDistance / (kCurrentDistance - kNextDistance);
+      ClipVertex& result = polygon[count++];
+      result.x = current.x + ((next.x - current.x) * kT);
+      result.y = current.y + ((next.y - current.y) * kT);
+      result.z = current.z + ((next.z - current.z) * kT);
+      result.w = current.w + ((next.w - current.w) * kT);
+    }
+  }
+  for (int ix = 0; ix < count; ix++) {
+    if (polygon[ix].w <= 0.0f) {
+      return;
+    }
+  }
+  for (int ix = 1; ix + 1 < count; ix++) {
+    float x[3], y[3], z[3];
+    ToScreen(polygon[0], x[0], y[0], z[0]);
+    ToScreen(polygon[ix], x[1], y[1], z[1]);
+    ToScreen(polygon[ix + 1], x[2], y[2], z[2]);
+    RasterizeScreen(x, y, z);
+  }
+}
+
+void
+OcclusionBuffer::State::RasterizeScreen(const float* aX, const float* aY, const float* aZ) {
+  float area = ((aX[1] - aX[0]) * (aY[2] - aY[0])) - ((aX[2] - aX[0]) * (aY[1] - aY[0]));
+  if (std::fabs(area) < 1e-6f) {
+    return;
+  }
+  // Occluders are two sided, flip clockwise triangles.
+  int order[3] = {0, 1, 2};
+  if (area < 0.0f) {
+    std::swap(order[1], order[2]);
+    area = -area;
+  }
+  const float kX[3] = {aX[order[0]], aX[order[1]], aX[order[2]]};
+  const float kY[3] = {aY[order[0]], aY[order[1]], aY[order[2]]};
+  const float kZ[3] = {aZ[order[0]], aZ[order[1]], aZ[order[2]]};
+
+  const int32_t kMinX = std::max(0, (int32_t)std::floor(std::min(kX[0], std::min(kX[1], kX[2])))) & ~3;
+  const int32_t kMaxX = std::min(width - 1, (int32_t)std::ceil(std::max(kX[0], std::max(kX[1], kX[2]))));
+  const int32_t kMinY = std::max(0, (int32_t)std::floor(std::min(kY[0], std::min(kY[1], kY[2]))));
+  const int32_t kMaxY = std::min(height - 1, (int32_t)std::ceil(std::max(kY[0], std::max(kY[1], kY[2]))));
+  if ((kMinX > kMaxX) || (kMinY > kMaxY)) {
+    return;
+  }
+
+  // Edge functions, edge i is opposite vertex i and evaluates to the
+  // triangle area at that vertex.
+  float a[3], b[3], c[3];
+  for (int ix = 0; ix < 3; ix++) {
+    const int kFrom = (ix + 1) % 3;
+    const int kTo = (ix + 2) % 3;
+    a[ix] = kY[kFrom] - kY[kTo];
+    b[ix] = kX[kTo] - kX[kFrom];
+    c[ix] = (kX[kFrom] * kY[kTo]) - (kX[kTo] * kY[kFrom]);
+  }
+  // Depth is affine in screen space, interpolate it as a plane.
+  const float kInverseArea = 1.0f / area;
+  const float kDepthA = ((a[0] * kZ[0]) + (a[1] * kZ[1]) + (a[2] * kZ[2])) * kInverseArea;
+  const float kDepthB = ((b[0] * kZ[0]) + (b[1] * kZ[1]) + (b[2] * kZ[2])) * kInverseArea;
+  const float kDepthC = ((c[0] * kZ[0]) + (c[1] * kZ[1]) + (c[2] * kZ[2])) * kInverseArea;
+
+  const Float4 kZero = Splat(0.0f);
+  const Float4 kA0 = Splat(a[0]), kA1 = Splat(a[1]), kA2 = Splat(a[2]), kDA = Splat(kDepthA);
+  for (int32_t y = kMinY; y <= kMaxY; y++) {
+    const float kPixelY = y + 0.5f;
+    const Float4 kRow0 = Splat((b[0] * kPixelY) + c[0]);
+    const Float4 kRow1 = Splat((b[1] * kPixelY) + c[1]);
+    const Float4 kRow2 = Splat((b[2] * kPixelY) + c[2]);
+    const Float4 kRowDepth = Splat((kDepthB * kPixelY) + kDepthC);
+    float* row = &depth[(size_t)y * width];
+    for (int32_t x = kMinX; x <= kMaxX; x += 4) {
+      const Float4 kPixelX = Ramp(x + 0.5f);
+      const Mask4 kInside = And(And(GreaterEqual(MulAdd(kA0, kPixelX, kRow0), kZero),
+                                    GreaterEqual(MulAdd(kA1, kPixelX, kRow1), kZero)),
+                                GreaterEqual(MulAdd(kA2, kPixelX, kRow2), kZero));
+      if (!Any(kInside)) {
+        continue;
+      }
+      const Float4 kCurrent = Load(row + x);
+      const Float4 kDepth = MulAdd(kDA, kPixelX, kRowDepth);
+      Store(row + x, Select(kInside, Min(kCurrent, kDepth), kCurrent));
+    }
+  }
+  triangleCount++;
+}
+
+OcclusionBufferPtr
+OcclusionBuffer::Create() {
+  return std::make_shared<ConcreteClass<OcclusionBuffer, OcclusionBuffer::State> >();
+}
+
+void
+OcclusionBuffer::SetResolution(const int32_t aWidth, const int32_t aHeight) {
+  m.width = std::max(4, (aWidth + 3) & ~3);
+  m.height = std::max(1, aHeight);
+  m.depth.clear();
+}
+
+int32_t
+OcclusionBuffer::GetWidth() const {
+  return m.width;
+}
+
+int32_t
+OcclusionBuffer::GetHeight() const {
+  return m.height;
+}
+
+void
+OcclusionBuffer::Clear(const Matrix& aViewProjection) {
+  m.viewProjection = aViewProjection;
+  m.depth.assign((size_t)m.width * m.height, kEmptyDepth);
+  m.triangleCount = 0;
+}
+
+void
+OcclusionBuffer::RasterizeTriangles(const Matrix& aModel, const std::vector<Vector>& aPositions, const std::vector<GLushort>& aIndices) {
+  if (m.depth.empty()) {
+    Clear(m.viewProjection);
+  }
+  const Matrix kTransform = m.viewProjection.PostMultiply(aModel);
+  std::vector<ClipVertex> vertices(aPositions.size());
+  for (size_t ix = 0; ix < aPositions.size(); ix++) {
+    vertices[ix] = ToClip(kTransform, aPositions[ix]);
+  }
+  for (size_t ix = 0; ix + 2 < aIndices.size(); ix += 3) {
+    if ((aIndices[ix] >= vertices.size()) || (aIndices[ix + 1] >= vertices.size()) || (aIndices[ix + 2] >= vertices.size())) {
+      continue;
+    }
+    const ClipVertex& v0 = vertices[aIndices[ix]];
+    const ClipVertex& v1 = vertices[aIndices[ix + 1]];
+    const ClipVertex& v2 = vertices[aIndices[ix + 2]];
+    // Trivially reject triangles entirely outside of one frustum plane.
+    if (((v0.x > v0.w) && (v1.x > v1.w) && (v2.x > v2.w)) ||
+        ((v0.x < -v0.w) && (v1.x < -v1.w) && (v2.x < -v2.w)) ||
+        ((v0.y > v0.w) && (v1.y > v1.w) && (v2.y > v2.w)) ||
+        ((v0.y < -v0.w) && (v1.y < -v1.w) && (v2.y < -v2.w)) ||
+        ((NearDistance(v0) < 0.0f) && (NearDistance(v1) < 0.0f) && (NearDistance(v2) < 0.0f))) {
+      continue;
+    }
+    m.RasterizeClipped(v0, v1, v2);
+  }
+}
+
+bool
+OcclusionBuffer::IsBoxVisible(const Matrix& aModel, const Vector& aMin, const Vector& aMax) const {
+  if (m.depth.empty()) {
+    return true;
+  }
+  const Matrix kTransform = m.viewProjection.PostMultiply(aModel);
+  float minX = std::numeric_limits<float>::max();
+  float minY = minX;
+  float minZ = minX;
+  float maxX = -minX;
+  float maxY = -minX;
+  for (int corner = 0; corner < 8; corner++) {
+    const Vector kPoint((corner & 1) ? aMax.x() : aMin.x(), (corner & 2) ? aMax.y() : aMin.y(), (corner & 4) ? aMax.z() : aMin.z());
+    const ClipVertex kVertex = ToClip(kTransform, kPoint);
+    if ((NearDistance(kVertex) <= 0.0f) || (kVertex.w <= 0.0f)) {
+      return true;
+    }
+    float x, y, z;
+    m.ToScreen(kVertex, x, y, z);
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, z);
+  }
+
+  const int32_t kMinX = std::max(0, (int32_t)std::floor(minX));
+  const int32_t kMaxX = std::min(m.width - 1, (int32_t)std::ceil(maxX));
+  const int32_t kMinY = std::max(0, (int32_t)std::floor(minY));
+  const int32_t kMaxY = std::min(m.height - 1, (int32_t)std::ceil(maxY));
+  if ((kMinX > kMaxX) || (kMinY > kMaxY)) {
+    // Entirely off screen, the frustum test owns this case.
+    return true;
+  }
+  const Float4 kBoxDepth = Splat(minZ);
+  const Float4 kFirst = Splat((float)kMinX);
+  const Float4 kLast = Splat((float)kMaxX);
+  const int32_t kStartX = kMinX & ~3;
+  for (int32_t y = kMinY; y <= kMaxY; y++) {
+    const float* row = &m.depth[(size_t)y * m.width];
+    for (int32_t x = kStartX; x <= kMaxX; x += 4) {
+      const Float4 kColumn = Ramp((float)x);
+      const Mask4 kInRange = And(GreaterEqual(kColumn, kFirst), GreaterEqual(kLast, kColumn));
+      if (Any(And(kInRange, GreaterEqual(Load(row + x), kBoxDepth)))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int32_t
+OcclusionBuffer::GetTriangleCount() const {
+  return m.triangleCount;
+}
+
+const float*
+OcclusionBuffer::GetDepthData() const {
+  return m.depth.empty() ? nullptr : m.depth.data();
+}
+
+OcclusionBuffer::OcclusionBuffer(State& aState) : m(aState) {}
+OcclusionBuffer::~OcclusionBuffer() {}
+
+} // namespace vrb
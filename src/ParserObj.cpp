@@ -5,6 +5,7 @@
 
 #include "vrb/ParserObj.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/ConcreteClass.h"
 #include "vrb/CreationContext.h"
 #include "vrb/Vector.h"
@@ -432,6 +433,7 @@ ParserObj::LoadFailed(const int aFileHandle, const std::string& aReason) {
 
 void
 ParserObj::ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) {
+  VRB_ALLOCATION_SCOPE(Parse);
   std::string* lineBuffer = m.GetBuffer(aFileHandle);
 
   if (!lineBuffer) {
@@ -459,6 +461,7 @@ ParserObj::ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const
 
 void
 ParserObj::FinishRawFile(const int aFileHandle) {
+  VRB_ALLOCATION_SCOPE(Parse);
   m.Parse(aFileHandle, *this);
   m.Finish(aFileHandle);
 
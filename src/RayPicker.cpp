@@ -0,0 +1,102 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/RayPicker.h"
+
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Matrix.h"
+#include "vrb/Transform.h"
+#include "vrb/TriangleBVH.h"
+
+#include <limits>
+
+namespace {
+
+struct PickRay {
+  vrb::Vector origin;
+  vrb::Vector direction;
+};
+
+void
+PickGeometry(const vrb::GeometryPtr& aGeometry, const vrb::Matrix& aWorld, const PickRay& aRay, vrb::PickResult& aResult, bool& aFound) {
+  vrb::TriangleBVHPtr bvh = aGeometry->GetBVH();
+  if (!bvh) {
+    return;
+  }
+  const vrb::Matrix kInverse = aWorld.AfineInverse();
+  const vrb::Vector kOrigin = kInverse.MultiplyPosition(aRay.origin);
+  const vrb::Vector kDirection = kInverse.MultiplyDirection(aRay.direction);
+  vrb::TriangleBVH::TriangleFilter filter;
+  if (aGeometry->GetRangeCount() > 0) {
+    vrb::Geometry* geometry = aGeometry.get();
+    filter = [geometry](const int32_t aTriangle) {
+      const int32_t kRange = geometry->GetRangeForIndex(aTriangle * 3);
+      return (kRange < 0) || geometry->IsRangeEnabled(kRange);
+    };
+  }
+  vrb::TriangleBVH::Hit hit;
+  if (!bvh->Intersect(kOrigin, kDirection, std::numeric_limits<float>::max(), filter, hit)) {
+    return;
+  }
+  const vrb::Vector kPosition = aWorld.MultiplyPosition(hit.position);
+  const float kDistance = (kPosition - aRay.origin).Magnitude();
+  if (aFound && (kDistance >= aResult.distance)) {
+    return;
+  }
+  aFound = true;
+  aResult.geometry = aGeometry;
+  aResult.triangle = hit.triangle;
+  aResult.range = aGeometry->GetRangeForIndex(hit.triangle * 3);
+  aResult.distance = kDistance;
+  aResult.barycentric = hit.barycentric;
+  aResult.uv = hit.uv;
+  aResult.position = kPosition;
+  aResult.normal = kInverse.Transpose().MultiplyDirection(hit.normal).Normalize();
+}
+
+void
+PickNode(const vrb::NodePtr& aNode, const vrb::Matrix& aParent, const PickRay& aRay, vrb::PickResult& aResult, bool& aFound) {
+  vrb::GeometryPtr geometry = std::dynamic_pointer_cast<vrb::Geometry>(aNode);
+  if (geometry) {
+    PickGeometry(geometry, aParent, aRay, aResult, aFound);
+    return;
+  }
+  vrb::GroupPtr group = std::dynamic_pointer_cast<vrb::Group>(aNode);
+  if (!group) {
+    return;
+  }
+  vrb::Matrix world = aParent;
+  vrb::TransformPtr transform = std::dynamic_pointer_cast<vrb::Transform>(group);
+  if (transform) {
+    world = aParent.PostMultiply(transform->GetTransform());
+  }
+  for (int32_t ix = 0; ix < group->GetNodeCount(); ix++) {
+    const vrb::NodePtr& child = group->GetNode(ix);
+    if (group->IsEnabled(*child)) {
+      PickNode(child, world, aRay, aResult, aFound);
+    }
+  }
+}
+
+}
+
+namespace vrb {
+
+bool
+PickNearest(const NodePtr& aRoot, const Vector& aOrigin, const Vector& aDirection, PickResult& aResult) {
+  aResult = PickResult();
+  if (!aRoot) {
+    return false;
+  }
+  PickRay ray;
+  ray.origin = aOrigin;
+  ray.direction = aDirection.Normalize();
+  bool found = false;
+  PickNode(aRoot, Matrix::Identity(), ray, aResult, found);
+  return found;
+}
+
+} // namespace vrb
@@ -8,6 +8,7 @@
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/private/UpdatableState.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/ContextSynchronizer.h"
 #include "vrb/CreationContext.h"
 #if defined(ANDROID)
@@ -15,26 +16,52 @@
 #include "vrb/FileReaderAndroid.h"
 #endif // defined(ANDROID)
 #include "vrb/DataCache.h"
+#include "vrb/DrawableRegistry.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLExtensions.h"
+#include "vrb/GeometryCache.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
 #include "vrb/ResourceGL.h"
 #if defined(ANDROID)
 #include "vrb/SurfaceTextureFactory.h"
 #endif // defined(ANDROID)
+#include "vrb/RenderStateCache.h"
+#include "vrb/RenderStats.h"
 #include "vrb/TextureCache.h"
 #include "vrb/Updatable.h"
 #if defined(ANDROID)
 #include <EGL/egl.h>
 #endif // defined(ANDROID)
 #include <pthread.h>
+#include <time.h>
 #include <vector>
 
+namespace {
+
+const float kDefaultRestoreBudget = 2.0f;
+
+float
+MillisecondsSince(const timespec& aStart) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (float)(now.tv_sec - aStart.tv_sec) * 1000.0f + (float)(now.tv_nsec - aStart.tv_nsec) / 1000000.0f;
+}
+
+}
+
 namespace vrb {
 
 struct RenderContext::State {
   pthread_t threadSelf;
   TextureCachePtr textureCache;
   DataCachePtr dataCache;
+  RenderStateCachePtr renderStateCache;
+  GeometryCachePtr geometryCache;
+  DrawableRegistryPtr drawableRegistry;
+  RenderStatsPtr renderStats;
+  GpuMemoryLedgerPtr gpuMemoryLedger;
+  GLDeletionQueuePtr deletionQueue;
   CreationContextPtr creationContext;
   GLExtensionsPtr glExtensions;
 #if defined(ANDROID)
@@ -46,8 +73,13 @@ struct RenderContext::State {
   UpdatableList updatables;
   ResourceGLList uninitializedResources;
   ResourceGLList resources;
+  // Resources waiting to be restored after InitializeGL, in restore order.
+  ResourceGLList restoring;
+  float restoreBudget;
   std::vector<ContextSynchronizerPtr> synchronizers;
   State();
+  void StartRestore();
+  void RestoreResources();
 };
 
 RenderContext::State::State()
@@ -57,8 +89,46 @@ RenderContext::State::State()
 #endif // defined(ANDROID)
     , dataCache(DataCache::Create())
     , textureCache(TextureCache::Create())
+    , renderStateCache(RenderStateCache::Create())
+    , geometryCache(GeometryCache::Create())
+    , drawableRegistry(DrawableRegistry::Create())
+    , renderStats(RenderStats::Create())
+    , gpuMemoryLedger(GpuMemoryLedger::Create())
+    , deletionQueue(GLDeletionQueue::Create())
+    , restoreBudget(kDefaultRestoreBudget)
 {}
 
+void
+RenderContext::State::StartRestore() {
+  if (!restoring.IsDirty()) {
+    return;
+  }
+  restoring.SortForRestore();
+  std::vector<uint32_t> handles;
+  restoring.GetRestoreDataHandles(handles);
+  dataCache->Prefetch(handles);
+}
+
+void
+RenderContext::State::RestoreResources() {
+  if (!restoring.IsDirty()) {
+    return;
+  }
+  timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  // Always restore at least one resource so the restore finishes even when
+  // a single upload takes longer than the budget.
+  while (restoring.RestoreNext(resources)) {
+    if (MillisecondsSince(start) >= restoreBudget) {
+      break;
+    }
+  }
+  if (!restoring.IsDirty()) {
+    VRB_LOG("Finished restoring GL resources");
+    dataCache->DropPrefetchedData();
+  }
+}
+
 RenderContextPtr
 RenderContext::Create() {
   RenderContextPtr result = std::make_shared<ConcreteClass<RenderContext, RenderContext::State> >();
@@ -110,18 +180,39 @@ RenderContext::InitializeGL() {
   }
   m.eglContext = current;
 #endif // defined(ANDROID)
+  // Anything still queued was created before this context, for instance by one
+  // lost without a ShutdownGL(). Its names may already be reused.
+  m.deletionQueue->Discard();
+  // Textures are restored over the following frames by Update(), everything
+  // else is needed to draw the first frame.
+  m.resources.GetDeferredRestoreResources(m.restoring);
   m.resources.InitializeGL();
   m.glExtensions->Initialize();
+  m.StartRestore();
   return true;
 }
 
 void
 RenderContext::ShutdownGL() {
+  // Resources still waiting for a restore go back with the others.
+  m.restoring.ClearRestorePending();
+  m.resources.AppendAndAdoptList(m.restoring);
+  m.dataCache->DropPrefetchedData();
   m.resources.ShutdownGL();
+  m.deletionQueue->Flush();
+  if (m.gpuMemoryLedger->GetOwnerCount() > 0) {
+    m.gpuMemoryLedger->LogReport();
+  }
 }
 
 void
 RenderContext::Update() {
+  // Each Update() closes the previous frame's allocation counts.
+  if (AllocationTracker::IsEnabled()) {
+    AllocationTracker::EndFrame();
+    AllocationTracker::BeginFrame();
+  }
+  m.renderStats->NextFrame();
   m.creationContext->Synchronize();
   for(auto iter = m.synchronizers.begin(); iter != m.synchronizers.end();) {
     bool active = true;
@@ -135,7 +226,12 @@ RenderContext::Update() {
   if (m.uninitializedResources.Update()) {
     m.resources.AppendAndAdoptList(m.uninitializedResources);
   }
+  m.RestoreResources();
+  m.textureCache->UpdateStreaming(m.renderStats->GetFrameNumber());
   m.updatables.UpdateResource(*this);
+  // Drawables dropped from the scene are released once a frame has not used them.
+  m.drawableRegistry->RetireFrame();
+  m.deletionQueue->Drain();
 }
 
 DataCachePtr&
@@ -148,6 +244,51 @@ RenderContext::GetTextureCache() {
   return m.textureCache;
 }
 
+RenderStateCachePtr&
+RenderContext::GetRenderStateCache() {
+  return m.renderStateCache;
+}
+
+GeometryCachePtr&
+RenderContext::GetGeometryCache() {
+  return m.geometryCache;
+}
+
+DrawableRegistryPtr&
+RenderContext::GetDrawableRegistry() {
+  return m.drawableRegistry;
+}
+
+RenderStatsPtr&
+RenderContext::GetRenderStats() {
+  return m.renderStats;
+}
+
+GpuMemoryLedgerPtr&
+RenderContext::GetGpuMemoryLedger() {
+  return m.gpuMemoryLedger;
+}
+
+GLDeletionQueuePtr&
+RenderContext::GetGLDeletionQueue() {
+  return m.deletionQueue;
+}
+
+void
+RenderContext::SetRestoreBudget(const float aMilliseconds) {
+  m.restoreBudget = aMilliseconds;
+}
+
+float
+RenderContext::GetRestoreBudget() const {
+  return m.restoreBudget;
+}
+
+bool
+RenderContext::IsRestoringResources() {
+  return m.restoring.IsDirty();
+}
+
 CreationContextPtr&
 RenderContext::GetRenderThreadCreationContext() {
   return m.creationContext;
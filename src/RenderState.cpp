@@ -8,9 +8,13 @@
 
 #include "vrb/Color.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
 #include "vrb/Logger.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Matrix.h"
+#include "vrb/RenderStats.h"
 #include "vrb/ShaderUtil.h"
 #include "vrb/Texture.h"
 #if defined(ANDROID)
@@ -19,6 +23,7 @@
 #include "vrb/Vector.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -32,6 +37,8 @@ static const char* sVertexShaderSource = R"SHADER(
 #define MAX_LIGHTS 2
 #define VRB_USE_TEXTURE VRB_TEXTURE_STATE
 #define VRB_UV_TYPE VRB_TEXTURE_UV_TYPE
+#define VRB_INSTANCED VRB_INSTANCED_STATE
+#define VRB_UV_TRANSFORM VRB_UV_TRANSFORM_STATE
 
 struct Light {
   vec3 direction;
@@ -60,9 +67,20 @@ attribute vec3 a_normal;
 
 varying vec4 v_color;
 
+#if VRB_INSTANCED
+attribute mat4 a_instanceModel;
+attribute vec4 a_instanceTint;
+#define VRB_MODEL_MATRIX a_instanceModel
+#else
+#define VRB_MODEL_MATRIX u_model
+#endif // VRB_INSTANCED
+
 #ifdef VRB_USE_TEXTURE
 attribute VRB_UV_TYPE a_uv;
 varying VRB_UV_TYPE v_uv;
+#if VRB_UV_TRANSFORM
+uniform vec4 u_uvTransform;
+#endif // VRB_UV_TRANSFORM
 #endif // VRB_USE_TEXTURE
 
 vec4 normal;
@@ -88,7 +106,7 @@ calculate_light(int index) {
 void main(void) {
   int ix;
   v_color = vec4(0, 0, 0, 0);
-  normal = normalize(u_view * u_model * vec4(a_normal.xyz, 0));
+  normal = normalize(u_view * VRB_MODEL_MATRIX * vec4(a_normal.xyz, 0));
   for(ix = 0; ix < MAX_LIGHTS; ix++) {
     if (ix >= u_lightCount) {
       break;
@@ -100,10 +118,17 @@ void main(void) {
     v_color = u_material.diffuse;
   }
   v_color *= u_tintColor;
+#if VRB_INSTANCED
+  v_color *= a_instanceTint;
+#endif // VRB_INSTANCED
 #ifdef VRB_USE_TEXTURE
+#if VRB_UV_TRANSFORM
+  v_uv = a_uv * u_uvTransform.zw + u_uvTransform.xy;
+#else
   v_uv = a_uv;
+#endif // VRB_UV_TRANSFORM
 #endif // VRB_USE_TEXTURE
-  gl_Position = u_perspective * u_view * u_model * vec4(a_position.xyz, 1);
+  gl_Position = u_perspective * u_view * VRB_MODEL_MATRIX * vec4(a_position.xyz, 1);
 }
 
 )SHADER";
@@ -189,23 +214,59 @@ struct RenderState::State : public ResourceGL::State {
         , specular(0)
     {}
   };
-  GLuint vertexShader;
-  GLuint fragmentShader;
-  GLuint program;
-  GLint uPerspective;
-  GLint uView;
-  GLint uModel;
-  GLint uLightCount;
-  ULight uLights[MaxLights];
-  GLint uMatterialAmbient;
-  GLint uMatterialDiffuse;
-  GLint uMatterialSpecular;
-  GLint uMatterialSpecularExponent;
-  GLint uTexture0;
-  GLint uTintColor;
-  GLint aPosition;
-  GLint aNormal;
-  GLint aUV;
+  struct ProgramState {
+    GLuint vertexShader;
+    GLuint fragmentShader;
+    GLuint program;
+    GLint uPerspective;
+    GLint uView;
+    GLint uModel;
+    GLint uLightCount;
+    ULight uLights[MaxLights];
+    GLint uMatterialAmbient;
+    GLint uMatterialDiffuse;
+    GLint uMatterialSpecular;
+    GLint uMatterialSpecularExponent;
+    GLint uTexture0;
+    GLint uUVTransform;
+    GLint uTintColor;
+    GLint aPosition;
+    GLint aNormal;
+    GLint aUV;
+    GLint aInstanceModel;
+    GLint aInstanceTint;
+    bool updateLights;
+    bool updateMaterial;
+    GLint binaryLength;
+
+    ProgramState()
+        : vertexShader(0)
+        , fragmentShader(0)
+        , program(0)
+        , uPerspective(-1)
+        , uView(-1)
+        , uModel(-1)
+        , uLightCount(-1)
+        , uMatterialAmbient(-1)
+        , uMatterialDiffuse(-1)
+        , uMatterialSpecular(-1)
+        , uMatterialSpecularExponent(-1)
+        , uTexture0(-1)
+        , uUVTransform(-1)
+        , uTintColor(-1)
+        , aPosition(-1)
+        , aNormal(-1)
+        , aUV(-1)
+        , aInstanceModel(-1)
+        , aInstanceTint(-1)
+        , updateLights(false)
+        , updateMaterial(true)
+        , binaryLength(0)
+    {}
+  };
+  ProgramState standard;
+  ProgramState instanced;
+  ProgramState* current;
   std::vector<Light> lights;
   Color ambient;
   Color diffuse;
@@ -214,38 +275,212 @@ struct RenderState::State : public ResourceGL::State {
   TexturePtr texture;
   Color tintColor;
   uint32_t lightId;
-  bool updateLights;
-  bool updateMaterial;
   bool lightsEnabled;
+  RenderState* self;
+  std::vector<RenderStateObserverWeak> observers;
+  RenderStatsPtr stats;
+  GpuMemoryLedgerPtr ledger;
+  GLDeletionQueuePtr deletionQueue;
 
   State()
-      : vertexShader(0)
-      , fragmentShader(0)
-      , program(0)
-      , uPerspective(-1)
-      , uView(-1)
-      , uModel(-1)
-      , uLightCount(-1)
-      , uMatterialAmbient(-1)
-      , uMatterialDiffuse(-1)
-      , uMatterialSpecular(-1)
-      , uMatterialSpecularExponent(-1)
-      , uTexture0(-1)
-      , uTintColor(-1)
-      , aPosition(-1)
-      , aNormal(-1)
-      , aUV(-1)
+      : current(&standard)
       , specularExponent(0.0f)
       , ambient(0.5f, 0.5f, 0.5f, 1.0f) // default to gray
       , diffuse(1.0f, 1.0f, 1.0f, 1.0f) // default to white
       , tintColor(1.0f, 1.0f, 1.0f, 1.0f)
       , lightId(0)
-      , updateLights(false)
-      , updateMaterial(true)
       , lightsEnabled(true)
+      , self(nullptr)
   {}
+
+  void NotifyObservers();
+  void CompileProgram(ProgramState& aProgram, const bool aInstanced);
+  void DeleteProgram(ProgramState& aProgram);
+  void UpdateLedger();
+  void UpdateUniforms(ProgramState& aProgram, const Matrix& aPerspective, const Matrix& aView);
 };
 
+void
+RenderState::State::NotifyObservers() {
+  if (observers.empty()) {
+    return;
+  }
+  std::vector<RenderStateObserverWeak> current(observers);
+  for (RenderStateObserverWeak& weak: current) {
+    RenderStateObserverPtr observer = weak.lock();
+    if (observer) {
+      observer->RenderStateChanged(*self);
+    }
+  }
+  observers.erase(std::remove_if(observers.begin(), observers.end(), [](const RenderStateObserverWeak& aObserver) {
+    return aObserver.expired();
+  }), observers.end());
+}
+
+void
+RenderState::State::CompileProgram(ProgramState& aProgram, const bool aInstanced) {
+  const bool kEnableTexturing = texture != nullptr;
+  std::string vertexShaderSource = sVertexShaderSource;
+  const std::string kTextureUVMacro("VRB_TEXTURE_UV_TYPE");
+  const size_t kUVStart = vertexShaderSource.find(kTextureUVMacro);
+  if (kUVStart != std::string::npos) {
+    vertexShaderSource.replace(kUVStart, kTextureUVMacro.length(), texture && texture->GetTarget() == GL_TEXTURE_CUBE_MAP ? "vec3" : "vec2");
+  }
+
+  // Only 2D textures can be packed into an atlas.
+  const bool kUVTransform = kEnableTexturing && (texture->GetTarget() == GL_TEXTURE_2D);
+  const std::string kUVTransformMacro("VRB_UV_TRANSFORM_STATE");
+  const size_t kUVTransformStart = vertexShaderSource.find(kUVTransformMacro);
+  if (kUVTransformStart != std::string::npos) {
+    vertexShaderSource.replace(kUVTransformStart, kUVTransformMacro.length(), kUVTransform ? "1" : "0");
+  }
+
+  const std::string kInstancedMacro("VRB_INSTANCED_STATE");
+  const size_t kInstancedStart = vertexShaderSource.find(kInstancedMacro);
+  if (kInstancedStart != std::string::npos) {
+    vertexShaderSource.replace(kInstancedStart, kInstancedMacro.length(), aInstanced ? "1" : "0");
+  }
+
+  const std::string kTextureMacro("VRB_TEXTURE_STATE");
+  const size_t kStart = vertexShaderSource.find(kTextureMacro);
+  if (kEnableTexturing) {
+    if(kStart != std::string::npos) {
+      vertexShaderSource.replace(kStart, kTextureMacro.length(), "1");
+    }
+    aProgram.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+    const char* frag = sFragmentTextureShaderSource;
+    if (texture->GetTarget() == GL_TEXTURE_CUBE_MAP) {
+      frag = sFragmentCubeMapTextureShaderSource;
+    }
+#if defined(ANDROID)
+    // SurfaceTexture requires usage of fragment shader extension.
+    if (dynamic_cast<TextureSurface*>(texture.get()) != nullptr) {
+      frag = sFragmentSurfaceTextureShaderSource;
+    }
+#endif // defined(ANDROID)
+    aProgram.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, frag);
+  } else {
+    if(kStart != std::string::npos) {
+      vertexShaderSource.replace(kStart, kTextureMacro.length(), "0");
+    }
+    aProgram.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
+    aProgram.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, sFragmentShaderSource);
+  }
+  if (aProgram.fragmentShader && aProgram.vertexShader) {
+    aProgram.program = CreateProgram(aProgram.vertexShader, aProgram.fragmentShader);
+  }
+  if (aProgram.program) {
+    aProgram.uPerspective = GetUniformLocation(aProgram.program, "u_perspective");
+    aProgram.uView = GetUniformLocation(aProgram.program, "u_view");
+    if (!aInstanced) {
+      aProgram.uModel = GetUniformLocation(aProgram.program, "u_model");
+    }
+    aProgram.uLightCount = GetUniformLocation(aProgram.program, "u_lightCount");
+    const std::string structNameOpen("u_lights[");
+    const std::string structNameClose("].");
+    const std::string directionName("direction");
+    const std::string ambientName("ambient");
+    const std::string diffuseName("diffuse");
+    const std::string specularName("specular");
+    for (int ix = 0; ix < MaxLights; ix++) {
+      const std::string structName = structNameOpen + std::to_string(ix) + structNameClose;
+      const std::string direction = structName + directionName;
+      const std::string ambient = structName + ambientName;
+      const std::string diffuse = structName + diffuseName;
+      const std::string specular = structName + specularName;
+      aProgram.uLights[ix].direction = GetUniformLocation(aProgram.program, direction);
+      aProgram.uLights[ix].ambient = GetUniformLocation(aProgram.program, ambient);
+      aProgram.uLights[ix].diffuse = GetUniformLocation(aProgram.program, diffuse);
+      aProgram.uLights[ix].specular = GetUniformLocation(aProgram.program, specular);
+    }
+    const std::string materialName("u_material.");
+    const std::string specularExponentName("specularExponent");
+    const std::string ambient = materialName + ambientName;
+    const std::string diffuse = materialName + diffuseName;
+    const std::string specular = materialName + specularName;
+    const std::string specularExponent = materialName + specularExponentName;
+    aProgram.uMatterialAmbient = GetUniformLocation(aProgram.program, ambient);
+    aProgram.uMatterialDiffuse = GetUniformLocation(aProgram.program, diffuse);
+    aProgram.uMatterialSpecular = GetUniformLocation(aProgram.program, specular);
+    aProgram.uMatterialSpecularExponent = GetUniformLocation(aProgram.program, specularExponent);
+    if (kEnableTexturing) {
+      const std::string texture0("u_texture0");
+      aProgram.uTexture0 = GetUniformLocation(aProgram.program, texture0);
+    }
+    if (kUVTransform) {
+      aProgram.uUVTransform = GetUniformLocation(aProgram.program, "u_uvTransform");
+    }
+    aProgram.uTintColor = GetUniformLocation(aProgram.program, "u_tintColor");
+    aProgram.aPosition = GetAttributeLocation(aProgram.program, "a_position");
+    aProgram.aNormal = GetAttributeLocation(aProgram.program, "a_normal");
+    if (kEnableTexturing) {
+      aProgram.aUV = GetAttributeLocation(aProgram.program, "a_uv");
+    }
+    if (aInstanced) {
+      aProgram.aInstanceModel = GetAttributeLocation(aProgram.program, "a_instanceModel");
+      aProgram.aInstanceTint = GetAttributeLocation(aProgram.program, "a_instanceTint");
+    }
+    aProgram.updateLights = true;
+    aProgram.updateMaterial = true;
+    // The size of the linked binary is the closest estimate of the program's footprint.
+    VRB_GL_CHECK(glGetProgramiv(aProgram.program, GL_PROGRAM_BINARY_LENGTH, &aProgram.binaryLength));
+  }
+  UpdateLedger();
+}
+
+void
+RenderState::State::DeleteProgram(ProgramState& aProgram) {
+  deletionQueue->DeleteProgram(aProgram.program);
+  deletionQueue->DeleteShader(aProgram.vertexShader);
+  deletionQueue->DeleteShader(aProgram.fragmentShader);
+  aProgram = ProgramState();
+}
+
+void
+RenderState::State::UpdateLedger() {
+  if (ledger) {
+    ledger->Set(this, GpuMemoryCategory::Program, (uint64_t)(standard.binaryLength + instanced.binaryLength), "RenderState");
+  }
+}
+
+void
+RenderState::State::UpdateUniforms(ProgramState& aProgram, const Matrix& aPerspective, const Matrix& aView) {
+  if (aProgram.updateLights) {
+    aProgram.updateLights = false;
+    int lightCount = 0;
+    if (lightsEnabled) {
+      for (State::Light& light: lights) {
+        VRB_GL_CHECK(glUniform3f(aProgram.uLights[lightCount].direction, light.direction.x(), light.direction.y(), light.direction.z()));
+        VRB_GL_CHECK(glUniform4fv(aProgram.uLights[lightCount].ambient, 1, light.ambient.Data()));
+        VRB_GL_CHECK(glUniform4fv(aProgram.uLights[lightCount].diffuse, 1, light.diffuse.Data()));
+        VRB_GL_CHECK(glUniform4fv(aProgram.uLights[lightCount].specular, 1, light.specular.Data()));
+        lightCount++;
+      }
+    }
+    VRB_GL_CHECK(glUniform1i(aProgram.uLightCount, lightCount));
+  }
+  if (aProgram.updateMaterial) {
+    aProgram.updateMaterial = false;
+     VRB_GL_CHECK(glUniform4fv(aProgram.uMatterialAmbient, 1, ambient.Data()));
+     VRB_GL_CHECK(glUniform4fv(aProgram.uMatterialDiffuse, 1, diffuse.Data()));
+     VRB_GL_CHECK(glUniform4fv(aProgram.uMatterialSpecular, 1, specular.Data()));
+     VRB_GL_CHECK(glUniform1f(aProgram.uMatterialSpecularExponent, specularExponent));
+  }
+  if (texture) {
+    VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
+    texture->Bind();
+    VRB_GL_CHECK(glUniform1i(aProgram.uTexture0, 0));
+    if (aProgram.uUVTransform >= 0) {
+      float offsetU, offsetV, scaleU, scaleV;
+      texture->GetUVTransform(offsetU, offsetV, scaleU, scaleV);
+      VRB_GL_CHECK(glUniform4f(aProgram.uUVTransform, offsetU, offsetV, scaleU, scaleV));
+    }
+  }
+  VRB_GL_CHECK(glUniform4f(aProgram.uTintColor, tintColor.Red(), tintColor.Green(), tintColor.Blue(), tintColor.Alpha()));
+  VRB_GL_CHECK(glUniformMatrix4fv(aProgram.uPerspective, 1, GL_FALSE, aPerspective.Data()));
+  VRB_GL_CHECK(glUniformMatrix4fv(aProgram.uView, 1, GL_FALSE, aView.Data()));
+}
+
 RenderStatePtr
 RenderState::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<RenderState, RenderState::State>>(aContext);
@@ -253,22 +488,32 @@ RenderState::Create(CreationContextPtr& aContext) {
 
 GLuint
 RenderState::Program() const {
-  return m.program;
+  return m.current->program;
 }
 
 GLint
 RenderState::AttributePosition() const {
-  return m.aPosition;
+  return m.current->aPosition;
 }
 
 GLint
 RenderState::AttributeNormal() const {
-  return m.aNormal;
+  return m.current->aNormal;
 }
 
 GLint
 RenderState::AttributeUV() const {
-  return m.aUV;
+  return m.current->aUV;
+}
+
+GLint
+RenderState::AttributeInstanceModel() const {
+  return m.current->aInstanceModel;
+}
+
+GLint
+RenderState::AttributeInstanceTint() const {
+  return m.current->aInstanceTint;
 }
 
 uint32_t
@@ -279,7 +524,8 @@ RenderState::GetLightId() const {
 void
 RenderState::ResetLights(const uint32_t aId) {
   m.lightId = aId;
-  m.updateLights = true;
+  m.standard.updateLights = true;
+  m.instanced.updateLights = true;
   m.lights.clear();
 }
 
@@ -294,20 +540,26 @@ RenderState::SetMaterial(const Color& aAmbient, const Color& aDiffuse, const Col
   m.diffuse = aDiffuse;
   m.specular = aSpecular;
   m.specularExponent = aSpecularExponent;
-  m.updateMaterial = true;
+  m.standard.updateMaterial = true;
+  m.instanced.updateMaterial = true;
+  m.NotifyObservers();
 }
 
 
 void
 RenderState::SetAmbient(const Color& aColor) {
   m.ambient = aColor;
-  m.updateMaterial = true;
+  m.standard.updateMaterial = true;
+  m.instanced.updateMaterial = true;
+  m.NotifyObservers();
 }
 
 void
 RenderState::SetDiffuse(const Color& aColor) {
   m.diffuse = aColor;
-  m.updateMaterial = true;
+  m.standard.updateMaterial = true;
+  m.instanced.updateMaterial = true;
+  m.NotifyObservers();
 }
 
 void
@@ -326,6 +578,7 @@ RenderState::GetTexture() const {
 void
 RenderState::SetTexture(const TexturePtr& aTexture) {
   m.texture = aTexture;
+  m.NotifyObservers();
 }
 
 bool
@@ -341,42 +594,36 @@ RenderState::GetTintColor() const {
 void
 RenderState::SetTintColor(const Color& aColor) {
   m.tintColor = aColor;
+  m.NotifyObservers();
 }
 
 bool
 RenderState::Enable(const Matrix& aPerspective, const Matrix& aView, const Matrix& aModel) {
-  if (!m.program) { return false; }
-  VRB_GL_CHECK(glUseProgram(m.program));
-  if (m.updateLights) {
-    m.updateLights = false;
-    int lightCount = 0;
-    if (m.lightsEnabled) {
-      for (State::Light& light: m.lights) {
-        VRB_GL_CHECK(glUniform3f(m.uLights[lightCount].direction, light.direction.x(), light.direction.y(), light.direction.z()));
-        VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].ambient, 1, light.ambient.Data()));
-        VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].diffuse, 1, light.diffuse.Data()));
-        VRB_GL_CHECK(glUniform4fv(m.uLights[lightCount].specular, 1, light.specular.Data()));
-        lightCount++;
-      }
-    }
-    VRB_GL_CHECK(glUniform1i(m.uLightCount, lightCount));
+  m.current = &m.standard;
+  if (!m.standard.program) { return false; }
+  VRB_GL_CHECK(glUseProgram(m.standard.program));
+  if (m.stats) {
+    m.stats->CountProgram(m.standard.program);
   }
-  if (m.updateMaterial) {
-    m.updateMaterial = false;
-     VRB_GL_CHECK(glUniform4fv(m.uMatterialAmbient, 1, m.ambient.Data()));
-     VRB_GL_CHECK(glUniform4fv(m.uMatterialDiffuse, 1, m.diffuse.Data()));
-     VRB_GL_CHECK(glUniform4fv(m.uMatterialSpecular, 1, m.specular.Data()));
-     VRB_GL_CHECK(glUniform1f(m.uMatterialSpecularExponent, m.specularExponent));
+  m.UpdateUniforms(m.standard, aPerspective, aView);
+  VRB_GL_CHECK(glUniformMatrix4fv(m.standard.uModel, 1, GL_FALSE, aModel.Data()));
+  return true;
+}
+
+bool
+RenderState::EnableInstanced(const Matrix& aPerspective, const Matrix& aView) {
+  m.current = &m.instanced;
+  if (!m.standard.program) { return false; }
+  if (!m.instanced.program) {
+    // The instanced program is only compiled once something draws instanced with this state.
+    m.CompileProgram(m.instanced, true);
+    if (!m.instanced.program) { return false; }
   }
-  if (m.texture) {
-    VRB_GL_CHECK(glActiveTexture(GL_TEXTURE0));
-    m.texture->Bind();
-    VRB_GL_CHECK(glUniform1i(m.uTexture0, 0));
+  VRB_GL_CHECK(glUseProgram(m.instanced.program));
+  if (m.stats) {
+    m.stats->CountProgram(m.instanced.program);
   }
-  VRB_GL_CHECK(glUniform4f(m.uTintColor, m.tintColor.Red(), m.tintColor.Green(), m.tintColor.Blue(), m.tintColor.Alpha()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uPerspective, 1, GL_FALSE, aPerspective.Data()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uView, 1, GL_FALSE, aView.Data()));
-  VRB_GL_CHECK(glUniformMatrix4fv(m.uModel, 1, GL_FALSE, aModel.Data()));
+  m.UpdateUniforms(m.instanced, aPerspective, aView);
   return true;
 }
 
@@ -391,96 +638,53 @@ RenderState::Disable() {
 void
 RenderState::SetLightsEnabled(bool aEnabled) {
   m.lightsEnabled = aEnabled;
+  m.NotifyObservers();
 }
 
-RenderState::RenderState(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {}
-RenderState::~RenderState() {}
-
 void
-RenderState::InitializeGL() {
-  const bool kEnableTexturing = m.texture != nullptr;
-  std::string vertexShaderSource = sVertexShaderSource;
-  const std::string kTextureUVMacro("VRB_TEXTURE_UV_TYPE");
-  const size_t kUVStart = vertexShaderSource.find(kTextureUVMacro);
-  if (kUVStart != std::string::npos) {
-    vertexShaderSource.replace(kUVStart, kTextureUVMacro.length(), m.texture && m.texture->GetTarget() == GL_TEXTURE_CUBE_MAP ? "vec3" : "vec2");
+RenderState::AddObserver(const RenderStateObserverPtr& aObserver) {
+  if (!aObserver) {
+    return;
   }
-
-  const std::string kTextureMacro("VRB_TEXTURE_STATE");
-  const size_t kStart = vertexShaderSource.find(kTextureMacro);
-  if (kEnableTexturing) {
-    if(kStart != std::string::npos) {
-      vertexShaderSource.replace(kStart, kTextureMacro.length(), "1");
-    }
-    m.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
-    const char* frag = sFragmentTextureShaderSource;
-    if (m.texture->GetTarget() == GL_TEXTURE_CUBE_MAP) {
-      frag = sFragmentCubeMapTextureShaderSource;
+  for (const RenderStateObserverWeak& observer: m.observers) {
+    if (observer.lock() == aObserver) {
+      return;
     }
-#if defined(ANDROID)
-    // SurfaceTexture requires usage of fragment shader extension.
-    if (dynamic_cast<TextureSurface*>(m.texture.get()) != nullptr) {
-      frag = sFragmentSurfaceTextureShaderSource;
-    }
-#endif // defined(ANDROID)
-    m.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, frag);
-  } else {
-    if(kStart != std::string::npos) {
-      vertexShaderSource.replace(kStart, kTextureMacro.length(), "0");
-    }
-    m.vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSource.c_str());
-    m.fragmentShader = LoadShader(GL_FRAGMENT_SHADER, sFragmentShaderSource);
-  }
-  if (m.fragmentShader && m.vertexShader) {
-    m.program = CreateProgram(m.vertexShader, m.fragmentShader);
-  }
-  if (m.program) {
-    m.uPerspective = GetUniformLocation(m.program, "u_perspective");
-    m.uView = GetUniformLocation(m.program, "u_view");
-    m.uModel = GetUniformLocation(m.program, "u_model");
-    m.uLightCount = GetUniformLocation(m.program, "u_lightCount");
-    const std::string structNameOpen("u_lights[");
-    const std::string structNameClose("].");
-    const std::string directionName("direction");
-    const std::string ambientName("ambient");
-    const std::string diffuseName("diffuse");
-    const std::string specularName("specular");
-    for (int ix = 0; ix < MaxLights; ix++) {
-      const std::string structName = structNameOpen + std::to_string(ix) + structNameClose;
-      const std::string direction = structName + directionName;
-      const std::string ambient = structName + ambientName;
-      const std::string diffuse = structName + diffuseName;
-      const std::string specular = structName + specularName;
-      m.uLights[ix].direction = GetUniformLocation(m.program, direction);
-      m.uLights[ix].ambient = GetUniformLocation(m.program, ambient);
-      m.uLights[ix].diffuse = GetUniformLocation(m.program, diffuse);
-      m.uLights[ix].specular = GetUniformLocation(m.program, specular);
-    }
-    const std::string materialName("u_material.");
-    const std::string specularExponentName("specularExponent");
-    const std::string ambient = materialName + ambientName;
-    const std::string diffuse = materialName + diffuseName;
-    const std::string specular = materialName + specularName;
-    const std::string specularExponent = materialName + specularExponentName;
-    m.uMatterialAmbient = GetUniformLocation(m.program, ambient);
-    m.uMatterialDiffuse = GetUniformLocation(m.program, diffuse);
-    m.uMatterialSpecular = GetUniformLocation(m.program, specular);
-    m.uMatterialSpecularExponent = GetUniformLocation(m.program, specularExponent);
-    if (kEnableTexturing) {
-      const std::string texture0("u_texture0");
-      m.uTexture0 = GetUniformLocation(m.program, texture0);
-    }
-    m.uTintColor = GetUniformLocation(m.program, "u_tintColor");
-    m.aPosition = GetAttributeLocation(m.program, "a_position");
-    m.aNormal = GetAttributeLocation(m.program, "a_normal");
-    if (kEnableTexturing) {
-      m.aUV = GetAttributeLocation(m.program, "a_uv");
-    }
-    m.updateMaterial = true;
   }
+  m.observers.push_back(aObserver);
+}
+
+void
+RenderState::RemoveObserver(const RenderStateObserverPtr& aObserver) {
+  m.observers.erase(std::remove_if(m.observers.begin(), m.observers.end(), [&](const RenderStateObserverWeak& aCurrent) {
+    RenderStateObserverPtr current = aCurrent.lock();
+    return !current || (current == aObserver);
+  }), m.observers.end());
+}
+
+RenderState::RenderState(State& aState, CreationContextPtr& aContext) : ResourceGL(aState, aContext), m(aState) {
+  m.self = this;
+  m.stats = aContext->GetRenderStats();
+  m.ledger = aContext->GetGpuMemoryLedger();
+  m.deletionQueue = aContext->GetGLDeletionQueue();
+}
+RenderState::~RenderState() {
+  m.DeleteProgram(m.standard);
+  m.DeleteProgram(m.instanced);
+  m.UpdateLedger();
 }
 
 void
-RenderState::ShutdownGL() {}
+RenderState::InitializeGL() {
+  m.CompileProgram(m.standard, false);
+}
+
+void
+RenderState::ShutdownGL() {
+  m.DeleteProgram(m.standard);
+  m.DeleteProgram(m.instanced);
+  m.UpdateLedger();
+  m.current = &m.standard;
+}
 
 } // namespace vrb
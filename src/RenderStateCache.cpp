@@ -0,0 +1,169 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/RenderStateCache.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/AllocationTracker.h"
+#include "vrb/Color.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/RenderState.h"
+#include "vrb/Texture.h"
+
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+namespace {
+
+struct MaterialKey {
+  float values[13];
+  const vrb::Texture* texture;
+
+  MaterialKey(const vrb::Color& aAmbient, const vrb::Color& aDiffuse, const vrb::Color& aSpecular,
+              const float aSpecularExponent, const vrb::TexturePtr& aTexture)
+      : texture(aTexture.get()) {
+    memcpy(&values[0], aAmbient.Data(), 4 * sizeof(float));
+    memcpy(&values[4], aDiffuse.Data(), 4 * sizeof(float));
+    memcpy(&values[8], aSpecular.Data(), 4 * sizeof(float));
+    values[12] = aSpecularExponent;
+  }
+
+  bool operator==(const MaterialKey& aOther) const {
+    return (texture == aOther.texture) && (memcmp(values, aOther.values, sizeof(values)) == 0);
+  }
+};
+
+struct MaterialKeyHash {
+  size_t operator()(const MaterialKey& aKey) const {
+    size_t result = std::hash<const void*>()(aKey.texture);
+    for (float value: aKey.values) {
+      uint32_t bits = 0;
+      memcpy(&bits, &value, sizeof(bits));
+      result ^= std::hash<uint32_t>()(bits) + 0x9e3779b9 + (result << 6) + (result >> 2);
+    }
+    return result;
+  }
+};
+
+}
+
+namespace vrb {
+
+struct RenderStateCache::State {
+  // Drops a RenderState from the cache once it no longer matches its key.
+  class Observer : public RenderStateObserver {
+  public:
+    Observer(RenderStateCache::State* aState) : state(aState) {}
+    void RenderStateChanged(RenderState& aRenderState) override;
+    RenderStateCache::State* state;
+  private:
+    VRB_NO_DEFAULTS(Observer)
+  };
+
+  Mutex lock;
+  std::unordered_map<MaterialKey, std::weak_ptr<RenderState>, MaterialKeyHash> cache;
+  RenderStateObserverPtr observer;
+  int32_t hits;
+  int32_t misses;
+
+  State() : hits(0), misses(0) {
+    observer = std::make_shared<Observer>(this);
+  }
+
+  void Prune() {
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (it->second.expired()) {
+        it = cache.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+};
+
+void
+RenderStateCache::State::Observer::RenderStateChanged(RenderState& aRenderState) {
+  {
+    MutexAutoLock autoLock(state->lock);
+    for (auto it = state->cache.begin(); it != state->cache.end(); it++) {
+      if (it->second.lock().get() == &aRenderState) {
+        VRB_WARN("Shared RenderState modified, removing it from the cache");
+        state->cache.erase(it);
+        break;
+      }
+    }
+  }
+  aRenderState.RemoveObserver(state->observer);
+}
+
+RenderStateCachePtr
+RenderStateCache::Create() {
+  return std::make_shared<ConcreteClass<RenderStateCache, RenderStateCache::State> >();
+}
+
+RenderStatePtr
+RenderStateCache::FindOrCreate(
+    CreationContextPtr& aContext,
+    const Color& aAmbient,
+    const Color& aDiffuse,
+    const Color& aSpecular,
+    const float aSpecularExponent,
+    const TexturePtr& aTexture) {
+  VRB_ALLOCATION_SCOPE(Cache);
+  MutexAutoLock lock(m.lock);
+  const MaterialKey key(aAmbient, aDiffuse, aSpecular, aSpecularExponent, aTexture);
+  RenderStatePtr result = m.cache[key].lock();
+  if (result) {
+    m.hits++;
+    return result;
+  }
+  m.misses++;
+  result = RenderState::Create(aContext);
+  if (aTexture) {
+    result->SetTexture(aTexture);
+  }
+  result->SetMaterial(aAmbient, aDiffuse, aSpecular, aSpecularExponent);
+  result->AddObserver(m.observer);
+  m.cache[key] = result;
+  // Expired entries hold stale texture addresses, so drop them from time to time.
+  if ((m.misses % 64) == 0) {
+    m.Prune();
+  }
+  return result;
+}
+
+void
+RenderStateCache::Clear() {
+  MutexAutoLock lock(m.lock);
+  m.cache.clear();
+  m.hits = 0;
+  m.misses = 0;
+}
+
+int32_t
+RenderStateCache::GetCount() {
+  MutexAutoLock lock(m.lock);
+  m.Prune();
+  return (int32_t)m.cache.size();
+}
+
+int32_t
+RenderStateCache::GetHitCount() {
+  MutexAutoLock lock(m.lock);
+  return m.hits;
+}
+
+int32_t
+RenderStateCache::GetMissCount() {
+  MutexAutoLock lock(m.lock);
+  return m.misses;
+}
+
+RenderStateCache::RenderStateCache(State& aState) : m(aState) {}
+RenderStateCache::~RenderStateCache() {}
+
+}
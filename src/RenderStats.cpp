@@ -0,0 +1,220 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/RenderStats.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Logger.h"
+
+#include <atomic>
+
+namespace vrb {
+
+RenderStats::Frame::Frame()
+    : frame(0)
+    , nodesTraversed(0)
+    , nodesCulled(0)
+    , drawablesSubmitted(0)
+    , drawCalls(0)
+    , triangles(0)
+    , programSwitches(0)
+    , textureBinds(0)
+    , bufferBinds(0)
+    , bytesUploaded(0)
+{}
+
+struct RenderStats::State {
+  Frame current;
+  Frame empty;
+  // Ring buffer of completed frames. next is the slot written by the next
+  // NextFrame() call.
+  std::vector<Frame> history;
+  int32_t historySize;
+  int32_t next;
+  int32_t count;
+  GLuint lastProgram;
+  std::atomic<uint64_t> uploaded;
+
+  State() : historySize(120), next(0), count(0), lastProgram(0), uploaded(0) {
+    current.frame = 1;
+  }
+
+  const Frame& Get(const int32_t aAge) const {
+    int32_t index = next - 1 - aAge;
+    if (index < 0) {
+      index += (int32_t)history.size();
+    }
+    return history[index];
+  }
+};
+
+RenderStatsPtr
+RenderStats::Create() {
+  return std::make_shared<ConcreteClass<RenderStats, RenderStats::State> >();
+}
+
+void
+RenderStats::SetHistorySize(const int32_t aSize) {
+  if (aSize <= 0) {
+    VRB_WARN("Invalid RenderStats history size: %d", aSize);
+    return;
+  }
+  std::vector<Frame> frames;
+  GetHistory(frames);
+  if ((int32_t)frames.size() > aSize) {
+    frames.erase(frames.begin(), frames.end() - aSize);
+  }
+  m.historySize = aSize;
+  m.history = frames;
+  m.count = (int32_t)frames.size();
+  m.next = m.count % aSize;
+}
+
+int32_t
+RenderStats::GetHistorySize() const {
+  return m.historySize;
+}
+
+RenderStats::Frame
+RenderStats::GetCurrentFrame() const {
+  Frame result = m.current;
+  result.bytesUploaded = m.uploaded.load();
+  return result;
+}
+
+const RenderStats::Frame&
+RenderStats::GetLastFrame() const {
+  if (m.count == 0) {
+    return m.empty;
+  }
+  return m.Get(0);
+}
+
+void
+RenderStats::GetHistory(std::vector<Frame>& aHistory) const {
+  aHistory.clear();
+  aHistory.reserve((size_t)m.count);
+  for (int32_t age = m.count - 1; age >= 0; age--) {
+    aHistory.push_back(m.Get(age));
+  }
+}
+
+RenderStats::Frame
+RenderStats::GetAverage() const {
+  Frame result;
+  if (m.count == 0) {
+    return result;
+  }
+  uint64_t sums[8] = {};
+  for (int32_t age = 0; age < m.count; age++) {
+    const Frame& frame = m.Get(age);
+    sums[0] += frame.nodesTraversed;
+    sums[1] += frame.nodesCulled;
+    sums[2] += frame.drawablesSubmitted;
+    sums[3] += frame.drawCalls;
+    sums[4] += frame.programSwitches;
+    sums[5] += frame.textureBinds;
+    sums[6] += frame.bufferBinds;
+    result.triangles += frame.triangles;
+    result.bytesUploaded += frame.bytesUploaded;
+  }
+  const uint64_t kCount = (uint64_t)m.count;
+  result.frame = GetLastFrame().frame;
+  result.nodesTraversed = (uint32_t)(sums[0] / kCount);
+  result.nodesCulled = (uint32_t)(sums[1] / kCount);
+  result.drawablesSubmitted = (uint32_t)(sums[2] / kCount);
+  result.drawCalls = (uint32_t)(sums[3] / kCount);
+  result.programSwitches = (uint32_t)(sums[4] / kCount);
+  result.textureBinds = (uint32_t)(sums[5] / kCount);
+  result.bufferBinds = (uint32_t)(sums[6] / kCount);
+  result.triangles /= kCount;
+  result.bytesUploaded /= kCount;
+  return result;
+}
+
+uint32_t
+RenderStats::GetFrameNumber() const {
+  return m.current.frame;
+}
+
+void
+RenderStats::NextFrame() {
+  m.current.bytesUploaded = m.uploaded.exchange(0);
+  if ((int32_t)m.history.size() < m.historySize) {
+    m.history.push_back(m.current);
+  } else {
+    m.history[m.next] = m.current;
+  }
+  m.next = (m.next + 1) % m.historySize;
+  if (m.count < m.historySize) {
+    m.count++;
+  }
+  const uint32_t kFrame = m.current.frame + 1;
+  m.current = Frame();
+  m.current.frame = kFrame;
+  // Other code may have changed the bound program between frames.
+  m.lastProgram = 0;
+}
+
+void
+RenderStats::Reset() {
+  m.history.clear();
+  m.next = 0;
+  m.count = 0;
+  m.current = Frame();
+  m.current.frame = 1;
+  m.lastProgram = 0;
+  m.uploaded.store(0);
+}
+
+void
+RenderStats::CountNodeTraversed() {
+  m.current.nodesTraversed++;
+}
+
+void
+RenderStats::CountNodeCulled() {
+  m.current.nodesCulled++;
+}
+
+void
+RenderStats::CountDrawables(const uint32_t aCount) {
+  m.current.drawablesSubmitted += aCount;
+}
+
+void
+RenderStats::CountDraw(const uint64_t aTriangles) {
+  m.current.drawCalls++;
+  m.current.triangles += aTriangles;
+}
+
+void
+RenderStats::CountProgram(const GLuint aProgram) {
+  if (aProgram == m.lastProgram) {
+    return;
+  }
+  m.lastProgram = aProgram;
+  m.current.programSwitches++;
+}
+
+void
+RenderStats::CountTextureBind() {
+  m.current.textureBinds++;
+}
+
+void
+RenderStats::CountBufferBind() {
+  m.current.bufferBinds++;
+}
+
+void
+RenderStats::CountUpload(const uint64_t aBytes) {
+  m.uploaded.fetch_add(aBytes);
+}
+
+RenderStats::RenderStats(State& aState) : m(aState) {}
+RenderStats::~RenderStats() {}
+
+} // namespace vrb
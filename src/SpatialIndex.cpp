@@ -0,0 +1,409 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/SpatialIndex.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/CullVisitor.h"
+#include "vrb/Geometry.h"
+#include "vrb/Group.h"
+#include "vrb/Logger.h"
+#include "vrb/Matrix.h"
+#include "vrb/Transform.h"
+#include "vrb/Vector.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+const int kMaxDepth = 8;
+// Each octant's loose bounds extend this many times its half size from its center.
+const float kLooseFactor = 2.0f;
+
+struct Octant {
+  vrb::Vector center;
+  float halfSize;
+  int32_t children[8];
+  std::vector<int32_t> entries;
+
+  Octant(const vrb::Vector& aCenter, const float aHalfSize) : center(aCenter), halfSize(aHalfSize) {
+    std::fill(children, children + 8, -1);
+  }
+};
+
+struct Entry {
+  vrb::NodePtr node;
+  vrb::Vector min;
+  vrb::Vector max;
+  vrb::Vector center;
+  float radius;
+  int32_t octant;
+  Entry() : radius(0.0f), octant(-1) {}
+};
+
+struct TransformEntry {
+  vrb::TransformPtr transform;
+  // World transform of the parent along the path from the root.
+  vrb::Matrix parent;
+  int32_t paths;
+  TransformEntry() : parent(vrb::Matrix::Identity()), paths(0) {}
+};
+
+bool
+BoxesOverlap(const vrb::Vector& aMin, const vrb::Vector& aMax, const vrb::Vector& aOtherMin, const vrb::Vector& aOtherMax) {
+  return (aMin.x() <= aOtherMax.x()) && (aMax.x() >= aOtherMin.x()) &&
+         (aMin.y() <= aOtherMax.y()) && (aMax.y() >= aOtherMin.y()) &&
+         (aMin.z() <= aOtherMax.z()) && (aMax.z() >= aOtherMin.z());
+}
+
+float
+DistanceSquaredToBox(const vrb::Vector& aPoint, const vrb::Vector& aMin, const vrb::Vector& aMax) {
+  float result = 0.0f;
+  for (int ix = 0; ix < 3; ix++) {
+    const float kValue = aPoint.Data()[ix];
+    if (kValue < aMin.Data()[ix]) {
+      result += (aMin.Data()[ix] - kValue) * (aMin.Data()[ix] - kValue);
+    } else if (kValue > aMax.Data()[ix]) {
+      result += (kValue - aMax.Data()[ix]) * (kValue - aMax.Data()[ix]);
+    }
+  }
+  return result;
+}
+
+}
+
+namespace vrb {
+
+struct SpatialIndex::State {
+  class Observer : public GroupObserver {
+  public:
+    Observer(SpatialIndex::State* aState) : state(aState) {}
+    void TransformChanged(Transform& aTransform) override {
+      if (state) {
+        state->dirty.insert(&aTransform);
+      }
+    }
+    SpatialIndex::State* state;
+  private:
+    VRB_NO_DEFAULTS(Observer)
+  };
+
+  NodePtr root;
+  std::shared_ptr<Observer> observer;
+  std::vector<Octant> octants;
+  std::vector<Entry> entries;
+  // Entries that fall outside of the root octant are always tested.
+  std::vector<int32_t> outside;
+  std::unordered_map<const Node*, int32_t> entryMap;
+  // Geometry reached through more than one path from the root. A node only has
+  // one entry, so shared nodes are left out of the index instead of being
+  // culled at the wrong location.
+  std::unordered_set<const Node*> shared;
+  std::unordered_map<Transform*, TransformEntry> transforms;
+  std::unordered_set<Transform*> dirty;
+
+  State() {
+    observer = std::make_shared<Observer>(this);
+  }
+  ~State() {
+    observer->state = nullptr;
+  }
+
+  void Clear() {
+    GroupObserverPtr baseObserver = observer;
+    for (auto& transform: transforms) {
+      transform.second.transform->RemoveObserver(baseObserver);
+    }
+    transforms.clear();
+    octants.clear();
+    entries.clear();
+    outside.clear();
+    entryMap.clear();
+    shared.clear();
+    dirty.clear();
+  }
+
+  void Collect(const NodePtr& aNode, const Matrix& aWorld) {
+    GeometryPtr geometry = std::dynamic_pointer_cast<Geometry>(aNode);
+    if (geometry) {
+      if (entryMap.count(aNode.get()) > 0) {
+        shared.insert(aNode.get());
+        return;
+      }
+      Entry entry;
+      entry.node = aNode;
+      if (ComputeBounds(*geometry, aWorld, entry)) {
+        entryMap[aNode.get()] = (int32_t)entries.size();
+        entries.push_back(entry);
+      }
+      return;
+    }
+    GroupPtr group = std::dynamic_pointer_cast<Group>(aNode);
+    if (!group) {
+      return;
+    }
+    Matrix world = aWorld;
+    TransformPtr transform = std::dynamic_pointer_cast<Transform>(group);
+    if (transform) {
+      world = aWorld.PostMultiply(transform->GetTransform());
+      TransformEntry& entry = transforms[transform.get()];
+      if (entry.paths == 0) {
+        entry.transform = transform;
+        entry.parent = aWorld;
+        transform->AddObserver(observer);
+      }
+      entry.paths++;
+    }
+    for (int32_t ix = 0; ix < group->GetNodeCount(); ix++) {
+      Collect(group->GetNode(ix), world);
+    }
+  }
+
+  void RemoveShared() {
+    if (shared.empty()) {
+      return;
+    }
+    std::vector<Entry> kept;
+    entryMap.clear();
+    for (Entry& entry: entries) {
+      if (shared.count(entry.node.get()) == 0) {
+        entryMap[entry.node.get()] = (int32_t)kept.size();
+        kept.push_back(entry);
+      }
+    }
+    entries.swap(kept);
+  }
+
+  static bool ComputeBounds(Geometry& aGeometry, const Matrix& aWorld, Entry& aEntry) {
+    Vector min, max;
+    if (!aGeometry.GetBounds(min, max)) {
+      return false;
+    }
+    bool first = true;
+    for (int corner = 0; corner < 8; corner++) {
+      const Vector kLocal((corner & 1) ? max.x() : min.x(), (corner & 2) ? max.y() : min.y(), (corner & 4) ? max.z() : min.z());
+      const Vector kWorld = aWorld.MultiplyPosition(kLocal);
+      if (first) {
+        aEntry.min = kWorld;
+        aEntry.max = kWorld;
+        first = false;
+        continue;
+      }
+      aEntry.min.Set(std::min(aEntry.min.x(), kWorld.x()), std::min(aEntry.min.y(), kWorld.y()), std::min(aEntry.min.z(), kWorld.z()));
+      aEntry.max.Set(std::max(aEntry.max.x(), kWorld.x()), std::max(aEntry.max.y(), kWorld.y()), std::max(aEntry.max.z(), kWorld.z()));
+    }
+    aEntry.center = (aEntry.min + aEntry.max) * 0.5f;
+    aEntry.radius = (aEntry.max - aEntry.center).Magnitude();
+    return true;
+  }
+
+  void Insert(const int32_t aEntry) {
+    Entry& entry = entries[aEntry];
+    if (octants.empty()) {
+      outside.push_back(aEntry);
+      entry.octant = -1;
+      return;
+    }
+    const Octant& root = octants[0];
+    const Vector kOffset = entry.center - root.center;
+    if ((std::fabs(kOffset.x()) > root.halfSize) || (std::fabs(kOffset.y()) > root.halfSize) ||
+        (std::fabs(kOffset.z()) > root.halfSize) || (entry.radius > root.halfSize)) {
+      outside.push_back(aEntry);
+      entry.octant = -1;
+      return;
+    }
+    // Descend while the entry still fits the loose bounds of a smaller octant.
+    int32_t current = 0;
+    for (int depth = 0; depth < kMaxDepth; depth++) {
+      const float kChildHalf = octants[current].halfSize * 0.5f;
+      if (entry.radius > (kChildHalf * (kLooseFactor - 1.0f))) {
+        break;
+      }
+      const Vector kCenter = octants[current].center;
+      const int kChild = (entry.center.x() >= kCenter.x() ? 1 : 0) |
+                         (entry.center.y() >= kCenter.y() ? 2 : 0) |
+                         (entry.center.z() >= kCenter.z() ? 4 : 0);
+      if (octants[current].children[kChild] < 0) {
+        const Vector kChildCenter(
+            kCenter.x() + ((kChild & 1) ? kChildHalf : -kChildHalf),
+            kCenter.y() + ((kChild & 2) ? kChildHalf : -kChildHalf),
+            kCenter.z() + ((kChild & 4) ? kChildHalf : -kChildHalf));
+        octants.push_back(Octant(kChildCenter, kChildHalf));
+        octants[current].children[kChild] = (int32_t)octants.size() - 1;
+      }
+      current = octants[current].children[kChild];
+    }
+    octants[current].entries.push_back(aEntry);
+    entry.octant = current;
+  }
+
+  void Remove(const int32_t aEntry) {
+    Entry& entry = entries[aEntry];
+    std::vector<int32_t>& list = entry.octant >= 0 ? octants[entry.octant].entries : outside;
+    list.erase(std::remove(list.begin(), list.end(), aEntry), list.end());
+    entry.octant = -1;
+  }
+
+  void Refresh(const NodePtr& aNode, const Matrix& aWorld) {
+    GeometryPtr geometry = std::dynamic_pointer_cast<Geometry>(aNode);
+    if (geometry) {
+      auto it = entryMap.find(aNode.get());
+      if (it == entryMap.end()) {
+        return;
+      }
+      Remove(it->second);
+      ComputeBounds(*geometry, aWorld, entries[it->second]);
+      Insert(it->second);
+      return;
+    }
+    GroupPtr group = std::dynamic_pointer_cast<Group>(aNode);
+    if (!group) {
+      return;
+    }
+    Matrix world = aWorld;
+    TransformPtr transform = std::dynamic_pointer_cast<Transform>(group);
+    if (transform) {
+      world = aWorld.PostMultiply(transform->GetTransform());
+      // A nested dirty transform is refreshed as part of this subtree.
+      dirty.erase(transform.get());
+      auto it = transforms.find(transform.get());
+      if ((it != transforms.end()) && (it->second.paths == 1)) {
+        it->second.parent = aWorld;
+      }
+    }
+    for (int32_t ix = 0; ix < group->GetNodeCount(); ix++) {
+      Refresh(group->GetNode(ix), world);
+    }
+  }
+
+  template<typename OctantTest, typename EntryTest>
+  void Query(const OctantTest& aOctantTest, const EntryTest& aEntryTest, std::vector<NodePtr>& aResult) const {
+    for (int32_t index: outside) {
+      if (aEntryTest(entries[index])) {
+        aResult.push_back(entries[index].node);
+      }
+    }
+    if (octants.empty()) {
+      return;
+    }
+    std::vector<int32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+      const Octant& octant = octants[stack.back()];
+      stack.pop_back();
+      const float kLoose = octant.halfSize * kLooseFactor;
+      const Vector kExtent(kLoose, kLoose, kLoose);
+      if (!aOctantTest(octant.center - kExtent, octant.center + kExtent)) {
+        continue;
+      }
+      for (int32_t index: octant.entries) {
+        if (aEntryTest(entries[index])) {
+          aResult.push_back(entries[index].node);
+        }
+      }
+      for (int32_t child: octant.children) {
+        if (child >= 0) {
+          stack.push_back(child);
+        }
+      }
+    }
+  }
+};
+
+SpatialIndexPtr
+SpatialIndex::Create(CreationContextPtr& aContext) {
+  return std::make_shared<ConcreteClass<SpatialIndex, SpatialIndex::State> >(aContext);
+}
+
+void
+SpatialIndex::SetRoot(const NodePtr& aRoot) {
+  m.Clear();
+  m.root = aRoot;
+  if (!m.root) {
+    return;
+  }
+  m.Collect(m.root, Matrix::Identity());
+  m.RemoveShared();
+  if (m.entries.empty()) {
+    return;
+  }
+  Vector min = m.entries[0].min;
+  Vector max = m.entries[0].max;
+  for (const Entry& entry: m.entries) {
+    min.Set(std::min(min.x(), entry.min.x()), std::min(min.y(), entry.min.y()), std::min(min.z(), entry.min.z()));
+    max.Set(std::max(max.x(), entry.max.x()), std::max(max.y(), entry.max.y()), std::max(max.z(), entry.max.z()));
+  }
+  const Vector kSize = max - min;
+  // Leave room for nodes to move before they fall outside of the tree.
+  const float kHalfSize = std::max(std::max(kSize.x(), kSize.y()), std::max(kSize.z(), 1.0f));
+  m.octants.push_back(Octant((min + max) * 0.5f, kHalfSize));
+  for (int32_t ix = 0; ix < (int32_t)m.entries.size(); ix++) {
+    m.Insert(ix);
+  }
+}
+
+void
+SpatialIndex::Update() {
+  while (!m.dirty.empty()) {
+    Transform* transform = *m.dirty.begin();
+    m.dirty.erase(m.dirty.begin());
+    auto it = m.transforms.find(transform);
+    // Everything below a transform with several paths is shared and not indexed.
+    if ((it == m.transforms.end()) || (it->second.paths > 1)) {
+      continue;
+    }
+    // Use the root path recorded by Collect so bounds match the initial build.
+    m.Refresh(it->second.transform, it->second.parent);
+  }
+}
+
+bool
+SpatialIndex::Contains(const Node& aNode) const {
+  return m.entryMap.count(&aNode) > 0;
+}
+
+int32_t
+SpatialIndex::GetNodeCount() const {
+  return (int32_t)m.entries.size();
+}
+
+void
+SpatialIndex::QuerySphere(const Vector& aCenter, const float aRadius, std::vector<NodePtr>& aResult) const {
+  const float kRadiusSquared = aRadius * aRadius;
+  m.Query([&](const Vector& aMin, const Vector& aMax) {
+    return DistanceSquaredToBox(aCenter, aMin, aMax) <= kRadiusSquared;
+  }, [&](const Entry& aEntry) {
+    return DistanceSquaredToBox(aCenter, aEntry.min, aEntry.max) <= kRadiusSquared;
+  }, aResult);
+}
+
+void
+SpatialIndex::QueryBox(const Vector& aMin, const Vector& aMax, std::vector<NodePtr>& aResult) const {
+  m.Query([&](const Vector& aOctantMin, const Vector& aOctantMax) {
+    return BoxesOverlap(aMin, aMax, aOctantMin, aOctantMax);
+  }, [&](const Entry& aEntry) {
+    return BoxesOverlap(aMin, aMax, aEntry.min, aEntry.max);
+  }, aResult);
+}
+
+void
+SpatialIndex::QueryVisible(const CullVisitor& aVisitor, std::vector<NodePtr>& aResult) const {
+  m.Query([&](const Vector& aMin, const Vector& aMax) {
+    const Vector kCenter = (aMin + aMax) * 0.5f;
+    return aVisitor.IsVisible(kCenter, (aMax - kCenter).Magnitude());
+  }, [&](const Entry& aEntry) {
+    return aVisitor.IsVisible(aEntry.center, aEntry.radius);
+  }, aResult);
+}
+
+SpatialIndex::SpatialIndex(State& aState, CreationContextPtr& aContext) : m(aState) {}
+SpatialIndex::~SpatialIndex() {
+  m.Clear();
+}
+
+} // namespace vrb
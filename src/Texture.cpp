@@ -7,15 +7,21 @@
 #include "vrb/private/TextureState.h"
 
 #include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
 #include "vrb/GLError.h"
 #include "vrb/Logger.h"
+#include "vrb/RenderStats.h"
 
 namespace vrb {
 
 void
 Texture::Bind() {
   AboutToBind();
-  VRB_GL_CHECK(glBindTexture(m.target, m.texture));
+  VRB_GL_CHECK(glBindTexture(m.target, m.texture > 0 ? m.texture : m.placeholder));
+  if (m.stats) {
+    m.stats->CountTextureBind();
+    m.lastBindFrame = m.stats->GetFrameNumber();
+  }
 }
 
 void
@@ -47,7 +53,48 @@ Texture::SetTextureParameter(GLenum aName, GLint aParam) {
   VRB_GL_CHECK(glBindTexture(m.target, 0));
 }
 
-Texture::Texture(State& aState, CreationContextPtr& aContext) : m(aState) {}
+void
+Texture::SetPriority(const int32_t aPriority) {
+  m.priority = aPriority;
+}
+
+int32_t
+Texture::GetPriority() const {
+  return m.priority;
+}
+
+uint32_t
+Texture::GetLastBindFrame() const {
+  return m.lastBindFrame;
+}
+
+void
+Texture::GetUVTransform(float& aOffsetU, float& aOffsetV, float& aScaleU, float& aScaleV) const {
+  aOffsetU = m.uvTransform[0];
+  aOffsetV = m.uvTransform[1];
+  aScaleU = m.uvTransform[2];
+  aScaleV = m.uvTransform[3];
+}
+
+void
+Texture::ReportScreenSize(const float aPixels) {
+  if (aPixels <= 0.0f) {
+    return;
+  }
+  const uint32_t kFrame = m.stats ? m.stats->GetFrameNumber() : 0;
+  if ((kFrame != m.screenSizeFrame) || (aPixels > m.screenSize)) {
+    m.screenSize = aPixels;
+    m.screenSizeFrame = kFrame;
+  }
+}
+
+Texture::Texture(State& aState, CreationContextPtr& aContext) : m(aState) {
+  if (aContext) {
+    m.stats = aContext->GetRenderStats();
+    m.ledger = aContext->GetGpuMemoryLedger();
+    m.deletionQueue = aContext->GetGLDeletionQueue();
+  }
+}
 Texture::~Texture() {}
 
 } // namespace vrb
@@ -0,0 +1,405 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TextureAtlas.h"
+#include "vrb/private/TextureState.h"
+
+#include "vrb/ConcreteClass.h"
+#include "vrb/CreationContext.h"
+#include "vrb/GLDeletionQueue.h"
+#include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
+#include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/RenderStats.h"
+#include "vrb/private/ResourceGLState.h"
+
+#include "vrb/gl.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Pixels kept around each image so linear filtering does not bleed into its
+// neighbours. They repeat the edge texels of the image.
+const int32_t kPadding = 1;
+const int32_t kBytesPerPixel = 4;
+
+// Top edge of the packed area, from x to x + width.
+struct SkylineNode {
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  SkylineNode(const int32_t aX, const int32_t aY, const int32_t aWidth) : x(aX), y(aY), width(aWidth) {}
+};
+
+}
+
+namespace vrb {
+
+struct TextureAtlas::State : public Texture::State, public ResourceGL::State {
+  mutable Mutex lock;
+  int32_t width;
+  int32_t height;
+  std::unique_ptr<uint8_t[]> pixels;
+  std::vector<SkylineNode> skyline;
+  // Padded rectangles of removed images.
+  std::vector<Region> freeRegions;
+  int32_t imageCount;
+  int64_t usedArea;
+  // Rows that changed since the last upload, dirtyEnd is exclusive.
+  int32_t dirtyStart;
+  int32_t dirtyEnd;
+  int32_t usedHeight;
+
+  State()
+      : width(0)
+      , height(0)
+      , imageCount(0)
+      , usedArea(0)
+      , dirtyStart(0)
+      , dirtyEnd(0)
+      , usedHeight(0)
+  {}
+  void Resize(const int32_t aWidth, const int32_t aHeight);
+  void ResetSpace();
+  int32_t Fit(const size_t aIndex, const int32_t aWidth, const int32_t aHeight) const;
+  bool Allocate(const int32_t aWidth, const int32_t aHeight, int32_t& aX, int32_t& aY);
+  bool AllocateFree(const int32_t aWidth, const int32_t aHeight, int32_t& aX, int32_t& aY);
+  void CopyImage(const uint8_t* aImage, const Region& aRegion);
+  void Upload();
+  void DestroyTexture();
+};
+
+void
+TextureAtlas::State::Resize(const int32_t aWidth, const int32_t aHeight) {
+  width = std::max(aWidth, 1);
+  height = std::max(aHeight, 1);
+  pixels = std::make_unique<uint8_t[]>((size_t)width * (size_t)height * kBytesPerPixel);
+  memset(pixels.get(), 0, (size_t)width * (size_t)height * kBytesPerPixel);
+  ResetSpace();
+}
+
+// Frees the whole atlas. The pixels are left as they are, new images
+// overwrite them.
+void
+TextureAtlas::State::ResetSpace() {
+  skyline.clear();
+  skyline.emplace_back(0, 0, width);
+  freeRegions.clear();
+  imageCount = 0;
+  usedArea = 0;
+}
+
+// Returns the y at which a aWidth x aHeight rectangle fits when its left
+// edge is placed at skyline[aIndex], or -1 when it does not fit.
+int32_t
+TextureAtlas::State::Fit(const size_t aIndex, const int32_t aWidth, const int32_t aHeight) const {
+  const int32_t x = skyline[aIndex].x;
+  if ((x + aWidth) > width) {
+    return -1;
+  }
+  int32_t y = 0;
+  int32_t remaining = aWidth;
+  size_t index = aIndex;
+  while (remaining > 0) {
+    if (index >= skyline.size()) {
+      return -1;
+    }
+    y = std::max(y, skyline[index].y);
+    if ((y + aHeight) > height) {
+      return -1;
+    }
+    remaining -= skyline[index].width;
+    index++;
+  }
+  return y;
+}
+
+// Bottom-left skyline: picks the position with the lowest top edge, the
+// narrowest node breaking ties.
+bool
+TextureAtlas::State::Allocate(const int32_t aWidth, const int32_t aHeight, int32_t& aX, int32_t& aY) {
+  int32_t bestIndex = -1;
+  int32_t bestTop = height + 1;
+  int32_t bestWidth = width + 1;
+  for (size_t index = 0; index < skyline.size(); index++) {
+    const int32_t y = Fit(index, aWidth, aHeight);
+    if (y < 0) {
+      continue;
+    }
+    const int32_t top = y + aHeight;
+    if ((top < bestTop) || ((top == bestTop) && (skyline[index].width < bestWidth))) {
+      bestIndex = (int32_t)index;
+      bestTop = top;
+      bestWidth = skyline[index].width;
+      aX = skyline[index].x;
+      aY = y;
+    }
+  }
+  if (bestIndex < 0) {
+    return false;
+  }
+
+  skyline.insert(skyline.begin() + bestIndex, SkylineNode(aX, aY + aHeight, aWidth));
+  // Trim or remove the nodes now covered by the new one.
+  for (size_t index = (size_t)bestIndex + 1; index < skyline.size();) {
+    const SkylineNode& previous = skyline[index - 1];
+    SkylineNode& node = skyline[index];
+    const int32_t overlap = previous.x + previous.width - node.x;
+    if (overlap <= 0) {
+      break;
+    }
+    node.x += overlap;
+    node.width -= overlap;
+    if (node.width > 0) {
+      break;
+    }
+    skyline.erase(skyline.begin() + index);
+  }
+  // Merge neighbours at the same height.
+  for (size_t index = 0; (index + 1) < skyline.size();) {
+    if (skyline[index].y == skyline[index + 1].y) {
+      skyline[index].width += skyline[index + 1].width;
+      skyline.erase(skyline.begin() + index + 1);
+    } else {
+      index++;
+    }
+  }
+  usedArea += (int64_t)aWidth * (int64_t)aHeight;
+  return true;
+}
+
+// Best area fit among the rectangles of removed images. The rest of the
+// chosen rectangle is split into the strip to its right and the one below.
+bool
+TextureAtlas::State::AllocateFree(const int32_t aWidth, const int32_t aHeight, int32_t& aX, int32_t& aY) {
+  int32_t best = -1;
+  int64_t bestArea = 0;
+  for (size_t index = 0; index < freeRegions.size(); index++) {
+    const Region& region = freeRegions[index];
+    if ((region.width < aWidth) || (region.height < aHeight)) {
+      continue;
+    }
+    const int64_t kArea = (int64_t)region.width * (int64_t)region.height;
+    if ((best < 0) || (kArea < bestArea)) {
+      best = (int32_t)index;
+      bestArea = kArea;
+    }
+  }
+  if (best < 0) {
+    return false;
+  }
+  const Region kFree = freeRegions[best];
+  freeRegions.erase(freeRegions.begin() + best);
+  aX = kFree.x;
+  aY = kFree.y;
+  if (kFree.width > aWidth) {
+    Region right;
+    right.x = kFree.x + aWidth;
+    right.y = kFree.y;
+    right.width = kFree.width - aWidth;
+    right.height = aHeight;
+    freeRegions.push_back(right);
+  }
+  if (kFree.height > aHeight) {
+    Region below;
+    below.x = kFree.x;
+    below.y = kFree.y + aHeight;
+    below.width = kFree.width;
+    below.height = kFree.height - aHeight;
+    freeRegions.push_back(below);
+  }
+  usedArea += (int64_t)aWidth * (int64_t)aHeight;
+  return true;
+}
+
+// Copies the image into aRegion and repeats its edge texels into the padding.
+void
+TextureAtlas::State::CopyImage(const uint8_t* aImage, const Region& aRegion) {
+  const size_t kRowBytes = (size_t)aRegion.width * kBytesPerPixel;
+  auto pixel = [&](const int32_t aX, const int32_t aY) {
+    return pixels.get() + ((size_t)aY * (size_t)width + (size_t)aX) * kBytesPerPixel;
+  };
+  for (int32_t row = 0; row < aRegion.height; row++) {
+    uint8_t* target = pixel(aRegion.x, aRegion.y + row);
+    memcpy(target, aImage + kRowBytes * (size_t)row, kRowBytes);
+    for (int32_t pad = 1; pad <= kPadding; pad++) {
+      memcpy(target - pad * kBytesPerPixel, target, kBytesPerPixel);
+      memcpy(target + kRowBytes + (pad - 1) * kBytesPerPixel, target + kRowBytes - kBytesPerPixel, kBytesPerPixel);
+    }
+  }
+  const size_t kPaddedRowBytes = kRowBytes + 2 * kPadding * kBytesPerPixel;
+  const uint8_t* first = pixel(aRegion.x - kPadding, aRegion.y);
+  const uint8_t* last = pixel(aRegion.x - kPadding, aRegion.y + aRegion.height - 1);
+  for (int32_t pad = 1; pad <= kPadding; pad++) {
+    memcpy(pixel(aRegion.x - kPadding, aRegion.y - pad), first, kPaddedRowBytes);
+    memcpy(pixel(aRegion.x - kPadding, aRegion.y + aRegion.height - 1 + pad), last, kPaddedRowBytes);
+  }
+}
+
+void
+TextureAtlas::State::Upload() {
+  std::unique_ptr<uint8_t[]> rows;
+  int32_t start = 0;
+  int32_t count = 0;
+  {
+    MutexAutoLock hold(lock);
+    if (texture == 0) {
+      VRB_GL_CHECK(glGenTextures(1, &texture));
+      VRB_GL_CHECK(glBindTexture(target, texture));
+      VRB_GL_CHECK(glTexStorage2D(target, 1, GL_RGBA8, width, height));
+      for (auto param = intMap.begin(); param != intMap.end(); param++) {
+        VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+      }
+      if (ledger) {
+        ledger->Set(this, GpuMemoryCategory::Texture, (uint64_t)width * (uint64_t)height * kBytesPerPixel,
+                    name.empty() ? "TextureAtlas" : name.c_str());
+      }
+      // A new texture needs everything packed so far.
+      dirtyStart = 0;
+      dirtyEnd = usedHeight;
+    }
+    if (dirtyEnd <= dirtyStart) {
+      return;
+    }
+    // Copy the rows out so images can keep being added during the upload.
+    start = dirtyStart;
+    count = dirtyEnd - dirtyStart;
+    const size_t kRowBytes = (size_t)width * kBytesPerPixel;
+    rows = std::make_unique<uint8_t[]>(kRowBytes * (size_t)count);
+    memcpy(rows.get(), pixels.get() + kRowBytes * (size_t)start, kRowBytes * (size_t)count);
+    dirtyStart = dirtyEnd = 0;
+  }
+  VRB_GL_CHECK(glBindTexture(target, texture));
+  VRB_GL_CHECK(glTexSubImage2D(target, 0, 0, start, width, count, GL_RGBA, GL_UNSIGNED_BYTE, rows.get()));
+  if (stats) {
+    stats->CountUpload((uint64_t)width * (uint64_t)count * kBytesPerPixel);
+  }
+}
+
+void
+TextureAtlas::State::DestroyTexture() {
+  if (texture > 0) {
+    deletionQueue->DeleteTexture(texture);
+    texture = 0;
+  }
+  if (ledger) {
+    ledger->Release(this);
+  }
+}
+
+TextureAtlasPtr
+TextureAtlas::Create(CreationContextPtr& aContext, const int32_t aWidth, const int32_t aHeight) {
+  TextureAtlasPtr result = std::make_shared<ConcreteClass<TextureAtlas, TextureAtlas::State> >(aContext);
+  result->m.Resize(aWidth, aHeight);
+  return result;
+}
+
+int32_t
+TextureAtlas::GetWidth() const {
+  return m.width;
+}
+
+int32_t
+TextureAtlas::GetHeight() const {
+  return m.height;
+}
+
+bool
+TextureAtlas::AddImage(const uint8_t* aImage, const int32_t aWidth, const int32_t aHeight, Region& aRegion) {
+  if (!aImage || (aWidth <= 0) || (aHeight <= 0)) {
+    return false;
+  }
+  MutexAutoLock hold(m.lock);
+  const int32_t kPaddedWidth = aWidth + kPadding * 2;
+  const int32_t kPaddedHeight = aHeight + kPadding * 2;
+  int32_t x = 0;
+  int32_t y = 0;
+  if (!m.AllocateFree(kPaddedWidth, kPaddedHeight, x, y) && !m.Allocate(kPaddedWidth, kPaddedHeight, x, y)) {
+    return false;
+  }
+  aRegion.x = x + kPadding;
+  aRegion.y = y + kPadding;
+  aRegion.width = aWidth;
+  aRegion.height = aHeight;
+  m.CopyImage(aImage, aRegion);
+  m.imageCount++;
+  if (m.dirtyEnd <= m.dirtyStart) {
+    m.dirtyStart = y;
+    m.dirtyEnd = y + kPaddedHeight;
+  } else {
+    m.dirtyStart = std::min(m.dirtyStart, y);
+    m.dirtyEnd = std::max(m.dirtyEnd, y + kPaddedHeight);
+  }
+  m.usedHeight = std::max(m.usedHeight, y + kPaddedHeight);
+  return true;
+}
+
+void
+TextureAtlas::RemoveImage(const Region& aRegion) {
+  if ((aRegion.width <= 0) || (aRegion.height <= 0)) {
+    return;
+  }
+  MutexAutoLock hold(m.lock);
+  m.imageCount--;
+  if (m.imageCount <= 0) {
+    m.ResetSpace();
+    return;
+  }
+  Region padded;
+  padded.x = aRegion.x - kPadding;
+  padded.y = aRegion.y - kPadding;
+  padded.width = aRegion.width + kPadding * 2;
+  padded.height = aRegion.height + kPadding * 2;
+  m.usedArea -= (int64_t)padded.width * (int64_t)padded.height;
+  m.freeRegions.push_back(padded);
+}
+
+int32_t
+TextureAtlas::GetImageCount() const {
+  MutexAutoLock hold(m.lock);
+  return m.imageCount;
+}
+
+float
+TextureAtlas::GetUsage() const {
+  MutexAutoLock hold(m.lock);
+  return (float)m.usedArea / ((float)m.width * (float)m.height);
+}
+
+GLuint
+TextureAtlas::Update() {
+  m.Upload();
+  return m.texture;
+}
+
+TextureAtlas::TextureAtlas(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), ResourceGL(aState, aContext), m(aState) {
+  m.intMap[GL_TEXTURE_MAG_FILTER] = GL_LINEAR;
+  m.intMap[GL_TEXTURE_MIN_FILTER] = GL_LINEAR;
+}
+
+TextureAtlas::~TextureAtlas() {
+  m.DestroyTexture();
+}
+
+void
+TextureAtlas::AboutToBind() {
+  m.Upload();
+}
+
+void
+TextureAtlas::InitializeGL() {
+  m.Upload();
+}
+
+void
+TextureAtlas::ShutdownGL() {
+  m.DestroyTexture();
+}
+
+} // namespace vrb
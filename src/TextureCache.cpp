@@ -6,24 +6,204 @@
 #include "vrb/TextureCache.h"
 #include "vrb/ConcreteClass.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/CreationContext.h"
 #include "vrb/DefaultImageData.h"
 #include "vrb/FileReader.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
 #include "vrb/Mutex.h"
+#include "vrb/ResourceGL.h"
 #include "vrb/Texture.h"
+#include "vrb/TextureAtlas.h"
 #include "vrb/TextureGL.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+const int32_t kDefaultAtlasSize = 1024;
+const int32_t kDefaultMaxAtlasImageSize = 128;
+const uint64_t kDefaultStreamingBudget = 4 * 1024 * 1024;
+
+// FNV-1a byte by byte. Matching hashes are only a hint, the bytes are
+// compared before a texture is aliased.
+uint64_t
+HashImage(const uint8_t* aImage, const uint64_t aLength) {
+  const uint64_t kPrime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (uint64_t offset = 0; offset < aLength; offset++) {
+    hash = (hash ^ aImage[offset]) * kPrime;
+  }
+  return hash;
+}
+
+const uint32_t kContentPruneInterval = 64;
+
+struct TextureContent {
+  vrb::TextureGLWeak texture;
+  uint64_t length;
+  int width;
+  int height;
+  GLenum format;
+};
+}
 
 namespace vrb {
 
 struct TextureCache::State {
-  Mutex lock;
+  mutable Mutex lock;
   TextureGLPtr defaultTexture;
   std::unordered_map<std::string, TextureGLPtr> cache;
+  bool atlasEnabled;
+  int32_t atlasSize;
+  int32_t maxAtlasImageSize;
+  // Atlases are owned by the textures placed in them and go away with the
+  // last one.
+  std::vector<TextureAtlasWeak> atlases;
+  uint32_t atlasCount;
+  bool deduplicationEnabled;
+  std::unordered_map<uint64_t, TextureContent> contents;
+  uint32_t contentCount;
+  uint32_t duplicateCount;
+  uint64_t duplicateBytes;
+  int32_t streamingThreshold;
+  uint64_t streamingBudget;
+  std::vector<TextureGLWeak> streaming;
+  GpuMemoryLedgerPtr ledger;
+  TextureMemoryPressure pressure;
+  uint64_t memoryBudget;
 
+  State()
+      : atlasEnabled(false)
+      , atlasSize(kDefaultAtlasSize)
+      , maxAtlasImageSize(kDefaultMaxAtlasImageSize)
+      , atlasCount(0)
+      , deduplicationEnabled(false)
+      , contentCount(0)
+      , duplicateCount(0)
+      , duplicateBytes(0)
+      , streamingThreshold(0)
+      , streamingBudget(kDefaultStreamingBudget)
+      , pressure(TextureMemoryPressure::None)
+      , memoryBudget(0)
+  {}
+  void PruneContents() {
+    for (auto it = contents.begin(); it != contents.end();) {
+      if (it->second.texture.expired()) {
+        it = contents.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+  void ApplyMemoryPolicy(const uint32_t aFrame, const TextureMemoryPressure aPressure, const uint64_t aMemoryBudget,
+                         std::vector<TextureGLPtr>& aTextures, std::vector<TextureGLPtr>& aConverted);
 };
+
+namespace {
+
+bool
+IsVisible(const TextureGLPtr& aTexture, const uint32_t aFrame) {
+  return (aTexture->GetLastBindFrame() > 0) && ((aFrame - aTexture->GetLastBindFrame()) <= 1);
+}
+
+}
+
+// Drops levels of aTextures, least visible first, as required by the memory
+// pressure and budget, and restores them, most visible first, when allowed.
+// Textures that became streaming are added to aConverted.
+void
+TextureCache::State::ApplyMemoryPolicy(const uint32_t aFrame, const TextureMemoryPressure aPressure, const uint64_t aMemoryBudget,
+                                       std::vector<TextureGLPtr>& aTextures, std::vector<TextureGLPtr>& aConverted) {
+  const int32_t kPressureDrop = aPressure == TextureMemoryPressure::Critical ? 2 :
+                                (aPressure == TextureMemoryPressure::Moderate ? 1 : 0);
+  bool active = (kPressureDrop > 0) || (aMemoryBudget > 0);
+  for (const TextureGLPtr& texture: aTextures) {
+    active = active || (texture->GetDroppedLevels() > 0);
+  }
+  if (!active) {
+    return;
+  }
+  std::stable_sort(aTextures.begin(), aTextures.end(), [aFrame](const TextureGLPtr& aLeft, const TextureGLPtr& aRight) {
+    const bool kLeftVisible = IsVisible(aLeft, aFrame);
+    if (kLeftVisible != IsVisible(aRight, aFrame)) {
+      return !kLeftVisible;
+    }
+    if (aLeft->GetPriority() != aRight->GetPriority()) {
+      return aLeft->GetPriority() < aRight->GetPriority();
+    }
+    return aLeft->GetLastBindFrame() < aRight->GetLastBindFrame();
+  });
+
+  // What the ledger will hold once every texture has its wanted levels.
+  int64_t estimate = ledger ? (int64_t)ledger->GetTotal(GpuMemoryCategory::Texture) : 0;
+  for (const TextureGLPtr& texture: aTextures) {
+    estimate += (int64_t)texture->GetWantedTextureBytes(aFrame) - (int64_t)texture->GetTextureBytes();
+  }
+  const int64_t kBudget = (int64_t)aMemoryBudget;
+  // Converting reads the image back and builds its mip chain on a worker, at
+  // most one texture per frame.
+  bool converted = false;
+  auto setDropped = [&](const TextureGLPtr& aTexture, const int32_t aLevels) {
+    const bool kWasStreaming = aTexture->IsStreaming();
+    if (!kWasStreaming && converted) {
+      return false;
+    }
+    const int64_t kBefore = (int64_t)aTexture->GetWantedTextureBytes(aFrame);
+    if (!aTexture->SetDroppedLevels(aLevels)) {
+      return false;
+    }
+    if (!kWasStreaming) {
+      converted = true;
+      aConverted.push_back(aTexture);
+    }
+    estimate += (int64_t)aTexture->GetWantedTextureBytes(aFrame) - kBefore;
+    return true;
+  };
+  auto getFloor = [&](const TextureGLPtr& aTexture) {
+    const int32_t kDrop = IsVisible(aTexture, aFrame) ? std::max(kPressureDrop - 1, 0) : kPressureDrop;
+    return std::min(kDrop, aTexture->GetMaxDroppedLevels());
+  };
+
+  for (const TextureGLPtr& texture: aTextures) {
+    const int32_t kFloor = getFloor(texture);
+    if (texture->GetDroppedLevels() < kFloor) {
+      setDropped(texture, kFloor);
+    }
+  }
+  if (kBudget > 0) {
+    for (const TextureGLPtr& texture: aTextures) {
+      if (estimate <= kBudget) {
+        break;
+      }
+      if (texture->GetDroppedLevels() < texture->GetMaxDroppedLevels()) {
+        setDropped(texture, texture->GetDroppedLevels() + 1);
+      }
+    }
+  }
+  for (auto texture = aTextures.rbegin(); texture != aTextures.rend(); texture++) {
+    const int32_t kFloor = getFloor(*texture);
+    while ((*texture)->GetDroppedLevels() > kFloor) {
+      const int32_t kDropped = (*texture)->GetDroppedLevels();
+      const int64_t kBefore = estimate;
+      if (!setDropped(*texture, kDropped - 1)) {
+        break;
+      }
+      if ((kBudget > 0) && (estimate > kBudget)) {
+        setDropped(*texture, kDropped);
+        estimate = kBefore;
+        break;
+      }
+    }
+  }
+}
+
 TextureCachePtr
 TextureCache::Create() {
   return std::make_shared<ConcreteClass<TextureCache, TextureCache::State> >();
@@ -32,22 +212,29 @@ TextureCache::Create() {
 void
 TextureCache::Init(CreationContextPtr& aContext) {
   MutexAutoLock lock(m.lock);
+  m.ledger = aContext->GetGpuMemoryLedger();
   m.defaultTexture = TextureGL::Create(aContext);
   const size_t kArraySize = kDefaultImageDataSize * sizeof(uint32_t);
   std::unique_ptr<uint8_t[]> data = std::make_unique<uint8_t[]>(kArraySize);
   memcpy(data.get(), (void*)kDefaultImageData, kArraySize);
   uint64_t length = kDefaultImageDataWidth * kDefaultImageDataHeight * 4;
   m.defaultTexture->SetImageData(data, length, kDefaultImageDataWidth,  kDefaultImageDataHeight, GL_RGBA);
+  // Other textures fall back to the default one, so it is never restored late.
+  m.defaultTexture->SetPriority(ResourceGL::kRestoreImmediately);
 }
 
 void
 TextureCache::Shutdown() {
   m.defaultTexture = nullptr;
   m.cache.clear();
+  m.atlases.clear();
+  m.contents.clear();
+  m.streaming.clear();
 }
 
 TextureGLPtr
 TextureCache::FindTexture(const std::string& aTextureName) {
+  VRB_ALLOCATION_SCOPE(Cache);
   MutexAutoLock lock(m.lock);
   TextureGLPtr result;
 
@@ -61,6 +248,7 @@ TextureCache::FindTexture(const std::string& aTextureName) {
 
 void
 TextureCache::AddTexture(const std::string& aTextureName, TextureGLPtr& aTexture) {
+  VRB_ALLOCATION_SCOPE(Cache);
   MutexAutoLock lock(m.lock);
   m.cache[aTextureName] = aTexture;
 }
@@ -70,6 +258,243 @@ TextureCache::GetDefaultTexture() {
   return m.defaultTexture;
 }
 
+void
+TextureCache::SetAtlasEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.atlasEnabled = aEnabled;
+}
+
+bool
+TextureCache::IsAtlasEnabled() const {
+  return m.atlasEnabled;
+}
+
+void
+TextureCache::SetAtlasSize(const int32_t aAtlasSize, const int32_t aMaxImageSize) {
+  MutexAutoLock lock(m.lock);
+  m.atlasSize = aAtlasSize;
+  m.maxAtlasImageSize = std::min(aMaxImageSize, aAtlasSize / 2);
+}
+
+TextureAtlasPtr
+TextureCache::AddToAtlas(CreationContextPtr& aContext, const uint8_t* aImage, const uint64_t aImageLength,
+                         const int aWidth, const int aHeight, const GLenum aFormat, TextureAtlas::Region& aRegion) {
+  VRB_ALLOCATION_SCOPE(Cache);
+  MutexAutoLock lock(m.lock);
+  if (!m.atlasEnabled || !aImage || (aFormat != GL_RGBA)) {
+    return nullptr;
+  }
+  if ((aWidth <= 0) || (aHeight <= 0) || (aWidth > m.maxAtlasImageSize) || (aHeight > m.maxAtlasImageSize)) {
+    return nullptr;
+  }
+  if (aImageLength < (uint64_t)aWidth * (uint64_t)aHeight * 4) {
+    return nullptr;
+  }
+  m.atlases.erase(std::remove_if(m.atlases.begin(), m.atlases.end(), [](const TextureAtlasWeak& aAtlas) {
+    return aAtlas.expired();
+  }), m.atlases.end());
+  // Newer atlases are the least full, try them first.
+  for (auto weak = m.atlases.rbegin(); weak != m.atlases.rend(); weak++) {
+    TextureAtlasPtr atlas = weak->lock();
+    if (atlas && atlas->AddImage(aImage, aWidth, aHeight, aRegion)) {
+      return atlas;
+    }
+  }
+  TextureAtlasPtr atlas = TextureAtlas::Create(aContext, m.atlasSize, m.atlasSize);
+  atlas->SetName("TextureAtlas" + std::to_string(m.atlasCount++));
+  if (!atlas->AddImage(aImage, aWidth, aHeight, aRegion)) {
+    return nullptr;
+  }
+  m.atlases.push_back(atlas);
+  return atlas;
+}
+
+void
+TextureCache::SetDeduplicationEnabled(const bool aEnabled) {
+  MutexAutoLock lock(m.lock);
+  m.deduplicationEnabled = aEnabled;
+  if (!aEnabled) {
+    m.contents.clear();
+  }
+}
+
+bool
+TextureCache::IsDeduplicationEnabled() const {
+  MutexAutoLock lock(m.lock);
+  return m.deduplicationEnabled;
+}
+
+TextureGLPtr
+TextureCache::AddTextureContent(const std::string& aTextureName, const TextureGLPtr& aTexture, const uint8_t* aImage,
+                                const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if (!aTexture || !aImage || (aImageLength == 0) || !IsDeduplicationEnabled()) {
+    return nullptr;
+  }
+  // Hashing and comparing happen outside of the lock, they touch the whole
+  // image.
+  const uint64_t hash = HashImage(aImage, aImageLength);
+  VRB_ALLOCATION_SCOPE(Cache);
+  TextureGLPtr original;
+  {
+    MutexAutoLock lock(m.lock);
+    auto entry = m.contents.find(hash);
+    if (entry != m.contents.end()) {
+      original = entry->second.texture.lock();
+    }
+    if (!original) {
+      // Entries of released textures are dropped from time to time.
+      if ((++m.contentCount % kContentPruneInterval) == 0) {
+        m.PruneContents();
+      }
+      TextureContent& content = m.contents[hash];
+      content.texture = aTexture;
+      content.length = aImageLength;
+      content.width = aWidth;
+      content.height = aHeight;
+      content.format = aFormat;
+      return nullptr;
+    }
+    const TextureContent& content = entry->second;
+    if ((original == aTexture) || (content.length != aImageLength) || (content.width != aWidth) ||
+        (content.height != aHeight) || (content.format != aFormat)) {
+      return nullptr;
+    }
+  }
+
+  if (!original->MatchesImageData(aImage, aImageLength)) {
+    VRB_LOG("TextureCache: %s has the hash but not the content of %s", aTextureName.c_str(), original->GetName().c_str());
+    return nullptr;
+  }
+  MutexAutoLock lock(m.lock);
+  m.cache[aTextureName] = original;
+  m.duplicateCount++;
+  m.duplicateBytes += aImageLength;
+  VRB_LOG("TextureCache: %s duplicates %s", aTextureName.c_str(), original->GetName().c_str());
+  return original;
+}
+
+uint32_t
+TextureCache::GetDuplicateCount() const {
+  MutexAutoLock lock(m.lock);
+  return m.duplicateCount;
+}
+
+uint64_t
+TextureCache::GetDuplicateBytesSaved() const {
+  MutexAutoLock lock(m.lock);
+  return m.duplicateBytes;
+}
+
+void
+TextureCache::SetStreamingThreshold(const int32_t aSize) {
+  MutexAutoLock lock(m.lock);
+  m.streamingThreshold = aSize;
+}
+
+int32_t
+TextureCache::GetStreamingThreshold() const {
+  MutexAutoLock lock(m.lock);
+  return m.streamingThreshold;
+}
+
+void
+TextureCache::SetStreamingBudget(const uint64_t aBytesPerFrame) {
+  MutexAutoLock lock(m.lock);
+  m.streamingBudget = aBytesPerFrame;
+}
+
+void
+TextureCache::AddStreamingTexture(const TextureGLPtr& aTexture) {
+  if (!aTexture) {
+    return;
+  }
+  VRB_ALLOCATION_SCOPE(Cache);
+  MutexAutoLock lock(m.lock);
+  m.streaming.push_back(aTexture);
+}
+
+void
+TextureCache::SetMemoryPressure(const TextureMemoryPressure aPressure) {
+  MutexAutoLock lock(m.lock);
+  m.pressure = aPressure;
+}
+
+TextureMemoryPressure
+TextureCache::GetMemoryPressure() const {
+  MutexAutoLock lock(m.lock);
+  return m.pressure;
+}
+
+void
+TextureCache::SetTextureMemoryBudget(const uint64_t aBytes) {
+  MutexAutoLock lock(m.lock);
+  m.memoryBudget = aBytes;
+}
+
+uint64_t
+TextureCache::GetTextureMemoryBudget() const {
+  MutexAutoLock lock(m.lock);
+  return m.memoryBudget;
+}
+
+void
+TextureCache::UpdateStreaming(const uint32_t aFrame) {
+  std::vector<std::pair<float, TextureGLPtr> > textures;
+  std::vector<TextureGLPtr> candidates;
+  uint64_t budget = 0;
+  TextureMemoryPressure pressure = TextureMemoryPressure::None;
+  uint64_t memoryBudget = 0;
+  {
+    MutexAutoLock lock(m.lock);
+    budget = m.streamingBudget;
+    pressure = m.pressure;
+    memoryBudget = m.memoryBudget;
+    std::unordered_set<TextureGL*> known;
+    auto addCandidate = [&](const TextureGLPtr& aTexture) {
+      if (aTexture && (aTexture != m.defaultTexture) && (aTexture->GetPriority() != ResourceGL::kRestoreImmediately) &&
+          known.insert(aTexture.get()).second) {
+        candidates.push_back(aTexture);
+      }
+    };
+    for (auto& entry: m.cache) {
+      addCandidate(entry.second);
+    }
+    for (auto texture = m.streaming.begin(); texture != m.streaming.end();) {
+      TextureGLPtr live = texture->lock();
+      if (!live || !live->IsStreaming()) {
+        texture = m.streaming.erase(texture);
+        continue;
+      }
+      textures.emplace_back(live->GetStreamingPriority(aFrame), live);
+      addCandidate(live);
+      texture++;
+    }
+  }
+  std::vector<TextureGLPtr> converted;
+  m.ApplyMemoryPolicy(aFrame, pressure, memoryBudget, candidates, converted);
+  if (!converted.empty()) {
+    MutexAutoLock lock(m.lock);
+    for (const TextureGLPtr& texture: converted) {
+      m.streaming.push_back(texture);
+      textures.emplace_back(texture->GetStreamingPriority(aFrame), texture);
+    }
+  }
+  if (textures.empty()) {
+    return;
+  }
+  std::stable_sort(textures.begin(), textures.end(), [](const std::pair<float, TextureGLPtr>& aLeft, const std::pair<float, TextureGLPtr>& aRight) {
+    return aLeft.first > aRight.first;
+  });
+  bool refined = false;
+  for (auto& texture: textures) {
+    const uint64_t kUploaded = texture.second->UpdateStreaming(aFrame, refined ? budget : std::numeric_limits<uint64_t>::max());
+    if (kUploaded > 0) {
+      refined = true;
+      budget -= std::min(budget, kUploaded);
+    }
+  }
+}
+
 TextureCache::TextureCache(State& aState) : m(aState) {}
 
 TextureCache::~TextureCache() {}
@@ -10,12 +10,17 @@
 #include "vrb/CreationContext.h"
 #include "vrb/DataCache.h"
 #include "vrb/FileReader.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
 #include "vrb/private/ResourceGLState.h"
 #include "vrb/RenderContext.h"
+#include "vrb/RenderStats.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <vector>
 
@@ -52,6 +57,56 @@ private:
   CubeMapFace& operator=(const CubeMapFace&) = delete;
 };
 
+bool
+IsCompressed(const CubeMapFace& aFace) {
+  return (aFace.format != GL_RG8) && (aFace.format != GL_RGBA);
+}
+
+GLenum
+SizedFormat(const CubeMapFace& aFace) {
+  return aFace.internalFormat == GL_RGBA ? GL_RGBA8 : (GLenum)aFace.internalFormat;
+}
+
+GLenum
+PixelFormat(const CubeMapFace& aFace) {
+  return aFace.format == GL_RG8 ? GL_RG : aFace.format;
+}
+
+size_t
+BytesPerPixel(const GLenum aFormat) {
+  if (aFormat == GL_RGBA) {
+    return 4;
+  }
+  if (aFormat == GL_RG8) {
+    return 2;
+  }
+  return 0;
+}
+
+// Compressed faces come with a single level, uncompressed ones get a full
+// chain that is filled with glGenerateMipmap.
+GLsizei
+MipLevels(const CubeMapFace& aFace) {
+  if (IsCompressed(aFace)) {
+    return 1;
+  }
+  GLsizei levels = 1;
+  for (GLsizei size = std::max(aFace.width, aFace.height); size > 1; size >>= 1) {
+    levels++;
+  }
+  return levels;
+}
+
+bool
+HasExtension(const std::string& aFileName, const std::string& aExtension) {
+  if (aFileName.size() < aExtension.size()) {
+    return false;
+  }
+  return std::equal(aExtension.rbegin(), aExtension.rend(), aFileName.rbegin(), [](const char aLeft, const char aRight) {
+    return std::tolower(aLeft) == std::tolower(aRight);
+  });
+}
+
 
 
 class CubeMapTextureHandler;
@@ -99,6 +154,249 @@ CubeMapTextureHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<u
   }
 }
 
+// Face positions in a cross or strip image, in units of the face size.
+struct CubeMapLayout {
+  int columns;
+  int rows;
+  int x[6];
+  int y[6];
+  // The last face of a vertical cross is stored upside down.
+  bool rotateNegativeZ;
+};
+
+//      +Y
+//  -X  +Z  +X  -Z
+//      -Y
+const CubeMapLayout kHorizontalCross = {4, 3, {2, 0, 1, 1, 1, 3}, {1, 1, 0, 2, 1, 1}, false};
+//      +Y
+//  -X  +Z  +X
+//      -Y
+//      -Z
+const CubeMapLayout kVerticalCross = {3, 4, {2, 0, 1, 1, 1, 1}, {1, 1, 0, 2, 1, 3}, true};
+// +X -X +Y -Y +Z -Z
+const CubeMapLayout kHorizontalStrip = {6, 1, {0, 1, 2, 3, 4, 5}, {0, 0, 0, 0, 0, 0}, false};
+const CubeMapLayout kVerticalStrip = {1, 6, {0, 0, 0, 0, 0, 0}, {0, 1, 2, 3, 4, 5}, false};
+
+const CubeMapLayout*
+FindLayout(const int aWidth, const int aHeight) {
+  for (const CubeMapLayout* layout: {&kHorizontalCross, &kVerticalCross, &kHorizontalStrip, &kVerticalStrip}) {
+    if ((aWidth % layout->columns) || (aHeight % layout->rows)) {
+      continue;
+    }
+    if ((aWidth / layout->columns) == (aHeight / layout->rows)) {
+      return layout;
+    }
+  }
+  return nullptr;
+}
+
+class CrossCubeMapHandler;
+typedef std::shared_ptr<CrossCubeMapHandler> CrossCubeMapHandlerPtr;
+
+// Splits a single image holding all six faces.
+class CrossCubeMapHandler : public vrb::FileHandler {
+public:
+  static CrossCubeMapHandlerPtr Create(const vrb::TextureCubeMapPtr& aTexture);
+  void BindFileHandle(const std::string& aFileName, const int aFileHandle) override;
+  void LoadFailed(const int aFileHandle, const std::string& aReason) override;
+  void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override {};
+  void FinishRawFile(const int aFileHandle) override {};
+  void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) override;
+  CrossCubeMapHandler() {}
+  ~CrossCubeMapHandler() {}
+protected:
+  vrb::TextureCubeMapPtr mTexture;
+  std::string mFileName;
+private:
+  VRB_NO_DEFAULTS(CrossCubeMapHandler);
+};
+
+CrossCubeMapHandlerPtr
+CrossCubeMapHandler::Create(const vrb::TextureCubeMapPtr& aTexture) {
+  CrossCubeMapHandlerPtr result = std::make_shared<CrossCubeMapHandler>();
+  result->mTexture = aTexture;
+  return result;
+}
+
+void
+CrossCubeMapHandler::BindFileHandle(const std::string& aFileName, const int aFileHandle) {
+  mFileName = aFileName;
+}
+
+void
+CrossCubeMapHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
+  VRB_ERROR("Failed to load CubeMap texture %s: %s", mFileName.c_str(), aReason.c_str());
+}
+
+void
+CrossCubeMapHandler::ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  if (!mTexture || !aImage) {
+    return;
+  }
+  const size_t kPixelSize = BytesPerPixel(aFormat);
+  const CubeMapLayout* layout = FindLayout(aWidth, aHeight);
+  if (!kPixelSize || !layout || (aImageLength < (uint64_t)aWidth * (uint64_t)aHeight * kPixelSize)) {
+    VRB_ERROR("Unsupported CubeMap image layout %dx%d in %s", aWidth, aHeight, mFileName.c_str());
+    return;
+  }
+  const int kFaceSize = aWidth / layout->columns;
+  const size_t kRowBytes = (size_t)kFaceSize * kPixelSize;
+  const size_t kFaceBytes = kRowBytes * (size_t)kFaceSize;
+  for (int index = 0; index < 6; index++) {
+    std::unique_ptr<uint8_t[]> face = std::make_unique<uint8_t[]>(kFaceBytes);
+    const bool rotate = layout->rotateNegativeZ && ((GL_TEXTURE_CUBE_MAP_POSITIVE_X + index) == GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
+    for (int row = 0; row < kFaceSize; row++) {
+      const int sourceRow = layout->y[index] * kFaceSize + (rotate ? (kFaceSize - 1 - row) : row);
+      const uint8_t* source = aImage.get() + ((size_t)sourceRow * (size_t)aWidth + (size_t)(layout->x[index] * kFaceSize)) * kPixelSize;
+      uint8_t* target = face.get() + kRowBytes * (size_t)row;
+      if (!rotate) {
+        memcpy(target, source, kRowBytes);
+        continue;
+      }
+      for (int column = 0; column < kFaceSize; column++) {
+        memcpy(target + (size_t)column * kPixelSize, source + (size_t)(kFaceSize - 1 - column) * kPixelSize, kPixelSize);
+      }
+    }
+    mTexture->SetImageData((GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index), face, kFaceBytes, kFaceSize, kFaceSize, aFormat);
+  }
+}
+
+class KTXCubeMapHandler;
+typedef std::shared_ptr<KTXCubeMapHandler> KTXCubeMapHandlerPtr;
+
+// Reads the first level of a KTX 1.1 cube map.
+class KTXCubeMapHandler : public vrb::FileHandler {
+public:
+  static KTXCubeMapHandlerPtr Create(const vrb::TextureCubeMapPtr& aTexture);
+  void BindFileHandle(const std::string& aFileName, const int aFileHandle) override;
+  void LoadFailed(const int aFileHandle, const std::string& aReason) override;
+  void ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) override;
+  void FinishRawFile(const int aFileHandle) override;
+  void ProcessImageFile(const int aFileHandle, std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) override {}
+  KTXCubeMapHandler() {}
+  ~KTXCubeMapHandler() {}
+protected:
+  bool Parse(std::string& aError);
+  vrb::TextureCubeMapPtr mTexture;
+  std::string mFileName;
+  std::vector<uint8_t> mData;
+private:
+  VRB_NO_DEFAULTS(KTXCubeMapHandler);
+};
+
+const uint8_t kKTXIdentifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+const uint32_t kKTXEndianness = 0x04030201;
+
+struct KTXHeader {
+  uint8_t identifier[12];
+  uint32_t endianness;
+  uint32_t glType;
+  uint32_t glTypeSize;
+  uint32_t glFormat;
+  uint32_t glInternalFormat;
+  uint32_t glBaseInternalFormat;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t numberOfArrayElements;
+  uint32_t numberOfFaces;
+  uint32_t numberOfMipmapLevels;
+  uint32_t bytesOfKeyValueData;
+};
+
+KTXCubeMapHandlerPtr
+KTXCubeMapHandler::Create(const vrb::TextureCubeMapPtr& aTexture) {
+  KTXCubeMapHandlerPtr result = std::make_shared<KTXCubeMapHandler>();
+  result->mTexture = aTexture;
+  return result;
+}
+
+void
+KTXCubeMapHandler::BindFileHandle(const std::string& aFileName, const int aFileHandle) {
+  mFileName = aFileName;
+  mData.clear();
+}
+
+void
+KTXCubeMapHandler::LoadFailed(const int aFileHandle, const std::string& aReason) {
+  VRB_ERROR("Failed to load CubeMap texture %s: %s", mFileName.c_str(), aReason.c_str());
+  mData.clear();
+}
+
+void
+KTXCubeMapHandler::ProcessRawFileChunk(const int aFileHandle, const char* aBuffer, const size_t aSize) {
+  mData.insert(mData.end(), (const uint8_t*)aBuffer, (const uint8_t*)aBuffer + aSize);
+}
+
+void
+KTXCubeMapHandler::FinishRawFile(const int aFileHandle) {
+  std::string error;
+  if (!Parse(error)) {
+    LoadFailed(aFileHandle, error);
+  }
+  mData.clear();
+  mData.shrink_to_fit();
+}
+
+bool
+KTXCubeMapHandler::Parse(std::string& aError) {
+  KTXHeader header;
+  if (mData.size() < sizeof(header)) {
+    aError = "File too small for a KTX header";
+    return false;
+  }
+  memcpy(&header, mData.data(), sizeof(header));
+  if (memcmp(header.identifier, kKTXIdentifier, sizeof(kKTXIdentifier)) != 0) {
+    aError = "Not a KTX file";
+    return false;
+  }
+  if (header.endianness != kKTXEndianness) {
+    aError = "Byte swapped KTX files are not supported";
+    return false;
+  }
+  if ((header.numberOfFaces != 6) || (header.pixelDepth > 0) || (header.numberOfArrayElements > 0) ||
+      (header.pixelWidth == 0) || (header.pixelWidth != header.pixelHeight)) {
+    aError = "KTX file is not a cube map";
+    return false;
+  }
+  GLenum format = (GLenum)header.glInternalFormat;
+  if (header.glType != 0) {
+    if ((header.glType != GL_UNSIGNED_BYTE) || ((header.glFormat != GL_RGBA) && (header.glFormat != GL_RG))) {
+      aError = "Unsupported KTX pixel format";
+      return false;
+    }
+    format = header.glFormat == GL_RGBA ? (GLenum)GL_RGBA : (GLenum)GL_RG8;
+  }
+
+  size_t offset = sizeof(header) + (size_t)header.bytesOfKeyValueData;
+  uint32_t imageSize = 0;
+  if ((offset + sizeof(imageSize)) > mData.size()) {
+    aError = "KTX file is truncated";
+    return false;
+  }
+  memcpy(&imageSize, mData.data() + offset, sizeof(imageSize));
+  offset += sizeof(imageSize);
+  // Each face of a non array cube map is padded to four bytes.
+  const size_t kFaceStride = ((size_t)imageSize + 3) & ~(size_t)3;
+  if ((imageSize == 0) || ((offset + kFaceStride * 5 + imageSize) > mData.size())) {
+    aError = "KTX file is truncated";
+    return false;
+  }
+  // Uncompressed faces are uploaded as width * height texels.
+  const size_t kPixelSize = header.glType != 0 ? BytesPerPixel(format) : 0;
+  if ((kPixelSize > 0) && ((uint64_t)imageSize < (uint64_t)header.pixelWidth * (uint64_t)header.pixelHeight * kPixelSize)) {
+    aError = "KTX face is smaller than its dimensions";
+    return false;
+  }
+  for (int index = 0; index < 6; index++) {
+    std::unique_ptr<uint8_t[]> face = std::make_unique<uint8_t[]>(imageSize);
+    memcpy(face.get(), mData.data() + offset + kFaceStride * (size_t)index, imageSize);
+    mTexture->SetImageData((GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index), face, imageSize,
+                           (int)header.pixelWidth, (int)header.pixelHeight, format);
+  }
+  return true;
+}
+
 }
 
 namespace vrb {
@@ -108,6 +406,7 @@ struct TextureCubeMap::State : public Texture::State, public ResourceGL::State {
   CubeMapFace faces[6];
   DataCachePtr dataCache;
 
+  State() : dirty(true) {}
   void CreateTexture();
   void DestroyTexture();
 };
@@ -127,30 +426,31 @@ TextureCubeMap::State::CreateTexture() {
       }
     }
   }
+  const CubeMapFace& base = faces[0];
+  for (const CubeMapFace& face: faces) {
+    if ((face.width != base.width) || (face.height != base.height) || (face.internalFormat != base.internalFormat)) {
+      VRB_ERROR("CubeMap faces must share size and format");
+      return;
+    }
+  }
+  // New image data replaces the texture created for the previous one.
+  DestroyTexture();
   VRB_GL_CHECK(glGenTextures(1, &texture));
   VRB_GL_CHECK(glBindTexture(target, texture));
+  const GLsizei levels = MipLevels(base);
+  VRB_GL_CHECK(glTexStorage2D(target, levels, SizedFormat(base), base.width, base.height));
+  uint64_t bytes = 0;
   for (CubeMapFace& face: faces) {
-    if (face.format == GL_RG8 || face.format == GL_RGBA) {
-      VRB_GL_CHECK(glTexImage2D(
-          face.target,
-          face.level,
-          face.internalFormat,
-          face.width,
-          face.height,
-          face.border,
-          face.format,
-          face.type,
-          (void*)face.data.get()));
+    if (IsCompressed(face)) {
+      VRB_GL_CHECK(glCompressedTexSubImage2D(face.target, 0, 0, 0, face.width, face.height,
+                                             (GLenum)face.internalFormat, face.dataSize, (void*)face.data.get()));
     } else {
-      VRB_GL_CHECK(glCompressedTexImage2D(
-          face.target,
-          face.level,
-          face.internalFormat,
-          face.width,
-          face.height,
-          face.border,
-          face.dataSize,
-          (void*)face.data.get()));
+      VRB_GL_CHECK(glTexSubImage2D(face.target, 0, 0, 0, face.width, face.height,
+                                   PixelFormat(face), face.type, (void*)face.data.get()));
+    }
+    bytes += (uint64_t)face.dataSize;
+    if (stats) {
+      stats->CountUpload((uint64_t)face.dataSize);
     }
     if (!face.dataCacheHandle && dataCache) {
       face.dataCacheHandle = dataCache->CacheData(face.data, (size_t)face.dataSize);
@@ -158,19 +458,30 @@ TextureCubeMap::State::CreateTexture() {
       face.data = nullptr;
     }
   }
+  if (levels > 1) {
+    VRB_GL_CHECK(glGenerateMipmap(target));
+    // A full chain adds a third to the base level.
+    bytes += bytes / 3;
+  }
 
   for (auto param = intMap.begin(); param != intMap.end(); param++) {
     VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
   }
+  if (ledger) {
+    ledger->Set(this, GpuMemoryCategory::Texture, bytes, name.empty() ? "TextureCubeMap" : name.c_str());
+  }
   dirty = false;
 }
 
 void
 TextureCubeMap::State::DestroyTexture() {
   if (texture > 0) {
-    VRB_GL_CHECK(glDeleteTextures(1, &texture));
+    deletionQueue->DeleteTexture(texture);
     texture = 0;
   }
+  if (ledger) {
+    ledger->Release(this);
+  }
   dirty = true;
 }
 
@@ -192,12 +503,28 @@ TextureCubeMap::Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTex
     return;
   }
 
-  reader->ReadImageFile(aFileXPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_X));
-  reader->ReadImageFile(aFileXNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_X));
-  reader->ReadImageFile(aFileYPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_Y));
-  reader->ReadImageFile(aFileYNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y));
-  reader->ReadImageFile(aFileZPos, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_POSITIVE_Z));
-  reader->ReadImageFile(aFileZNeg, CubeMapTextureHandler::Create(aTexture, GL_TEXTURE_CUBE_MAP_NEGATIVE_Z));
+  const std::vector<std::string> files = {aFileXPos, aFileXNeg, aFileYPos, aFileYNeg, aFileZPos, aFileZNeg};
+  std::vector<FileHandlerPtr> handlers;
+  for (int index = 0; index < 6; index++) {
+    handlers.push_back(CubeMapTextureHandler::Create(aTexture, (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index)));
+  }
+  reader->ReadImageFiles(files, handlers);
+}
+
+void
+TextureCubeMap::Load(CreationContextPtr& aContext, const TextureCubeMapPtr& aTexture, const std::string& aFile) {
+  FileReaderPtr reader = aContext->GetFileReader();
+
+  if (!reader) {
+    VRB_ERROR("FileReaderPtr not found while loading a CubeMap");
+    return;
+  }
+
+  if (HasExtension(aFile, ".ktx")) {
+    reader->ReadRawFile(aFile, KTXCubeMapHandler::Create(aTexture));
+  } else {
+    reader->ReadImageFile(aFile, CrossCubeMapHandler::Create(aTexture));
+  }
 }
 
 void
@@ -234,6 +561,7 @@ TextureCubeMap::TextureCubeMap(State& aState, CreationContextPtr& aContext) : Te
 }
 
 TextureCubeMap::~TextureCubeMap() {
+  m.DestroyTexture();
   if (!m.dataCache) {
     return;
   }
@@ -247,6 +575,9 @@ TextureCubeMap::~TextureCubeMap() {
 
 void
 TextureCubeMap::AboutToBind() {
+  if (m.restorePending) {
+    return;
+  }
   m.CreateTexture();
 }
 
@@ -255,6 +586,25 @@ TextureCubeMap::SupportOffRenderThreadInitialization() {
   return true;
 }
 
+int32_t
+TextureCubeMap::GetRestorePriority() {
+  return m.priority;
+}
+
+uint32_t
+TextureCubeMap::GetLastUsedFrame() {
+  return m.lastBindFrame;
+}
+
+void
+TextureCubeMap::GetRestoreDataHandles(std::vector<uint32_t>& aHandles) {
+  for (const CubeMapFace& face: m.faces) {
+    if (face.dataCacheHandle > 0) {
+      aHandles.push_back(face.dataCacheHandle);
+    }
+  }
+}
+
 void
 TextureCubeMap::InitializeGL() {
   m.CreateTexture();
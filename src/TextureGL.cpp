@@ -6,15 +6,28 @@
 #include "vrb/TextureGL.h"
 #include "vrb/private/TextureState.h"
 
+#include "vrb/AllocationTracker.h"
 #include "vrb/ConcreteClass.h"
+#include "vrb/ConditionVariable.h"
 #include "vrb/CreationContext.h"
 #include "vrb/DataCache.h"
+#include "vrb/GLDeletionQueue.h"
 #include "vrb/GLError.h"
+#include "vrb/GpuMemoryLedger.h"
 #include "vrb/Logger.h"
+#include "vrb/Mutex.h"
+#include "vrb/RenderStats.h"
+#include "vrb/TextureAtlas.h"
+#include "vrb/TextureCache.h"
 #include "vrb/private/ResourceGLState.h"
 
 #include "vrb/gl.h"
+#include <algorithm>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <pthread.h>
 #include <vector>
 
 namespace {
@@ -83,6 +96,363 @@ private:
   MipMap& operator=(const MipMap&) = delete;
 };
 
+// Uploads smaller than this are copied straight from client memory.
+const size_t kAsyncUploadMinBytes = 256 * 1024;
+// Streaming textures keep the levels no larger than this in memory and upload
+// them as soon as they are bound.
+const int kStreamBaseSize = 64;
+// Streaming textures not reported on screen for this many frames drop back
+// to their base levels.
+const uint32_t kStreamEvictFrames = 90;
+const size_t kStreamPixelSize = 4;
+
+// Levels above the first one no larger than kStreamBaseSize.
+int32_t
+GetStreamBaseLevel(const GLsizei aWidth, const GLsizei aHeight) {
+  int32_t result = 0;
+  for (GLsizei size = std::max(aWidth, aHeight); size > kStreamBaseSize; size >>= 1) {
+    result++;
+  }
+  return result;
+}
+
+// Halves an RGBA level with a box filter, odd edges repeat their last texel.
+MipMap
+Downsample(const MipMap& aSource) {
+  MipMap result;
+  result.level = aSource.level + 1;
+  result.width = std::max(aSource.width / 2, 1);
+  result.height = std::max(aSource.height / 2, 1);
+  result.internalFormat = aSource.internalFormat;
+  result.format = aSource.format;
+  result.type = aSource.type;
+  result.dataSize = (GLsizei)((size_t)result.width * (size_t)result.height * kStreamPixelSize);
+  result.data = std::make_unique<uint8_t[]>((size_t)result.dataSize);
+  const uint8_t* source = aSource.data.get();
+  uint8_t* target = result.data.get();
+  for (GLsizei y = 0; y < result.height; y++) {
+    const GLsizei kRow0 = std::min(y * 2, aSource.height - 1);
+    const GLsizei kRow1 = std::min(y * 2 + 1, aSource.height - 1);
+    for (GLsizei x = 0; x < result.width; x++) {
+      const GLsizei kColumn0 = std::min(x * 2, aSource.width - 1);
+      const GLsizei kColumn1 = std::min(x * 2 + 1, aSource.width - 1);
+      const uint8_t* texels[4] = {
+          source + ((size_t)kRow0 * aSource.width + kColumn0) * kStreamPixelSize,
+          source + ((size_t)kRow0 * aSource.width + kColumn1) * kStreamPixelSize,
+          source + ((size_t)kRow1 * aSource.width + kColumn0) * kStreamPixelSize,
+          source + ((size_t)kRow1 * aSource.width + kColumn1) * kStreamPixelSize};
+      for (size_t channel = 0; channel < kStreamPixelSize; channel++) {
+        const uint32_t kSum = texels[0][channel] + texels[1][channel] + texels[2][channel] + texels[3][channel];
+        *target++ = (uint8_t)((kSum + 2) / 4);
+      }
+    }
+  }
+  return result;
+}
+
+bool
+IsCompressed(const MipMap& aMipMap) {
+  return (aMipMap.format != GL_RG8) && (aMipMap.format != GL_RGBA);
+}
+
+GLenum
+SizedFormat(const MipMap& aMipMap) {
+  if (aMipMap.internalFormat == GL_RGBA) {
+    return GL_RGBA8;
+  }
+  if (aMipMap.internalFormat == GL_RGB) {
+    return GL_RGB8;
+  }
+  return (GLenum)aMipMap.internalFormat;
+}
+
+GLenum
+PixelFormat(const MipMap& aMipMap) {
+  return aMipMap.format == GL_RG8 ? GL_RG : aMipMap.format;
+}
+
+void
+TexSubImage(const MipMap& aMipMap, const void* aPixels) {
+  if (IsCompressed(aMipMap)) {
+    VRB_GL_CHECK(glCompressedTexSubImage2D(aMipMap.target, aMipMap.level, 0, 0, aMipMap.width, aMipMap.height,
+                                           (GLenum)aMipMap.internalFormat, aMipMap.dataSize, aPixels));
+  } else {
+    VRB_GL_CHECK(glTexSubImage2D(aMipMap.target, aMipMap.level, 0, 0, aMipMap.width, aMipMap.height,
+                                 PixelFormat(aMipMap), aMipMap.type, aPixels));
+  }
+}
+
+// Once the image data is in the DataCache the client copy is no longer needed.
+void
+ReleaseUploadedData(const vrb::DataCachePtr& aDataCache, MipMap& aMipMap) {
+  if (!aDataCache || !aMipMap.data) {
+    return;
+  }
+  if (aMipMap.dataCacheHandle == 0) {
+    aMipMap.dataCacheHandle = aDataCache->CacheData(aMipMap.data, (size_t)aMipMap.dataSize);
+  } else {
+    aMipMap.data = nullptr;
+  }
+}
+
+// Small pool shared by every texture for work that has to stay off the render
+// thread. Threads start on demand, up to kMaxWorkerThreads, and exit once the
+// queue is empty. The pool is never destroyed so detached workers can not
+// outlive it.
+const int32_t kMaxWorkerThreads = 2;
+
+class TextureWorkers {
+public:
+  // Returns false when no worker could be started to run aTask.
+  static bool Post(std::function<void()>&& aTask) {
+    static TextureWorkers* sWorkers = new TextureWorkers;
+    vrb::MutexAutoLock lock(sWorkers->lock);
+    sWorkers->tasks.push_back(std::move(aTask));
+    if (sWorkers->threads >= kMaxWorkerThreads) {
+      return true;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, &TextureWorkers::Thread, sWorkers) != 0) {
+      if (sWorkers->threads > 0) {
+        return true;
+      }
+      sWorkers->tasks.pop_back();
+      return false;
+    }
+    pthread_detach(thread);
+    sWorkers->threads++;
+    return true;
+  }
+
+private:
+  TextureWorkers() : threads(0) {}
+
+  static void* Thread(void* aWorkers) {
+    TextureWorkers* workers = (TextureWorkers*)aWorkers;
+    while (true) {
+      std::function<void()> task;
+      {
+        vrb::MutexAutoLock lock(workers->lock);
+        if (workers->tasks.empty()) {
+          workers->threads--;
+          return nullptr;
+        }
+        task = std::move(workers->tasks.front());
+        workers->tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  vrb::Mutex lock;
+  std::deque<std::function<void()>> tasks;
+  int32_t threads;
+  VRB_NO_DEFAULTS(TextureWorkers)
+};
+
+// Copies the mip maps into a mapped pixel buffer on a worker thread. The
+// mip maps are owned by the copy until it is done so the texture can be
+// changed or destroyed while it runs.
+class PixelCopy;
+typedef std::shared_ptr<PixelCopy> PixelCopyPtr;
+
+class PixelCopy {
+public:
+  vrb::DataCachePtr dataCache;
+  std::vector<MipMap> mipMaps;
+  std::vector<size_t> offsets;
+  uint8_t* destination;
+
+  PixelCopy() : destination(nullptr), pixelBuffer(0), done(false), cancelled(false), discard(false) {}
+
+  bool Start(const PixelCopyPtr& aSelf) {
+    PixelCopyPtr self = aSelf;
+    return TextureWorkers::Post([self]() { self->Run(); });
+  }
+
+  void Run() {
+    VRB_ALLOCATION_SCOPE(Upload);
+    for (size_t index = 0; index < mipMaps.size(); index++) {
+      if (IsCancelled()) {
+        break;
+      }
+      MipMap& mipMap = mipMaps[index];
+      if (!mipMap.data && dataCache && (mipMap.dataCacheHandle > 0)) {
+        dataCache->LoadData(mipMap.dataCacheHandle, mipMap.data);
+      }
+      if (mipMap.data) {
+        memcpy(destination + offsets[index], mipMap.data.get(), (size_t)mipMap.dataSize);
+        ReleaseUploadedData(dataCache, mipMap);
+      }
+    }
+    vrb::MutexAutoLock lock(doneLock);
+    done = true;
+    ReleaseIfDone();
+  }
+
+  bool IsDone() {
+    vrb::MutexAutoLock lock(doneLock);
+    return done;
+  }
+
+  // Stops the copy without waiting for it. aBuffer is deleted through aQueue
+  // once the copy no longer writes to it.
+  void Cancel(const GLuint aBuffer, const vrb::GLDeletionQueuePtr& aQueue) {
+    vrb::MutexAutoLock lock(doneLock);
+    cancelled = true;
+    pixelBuffer = aBuffer;
+    deletionQueue = aQueue;
+    ReleaseIfDone();
+  }
+
+  // Removes the cached mip maps once the copy is done instead of handing
+  // them back to the texture.
+  void Discard() {
+    vrb::MutexAutoLock lock(doneLock);
+    discard = true;
+    ReleaseIfDone();
+  }
+
+private:
+  bool IsCancelled() {
+    vrb::MutexAutoLock lock(doneLock);
+    return cancelled;
+  }
+
+  // Called with doneLock held.
+  void ReleaseIfDone() {
+    if (!done) {
+      return;
+    }
+    if ((pixelBuffer > 0) && deletionQueue) {
+      deletionQueue->DeleteBuffer(pixelBuffer);
+      pixelBuffer = 0;
+    }
+    if (discard) {
+      for (MipMap& mipMap: mipMaps) {
+        if (dataCache && (mipMap.dataCacheHandle > 0)) {
+          dataCache->RemoveData(mipMap.dataCacheHandle);
+        }
+      }
+      mipMaps.clear();
+    }
+  }
+
+  vrb::ConditionVariable doneLock;
+  GLuint pixelBuffer;
+  vrb::GLDeletionQueuePtr deletionQueue;
+  bool done;
+  bool cancelled;
+  bool discard;
+  VRB_NO_DEFAULTS(PixelCopy)
+};
+
+// Builds the mip chain of a single RGBA level on a worker thread. Levels
+// larger than the base ones are moved to the DataCache. The texture takes
+// the levels once the build is done, a discarded build removes the ones it
+// cached.
+class MipChainBuild;
+typedef std::shared_ptr<MipChainBuild> MipChainBuildPtr;
+
+class MipChainBuild {
+public:
+  vrb::DataCachePtr dataCache;
+  // Level 0. When not owned its data is read back from the DataCache and the
+  // texture keeps the level.
+  MipMap source;
+  bool ownsSource;
+  int32_t baseLevel;
+  // The levels below the source, valid once done.
+  std::vector<MipMap> levels;
+  bool succeeded;
+
+  MipChainBuild() : ownsSource(false), baseLevel(0), succeeded(false), done(false), discard(false) {}
+
+  bool Start(const MipChainBuildPtr& aSelf) {
+    MipChainBuildPtr self = aSelf;
+    return TextureWorkers::Post([self]() { self->Run(); });
+  }
+
+  void Run() {
+    VRB_ALLOCATION_SCOPE(Cache);
+    if (!source.data && dataCache && (source.dataCacheHandle > 0) &&
+        (dataCache->LoadData(source.dataCacheHandle, source.data) != (size_t)source.dataSize)) {
+      source.data = nullptr;
+    }
+    if (source.data) {
+      levels.push_back(Downsample(source));
+      while (!IsDiscarded() && ((levels.back().width > 1) || (levels.back().height > 1))) {
+        levels.push_back(Downsample(levels.back()));
+      }
+      Cache(source);
+      for (MipMap& mipMap: levels) {
+        if (mipMap.level < baseLevel) {
+          Cache(mipMap);
+        }
+      }
+      succeeded = !IsDiscarded();
+    }
+    vrb::MutexAutoLock lock(doneLock);
+    done = true;
+    ReleaseIfDone();
+  }
+
+  bool IsDone() {
+    vrb::MutexAutoLock lock(doneLock);
+    return done;
+  }
+
+  // Drops the levels once the build is done instead of handing them to the
+  // texture.
+  void Discard() {
+    vrb::MutexAutoLock lock(doneLock);
+    discard = true;
+    ReleaseIfDone();
+  }
+
+private:
+  bool IsDiscarded() {
+    vrb::MutexAutoLock lock(doneLock);
+    return discard;
+  }
+
+  // Levels not kept in memory. Without a DataCache the whole chain stays.
+  void Cache(MipMap& aMipMap) {
+    if (!dataCache || (aMipMap.level >= baseLevel)) {
+      return;
+    }
+    if (aMipMap.dataCacheHandle == 0) {
+      aMipMap.dataCacheHandle = dataCache->CacheData(aMipMap.data, (size_t)aMipMap.dataSize);
+    }
+    if (aMipMap.dataCacheHandle > 0) {
+      aMipMap.data = nullptr;
+    }
+  }
+
+  // Called with doneLock held.
+  void ReleaseIfDone() {
+    if (!done || !discard) {
+      return;
+    }
+    for (MipMap& mipMap: levels) {
+      if (dataCache && (mipMap.dataCacheHandle > 0)) {
+        dataCache->RemoveData(mipMap.dataCacheHandle);
+      }
+    }
+    levels.clear();
+    if (ownsSource && dataCache && (source.dataCacheHandle > 0)) {
+      dataCache->RemoveData(source.dataCacheHandle);
+    }
+    source.dataCacheHandle = 0;
+    source.data = nullptr;
+  }
+
+  vrb::ConditionVariable doneLock;
+  bool done;
+  bool discard;
+  VRB_NO_DEFAULTS(MipChainBuild)
+};
+
 }
 
 namespace vrb {
@@ -90,75 +460,580 @@ namespace vrb {
 struct TextureGL::State : public Texture::State, public ResourceGL::State {
   bool dirty;
   DataCachePtr dataCache;
+  TextureCacheWeak textureCache;
   std::vector<MipMap> mipMaps;
+  // Set when the image lives in an atlas, which is bound instead.
+  TextureAtlasPtr atlas;
+  TextureAtlas::Region atlasRegion;
+  // Set when another texture holds the same image, which is bound instead.
+  TextureGLPtr alias;
+  // Asynchronous upload. The mip maps are copied into pixelBuffer by copy,
+  // transferred into uploadTexture, which replaces texture once uploadFence
+  // has signaled.
+  PixelCopyPtr copy;
+  // A canceled copy that still owns the mip maps. They are taken back by
+  // ReclaimMipMaps() once the worker is done with them.
+  PixelCopyPtr canceledCopy;
+  GLuint pixelBuffer;
+  GLuint uploadTexture;
+  GLsync uploadFence;
+  uint64_t uploadBytes;
+  // Progressive streaming. mipMaps holds the full chain and texture the
+  // levels from residentLevel down. Levels from baseLevel down stay in
+  // memory, finer ones are read back from the DataCache. Only progressive
+  // textures follow their on screen size, droppedLevels top levels are kept
+  // out under memory pressure. The chain is built by mipChain, taken over
+  // by FinishMipChain(). A texture created by StreamLevels() has mutable
+  // levels, so finer ones are added and dropped in place.
+  MipChainBuildPtr mipChain;
+  bool streamedTexture;
+  bool streaming;
+  // Set when a single level texture streams because of dropped levels. It
+  // goes back to the single level once none are dropped.
+  bool converted;
+  bool progressive;
+  int32_t baseLevel;
+  int32_t residentLevel;
+  int32_t droppedLevels;
+  uint64_t textureBytes;
 
-  State() : dirty(false) {}
+  State()
+      : dirty(false)
+      , pixelBuffer(0)
+      , uploadTexture(0)
+      , uploadFence(nullptr)
+      , uploadBytes(0)
+      , streamedTexture(false)
+      , streaming(false)
+      , converted(false)
+      , progressive(false)
+      , baseLevel(0)
+      , residentLevel(0)
+      , droppedLevels(0)
+      , textureBytes(0)
+  {}
+  GLuint AllocateTexture(uint64_t& aBytes);
+  void FinishTexture(const GLuint aTexture, const uint64_t aBytes);
+  void SetTextureBytes(const uint64_t aBytes);
   void CreateTexture();
+  size_t GetUploadSize() const;
+  bool StartUpload();
+  void UpdateUpload();
+  void CancelUpload();
+  bool ReclaimMipMaps();
+  void DropCanceledCopy();
+  void ReleaseAtlasImage();
+  void DiscardMipMaps(std::vector<MipMap>& aMipMaps);
+  void DeleteTexture(GLuint& aTexture);
+  void DeleteUploadObjects();
   void DestroyTexture();
+  void UpdatePlaceholder();
+  int32_t GetWantedLevel(const uint32_t aFrame) const;
+  uint64_t GetStreamSize(const int32_t aLevel) const;
+  int32_t GetStreamEnd(const int32_t aLevel) const;
+  bool PrefetchLevels(const int32_t aLevel);
+  void StreamLevels(const int32_t aLevel);
+  void StartMipChain();
+  bool FinishMipChain();
+  void DropMipChain();
+  void RestoreSingleLevel();
 };
 
+// Creates immutable storage for every level in mipMaps. Leaves the texture bound.
+GLuint
+TextureGL::State::AllocateTexture(uint64_t& aBytes) {
+  GLint levels = 0;
+  const MipMap* base = nullptr;
+  aBytes = 0;
+  for (const MipMap& mipMap: mipMaps) {
+    if (!mipMap.data && (mipMap.dataCacheHandle == 0)) {
+      continue;
+    }
+    levels = std::max(levels, mipMap.level + 1);
+    if (mipMap.level == 0) {
+      base = &mipMap;
+    }
+    aBytes += (uint64_t)mipMap.dataSize;
+  }
+  GLuint result = 0;
+  VRB_GL_CHECK(glGenTextures(1, &result));
+  VRB_GL_CHECK(glBindTexture(target, result));
+  if (base) {
+    VRB_GL_CHECK(glTexStorage2D(target, levels, SizedFormat(*base), base->width, base->height));
+  }
+  return result;
+}
+
+// Makes aTexture the texture that is bound, replacing the previous one.
+void
+TextureGL::State::FinishTexture(const GLuint aTexture, const uint64_t aBytes) {
+  VRB_GL_CHECK(glBindTexture(target, aTexture));
+  for (auto param = intMap.begin(); param != intMap.end(); param++) {
+    VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+  }
+  DeleteTexture(texture);
+  texture = aTexture;
+  streamedTexture = false;
+  SetTextureBytes(aBytes);
+}
+
+void
+TextureGL::State::SetTextureBytes(const uint64_t aBytes) {
+  textureBytes = aBytes;
+  if (ledger) {
+    ledger->Set(this, GpuMemoryCategory::Texture, aBytes, name.empty() ? "TextureGL" : name.c_str());
+  }
+}
+
 void
 TextureGL::State::CreateTexture() {
   if (!dirty) {
     return;
   }
-  VRB_GL_CHECK(glGenTextures(1, &texture));
-  VRB_GL_CHECK(glBindTexture(target, texture));
+  CancelUpload();
+  if (!ReclaimMipMaps()) {
+    return;
+  }
   for (MipMap& mipMap: mipMaps) {
-    if (dataCache && (mipMap.dataCacheHandle > 0)) {
+    if (!mipMap.data && dataCache && (mipMap.dataCacheHandle > 0)) {
       dataCache->LoadData(mipMap.dataCacheHandle, mipMap.data);
     }
+  }
+  uint64_t bytes = 0;
+  const GLuint created = AllocateTexture(bytes);
+  for (MipMap& mipMap: mipMaps) {
     if (!mipMap.data) {
       continue;
     }
+    TexSubImage(mipMap, (void*)mipMap.data.get());
+    if (stats) {
+      stats->CountUpload((uint64_t)mipMap.dataSize);
+    }
+    ReleaseUploadedData(dataCache, mipMap);
+  }
+  FinishTexture(created, bytes);
+  dirty = false;
+}
 
-    if (mipMap.format == GL_RG8 || mipMap.format == GL_RGBA) {
-      VRB_GL_CHECK(glTexImage2D(
-          mipMap.target,
-          mipMap.level,
-          mipMap.internalFormat,
-          mipMap.width,
-          mipMap.height,
-          mipMap.border,
-          mipMap.format,
-          mipMap.type,
-          (void*)mipMap.data.get()));
-    } else {
-      VRB_GL_CHECK(glCompressedTexImage2D(
-          mipMap.target,
-          mipMap.level,
-          mipMap.internalFormat,
-          mipMap.width,
-          mipMap.height,
-          mipMap.border,
-          mipMap.dataSize,
-          (void*)mipMap.data.get()));
-    }
-
-    if (dataCache) {
-      if (mipMap.dataCacheHandle == 0) {
-        mipMap.dataCacheHandle = dataCache->CacheData(mipMap.data, (size_t)mipMap.dataSize);
+size_t
+TextureGL::State::GetUploadSize() const {
+  size_t result = 0;
+  for (const MipMap& mipMap: mipMaps) {
+    if (mipMap.data || (mipMap.dataCacheHandle > 0)) {
+      result += (size_t)mipMap.dataSize;
+    }
+  }
+  return result;
+}
+
+// Returns false when the image is better uploaded by CreateTexture().
+bool
+TextureGL::State::StartUpload() {
+  const size_t total = GetUploadSize();
+  if (total < kAsyncUploadMinBytes) {
+    return false;
+  }
+  std::vector<size_t> offsets;
+  size_t offset = 0;
+  for (const MipMap& mipMap: mipMaps) {
+    offsets.push_back(offset);
+    if (mipMap.data || (mipMap.dataCacheHandle > 0)) {
+      offset += (size_t)mipMap.dataSize;
+    }
+  }
+  VRB_GL_CHECK(glGenBuffers(1, &pixelBuffer));
+  VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer));
+  VRB_GL_CHECK(glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)total, nullptr, GL_STREAM_DRAW));
+  void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)total,
+                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  if (!mapped) {
+    DeleteUploadObjects();
+    return false;
+  }
+  copy = std::make_shared<PixelCopy>();
+  copy->dataCache = dataCache;
+  copy->mipMaps = std::move(mipMaps);
+  copy->offsets = std::move(offsets);
+  copy->destination = (uint8_t*)mapped;
+  uploadBytes = total;
+  dirty = false;
+  if (!copy->Start(copy)) {
+    VRB_WARN("Failed to start texture copy worker, copying on the render thread");
+    copy->Run();
+  }
+  return true;
+}
+
+void
+TextureGL::State::UpdateUpload() {
+  if (copy) {
+    if (!copy->IsDone()) {
+      return;
+    }
+    PixelCopyPtr finished = std::move(copy);
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer));
+    const bool unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE;
+    if (dirty || !unmapped) {
+      // New image data arrived or the buffer contents were lost while copying.
+      VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+      if (dirty) {
+        DiscardMipMaps(finished->mipMaps);
       } else {
-        mipMap.data = nullptr;
+        mipMaps = std::move(finished->mipMaps);
+        dirty = true;
       }
+      DeleteUploadObjects();
+      return;
+    }
+    mipMaps = std::move(finished->mipMaps);
+    uint64_t bytes = 0;
+    uploadTexture = AllocateTexture(bytes);
+    for (size_t index = 0; index < mipMaps.size(); index++) {
+      const MipMap& mipMap = mipMaps[index];
+      if (mipMap.data || (mipMap.dataCacheHandle > 0)) {
+        TexSubImage(mipMap, (const void*)finished->offsets[index]);
+      }
+    }
+    VRB_GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    if (stats) {
+      stats->CountUpload(uploadBytes);
+    }
+    uploadFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return;
+  }
+  if (!uploadFence) {
+    return;
+  }
+  const GLenum status = glClientWaitSync(uploadFence, 0, 0);
+  if (status == GL_TIMEOUT_EXPIRED) {
+    return;
+  }
+  const GLuint uploaded = uploadTexture;
+  uploadTexture = 0;
+  DeleteUploadObjects();
+  FinishTexture(uploaded, uploadBytes);
+}
+
+// Releases the upload objects without waiting for a copy in flight, which
+// keeps the pixel buffer until it is done. The image data goes back to
+// mipMaps through ReclaimMipMaps() unless newer data replaced it.
+void
+TextureGL::State::CancelUpload() {
+  if (copy) {
+    copy->Cancel(pixelBuffer, deletionQueue);
+    pixelBuffer = 0;
+    if (dirty) {
+      copy->Discard();
+    } else {
+      DropCanceledCopy();
+      canceledCopy = copy;
+      dirty = true;
     }
+    copy = nullptr;
+  } else if (uploadFence) {
+    dirty = true;
   }
+  DeleteUploadObjects();
+}
 
-  for (auto param = intMap.begin(); param != intMap.end(); param++) {
-    VRB_GL_CHECK(glTexParameteri(target, param->first, param->second));
+// Returns false while a canceled copy still owns the mip maps.
+bool
+TextureGL::State::ReclaimMipMaps() {
+  if (!canceledCopy) {
+    return true;
+  }
+  if (!canceledCopy->IsDone()) {
+    return false;
+  }
+  mipMaps = std::move(canceledCopy->mipMaps);
+  canceledCopy = nullptr;
+  return true;
+}
+
+// Called when the mip maps of a canceled copy are replaced.
+void
+TextureGL::State::DropCanceledCopy() {
+  if (canceledCopy) {
+    canceledCopy->Discard();
+    canceledCopy = nullptr;
   }
-  dirty = false;
+}
+
+// Gives the region back to the atlas so other images can use it.
+void
+TextureGL::State::ReleaseAtlasImage() {
+  if (atlas) {
+    atlas->RemoveImage(atlasRegion);
+    atlas = nullptr;
+  }
+}
+
+void
+TextureGL::State::DiscardMipMaps(std::vector<MipMap>& aMipMaps) {
+  for (MipMap& mipMap: aMipMaps) {
+    if (dataCache && (mipMap.dataCacheHandle > 0)) {
+      dataCache->RemoveData(mipMap.dataCacheHandle);
+      mipMap.dataCacheHandle = 0;
+    }
+  }
+  aMipMaps.clear();
+}
+
+void
+TextureGL::State::DeleteTexture(GLuint& aTexture) {
+  if (aTexture == 0) {
+    return;
+  }
+  deletionQueue->DeleteTexture(aTexture);
+  aTexture = 0;
+}
+
+// Deleting a pixel buffer that is still mapped also unmaps it.
+void
+TextureGL::State::DeleteUploadObjects() {
+  if (uploadFence) {
+    deletionQueue->DeleteSync(uploadFence);
+    uploadFence = nullptr;
+  }
+  if (pixelBuffer > 0) {
+    deletionQueue->DeleteBuffer(pixelBuffer);
+    pixelBuffer = 0;
+  }
+  DeleteTexture(uploadTexture);
 }
 
 void
 TextureGL::State::DestroyTexture() {
-  if (texture > 0) {
-    VRB_GL_CHECK(glDeleteTextures(1, &texture));
-    texture = 0;
+  CancelUpload();
+  DeleteTexture(texture);
+  textureBytes = 0;
+  residentLevel = (int32_t)mipMaps.size();
+  if (ledger) {
+    ledger->Release(this);
   }
   dirty = true;
 }
 
+// Textures that are not ready yet render as the TextureCache default texture.
+void
+TextureGL::State::UpdatePlaceholder() {
+  if (texture > 0) {
+    placeholder = 0;
+    return;
+  }
+  TextureCachePtr cache = textureCache.lock();
+  TextureGLPtr fallback = cache ? cache->GetDefaultTexture() : nullptr;
+  placeholder = (fallback && (&fallback->m != this)) ? fallback->m.texture : 0;
+}
+
+int32_t
+TextureGL::State::GetWantedLevel(const uint32_t aFrame) const {
+  int32_t level = 0;
+  // Until the cull pass reports a size the image streams in at full resolution.
+  if (progressive && (screenSize > 0.0f)) {
+    if ((aFrame - screenSizeFrame) > kStreamEvictFrames) {
+      return baseLevel;
+    }
+    while ((level < baseLevel) && ((float)std::max(mipMaps[level + 1].width, mipMaps[level + 1].height) >= screenSize)) {
+      level++;
+    }
+  }
+  return std::max(level, std::min(droppedLevels, baseLevel));
+}
+
+uint64_t
+TextureGL::State::GetStreamSize(const int32_t aLevel) const {
+  uint64_t result = 0;
+  for (size_t index = (size_t)aLevel; index < mipMaps.size(); index++) {
+    result += (uint64_t)mipMaps[index].dataSize;
+  }
+  return result;
+}
+
+// End of the levels from aLevel down that StreamLevels() uploads. A streamed
+// texture keeps the levels it already holds.
+int32_t
+TextureGL::State::GetStreamEnd(const int32_t aLevel) const {
+  if ((texture > 0) && streamedTexture && !dirty) {
+    return std::max(aLevel, residentLevel);
+  }
+  return (int32_t)mipMaps.size();
+}
+
+// Returns true when the levels StreamLevels() uploads for aLevel can be read
+// without touching files, otherwise queues the missing ones on the DataCache.
+bool
+TextureGL::State::PrefetchLevels(const int32_t aLevel) {
+  if (!dataCache) {
+    return true;
+  }
+  std::vector<uint32_t> missing;
+  for (size_t index = (size_t)aLevel; index < (size_t)GetStreamEnd(aLevel); index++) {
+    const MipMap& mipMap = mipMaps[index];
+    if (!mipMap.data && (mipMap.dataCacheHandle > 0) && !dataCache->IsPrefetched(mipMap.dataCacheHandle)) {
+      missing.push_back(mipMap.dataCacheHandle);
+    }
+  }
+  if (missing.empty()) {
+    return true;
+  }
+  dataCache->Prefetch(missing);
+  return false;
+}
+
+// Starts building the chain of the single level in mipMaps. A new image
+// moves to the build, one already in the DataCache stays and is read back
+// by the build. The texture streams once FinishMipChain() takes the chain.
+void
+TextureGL::State::StartMipChain() {
+  MipChainBuildPtr build = std::make_shared<MipChainBuild>();
+  build->dataCache = dataCache;
+  MipMap& level = mipMaps[0];
+  if (level.dataCacheHandle > 0) {
+    build->source.target = level.target;
+    build->source.internalFormat = level.internalFormat;
+    build->source.width = level.width;
+    build->source.height = level.height;
+    build->source.format = level.format;
+    build->source.type = level.type;
+    build->source.dataSize = level.dataSize;
+    build->source.dataCacheHandle = level.dataCacheHandle;
+  } else {
+    build->source = std::move(level);
+    build->ownsSource = true;
+    mipMaps.clear();
+  }
+  build->baseLevel = GetStreamBaseLevel(build->source.width, build->source.height);
+  baseLevel = build->baseLevel;
+  streaming = true;
+  mipChain = build;
+  if (!build->Start(build)) {
+    VRB_WARN("Failed to start mip chain worker, building on the calling thread");
+    build->Run();
+  }
+}
+
+// Returns false while the chain is still being built.
+bool
+TextureGL::State::FinishMipChain() {
+  if (!mipChain) {
+    return true;
+  }
+  if (!mipChain->IsDone()) {
+    return false;
+  }
+  MipChainBuildPtr finished = std::move(mipChain);
+  if (finished->ownsSource) {
+    mipMaps.clear();
+    mipMaps.push_back(std::move(finished->source));
+    dirty = true;
+  }
+  if (!finished->succeeded) {
+    streaming = false;
+    progressive = false;
+    converted = false;
+    droppedLevels = 0;
+    return true;
+  }
+  for (MipMap& mipMap: finished->levels) {
+    mipMaps.push_back(std::move(mipMap));
+  }
+  // A converted texture still holds its single level.
+  residentLevel = finished->ownsSource ? (int32_t)mipMaps.size() : 0;
+  return true;
+}
+
+// Called when the image of a chain still being built is replaced.
+void
+TextureGL::State::DropMipChain() {
+  if (mipChain) {
+    mipChain->Discard();
+    mipChain = nullptr;
+  }
+}
+
+// Drops the chain of a converted texture. A streamed texture is replaced by
+// the single level when it is next bound.
+void
+TextureGL::State::RestoreSingleLevel() {
+  DropMipChain();
+  if (mipMaps.size() > 1) {
+    std::vector<MipMap> chain;
+    for (size_t index = 1; index < mipMaps.size(); index++) {
+      chain.push_back(std::move(mipMaps[index]));
+    }
+    mipMaps.erase(mipMaps.begin() + 1, mipMaps.end());
+    DiscardMipMaps(chain);
+  }
+  streaming = false;
+  converted = false;
+  droppedLevels = 0;
+  baseLevel = 0;
+  residentLevel = 0;
+  if (streamedTexture) {
+    dirty = true;
+  }
+}
+
+// Makes the levels from aLevel down resident. A streamed texture gets the
+// finer levels uploaded into it and releases the ones no longer wanted,
+// otherwise texture is replaced by a streamed one. Levels are uploaded from
+// the coarsest, when one can not be loaded the texture keeps the levels it
+// has.
+void
+TextureGL::State::StreamLevels(const int32_t aLevel) {
+  if (!ReclaimMipMaps() || (aLevel >= (int32_t)mipMaps.size())) {
+    return;
+  }
+  const bool kInPlace = (texture > 0) && streamedTexture && !dirty;
+  GLuint streamed = texture;
+  if (!kInPlace) {
+    VRB_GL_CHECK(glGenTextures(1, &streamed));
+  }
+  VRB_GL_CHECK(glBindTexture(target, streamed));
+  int32_t level = GetStreamEnd(aLevel);
+  while (level > aLevel) {
+    const MipMap& mipMap = mipMaps[level - 1];
+    std::unique_ptr<uint8_t[]> loaded;
+    const uint8_t* pixels = mipMap.data.get();
+    if (!pixels && dataCache && (mipMap.dataCacheHandle > 0) &&
+        (dataCache->LoadData(mipMap.dataCacheHandle, loaded) == (size_t)mipMap.dataSize)) {
+      pixels = loaded.get();
+    }
+    if (!pixels) {
+      VRB_ERROR("Failed to load level %d of texture: %s", (int)mipMap.level, name.c_str());
+      break;
+    }
+    VRB_GL_CHECK(glTexImage2D(target, mipMap.level, SizedFormat(mipMap), mipMap.width, mipMap.height, 0,
+                              PixelFormat(mipMap), mipMap.type, pixels));
+    if (stats) {
+      stats->CountUpload((uint64_t)mipMap.dataSize);
+    }
+    level--;
+  }
+  if (kInPlace) {
+    for (int32_t index = residentLevel; index < level; index++) {
+      const MipMap& mipMap = mipMaps[index];
+      VRB_GL_CHECK(glTexImage2D(target, mipMap.level, SizedFormat(mipMap), 0, 0, 0, PixelFormat(mipMap), mipMap.type, nullptr));
+    }
+  } else if (level > aLevel) {
+    DeleteTexture(streamed);
+    if (texture > 0) {
+      VRB_GL_CHECK(glBindTexture(target, texture));
+    }
+    return;
+  } else {
+    FinishTexture(streamed, 0);
+    streamedTexture = true;
+  }
+  VRB_GL_CHECK(glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, level));
+  VRB_GL_CHECK(glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)mipMaps.size() - 1));
+  SetTextureBytes(GetStreamSize(level));
+  residentLevel = level;
+  dirty = false;
+}
+
 TextureGLPtr
 TextureGL::Create(CreationContextPtr& aContext) {
   return std::make_shared<ConcreteClass<TextureGL, TextureGL::State> >(aContext);
@@ -174,6 +1049,15 @@ TextureGL::SetImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImag
     return;
   }
 
+  m.ReleaseAtlasImage();
+  m.DropMipChain();
+  m.alias = nullptr;
+  m.streaming = false;
+  m.converted = false;
+  m.progressive = false;
+  m.droppedLevels = 0;
+  m.uvTransform[0] = m.uvTransform[1] = 0.0f;
+  m.uvTransform[2] = m.uvTransform[3] = 1.0f;
   MipMap mipMap;
   mipMap.width = aWidth;
   mipMap.height = aHeight;
@@ -181,15 +1065,196 @@ TextureGL::SetImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImag
   mipMap.data = std::move(aImage);
   mipMap.internalFormat = aFormat;
   mipMap.format = aFormat;
-  m.mipMaps.clear();
+  m.DropCanceledCopy();
+  m.DiscardMipMaps(m.mipMaps);
   m.mipMaps.push_back(std::move(mipMap));
   m.dirty = true;
 }
 
+void
+TextureGL::SetStreamingImageData(std::unique_ptr<uint8_t[]>& aImage, const uint64_t aImageLength, const int aWidth, const int aHeight, const GLenum aFormat) {
+  SetImageData(aImage, aImageLength, aWidth, aHeight, aFormat);
+  if ((m.mipMaps.size() != 1) || (aFormat != GL_RGBA) ||
+      ((size_t)m.mipMaps[0].dataSize < (size_t)aWidth * (size_t)aHeight * kStreamPixelSize)) {
+    return;
+  }
+  m.StartMipChain();
+  m.progressive = true;
+}
+
+bool
+TextureGL::IsStreaming() const {
+  return m.streaming;
+}
+
+float
+TextureGL::GetStreamingPriority(const uint32_t aFrame) const {
+  if (!m.streaming || (m.lastBindFrame == 0) || ((aFrame - m.lastBindFrame) > kStreamEvictFrames)) {
+    return 0.0f;
+  }
+  if (m.screenSize <= 0.0f) {
+    return std::numeric_limits<float>::max();
+  }
+  if ((aFrame - m.screenSizeFrame) > kStreamEvictFrames) {
+    return 0.0f;
+  }
+  return m.screenSize;
+}
+
+bool
+TextureGL::SetDroppedLevels(const int32_t aLevels) {
+  if (!m.streaming) {
+    // Without a DataCache the whole chain would stay in memory.
+    if ((aLevels <= 0) || !m.dataCache || m.atlas || m.alias || m.restorePending || m.dirty || (m.texture == 0) ||
+        m.copy || m.canceledCopy || m.uploadFence) {
+      return false;
+    }
+    if ((m.mipMaps.size() != 1) || (m.mipMaps[0].format != GL_RGBA) || (m.mipMaps[0].dataCacheHandle == 0) ||
+        ((size_t)m.mipMaps[0].dataSize < (size_t)m.mipMaps[0].width * (size_t)m.mipMaps[0].height * kStreamPixelSize)) {
+      return false;
+    }
+    // The texture created from the single level stays until the chain is
+    // built and levels are dropped.
+    m.StartMipChain();
+    m.converted = true;
+    m.residentLevel = 0;
+  }
+  // Going back to the single level waits for UpdateStreaming(), the memory
+  // policy may still raise the dropped levels again this frame.
+  m.droppedLevels = std::max(aLevels, 0);
+  return true;
+}
+
+int32_t
+TextureGL::GetDroppedLevels() const {
+  return m.droppedLevels;
+}
+
+int32_t
+TextureGL::GetMaxDroppedLevels() const {
+  if (m.streaming) {
+    return m.baseLevel;
+  }
+  if (m.mipMaps.empty() || (m.mipMaps[0].format != GL_RGBA)) {
+    return 0;
+  }
+  return GetStreamBaseLevel(m.mipMaps[0].width, m.mipMaps[0].height);
+}
+
+uint64_t
+TextureGL::GetTextureBytes() const {
+  return m.textureBytes;
+}
+
+uint64_t
+TextureGL::GetWantedTextureBytes(const uint32_t aFrame) const {
+  if (m.converted && (m.droppedLevels <= 0)) {
+    return (uint64_t)m.mipMaps[0].dataSize;
+  }
+  if (!m.streaming || m.mipChain || m.dirty || (m.texture == 0)) {
+    return m.textureBytes;
+  }
+  return m.GetStreamSize(m.GetWantedLevel(aFrame));
+}
+
+bool
+TextureGL::MatchesImageData(const uint8_t* aImage, const uint64_t aImageLength) const {
+  if (!aImage || m.alias || m.atlas) {
+    return false;
+  }
+  for (const MipMap& mipMap: m.mipMaps) {
+    if ((mipMap.target != GL_TEXTURE_2D) || (mipMap.level != 0)) {
+      continue;
+    }
+    if ((uint64_t)mipMap.dataSize != aImageLength) {
+      return false;
+    }
+    if (mipMap.data) {
+      return memcmp(mipMap.data.get(), aImage, (size_t)aImageLength) == 0;
+    }
+    std::unique_ptr<uint8_t[]> stored;
+    return m.dataCache && (mipMap.dataCacheHandle > 0) &&
+           (m.dataCache->LoadData(mipMap.dataCacheHandle, stored) == (size_t)aImageLength) &&
+           (memcmp(stored.get(), aImage, (size_t)aImageLength) == 0);
+  }
+  return false;
+}
+
+uint64_t
+TextureGL::UpdateStreaming(const uint32_t aFrame, const uint64_t aBudget) {
+  if (m.converted && (m.droppedLevels <= 0)) {
+    m.RestoreSingleLevel();
+    return 0;
+  }
+  // The base levels are uploaded when the texture is first bound.
+  if (!m.FinishMipChain() || !m.streaming || m.restorePending || m.dirty || (m.texture == 0)) {
+    return 0;
+  }
+  const int32_t kWanted = m.GetWantedLevel(aFrame);
+  if (kWanted == m.residentLevel) {
+    return 0;
+  }
+  // Refine one level per update, drop unneeded levels in one go.
+  const int32_t kLevel = kWanted < m.residentLevel ? m.residentLevel - 1 : kWanted;
+  const uint64_t kBytes = m.GetStreamSize(kLevel) - m.GetStreamSize(m.GetStreamEnd(kLevel));
+  if ((kLevel < m.residentLevel) && (kBytes > aBudget)) {
+    return 0;
+  }
+  if (!m.PrefetchLevels(kLevel)) {
+    return 0;
+  }
+  m.StreamLevels(kLevel);
+  return kBytes;
+}
+
+void
+TextureGL::SetAtlasImage(const TextureAtlasPtr& aAtlas, const TextureAtlas::Region& aRegion) {
+  if (!aAtlas) {
+    return;
+  }
+  const float kWidth = (float)aAtlas->GetWidth();
+  const float kHeight = (float)aAtlas->GetHeight();
+  m.uvTransform[0] = (float)aRegion.x / kWidth;
+  m.uvTransform[1] = (float)aRegion.y / kHeight;
+  m.uvTransform[2] = (float)aRegion.width / kWidth;
+  m.uvTransform[3] = (float)aRegion.height / kHeight;
+  m.DropCanceledCopy();
+  m.DropMipChain();
+  m.mipMaps.clear();
+  m.alias = nullptr;
+  m.streaming = false;
+  m.converted = false;
+  m.progressive = false;
+  m.ReleaseAtlasImage();
+  m.atlas = aAtlas;
+  m.atlasRegion = aRegion;
+}
+
+void
+TextureGL::SetAliasTexture(const TextureGLPtr& aTexture) {
+  if (!aTexture || (&aTexture->m == &m)) {
+    return;
+  }
+  aTexture->GetUVTransform(m.uvTransform[0], m.uvTransform[1], m.uvTransform[2], m.uvTransform[3]);
+  m.DropCanceledCopy();
+  m.DropMipChain();
+  m.mipMaps.clear();
+  m.ReleaseAtlasImage();
+  m.streaming = false;
+  m.converted = false;
+  m.progressive = false;
+  m.alias = aTexture;
+}
+
 TextureGL::TextureGL(State& aState, CreationContextPtr& aContext) : Texture(aState, aContext), ResourceGL (aState, aContext), m(aState) {
   m.dataCache = aContext->GetDataCache();
+  m.textureCache = aContext->GetTextureCache();
 }
 TextureGL::~TextureGL() {
+  m.DestroyTexture();
+  m.DropCanceledCopy();
+  m.DropMipChain();
+  m.ReleaseAtlasImage();
   if (!m.dataCache) {
     return;
   }
@@ -203,7 +1268,49 @@ TextureGL::~TextureGL() {
 
 void
 TextureGL::AboutToBind() {
-  m.CreateTexture();
+  if (m.alias) {
+    if ((m.texture > 0) || m.copy || m.uploadFence) {
+      m.DestroyTexture();
+    }
+    m.dirty = false;
+    m.alias->AboutToBind();
+    m.placeholder = m.alias->m.texture > 0 ? m.alias->m.texture : m.alias->m.placeholder;
+    if (m.stats) {
+      m.alias->m.lastBindFrame = m.stats->GetFrameNumber();
+    }
+    return;
+  }
+  if (m.atlas) {
+    if ((m.texture > 0) || m.copy || m.uploadFence) {
+      m.DestroyTexture();
+    }
+    m.dirty = false;
+    m.placeholder = m.atlas->Update();
+    return;
+  }
+  // Until the restore scheduler reaches it, the texture renders as the
+  // placeholder instead of stalling the frame on the upload.
+  if (m.restorePending) {
+    m.UpdatePlaceholder();
+    return;
+  }
+  const bool kChainReady = m.FinishMipChain();
+  if (m.streaming) {
+    if (m.copy || m.uploadFence) {
+      m.CancelUpload();
+    }
+    if (kChainReady && (m.dirty || (m.texture == 0))) {
+      m.StreamLevels(m.baseLevel);
+    }
+    m.UpdatePlaceholder();
+    return;
+  }
+  if (m.copy || m.uploadFence) {
+    m.UpdateUpload();
+  } else if (m.dirty && m.ReclaimMipMaps() && !m.StartUpload()) {
+    m.CreateTexture();
+  }
+  m.UpdatePlaceholder();
 }
 
 bool
@@ -211,8 +1318,45 @@ TextureGL::SupportOffRenderThreadInitialization() {
   return true;
 }
 
+int32_t
+TextureGL::GetRestorePriority() {
+  return m.priority;
+}
+
+uint32_t
+TextureGL::GetLastUsedFrame() {
+  return m.lastBindFrame;
+}
+
+void
+TextureGL::GetRestoreDataHandles(std::vector<uint32_t>& aHandles) {
+  // Streaming textures restore their base levels, which stay in memory.
+  if (m.streaming) {
+    return;
+  }
+  for (const MipMap& mipMap: m.mipMaps) {
+    if (mipMap.dataCacheHandle > 0) {
+      aHandles.push_back(mipMap.dataCacheHandle);
+    }
+  }
+}
+
 void
 TextureGL::InitializeGL() {
+  VRB_ALLOCATION_SCOPE(Upload);
+  // A chain still being built is streamed once the texture is bound.
+  if (!m.FinishMipChain()) {
+    return;
+  }
+  if (m.streaming) {
+    m.StreamLevels(m.baseLevel);
+    return;
+  }
+  // Large images are uploaded through a pixel buffer once the texture is
+  // first bound on the render thread.
+  if (m.GetUploadSize() >= kAsyncUploadMinBytes) {
+    return;
+  }
   m.CreateTexture();
 }
 
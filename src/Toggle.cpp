@@ -34,31 +34,22 @@ Toggle::RemoveNode(Node& aNode) {
 // Toggle interface
 void
 Toggle::ToggleAll(const bool aEnabled) {
-  if (aEnabled) {
-    m.toggledOff.clear();
-    return;
-  }
   for (const NodePtr& node: m.children) {
-    m.toggledOff.insert(node.get());
+    ToggleChild(*node, aEnabled);
   }
 }
 
-bool
-Toggle::IsEnabled(const Node& aNode) {
-  return m.IsEnabled(aNode);
-}
-
 void
 Toggle::ToggleChild(const Node& aNode, const bool aEnabled) {
   if (!m.Contains(aNode)) {
     return;
   }
-  if (aEnabled) {
-    m.toggledOff.erase(&aNode);
-    return;
+  const bool kChanged = aEnabled ? (m.toggledOff.erase(&aNode) > 0) : m.toggledOff.insert(&aNode).second;
+  if (kChanged) {
+    m.NotifyObservers([&](GroupObserver& aObserver) {
+      aObserver.ChildToggled(*this, aNode, aEnabled);
+    });
   }
-
-  m.toggledOff.insert(&aNode);
 }
 
 Toggle::Toggle(State& aState, CreationContextPtr& aContext) : Group(aState, aContext), m(aState) {}
@@ -55,6 +55,9 @@ Transform::GetTransform() const {
 void
 Transform::SetTransform(const Matrix& aTransform) {
   m.transform = aTransform;
+  m.NotifyObservers([this](GroupObserver& aObserver) {
+    aObserver.TransformChanged(*this);
+  });
 }
 
 Transform::Transform(State& aState, CreationContextPtr& aContext) : Group(aState, aContext), m(aState) {}
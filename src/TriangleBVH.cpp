@@ -0,0 +1,391 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "vrb/TriangleBVH.h"
+#include "vrb/ConcreteClass.h"
+
+#include "vrb/Logger.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64)
+#  include <xmmintrin.h>
+#  define VRB_BVH_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define VRB_BVH_NEON 1
+#endif
+
+namespace {
+
+const int kBinCount = 12;
+const int kMaxLeafSize = 4;
+const float kTraversalCost = 1.0f;
+const float kIntersectionCost = 1.0f;
+
+struct Bounds {
+  // Padded to four floats so the SIMD slab test can load them directly.
+  float min[4];
+  float max[4];
+
+  Bounds() { Reset(); }
+
+  void Reset() {
+    min[0] = min[1] = min[2] = std::numeric_limits<float>::max();
+    max[0] = max[1] = max[2] = -std::numeric_limits<float>::max();
+    min[3] = max[3] = 0.0f;
+  }
+
+  void Expand(const vrb::Vector& aPoint) {
+    for (int ix = 0; ix < 3; ix++) {
+      min[ix] = std::min(min[ix], aPoint.Data()[ix]);
+      max[ix] = std::max(max[ix], aPoint.Data()[ix]);
+    }
+  }
+
+  void Expand(const Bounds& aBounds) {
+    for (int ix = 0; ix < 3; ix++) {
+      min[ix] = std::min(min[ix], aBounds.min[ix]);
+      max[ix] = std::max(max[ix], aBounds.max[ix]);
+    }
+  }
+
+  float SurfaceArea() const {
+    const float x = max[0] - min[0];
+    const float y = max[1] - min[1];
+    const float z = max[2] - min[2];
+    if ((x < 0.0f) || (y < 0.0f) || (z < 0.0f)) {
+      return 0.0f;
+    }
+    return 2.0f * ((x * y) + (y * z) + (z * x));
+  }
+};
+
+struct BVHNode {
+  Bounds bounds;
+  // Leaf nodes index the triangle list, interior nodes store the first child.
+  // The second child always directly follows the first.
+  uint32_t start;
+  uint32_t count;
+};
+
+struct Ray {
+  float origin[4];
+  float inverse[4];
+};
+
+inline bool
+HitBounds(const Bounds& aBounds, const Ray& aRay, const float aMaxDistance, float& aEntry) {
+#if defined(VRB_BVH_SSE)
+  const __m128 origin = _mm_loadu_ps(aRay.origin);
+  const __m128 inverse = _mm_loadu_ps(aRay.inverse);
+  const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(aBounds.min), origin), inverse);
+  const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(aBounds.max), origin), inverse);
+  float near[4], far[4];
+  _mm_storeu_ps(near, _mm_min_ps(t1, t2));
+  _mm_storeu_ps(far, _mm_max_ps(t1, t2));
+#elif defined(VRB_BVH_NEON)
+  const float32x4_t origin = vld1q_f32(aRay.origin);
+  const float32x4_t inverse = vld1q_f32(aRay.inverse);
+  const float32x4_t t1 = vmulq_f32(vsubq_f32(vld1q_f32(aBounds.min), origin), inverse);
+  const float32x4_t t2 = vmulq_f32(vsubq_f32(vld1q_f32(aBounds.max), origin), inverse);
+  float near[4], far[4];
+  vst1q_f32(near, vminq_f32(t1, t2));
+  vst1q_f32(far, vmaxq_f32(t1, t2));
+#else
+  float near[3], far[3];
+  for (int ix = 0; ix < 3; ix++) {
+    const float t1 = (aBounds.min[ix] - aRay.origin[ix]) * aRay.inverse[ix];
+    const float t2 = (aBounds.max[ix] - aRay.origin[ix]) * aRay.inverse[ix];
+    near[ix] = std::min(t1, t2);
+    far[ix] = std::max(t1, t2);
+  }
+#endif
+  const float kEntry = std::max(std::max(near[0], near[1]), std::max(near[2], 0.0f));
+  const float kExit = std::min(std::min(far[0], far[1]), std::min(far[2], aMaxDistance));
+  aEntry = kEntry;
+  return kEntry <= kExit;
+}
+
+} // namespace
+
+namespace vrb {
+
+struct TriangleBVH::State {
+  std::vector<Vector> positions;
+  std::vector<Vector> uvs;
+  std::vector<GLushort> indices;
+  std::vector<uint32_t> triangles;
+  std::vector<BVHNode> nodes;
+
+  void Subdivide(const uint32_t aNode, const std::vector<Bounds>& aTriangleBounds, const std::vector<Vector>& aCentroids);
+  bool IntersectTriangle(const uint32_t aTriangle, const Vector& aOrigin, const Vector& aDirection,
+                         float& aDistance, float& aU, float& aV) const;
+};
+
+void
+TriangleBVH::State::Subdivide(const uint32_t aNode, const std::vector<Bounds>& aTriangleBounds, const std::vector<Vector>& aCentroids) {
+  const uint32_t kStart = nodes[aNode].start;
+  const uint32_t kCount = nodes[aNode].count;
+  if (kCount <= kMaxLeafSize) {
+    return;
+  }
+
+  Bounds centroidBounds;
+  for (uint32_t ix = kStart; ix < kStart + kCount; ix++) {
+    centroidBounds.Expand(aCentroids[triangles[ix]]);
+  }
+
+  // Binned surface area heuristic over all three axes.
+  float bestCost = std::numeric_limits<float>::max();
+  int bestAxis = -1;
+  float bestSplit = 0.0f;
+  for (int axis = 0; axis < 3; axis++) {
+    const float kMin = centroidBounds.min[axis];
+    const float kExtent = centroidBounds.max[axis] - kMin;
+    if (kExtent <= 0.0f) {
+      continue;
+    }
+    Bounds bins[kBinCount];
+    uint32_t counts[kBinCount] = {0};
+    const float kScale = kBinCount / kExtent;
+    for (uint32_t ix = kStart; ix < kStart + kCount; ix++) {
+      const uint32_t triangle = triangles[ix];
+      const int bin = std::min(kBinCount - 1, (int)((aCentroids[triangle].Data()[axis] - kMin) * kScale));
+      bins[bin].Expand(aTriangleBounds[triangle]);
+      counts[bin]++;
+    }
+    float leftArea[kBinCount - 1];
+    uint32_t leftCount[kBinCount - 1];
+    Bounds accumulated;
+    uint32_t total = 0;
+    for (int ix = 0; ix < kBinCount - 1; ix++) {
+      accumulated.Expand(bins[ix]);
+      total += counts[ix];
+      leftArea[ix] = accumulated.SurfaceArea();
+      leftCount[ix] = total;
+    }
+    accumulated.Reset();
+    total = 0;
+    for (int ix = kBinCount - 1; ix > 0; ix--) {
+      accumulated.Expand(bins[ix]);
+      total += counts[ix];
+      const uint32_t kLeft = leftCount[ix - 1];
+      if ((kLeft == 0) || (total == 0)) {
+        continue;
+      }
+      const float kCost = (leftArea[ix - 1] * kLeft) + (accumulated.SurfaceArea() * total);
+      if (kCost < bestCost) {
+        bestCost = kCost;
+        bestAxis = axis;
+        bestSplit = kMin + (ix / kScale);
+      }
+    }
+  }
+
+  const float kParentArea = nodes[aNode].bounds.SurfaceArea();
+  if ((bestAxis < 0) || (kParentArea <= 0.0f)) {
+    return;
+  }
+  const float kSplitCost = kTraversalCost + (kIntersectionCost * bestCost / kParentArea);
+  if (kSplitCost >= (kIntersectionCost * kCount)) {
+    return;
+  }
+
+  uint32_t* begin = &triangles[kStart];
+  uint32_t* middle = std::partition(begin, begin + kCount, [&](const uint32_t aTriangle) {
+    return aCentroids[aTriangle].Data()[bestAxis] < bestSplit;
+  });
+  const uint32_t kLeftCount = (uint32_t)(middle - begin);
+  if ((kLeftCount == 0) || (kLeftCount == kCount)) {
+    return;
+  }
+
+  const uint32_t kLeft = (uint32_t)nodes.size();
+  nodes.resize(nodes.size() + 2);
+  BVHNode& left = nodes[kLeft];
+  BVHNode& right = nodes[kLeft + 1];
+  left.start = kStart;
+  left.count = kLeftCount;
+  right.start = kStart + kLeftCount;
+  right.count = kCount - kLeftCount;
+  for (uint32_t ix = left.start; ix < left.start + left.count; ix++) {
+    left.bounds.Expand(aTriangleBounds[triangles[ix]]);
+  }
+  for (uint32_t ix = right.start; ix < right.start + right.count; ix++) {
+    right.bounds.Expand(aTriangleBounds[triangles[ix]]);
+  }
+  nodes[aNode].start = kLeft;
+  nodes[aNode].count = 0;
+  Subdivide(kLeft, aTriangleBounds, aCentroids);
+  Subdivide(kLeft + 1, aTriangleBounds, aCentroids);
+}
+
+bool
+TriangleBVH::State::IntersectTriangle(const uint32_t aTriangle, const Vector& aOrigin, const Vector& aDirection,
+                                      float& aDistance, float& aU, float& aV) const {
+  // Moller-Trumbore, hits from both sides are reported.
+  const Vector& v0 = positions[indices[aTriangle * 3]];
+  const Vector& v1 = positions[indices[(aTriangle * 3) + 1]];
+  const Vector& v2 = positions[indices[(aTriangle * 3) + 2]];
+  const Vector edge1 = v1 - v0;
+  const Vector edge2 = v2 - v0;
+  const Vector p = aDirection.Cross(edge2);
+  const float kDeterminant = edge1.Dot(p);
+  if (std::fabs(kDeterminant) < 1e-12f) {
+    return false;
+  }
+  const float kInverse = 1.0f / kDeterminant;
+  const Vector t = aOrigin - v0;
+  aU = t.Dot(p) * kInverse;
+  if ((aU < 0.0f) || (aU > 1.0f)) {
+    return false;
+  }
+  const Vector q = t.Cross(edge1);
+  aV = aDirection.Dot(q) * kInverse;
+  if ((aV < 0.0f) || ((aU + aV) > 1.0f)) {
+    return false;
+  }
+  aDistance = edge2.Dot(q) * kInverse;
+  return aDistance >= 0.0f;
+}
+
+TriangleBVHPtr
+TriangleBVH::Create() {
+  return std::make_shared<ConcreteClass<TriangleBVH, TriangleBVH::State> >();
+}
+
+void
+TriangleBVH::Build(const std::vector<Vector>& aPositions, const std::vector<Vector>& aUVs, const std::vector<GLushort>& aIndices) {
+  m.positions = aPositions;
+  m.uvs = aUVs;
+  m.indices = aIndices;
+  m.nodes.clear();
+  m.triangles.clear();
+  const uint32_t kTriangleCount = (uint32_t)(aIndices.size() / 3);
+  if (kTriangleCount == 0) {
+    return;
+  }
+  std::vector<Bounds> triangleBounds(kTriangleCount);
+  std::vector<Vector> centroids(kTriangleCount);
+  m.triangles.resize(kTriangleCount);
+  BVHNode root;
+  root.start = 0;
+  root.count = kTriangleCount;
+  for (uint32_t triangle = 0; triangle < kTriangleCount; triangle++) {
+    for (int ix = 0; ix < 3; ix++) {
+      const GLushort kIndex = aIndices[(triangle * 3) + ix];
+      if (kIndex >= aPositions.size()) {
+        VRB_ERROR("TriangleBVH index %d out of range of %d vertices", (int)kIndex, (int)aPositions.size());
+        m.triangles.clear();
+        return;
+      }
+      triangleBounds[triangle].Expand(aPositions[kIndex]);
+    }
+    const Bounds& bounds = triangleBounds[triangle];
+    centroids[triangle].Set((bounds.min[0] + bounds.max[0]) * 0.5f, (bounds.min[1] + bounds.max[1]) * 0.5f, (bounds.min[2] + bounds.max[2]) * 0.5f);
+    root.bounds.Expand(bounds);
+    m.triangles[triangle] = triangle;
+  }
+  m.nodes.reserve(kTriangleCount * 2);
+  m.nodes.push_back(root);
+  m.Subdivide(0, triangleBounds, centroids);
+}
+
+bool
+TriangleBVH::Intersect(const Vector& aOrigin, const Vector& aDirection, const float aMaxDistance,
+                       const TriangleFilter& aFilter, Hit& aResult) const {
+  if (m.nodes.empty()) {
+    return false;
+  }
+  Ray ray;
+  for (int ix = 0; ix < 3; ix++) {
+    ray.origin[ix] = aOrigin.Data()[ix];
+    const float kDirection = aDirection.Data()[ix];
+    ray.inverse[ix] = kDirection != 0.0f ? 1.0f / kDirection : std::numeric_limits<float>::max();
+  }
+  ray.origin[3] = ray.inverse[3] = 0.0f;
+
+  float closest = aMaxDistance;
+  int32_t hitTriangle = -1;
+  float hitU = 0.0f, hitV = 0.0f;
+  uint32_t stack[64];
+  int depth = 0;
+  stack[depth++] = 0;
+  while (depth > 0) {
+    const BVHNode& node = m.nodes[stack[--depth]];
+    float entry = 0.0f;
+    if (!HitBounds(node.bounds, ray, closest, entry)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t ix = node.start; ix < node.start + node.count; ix++) {
+        const uint32_t triangle = m.triangles[ix];
+        float distance, u, v;
+        if (m.IntersectTriangle(triangle, aOrigin, aDirection, distance, u, v) && (distance < closest) &&
+            (!aFilter || aFilter((int32_t)triangle))) {
+          closest = distance;
+          hitTriangle = (int32_t)triangle;
+          hitU = u;
+          hitV = v;
+        }
+      }
+      continue;
+    }
+    if (depth > 62) {
+      VRB_WARN("TriangleBVH traversal stack overflow");
+      continue;
+    }
+    // Visit the nearer child first so more of the far child gets rejected.
+    float leftEntry = 0.0f, rightEntry = 0.0f;
+    const bool kLeft = HitBounds(m.nodes[node.start].bounds, ray, closest, leftEntry);
+    const bool kRight = HitBounds(m.nodes[node.start + 1].bounds, ray, closest, rightEntry);
+    if (kLeft && kRight) {
+      const bool kLeftFirst = leftEntry <= rightEntry;
+      stack[depth++] = kLeftFirst ? node.start + 1 : node.start;
+      stack[depth++] = kLeftFirst ? node.start : node.start + 1;
+    } else if (kLeft) {
+      stack[depth++] = node.start;
+    } else if (kRight) {
+      stack[depth++] = node.start + 1;
+    }
+  }
+
+  if (hitTriangle < 0) {
+    return false;
+  }
+  const GLushort* indices = &m.indices[hitTriangle * 3];
+  aResult.triangle = hitTriangle;
+  aResult.distance = closest;
+  aResult.barycentric.Set(1.0f - hitU - hitV, hitU, hitV);
+  aResult.position = aOrigin + (aDirection * closest);
+  const Vector& v0 = m.positions[indices[0]];
+  aResult.normal = (m.positions[indices[1]] - v0).Cross(m.positions[indices[2]] - v0).Normalize();
+  if (m.uvs.size() >= m.positions.size()) {
+    aResult.uv = (m.uvs[indices[0]] * aResult.barycentric.x()) +
+                 (m.uvs[indices[1]] * aResult.barycentric.y()) +
+                 (m.uvs[indices[2]] * aResult.barycentric.z());
+  } else {
+    aResult.uv = Vector();
+  }
+  return true;
+}
+
+int32_t
+TriangleBVH::GetTriangleCount() const {
+  return (int32_t)m.triangles.size();
+}
+
+int32_t
+TriangleBVH::GetNodeCount() const {
+  return (int32_t)m.nodes.size();
+}
+
+TriangleBVH::TriangleBVH(State& aState) : m(aState) {}
+TriangleBVH::~TriangleBVH() {}
+
+} // namespace vrb
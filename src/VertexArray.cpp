@@ -24,6 +24,8 @@ struct VertexArray::State {
   std::vector<Vector> vertices;
   std::vector<NormalState> normals;
   std::vector<Vector> uvs;
+  uint32_t version;
+  State() : version(0) {}
 };
 
 VertexArrayPtr
@@ -83,6 +85,7 @@ VertexArray::SetVertex(const int aIndex, const Vector& aPoint) {
     m.vertices.resize(aIndex + 1);
   }
   m.vertices[aIndex] = aPoint;
+  m.version++;
 }
 
 void
@@ -104,6 +107,7 @@ VertexArray::SetUV(const int aIndex, const Vector& aUV) {
 int
 VertexArray::AppendVertex(const Vector& aPoint) {
   m.vertices.push_back(aPoint);
+  m.version++;
   return m.vertices.size() - 1;
 }
 
@@ -131,6 +135,11 @@ VertexArray::AppendUV(const Vector& aUV) {
   return m.uvs.size() - 1;
 }
 
+uint32_t
+VertexArray::GetVersion() const {
+  return m.version;
+}
+
 VertexArray::VertexArray(State& aState, CreationContextPtr& aContext) : m(aState) {}
 VertexArray::~VertexArray() {}
 